@@ -86,6 +86,13 @@ struct AABB
         return THREE;
     }
 
+    void bounding_box(
+        const Real3& edge_lengths, Real3& lower, Real3& upper) const
+    {
+        lower = lower_;
+        upper = upper_;
+    }
+
     // Surface surface() const
     // {
     //     return Surface(std::shared_ptr<Shape>(new AABB(*this)));
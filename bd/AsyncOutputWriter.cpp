@@ -0,0 +1,166 @@
+#include "AsyncOutputWriter.hpp"
+
+#include <chrono>
+#include <algorithm>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+namespace
+{
+
+/**
+ * spin for a while, and then sleep not to occupy a core while idling.
+ */
+inline void backoff(unsigned int& count)
+{
+    if (count < 64)
+    {
+        ++count;
+        std::this_thread::yield();
+    }
+    else
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+}
+
+} // anonymous
+
+AsyncOutputWriter::AsyncOutputWriter(std::ostream& out, const std::size_t num_buffers)
+    : out_(out), frames_(std::max<std::size_t>(num_buffers, 1)),
+    head_(0), tail_(0), flushed_(0), running_(true), failed_(false), acquired_(false)
+{
+    thread_ = std::thread(&AsyncOutputWriter::run, this);
+}
+
+AsyncOutputWriter::~AsyncOutputWriter()
+{
+    stop();
+}
+
+OutputFrame& AsyncOutputWriter::frame()
+{
+    const std::size_t head(head_.load(std::memory_order_relaxed));
+    OutputFrame& retval(frames_[head % frames_.size()]);
+
+    if (!acquired_)
+    {
+        check_failure();
+
+        unsigned int count(0);
+        while (head - tail_.load(std::memory_order_acquire) >= frames_.size())
+        {
+            backoff(count);
+            check_failure();
+        }
+        retval.clear();
+        acquired_ = true;
+    }
+    return retval;
+}
+
+void AsyncOutputWriter::commit()
+{
+    frame();  // acquire an empty frame if nothing was written.
+    acquired_ = false;
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void AsyncOutputWriter::flush()
+{
+    unsigned int count(0);
+    while (running_.load(std::memory_order_acquire)
+           && flushed_.load(std::memory_order_acquire) != head_.load(std::memory_order_relaxed))
+    {
+        backoff(count);
+        check_failure();
+    }
+    check_failure();
+}
+
+void AsyncOutputWriter::stop()
+{
+    if (!thread_.joinable())
+    {
+        return;
+    }
+
+    running_.store(false, std::memory_order_release);
+    thread_.join();
+}
+
+void AsyncOutputWriter::check_failure() const
+{
+    if (failed_.load(std::memory_order_acquire))
+    {
+        throw IllegalState("Failed to write the output.");
+    }
+}
+
+void AsyncOutputWriter::run()
+{
+    unsigned int count(0);
+    while (true)
+    {
+        const std::size_t tail(tail_.load(std::memory_order_relaxed));
+        if (tail != head_.load(std::memory_order_acquire))
+        {
+            write(frames_[tail % frames_.size()]);
+            tail_.store(tail + 1, std::memory_order_release);
+            count = 0;
+            continue;
+        }
+
+        // nothing to write. make the output visible while idling.
+        if (count == 0)
+        {
+            out_.flush();
+            flushed_.store(tail, std::memory_order_release);
+        }
+
+        if (!out_)
+        {
+            failed_.store(true, std::memory_order_release);
+        }
+
+        if (!running_.load(std::memory_order_acquire))
+        {
+            if (tail == head_.load(std::memory_order_acquire))
+            {
+                break;
+            }
+            continue;
+        }
+
+        backoff(count);
+    }
+
+    out_.flush();
+    flushed_.store(tail_.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+void AsyncOutputWriter::write(const OutputFrame& frame)
+{
+    for (std::vector<OutputFrame::encounter_record>::const_iterator
+        i(frame.encounters().begin()); i != frame.encounters().end(); ++i)
+    {
+        out_ << "#C," << (*i).tracer << "," << (*i).crowder << "," << (*i).t << "\n";
+    }
+
+    for (std::vector<OutputFrame::position_record>::const_iterator
+        i(frame.positions().begin()); i != frame.positions().end(); ++i)
+    {
+        out_ << frame.t() << "," << frame.species((*i).species) << "," << (*i).serial
+            << "," << (*i).position[0] << "," << (*i).position[1]
+            << "," << (*i).position[2] << "\n";
+    }
+}
+
+} // bd
+
+} // ecell4
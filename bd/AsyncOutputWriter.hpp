@@ -0,0 +1,196 @@
+#ifndef ECELL4_BD_ASYNC_OUTPUT_WRITER_HPP
+#define ECELL4_BD_ASYNC_OUTPUT_WRITER_HPP
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "types.hpp"
+#include "Real3.hpp"
+#include "Identifier.hpp"
+#include "Species.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a preallocated buffer holding everything written at once.
+ * the capacities of the containers are kept between uses,
+ * so that filling a frame does not allocate in the steady state.
+ */
+class OutputFrame
+{
+public:
+
+    typedef ParticleID::serial_type serial_type;
+
+    struct position_record
+    {
+        uint32_t species;
+        serial_type serial;
+        Real3 position;
+    };
+
+    struct encounter_record
+    {
+        serial_type tracer;
+        serial_type crowder;
+        Real t;
+    };
+
+public:
+
+    OutputFrame()
+        : t_(0.0), num_species_(0)
+    {
+        ;
+    }
+
+    void clear()
+    {
+        t_ = 0.0;
+        num_species_ = 0;
+        positions_.clear();
+        encounters_.clear();
+    }
+
+    Real t() const
+    {
+        return t_;
+    }
+
+    void set_t(const Real t)
+    {
+        t_ = t;
+    }
+
+    void add_position(
+        const Species::serial_type& species, const ParticleID& pid, const Real3& position)
+    {
+        const position_record rec = {intern(species), pid.serial(), position};
+        positions_.push_back(rec);
+    }
+
+    void add_encounter(const ParticleID& tracer, const ParticleID& crowder, const Real t)
+    {
+        const encounter_record rec = {tracer.serial(), crowder.serial(), t};
+        encounters_.push_back(rec);
+    }
+
+    const std::string& species(const uint32_t idx) const
+    {
+        return species_[idx];
+    }
+
+    const std::vector<position_record>& positions() const
+    {
+        return positions_;
+    }
+
+    const std::vector<encounter_record>& encounters() const
+    {
+        return encounters_;
+    }
+
+protected:
+
+    uint32_t intern(const Species::serial_type& serial)
+    {
+        for (uint32_t i(0); i < num_species_; ++i)
+        {
+            if (species_[i] == serial)
+            {
+                return i;
+            }
+        }
+
+        if (num_species_ == species_.size())
+        {
+            species_.push_back(serial);
+        }
+        else
+        {
+            species_[num_species_] = serial;  // reuse the capacity
+        }
+        return num_species_++;
+    }
+
+protected:
+
+    Real t_;
+    std::vector<std::string> species_;
+    uint32_t num_species_;
+    std::vector<position_record> positions_;
+    std::vector<encounter_record> encounters_;
+};
+
+/**
+ * write frames from a dedicated thread.
+ * frames are passed through a lock-free single-producer single-consumer ring
+ * of preallocated buffers. the simulation thread fills the current frame
+ * and commits it, while the writer thread does the formatting and I/O.
+ * the text format is the same as the one written directly with std::ostream.
+ */
+class AsyncOutputWriter
+{
+public:
+
+    AsyncOutputWriter(std::ostream& out, const std::size_t num_buffers = 2);
+    virtual ~AsyncOutputWriter();
+
+    /**
+     * return the frame being filled by the producer.
+     * wait for a free buffer if all buffers are in use.
+     */
+    OutputFrame& frame();
+
+    /**
+     * pass the current frame to the writer thread.
+     */
+    void commit();
+
+    /**
+     * wait until all committed frames are written and the stream is flushed.
+     */
+    void flush();
+
+    /**
+     * write all committed frames and stop the writer thread.
+     */
+    void stop();
+
+    std::size_t num_buffers() const
+    {
+        return frames_.size();
+    }
+
+protected:
+
+    void run();
+    void write(const OutputFrame& frame);
+    void check_failure() const;
+
+protected:
+
+    std::ostream& out_;
+    std::vector<OutputFrame> frames_;
+    std::atomic<std::size_t> head_;  // the number of committed frames
+    std::atomic<std::size_t> tail_;  // the number of written frames
+    std::atomic<std::size_t> flushed_;  // the number of written and flushed frames
+    std::atomic<bool> running_;
+    std::atomic<bool> failed_;
+    bool acquired_;
+    std::thread thread_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_ASYNC_OUTPUT_WRITER_HPP */
@@ -1,12 +1,7 @@
 #ifndef ECELL4_BD_BD_SIMULATOR_HPP
 #define ECELL4_BD_BD_SIMULATOR_HPP
 
-#include <stdexcept>
-
-#include "./Model.hpp"
-#include "./SimulatorBase.hpp"
-
-#include "BDWorld.hpp"
+#include "BDSimulatorT.hpp"
 
 
 namespace ecell4
@@ -15,133 +10,60 @@ namespace ecell4
 namespace bd
 {
 
-class BDSimulator
-    : public SimulatorBase<BDWorld>
+extern template class BDSimulatorT<ParticleSpace, RandomNumberGenerator, DoubleLayerPolicy>;
+
+/**
+ * BDSimulatorT accepting any space and random number generator of BDWorld.
+ * a step is dispatched statically when the world holds
+ * ParticleSpaceCellListImpl and GSLRandomNumberGenerator, as it does by default,
+ * and through virtual calls otherwise.
+ */
+class BDSimulator final
+    : public BDSimulatorT<ParticleSpace, RandomNumberGenerator, DoubleLayerPolicy>
 {
 public:
 
-    typedef SimulatorBase<BDWorld> base_type;
-    // typedef BDPropagator::reaction_info_type reaction_info_type;
+    typedef BDSimulatorT<ParticleSpace, RandomNumberGenerator, DoubleLayerPolicy> base_type;
 
 public:
 
     BDSimulator(
         std::shared_ptr<BDWorld> world, std::shared_ptr<Model> model,
         Real bd_dt_factor = 1e-5)
-        : base_type(world, model), dt_(0), bd_dt_factor_(bd_dt_factor), dt_set_by_user_(false),
-        gamma_t_(1.0), beta_(1.0), region_radius(0.0)
+        : base_type(world, model, bd_dt_factor), is_static_(holds_static_types())
     {
-        initialize();
+        ;  // the base has been initialized.
     }
 
     BDSimulator(std::shared_ptr<BDWorld> world, Real bd_dt_factor = 1e-5)
-        : base_type(world), dt_(0), bd_dt_factor_(bd_dt_factor), dt_set_by_user_(false),
-        gamma_t_(1.0), beta_(1.0), region_radius(0.0)
+        : base_type(world, bd_dt_factor), is_static_(holds_static_types())
     {
-        initialize();
+        ;  // the base has been initialized.
     }
 
-    // SimulatorTraits
     void initialize();
+    void step() override;
 
-    Real determine_dt() const
-    {
-        constexpr Real inf = std::numeric_limits<Real>::infinity();
-        Real rmin(inf), Dmax(0.0);
-
-        for (std::vector<Species>::const_iterator i(model_->species_attributes().begin());
-            i != model_->species_attributes().end(); ++i)
-        {
-            const BDWorld::molecule_info_type
-                info(world_->get_molecule_info(*i));
-
-            if (rmin > info.radius)
-            {
-                rmin = info.radius;
-            }
-            if (Dmax < info.D)
-            {
-                Dmax = info.D;
-            }
-        }
-
-        const Real dt(rmin < inf && Dmax > 0.0
-            ? 4.0 * rmin * rmin / (2.0 * Dmax) * bd_dt_factor_
-            // ? rmin * rmin / (6.0 * Dmax) * bd_dt_factor_
-            : inf);
-        return dt;
-    }
-
-    Real dt() const
-    {
-        return dt_;
-    }
-
-    void step();
-    bool step(const Real& upto);
-
-    // Optional members
-
-    virtual bool check_reaction() const
-    {
-        return false;
-    }
-
-    void set_dt(const Real& dt)
-    {
-        if (dt <= 0)
-        {
-            throw std::invalid_argument("The step size must be positive.");
-        }
-        dt_ = dt;
-        dt_set_by_user_ = true;
-    }
-
-    inline std::shared_ptr<RandomNumberGenerator> rng()
-    {
-        return (*world_).rng();
-    }
-
-    Real beta() const
-    {
-        return beta_;
-    }
+    using base_type::step;
 
-    void set_beta(const Real& beta)
-    {
-        beta_ = beta;
-    }
-
-    Real gamma_t() const
-    {
-        return gamma_t_;
-    }
-
-    void set_gamma_t(const Real& gamma_t)
+    /**
+     * @return if a step is dispatched statically
+     */
+    bool is_static() const
     {
-        gamma_t_ = gamma_t;
+        return is_static_;
     }
 
-public:
-
-    std::map<std::pair<ParticleID, ParticleID>, Real> first_encount;  // unordered_map requires hash.
-    Real region_radius;
-
 protected:
 
     /**
-     * the protected internal state of BDSimulator.
-     * they are needed to be saved/loaded with Visitor pattern.
+     * @return if the world holds ParticleSpaceCellListImpl and GSLRandomNumberGenerator
      */
-    Real dt_;
-    const Real bd_dt_factor_;
-    bool dt_set_by_user_;
-    // std::vector<std::pair<ReactionRule, reaction_info_type> > last_reactions_;
+    bool holds_static_types() const;
 
-    std::vector<size_t> queue_;
-    std::vector<Real> scheduled_times_;
+protected:
 
-    Real gamma_t_, beta_;
+    bool is_static_;
 };
 
 } // bd
@@ -0,0 +1,1606 @@
+#ifndef ECELL4_BD_BD_SIMULATOR_T_HPP
+#define ECELL4_BD_BD_SIMULATOR_T_HPP
+
+#include <stdexcept>
+#include <istream>
+#include <ostream>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <unordered_set>
+
+#include "./Model.hpp"
+#include "./SimulatorBase.hpp"
+#include "./binary_io.hpp"
+
+#include "BDWorld.hpp"
+#include "AsyncOutputWriter.hpp"
+#include "EncounterTracker.hpp"
+#include "Statistics.hpp"
+#include "DoubleLayerPolicy.hpp"
+#include "ReactionTable.hpp"
+#include "InteractionTable.hpp"
+#include "collision.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * the Brownian dynamics simulator with the particle space and the random number
+ * generator of BDWorld bound at compile time.
+ * calls in the innermost loop are resolved statically for final classes,
+ * e.g. ParticleSpaceCellListImpl and GSLRandomNumberGenerator.
+ * Tpolicy_ gives the boundary conditions, see DoubleLayerPolicy, CompartmentPolicy
+ * and MeshBarrierPolicy.
+ * initialize throws IllegalArgument if the world holds other types.
+ * reaction rules of the model are compiled into ReactionTable at initialize,
+ * and again when the model is changed. a first-order reaction is tried for
+ * each particle before its move, and a second-order one when a move overlaps
+ * with exactly one particle. reactions are not supported by propose_accept.
+ * with continuous_exclusion, a move is tested along its path, not only at its end.
+ * an overlap is handled by the interaction of the pair, see InteractionTable.
+ * particles on membranes of the world diffuse on them after the others in a step,
+ * and take no part in reactions. the policy is not applied to them.
+ */
+template<typename Tspace_, typename Trng_, typename Tpolicy_ = DoubleLayerPolicy>
+class BDSimulatorT
+    : public SimulatorBase<BDWorld>
+{
+public:
+
+    typedef SimulatorBase<BDWorld> base_type;
+    typedef Tspace_ space_type;
+    typedef Trng_ rng_type;
+    typedef Tpolicy_ policy_type;
+    typedef ReactionInfo reaction_info_type;
+
+public:
+
+    BDSimulatorT(
+        std::shared_ptr<BDWorld> world, std::shared_ptr<Model> model,
+        Real bd_dt_factor = 1e-5)
+        : base_type(world, model), dt_(0), truncated_dt_(0), bd_dt_factor_(bd_dt_factor), dt_set_by_user_(false),
+        gamma_t_(1.0), beta_(1.0), propose_accept_(false),
+        continuous_exclusion_(false), search_limit_(std::numeric_limits<Real>::infinity())
+    {
+        initialize();
+    }
+
+    BDSimulatorT(std::shared_ptr<BDWorld> world, Real bd_dt_factor = 1e-5)
+        : base_type(world), dt_(0), truncated_dt_(0), bd_dt_factor_(bd_dt_factor), dt_set_by_user_(false),
+        gamma_t_(1.0), beta_(1.0), propose_accept_(false),
+        continuous_exclusion_(false), search_limit_(std::numeric_limits<Real>::infinity())
+    {
+        initialize();
+    }
+
+    // SimulatorTraits
+    void initialize()
+    {
+        if (dynamic_cast<Tspace_*>(&(*world_).space()) == NULL)
+        {
+            throw IllegalArgument("The world does not hold a space of the given type.");
+        }
+        if (dynamic_cast<Trng_*>((*world_).rng().get()) == NULL)
+        {
+            throw IllegalArgument(
+                "The world does not hold a random number generator of the given type.");
+        }
+
+        if (!dt_set_by_user_)
+        {
+            dt_ = determine_dt();
+        }
+
+        queue_.resize((*world_).num_particles());
+        for (Integer i(0); i < (*world_).num_particles(); ++i)
+        {
+            queue_[i] = i;
+        }
+
+        reactions_.compile(*model_, *world_, dt_);
+        last_reactions_.clear();
+        compile_interactions();
+
+        reset_stats();
+    }
+
+    Real determine_dt() const
+    {
+        constexpr Real inf = std::numeric_limits<Real>::infinity();
+        Real rmin(inf), Dmax(0.0);
+
+        for (std::vector<Species>::const_iterator i(model_->species_attributes().begin());
+            i != model_->species_attributes().end(); ++i)
+        {
+            const BDWorld::molecule_info_type
+                info(world_->get_molecule_info(*i));
+
+            if (rmin > info.radius)
+            {
+                rmin = info.radius;
+            }
+            if (Dmax < info.D)
+            {
+                Dmax = info.D;
+            }
+        }
+
+        const Real dt(rmin < inf && Dmax > 0.0
+            ? 4.0 * rmin * rmin / (2.0 * Dmax) * bd_dt_factor_
+            // ? rmin * rmin / (6.0 * Dmax) * bd_dt_factor_
+            : inf);
+        return dt;
+    }
+
+    Real dt() const
+    {
+        return dt_;
+    }
+
+    /**
+     * virtual, so that step(upto) calls the one of a derived class, e.g. BDSimulator.
+     */
+    void step() override
+    {
+        step_with(static_cast<Tspace_&>((*world_).space()),
+            static_cast<Trng_&>(*(*world_).rng()));
+    }
+
+    bool step(const Real& upto) override
+    {
+        const Real t0(t()), tnext(next_time());
+
+        if (upto <= t0)
+        {
+            return false;
+        }
+
+        if (upto >= tnext)
+        {
+            step();
+            return true;
+        }
+        else
+        {
+            // dt() is kept, and so are the probabilities of reactions for it.
+            truncated_dt_ = upto - t0;
+            step();
+            truncated_dt_ = 0;
+            return false;
+        }
+    }
+
+    // Optional members
+
+    virtual bool check_reaction() const
+    {
+        return last_reactions_.size() > 0;
+    }
+
+    /**
+     * @return reactions occurred in the last step
+     */
+    const std::vector<std::pair<ReactionRule, reaction_info_type> >& last_reactions() const
+    {
+        return last_reactions_;
+    }
+
+    /**
+     * @return reaction rules of the model compiled
+     */
+    const ReactionTable& reaction_table() const
+    {
+        return reactions_;
+    }
+
+    void set_dt(const Real& dt)
+    {
+        if (dt <= 0)
+        {
+            throw std::invalid_argument("The step size must be positive.");
+        }
+        dt_ = dt;
+        dt_set_by_user_ = true;
+    }
+
+    inline std::shared_ptr<RandomNumberGenerator> rng()
+    {
+        return (*world_).rng();
+    }
+
+    Real beta() const
+    {
+        return beta_;
+    }
+
+    void set_beta(const Real& beta)
+    {
+        beta_ = beta;
+    }
+
+    Real gamma_t() const
+    {
+        return gamma_t_;
+    }
+
+    void set_gamma_t(const Real& gamma_t)
+    {
+        gamma_t_ = gamma_t;
+    }
+
+    /**
+     * split a step into two phases: proposals of all particles over arrays,
+     * and the acceptance of them in the same random order.
+     * trajectories are identical to the default for the same seed.
+     */
+    void set_propose_accept(const bool propose_accept)
+    {
+        propose_accept_ = propose_accept;
+    }
+
+    bool propose_accept() const
+    {
+        return propose_accept_;
+    }
+
+    /**
+     * test the whole path of each move against neighbors, not only its end,
+     * so that a particle does not pass through another in larger steps.
+     * the policy needs nothing more, as it tests a straight move by crossings.
+     * neighbors are searched around the middle of the path, or of its pieces if
+     * longer than cells of the space allow. a step throws IllegalArgument if cells
+     * are not larger than twice the largest radius.
+     */
+    void set_continuous_exclusion(const bool continuous_exclusion)
+    {
+        continuous_exclusion_ = continuous_exclusion;
+    }
+
+    bool continuous_exclusion() const
+    {
+        return continuous_exclusion_;
+    }
+
+    /**
+     * set how a pair of species interacts on an overlap, a combination of
+     * InteractionTable::EXCLUDE and ENCOUNTER, or IGNORE.
+     * call initialize after adding particles of species unknown to the table.
+     */
+    void set_interaction(
+        const Species& sp1, const Species& sp2, const InteractionTable::interaction_type interaction)
+    {
+        interactions_.set(sp1, sp2, interaction);
+        compile_interactions();
+    }
+
+    /**
+     * replace all interactions, e.g. by those of another simulator.
+     */
+    void set_interactions(const InteractionTable& interactions)
+    {
+        interactions_ = interactions;
+        compile_interactions();
+    }
+
+    const InteractionTable& interactions() const
+    {
+        return interactions_;
+    }
+
+    policy_type& policy()
+    {
+        return policy_;
+    }
+
+    const policy_type& policy() const
+    {
+        return policy_;
+    }
+
+    /**
+     * save/load the world and the internal state of the simulator
+     * in the dependency-free binary format.
+     * a simulator restored with load_binary continues bit-identically.
+     */
+    void save_binary(std::ostream& out) const;
+    void load_binary(std::istream& in);
+
+    /**
+     * copy the internal state of another simulator, as save_binary and load_binary do,
+     * with its settings of steps and its policy. the world is left as it is, see BDWorld::clone.
+     */
+    void copy_state(const BDSimulatorT& other);
+
+    /**
+     * write encounters through the given writer instead of std::cout.
+     * the writer is shared with the observer dumping positions,
+     * so that the order of lines is kept.
+     */
+    void set_output(const std::shared_ptr<AsyncOutputWriter>& output)
+    {
+        output_ = output;
+    }
+
+    const std::shared_ptr<AsyncOutputWriter>& output() const
+    {
+        return output_;
+    }
+
+    /**
+     * counters and per-phase timers since the last reset.
+     * all zero unless built with ECELL4_BD_ENABLE_STATS.
+     */
+    BDStatistics stats() const
+    {
+        BDStatistics retval(stats_);
+        retval.cell_crossings = (*world_).space_statistics().cell_crossings;
+        retval.candidates_scanned = (*world_).space_statistics().candidates_scanned;
+        return retval;
+    }
+
+    void reset_stats()
+    {
+        stats_.reset();
+        (*world_).reset_space_statistics();
+    }
+
+    /**
+     * contacts of tracer-crowder pairs. set a log to it for recording all events.
+     */
+    EncounterTracker& encounters()
+    {
+        return encounters_;
+    }
+
+    const EncounterTracker& encounters() const
+    {
+        return encounters_;
+    }
+
+protected:
+
+    /**
+     * proposed moves of a step in the structure of arrays, in the order of queue_.
+     */
+    struct proposal_buffer
+    {
+        enum status_type
+        {
+            PROPOSED = 0,
+            REJECTED_CONSTRAINT = 1,
+            REJECTED_POLICY = 2
+        };
+
+        std::vector<size_t> index;
+        std::vector<Real> sigma;
+        std::vector<Real> px, py, pz;  // positions before the move
+        std::vector<Real> x, y, z;  // new positions before applying the periodic boundary
+        std::vector<Real> wx, wy, wz;  // new positions in the world
+        std::vector<Real> sx, sy, sz;  // strides, updated by the move
+        std::vector<Real> ox, oy, oz;  // original positions
+        std::vector<Real> r2;  // squared constraint radii
+        std::vector<uint8_t> status;
+
+        std::size_t size() const
+        {
+            return index.size();
+        }
+
+        void resize(const std::size_t n)
+        {
+            index.resize(n);
+            sigma.resize(n);
+            px.resize(n); py.resize(n); pz.resize(n);
+            x.resize(n); y.resize(n); z.resize(n);
+            wx.resize(n); wy.resize(n); wz.resize(n);
+            sx.resize(n); sy.resize(n); sz.resize(n);
+            ox.resize(n); oy.resize(n); oz.resize(n);
+            r2.resize(n);
+            status.resize(n);
+        }
+
+        /**
+         * set the k-th proposal to the particle before the move.
+         * new positions and the status are left to be overwritten.
+         */
+        void set(const std::size_t k, const size_t idx, const Particle& p, const Real s)
+        {
+            index[k] = idx;
+            sigma[k] = s;
+            px[k] = p.position()[0];
+            py[k] = p.position()[1];
+            pz[k] = p.position()[2];
+            sx[k] = p.stride()[0];
+            sy[k] = p.stride()[1];
+            sz[k] = p.stride()[2];
+            ox[k] = p.original_position()[0];
+            oy[k] = p.original_position()[1];
+            oz[k] = p.original_position()[2];
+            r2[k] = p.constraint_radius() * p.constraint_radius();
+        }
+    };
+
+    /**
+     * propagate all particles by a step, calling the space and the random
+     * number generator through the given types.
+     */
+    template<typename Tspace2_, typename Trng2_>
+    void step_with(Tspace2_& space, Trng2_& rng);
+
+    /**
+     * move particles one by one in the order of queue_.
+     */
+    template<typename Tspace2_, typename Trng2_>
+    void propagate(Tspace2_& space, Trng2_& rng, const Real t0, const Real dt0);
+
+    /**
+     * move particles on each membrane of the world in two dimensions, in a random order.
+     */
+    template<typename Tspace2_, typename Trng2_>
+    void propagate_membranes(Tspace2_& space, Trng2_& rng, const Real t0, const Real dt0);
+
+    /**
+     * the first phase of propose_accept: draw moves of all particles and test
+     * the constraint and the policy, over arrays.
+     */
+    template<typename Tspace2_, typename Trng2_>
+    void propose(Tspace2_& space, Trng2_& rng, const Real dt0);
+
+    /**
+     * test the constraint, and apply the periodic boundary by a single edge,
+     * for all drawn proposals in buf. branch-free over arrays.
+     */
+    static void wrap_proposals(proposal_buffer& buf, const Real3& edge_lengths);
+
+    /**
+     * apply the periodic boundary to the k-th proposal in buf if moved farther
+     * than an edge, and test the policy.
+     */
+    template<typename Tspace2_>
+    void test_proposal(Tspace2_& space, proposal_buffer& buf, const std::size_t k);
+
+    /**
+     * the second phase of propose_accept: test overlaps and update particles
+     * in the order of proposals.
+     */
+    template<typename Tspace2_>
+    void accept_proposals(Tspace2_& space, const Real t0, const Real dt0);
+
+    /**
+     * test overlaps of the k-th proposal in buf, and update the particle.
+     */
+    template<typename Tspace2_>
+    void accept_proposal(
+        Tspace2_& space, const proposal_buffer& buf, const std::size_t k,
+        const Real t0, const Real dt0);
+
+    /**
+     * compile interactions over species known, and partition the space by them.
+     */
+    void compile_interactions()
+    {
+        interactions_.compile(*model_, *world_, reactions_);
+        (*world_).space().set_cell_classes(interactions_.cell_classes(),
+            interactions_.partitioned() ? interactions_.num_classes() : 1);
+    }
+
+    /**
+     * close a step from t0 to t0 + dt0.
+     */
+    void finish_step(const Real t0, const Real dt0)
+    {
+        encounters_.sweep(num_steps_);
+        ECELL4_BD_STATS(++stats_.num_steps);
+
+        set_t(t0 + dt0);
+        num_steps_++;
+    }
+
+    /**
+     * update a particle unless it overlaps with others excluding it,
+     * and observe encounters with others overlapping.
+     */
+    template<typename Tspace2_>
+    void accept(
+        Tspace2_& space, const std::pair<ParticleID, Particle>& pid_particle_pair,
+        const Particle& particle_to_update, const Real t0, const Real dt0);
+
+    /**
+     * update a particle on the membrane unless it overlaps with others excluding it,
+     * in the space or on membranes, and observe encounters.
+     */
+    template<typename Tspace2_>
+    void accept_on_membrane(
+        Tspace2_& space, MembraneSpace& membrane,
+        const std::pair<ParticleID, Particle>& pid_particle_pair,
+        const Particle& particle_to_update, const Real t0, const Real dt0);
+
+    /**
+     * observe encounters of the particle of pid in the class cls with others overlapping.
+     */
+    void record_encounters(
+        const InteractionTable::index_type cls, const ParticleID& pid,
+        const std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >& overlapped,
+        const Real t0, const Real dt0);
+
+    /**
+     * list particles overlapping with the path of a move from particle to particle_to_update.
+     * a distance is from the path, as list_particles_within_radius.
+     * @param classes bits of classes of species to list
+     */
+    template<typename Tspace2_>
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > list_particles_along_path(
+        Tspace2_& space, const ParticleID& pid, const Particle& particle,
+        const Particle& particle_to_update, const uint64_t classes) const;
+
+    /**
+     * set search_limit_ to the largest radius of a query finding all overlaps within
+     * the adjacent cells, the smallest cell less the largest radius of particles.
+     * infinite for a space without cells.
+     */
+    template<typename Tspace2_>
+    void update_search_limit(const Tspace2_& space);
+
+    /**
+     * prepare the bookkeeping of queue_ for reactions in a step.
+     */
+    void begin_reactions();
+
+    /**
+     * rebuild queue_ over the particles left after reactions in a step.
+     * particles born in the step come last.
+     */
+    void end_reactions();
+
+    /**
+     * try a first-order reaction of the idx-th particle.
+     * @return true if it reacted
+     */
+    template<typename Tspace2_, typename Trng2_>
+    bool attempt_reaction(
+        Tspace2_& space, Trng2_& rng, const size_t idx, const Real t0, const Real dt0);
+
+    /**
+     * try a second-order reaction of a pair overlapping.
+     * @param reactant1 the particle moved, at the new position
+     * @param reactant2 the particle overlapping
+     * @return true if they reacted
+     */
+    template<typename Tspace2_, typename Trng2_>
+    bool attempt_reaction(
+        Tspace2_& space, Trng2_& rng,
+        const std::pair<ParticleID, Particle>& reactant1,
+        const std::pair<ParticleID, Particle>& reactant2,
+        const Real t0, const Real dt0);
+
+    /**
+     * draw the vector between products of a dissociation, as a pair from contact
+     * at the distance r12 diffusing for dt, conditioned to be apart.
+     */
+    template<typename Trng2_>
+    Real3 draw_ipv(Trng2_& rng, const Real r12, const Real dt, const Real D12);
+
+    /**
+     * remove a particle reacted, keeping queue_ over the rest.
+     */
+    template<typename Tspace2_>
+    void remove_reactant(Tspace2_& space, const ParticleID& pid);
+
+    /**
+     * add a particle born in a reaction, not moved until the next step.
+     */
+    std::pair<ParticleID, Particle> add_product(const Particle& p)
+    {
+        queue_slots_.push_back(npos);
+        return (*world_).new_particle_without_checking(p);
+    }
+
+protected:
+
+    static const size_t npos = static_cast<size_t>(-1);
+
+    /**
+     * the protected internal state of BDSimulator.
+     * they are needed to be saved/loaded with Visitor pattern.
+     */
+    Real dt_;
+    Real truncated_dt_;  // the interval of a step shorter than dt_ by step(upto), or 0
+    const Real bd_dt_factor_;
+    bool dt_set_by_user_;
+    std::vector<std::pair<ReactionRule, reaction_info_type> > last_reactions_;
+
+    std::vector<size_t> queue_;
+    std::vector<size_t> queue_slots_;  // positions in queue_ by particle, npos if not queued
+    std::vector<Real> scheduled_times_;
+    std::vector<size_t> membrane_queue_;
+
+    Real gamma_t_, beta_;
+    bool propose_accept_;
+    bool continuous_exclusion_;
+    Real search_limit_;  // see update_search_limit, at the start of a step
+
+    policy_type policy_;
+    proposal_buffer proposals_;
+    std::shared_ptr<AsyncOutputWriter> output_;
+    EncounterTracker encounters_;
+    BDStatistics stats_;
+    ReactionTable reactions_;
+    InteractionTable interactions_;
+};
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+const size_t BDSimulatorT<Tspace_, Trng_, Tpolicy_>::npos;
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_, typename Trng2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::step_with(Tspace2_& space, Trng2_& rng)
+{
+    const Real t0(t()), dt0(truncated_dt_ > 0 ? truncated_dt_ : dt());
+
+    if (continuous_exclusion_)
+    {
+        update_search_limit(space);
+    }
+    shuffle(rng, queue_);
+
+    last_reactions_.clear();
+    if ((*model_).revision() != reactions_.revision())
+    {
+        reactions_.compile(*model_, *world_, dt());
+        compile_interactions();
+    }
+
+    if (!reactions_.empty())
+    {
+        if (propose_accept_)
+        {
+            throw NotSupported("Reactions are not supported with propose_accept.");
+        }
+        if (reactions_.dt() != dt())
+        {
+            reactions_.set_dt(dt());
+        }
+
+        begin_reactions();
+        propagate(space, rng, t0, dt0);
+        end_reactions();
+    }
+    else if (propose_accept_)
+    {
+        propose(space, rng, dt0);
+        accept_proposals(space, t0, dt0);
+    }
+    else
+    {
+        propagate(space, rng, t0, dt0);
+    }
+
+    if ((*world_).has_membranes())
+    {
+        propagate_membranes(space, rng, t0, dt0);
+    }
+
+    finish_step(t0, dt0);
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_, typename Trng2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::propagate(
+    Tspace2_& space, Trng2_& rng, const Real t0, const Real dt0)
+{
+    const Real3& edge_lengths(space.edge_lengths());
+
+    for (std::vector<size_t>::const_iterator i(queue_.begin()); i != queue_.end(); i++)
+    {
+        // queue_ is rewritten ahead by reactions, but never resized in a step.
+        if ((*i) == npos)
+        {
+            continue;
+        }
+        if (reactions_.has_first_order() && attempt_reaction(space, rng, *i, t0, dt0))
+        {
+            continue;
+        }
+
+        std::pair<ParticleID, Particle> const& pid_particle_pair(space._get_particle(*i));
+        Particle const& particle(pid_particle_pair.second);
+
+        const Real D(particle.D());
+        if (D == 0)
+        {
+            continue;
+        }
+
+        ECELL4_BD_STATS(++stats_.attempted);
+        ECELL4_BD_STATS(uint64_t tick(read_ticks()));
+
+        const Real sigma(std::sqrt(2 * D * dt0));
+        const Real3 newpos_(
+            particle.position() + Real3(rng.gaussian(sigma), rng.gaussian(sigma), rng.gaussian(sigma)));
+
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_rng, tick));
+
+        const Real constraint_radius(particle.constraint_radius());
+        const Real distance_sq_from_original(
+            length_sq(subtract(add(newpos_, particle.stride()), particle.original_position())));
+        if (distance_sq_from_original > constraint_radius * constraint_radius)
+        {
+            ECELL4_BD_STATS(++stats_.rejected_constraint);
+            ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+            continue;
+        }
+
+        const Real3 newpos(space.apply_boundary(newpos_));
+
+        switch (policy_.test(particle, newpos_, newpos, edge_lengths))
+        {
+        case Tpolicy_::ACCEPTED:
+            break;
+        case Tpolicy_::REJECTED_LAYER:
+            ECELL4_BD_STATS(++stats_.rejected_layer);
+            ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+            continue;
+        default:
+            ECELL4_BD_STATS(++stats_.rejected_wall);
+            ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+            continue;
+        }
+
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+
+        Particle particle_to_update(
+            particle.species(), newpos,
+            particle.radius(), particle.D(), particle.constraint_radius(),
+            add(particle.stride(), subtract(newpos_, newpos)),
+            particle.original_position());
+
+        accept(space, pid_particle_pair, particle_to_update, t0, dt0);
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_update, tick));
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_, typename Trng2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::propagate_membranes(
+    Tspace2_& space, Trng2_& rng, const Real t0, const Real dt0)
+{
+    const BDWorld::membrane_container_type& membranes((*world_).membranes());
+    for (BDWorld::membrane_container_type::const_iterator i(membranes.begin());
+        i != membranes.end(); ++i)
+    {
+        MembraneSpace& membrane(*(*i).second);
+        membrane_queue_.resize(membrane.num_particles());
+        for (size_t j(0); j < membrane_queue_.size(); ++j)
+        {
+            membrane_queue_[j] = j;
+        }
+        shuffle(rng, membrane_queue_);
+
+        // particles keep their indices, as none is removed in a step.
+        for (std::vector<size_t>::const_iterator j(membrane_queue_.begin());
+            j != membrane_queue_.end(); ++j)
+        {
+            // a copy, as the membrane is updated in place.
+            const std::pair<ParticleID, Particle> pid_particle_pair(membrane._get_particle(*j));
+            const Particle& particle(pid_particle_pair.second);
+
+            const Real D(particle.D());
+            if (D == 0)
+            {
+                continue;
+            }
+
+            ECELL4_BD_STATS(++stats_.attempted);
+
+            const Real sigma(std::sqrt(2 * D * dt0));
+            const Real3 newpos_(particle.position()
+                + membrane.unit0() * rng.gaussian(sigma) + membrane.unit1() * rng.gaussian(sigma));
+
+            const Real constraint_radius(particle.constraint_radius());
+            const Real distance_sq_from_original(
+                length_sq(subtract(add(newpos_, particle.stride()), particle.original_position())));
+            if (distance_sq_from_original > constraint_radius * constraint_radius)
+            {
+                ECELL4_BD_STATS(++stats_.rejected_constraint);
+                continue;
+            }
+
+            const Real3 newpos(membrane.apply_boundary(newpos_));
+            Particle particle_to_update(
+                particle.species(), newpos,
+                particle.radius(), particle.D(), particle.constraint_radius(),
+                add(particle.stride(), subtract(newpos_, newpos)),
+                particle.original_position());
+
+            accept_on_membrane(space, membrane, pid_particle_pair, particle_to_update, t0, dt0);
+        }
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_, typename Trng2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::propose(
+    Tspace2_& space, Trng2_& rng, const Real dt0)
+{
+    const Real3& edge_lengths(space.edge_lengths());
+    proposal_buffer& buf(proposals_);
+
+    ECELL4_BD_STATS(uint64_t tick(read_ticks()));
+
+    // gather mobile particles in the order of queue_.
+    buf.resize(queue_.size());
+    std::size_t n(0);
+    for (std::vector<size_t>::const_iterator i(queue_.begin()); i != queue_.end(); i++)
+    {
+        const Particle& particle(space._get_particle(*i).second);
+        const Real D(particle.D());
+        if (D == 0)
+        {
+            continue;
+        }
+        buf.set(n++, *i, particle, std::sqrt(2 * D * dt0));
+    }
+    buf.resize(n);
+    ECELL4_BD_STATS(stats_.attempted += n);
+
+    // draws are sequential, in the same order as propagate.
+    for (std::size_t k(0); k < n; ++k)
+    {
+        const Real sigma(buf.sigma[k]);
+        const Real3 g(rng.gaussian(sigma), rng.gaussian(sigma), rng.gaussian(sigma));
+        buf.x[k] = buf.px[k] + g[0];
+        buf.y[k] = buf.py[k] + g[1];
+        buf.z[k] = buf.pz[k] + g[2];
+    }
+
+    ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_rng, tick));
+
+    wrap_proposals(buf, edge_lengths);
+    for (std::size_t k(0); k < n; ++k)
+    {
+        test_proposal(space, buf, k);
+    }
+
+    ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::wrap_proposals(
+    proposal_buffer& buf, const Real3& edge_lengths)
+{
+    // a wrap by a single edge equals modulo exactly.
+    const std::size_t n(buf.size());
+    const Real Lx(edge_lengths[0]), Ly(edge_lengths[1]), Lz(edge_lengths[2]);
+    const Real* x(buf.x.data());
+    const Real* y(buf.y.data());
+    const Real* z(buf.z.data());
+    Real* wx(buf.wx.data());
+    Real* wy(buf.wy.data());
+    Real* wz(buf.wz.data());
+    Real* sx(buf.sx.data());
+    Real* sy(buf.sy.data());
+    Real* sz(buf.sz.data());
+    const Real* ox(buf.ox.data());
+    const Real* oy(buf.oy.data());
+    const Real* oz(buf.oz.data());
+    const Real* r2(buf.r2.data());
+    uint8_t* status(buf.status.data());
+    for (std::size_t k(0); k < n; ++k)
+    {
+        const Real dx((x[k] + sx[k]) - ox[k]);
+        const Real dy((y[k] + sy[k]) - oy[k]);
+        const Real dz((z[k] + sz[k]) - oz[k]);
+        status[k] = (dx * dx + dy * dy + dz * dz > r2[k]
+            ? proposal_buffer::REJECTED_CONSTRAINT : proposal_buffer::PROPOSED);
+
+        wx[k] = (x[k] >= Lx ? x[k] - Lx : (x[k] < 0 ? x[k] + Lx : x[k]));
+        wy[k] = (y[k] >= Ly ? y[k] - Ly : (y[k] < 0 ? y[k] + Ly : y[k]));
+        wz[k] = (z[k] >= Lz ? z[k] - Lz : (z[k] < 0 ? z[k] + Lz : z[k]));
+        sx[k] += x[k] - wx[k];
+        sy[k] += y[k] - wy[k];
+        sz[k] += z[k] - wz[k];
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+inline void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::test_proposal(
+    Tspace2_& space, proposal_buffer& buf, const std::size_t k)
+{
+    const Real3& edge_lengths(space.edge_lengths());
+
+    if (buf.status[k] != proposal_buffer::PROPOSED)
+    {
+        ECELL4_BD_STATS(++stats_.rejected_constraint);
+        return;
+    }
+
+    const Real3 newpos_(buf.x[k], buf.y[k], buf.z[k]);
+    if (!(newpos_[0] > -edge_lengths[0] && newpos_[0] < 2 * edge_lengths[0]
+        && newpos_[1] > -edge_lengths[1] && newpos_[1] < 2 * edge_lengths[1]
+        && newpos_[2] > -edge_lengths[2] && newpos_[2] < 2 * edge_lengths[2]))
+    {
+        // moved farther than an edge.
+        const Particle& particle(space._get_particle(buf.index[k]).second);
+        const Real3 newpos(space.apply_boundary(newpos_));
+        const Real3 newstride(add(particle.stride(), subtract(newpos_, newpos)));
+        buf.wx[k] = newpos[0];
+        buf.wy[k] = newpos[1];
+        buf.wz[k] = newpos[2];
+        buf.sx[k] = newstride[0];
+        buf.sy[k] = newstride[1];
+        buf.sz[k] = newstride[2];
+    }
+
+    const Real3 newpos(buf.wx[k], buf.wy[k], buf.wz[k]);
+    switch (policy_.test(space._get_particle(buf.index[k]).second, newpos_, newpos, edge_lengths))
+    {
+    case Tpolicy_::ACCEPTED:
+        break;
+    case Tpolicy_::REJECTED_LAYER:
+        ECELL4_BD_STATS(++stats_.rejected_layer);
+        buf.status[k] = proposal_buffer::REJECTED_POLICY;
+        break;
+    default:
+        ECELL4_BD_STATS(++stats_.rejected_wall);
+        buf.status[k] = proposal_buffer::REJECTED_POLICY;
+        break;
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::accept_proposals(
+    Tspace2_& space, const Real t0, const Real dt0)
+{
+    ECELL4_BD_STATS(uint64_t tick(read_ticks()));
+
+    for (std::size_t k(0); k < proposals_.size(); ++k)
+    {
+        accept_proposal(space, proposals_, k, t0, dt0);
+    }
+
+    ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_update, tick));
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+inline void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::accept_proposal(
+    Tspace2_& space, const proposal_buffer& buf, const std::size_t k,
+    const Real t0, const Real dt0)
+{
+    if (buf.status[k] != proposal_buffer::PROPOSED)
+    {
+        return;
+    }
+
+    std::pair<ParticleID, Particle> const& pid_particle_pair(space._get_particle(buf.index[k]));
+    Particle const& particle(pid_particle_pair.second);
+    Particle particle_to_update(
+        particle.species(), Real3(buf.wx[k], buf.wy[k], buf.wz[k]),
+        particle.radius(), particle.D(), particle.constraint_radius(),
+        Real3(buf.sx[k], buf.sy[k], buf.sz[k]),
+        particle.original_position());
+
+    accept(space, pid_particle_pair, particle_to_update, t0, dt0);
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+inline void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::accept(
+    Tspace2_& space, const std::pair<ParticleID, Particle>& pid_particle_pair,
+    const Particle& particle_to_update, const Real t0, const Real dt0)
+{
+    // a copy, as the space may copy particles on write.
+    const ParticleID pid(pid_particle_pair.first);
+    const InteractionTable::index_type cls(interactions_.class_of(pid_particle_pair.second));
+
+    ECELL4_BD_STATS(uint64_t tick(read_ticks()));
+
+    // if (!(*world_)._check_particles_within_radius(newpos, particle.radius(), pid))
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+        overlapped(continuous_exclusion_
+            ? list_particles_along_path(space, pid, pid_particle_pair.second, particle_to_update,
+                interactions_.class_mask(cls))
+            : space.list_particles_within_radius(
+                particle_to_update.position(), particle_to_update.radius(), pid,
+                interactions_.class_mask(cls)));
+    // particles on membranes are tested at the new position, even with continuous_exclusion.
+    (*world_).list_membrane_particles_within_radius(
+        particle_to_update.position(), particle_to_update.radius(), pid, ParticleID(), overlapped);
+    ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_neighbor_search, tick));
+
+    if (overlapped.size() == 0)
+    {
+        space.update_particle(pid, particle_to_update);
+        ECELL4_BD_STATS(++stats_.accepted);
+        return;
+    }
+
+    std::size_t num_excluded(0);
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+        excluded(overlapped.end());
+    for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+        j(overlapped.begin()); j != overlapped.end(); ++j)
+    {
+        if (interactions_.interaction(cls, interactions_.class_of((*j).first.second))
+            & InteractionTable::EXCLUDE)
+        {
+            ++num_excluded;
+            excluded = j;
+        }
+    }
+
+    if (num_excluded == 0)
+    {
+        space.update_particle(pid, particle_to_update);
+        ECELL4_BD_STATS(++stats_.accepted);
+    }
+    else
+    {
+        ECELL4_BD_STATS(++stats_.rejected_overlap);
+
+        // particles on membranes do not react.
+        if (num_excluded == 1 && reactions_.has_second_order()
+            && (*excluded).first.second.location().empty())
+        {
+            // the generator is called through the base class, as reactions are rare.
+            if (attempt_reaction(space, *(*world_).rng(),
+                std::make_pair(pid, particle_to_update), (*excluded).first, t0, dt0))
+            {
+                return;
+            }
+        }
+    }
+
+    record_encounters(cls, pid, overlapped, t0, dt0);
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::accept_on_membrane(
+    Tspace2_& space, MembraneSpace& membrane,
+    const std::pair<ParticleID, Particle>& pid_particle_pair,
+    const Particle& particle_to_update, const Real t0, const Real dt0)
+{
+    const ParticleID& pid(pid_particle_pair.first);
+    const InteractionTable::index_type cls(interactions_.class_of(pid_particle_pair.second));
+
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+        overlapped(space.list_particles_within_radius(
+            particle_to_update.position(), particle_to_update.radius(), pid,
+            interactions_.class_mask(cls)));
+    (*world_).list_membrane_particles_within_radius(
+        particle_to_update.position(), particle_to_update.radius(), pid, ParticleID(), overlapped);
+
+    bool excluded(false);
+    for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+        j(overlapped.begin()); j != overlapped.end(); ++j)
+    {
+        if (interactions_.interaction(cls, interactions_.class_of((*j).first.second))
+            & InteractionTable::EXCLUDE)
+        {
+            excluded = true;
+            break;
+        }
+    }
+
+    if (excluded)
+    {
+        ECELL4_BD_STATS(++stats_.rejected_overlap);
+    }
+    else
+    {
+        membrane.update_particle(pid, particle_to_update);
+        ECELL4_BD_STATS(++stats_.accepted);
+    }
+
+    record_encounters(cls, pid, overlapped, t0, dt0);
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::record_encounters(
+    const InteractionTable::index_type cls, const ParticleID& pid,
+    const std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >& overlapped,
+    const Real t0, const Real dt0)
+{
+    for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator j = overlapped.begin(); j != overlapped.end(); j++)
+    {
+        const InteractionTable::interaction_type
+            interaction(interactions_.interaction(cls, interactions_.class_of((*j).first.second)));
+        if (!(interaction & InteractionTable::ENCOUNTER))
+        {
+            continue;
+        }
+
+        const std::pair<ParticleID, ParticleID>
+            tracer_crowder_pair(InteractionTable::encounter_pair(interaction, pid, (*j).first.first));
+
+        ECELL4_BD_STATS(++stats_.encounters);
+        if (encounters_.observe(tracer_crowder_pair, t0, dt0, num_steps_))
+        {
+            ECELL4_BD_STATS(++stats_.first_encounters);
+            if (output_)
+            {
+                (*output_).frame().add_encounter(
+                    tracer_crowder_pair.first, tracer_crowder_pair.second, t0);
+            }
+            else
+            {
+                std::cout
+                    << "#C,"
+                    << tracer_crowder_pair.first.serial() << ","
+                    << tracer_crowder_pair.second.serial() << ","
+                    << t0 << std::endl;
+            }
+        }
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+BDSimulatorT<Tspace_, Trng_, Tpolicy_>::list_particles_along_path(
+    Tspace2_& space, const ParticleID& pid, const Particle& particle,
+    const Particle& particle_to_update, const uint64_t classes) const
+{
+    // the displacement before applying the periodic boundary.
+    const Real3 disp(subtract(
+        add(particle_to_update.position(), particle_to_update.stride()),
+        add(particle.position(), particle.stride())));
+    const Real3 half(multiply(disp, 0.5));
+    const Real3 center(space.apply_boundary(add(particle.position(), half)));
+    const Real radius(particle_to_update.radius());
+
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > candidates;
+    if (radius + length(half) <= search_limit_)
+    {
+        candidates = space.list_particles_within_radius(center, radius + length(half), pid, classes);
+    }
+    else
+    {
+        // a query reaches only the adjacent cells, thus the path is split into pieces.
+        const Integer m(static_cast<Integer>(std::ceil(length(half) / (search_limit_ - radius))));
+        const Real reach(radius + length(half) / m);
+        std::unordered_set<ParticleID> seen;
+        for (Integer j(0); j < m; ++j)
+        {
+            const Real3 middle(space.apply_boundary(
+                add(particle.position(), multiply(disp, (j + 0.5) / m))));
+            const std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+                found(space.list_particles_within_radius(middle, reach, pid, classes));
+            for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+                i(found.begin()); i != found.end(); ++i)
+            {
+                if (seen.insert((*i).first.first).second)
+                {
+                    candidates.push_back(*i);
+                }
+            }
+        }
+    }
+
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > retval;
+    const Real3 p(subtract(center, half)), q(add(center, half));
+    for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+        i(candidates.begin()); i != candidates.end(); ++i)
+    {
+        // others stay still in the move.
+        const Real3 pos(space.periodic_transpose((*i).first.second.position(), center));
+        Real s(0.0), t(0.0);
+        Real3 c1, c2;
+        const Real dist(std::sqrt(collision::closest_point_segment_segment(
+            p, q, pos, pos, s, t, c1, c2)) - (*i).first.second.radius());
+        if (dist < radius)
+        {
+            retval.push_back(std::make_pair((*i).first, dist));
+        }
+    }
+    return retval;
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::update_search_limit(const Tspace2_& space)
+{
+    const ParticleSpaceCellListImpl* cells(dynamic_cast<const ParticleSpaceCellListImpl*>(&space));
+    if (cells == NULL)
+    {
+        search_limit_ = std::numeric_limits<Real>::infinity();
+        return;
+    }
+
+    Real rmax(0.0);
+    for (Integer i(0); i < space.num_particles(); ++i)
+    {
+        rmax = std::max(rmax, space._get_particle(i).second.radius());
+    }
+
+    const Real3& cell_sizes((*cells).cell_sizes());
+    const Real cell_size(std::min(std::min(cell_sizes[0], cell_sizes[1]), cell_sizes[2]));
+    if (cell_size <= 2 * rmax)
+    {
+        throw_exception<IllegalArgument>(
+            "Cells [", cell_size, "] must be larger than twice the largest radius [",
+            rmax, "] for continuous_exclusion.");
+    }
+    search_limit_ = cell_size - rmax;
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::begin_reactions()
+{
+    queue_slots_.assign(queue_.size(), npos);
+    for (size_t i(0); i < queue_.size(); ++i)
+    {
+        queue_slots_[queue_[i]] = i;
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::end_reactions()
+{
+    if (last_reactions_.empty())
+    {
+        return;
+    }
+
+    queue_.erase(std::remove(queue_.begin(), queue_.end(), npos), queue_.end());
+    for (size_t i(0); i < queue_slots_.size(); ++i)
+    {
+        if (queue_slots_[i] == npos)
+        {
+            queue_.push_back(i);
+        }
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::remove_reactant(
+    Tspace2_& space, const ParticleID& pid)
+{
+    // the space moves the last particle to the hole.
+    const size_t idx(space._get_index(pid));
+    const size_t last(space.num_particles() - 1);
+    space.remove_particle(pid);
+
+    if (queue_slots_[idx] != npos)
+    {
+        queue_[queue_slots_[idx]] = npos;
+    }
+    if (idx < last)
+    {
+        const size_t pos(queue_slots_[last]);
+        if (pos != npos)
+        {
+            queue_[pos] = idx;
+        }
+        queue_slots_[idx] = pos;
+    }
+    queue_slots_.pop_back();
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Trng2_>
+Real3 BDSimulatorT<Tspace_, Trng_, Tpolicy_>::draw_ipv(
+    Trng2_& rng, const Real r12, const Real dt, const Real D12)
+{
+    const Real sigma(std::sqrt(2 * D12 * dt));
+    while (true)
+    {
+        const Real3 u(rng.gaussian(1.0), rng.gaussian(1.0), rng.gaussian(1.0));
+        const Real len(length(u));
+        if (len == 0)
+        {
+            continue;
+        }
+
+        const Real3 ipv(add(multiply(u, r12 / len),
+            Real3(rng.gaussian(sigma), rng.gaussian(sigma), rng.gaussian(sigma))));
+        if (length_sq(ipv) >= r12 * r12)
+        {
+            return ipv;
+        }
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_, typename Trng2_>
+bool BDSimulatorT<Tspace_, Trng_, Tpolicy_>::attempt_reaction(
+    Tspace2_& space, Trng2_& rng, const size_t idx, const Real t0, const Real dt0)
+{
+    const ReactionTable::index_type sp(
+        reactions_.species_index(space._get_particle(idx).second.species()));
+    if (sp == ReactionTable::npos)
+    {
+        return false;
+    }
+    const ReactionTable::range_type rules(reactions_.first_order(sp));
+    if (rules.first == rules.second)
+    {
+        return false;
+    }
+
+    const Real rnd(rng.uniform(0, 1));
+    const Real scale(reactions_.first_order_scale(sp, dt0));
+    ReactionTable::const_iterator rule(rules.first);
+    while (rule != rules.second && (*rule).probability * scale <= rnd)
+    {
+        ++rule;
+    }
+    if (rule == rules.second)
+    {
+        return false;
+    }
+
+    // copied, as the space is changed below.
+    const std::pair<ParticleID, Particle> reactant(space._get_particle(idx));
+    const ParticleID& pid(reactant.first);
+    const Particle& particle(reactant.second);
+    reaction_info_type ri(t0 + dt0,
+        reaction_info_type::container_type(1, reactant), reaction_info_type::container_type());
+
+    switch ((*rule).num_products)
+    {
+    case 0:
+        remove_reactant(space, pid);
+        break;
+    case 1:
+        {
+            // a product keeps the trajectory of the reactant.
+            const ReactionTable::species_info_type& info(
+                reactions_.species_info((*rule).products[0]));
+            if (space.list_particles_within_radius(
+                particle.position(), info.radius, pid).size() > 0)
+            {
+                return false;
+            }
+
+            const Particle particle_to_update(
+                info.species, particle.position(), info.radius, info.D, info.constraint_radius,
+                particle.stride(), particle.original_position());
+            space.update_particle(pid, particle_to_update);
+            ri.add_product(std::make_pair(pid, particle_to_update));
+        }
+        break;
+    default:
+        {
+            const ReactionTable::species_info_type& info1(
+                reactions_.species_info((*rule).products[0]));
+            const ReactionTable::species_info_type& info2(
+                reactions_.species_info((*rule).products[1]));
+            const Real D12(info1.D + info2.D);
+            const Real3 ipv(draw_ipv(rng, info1.radius + info2.radius, dt0, D12));
+
+            const Real3 newpos1_(add(particle.position(),
+                multiply(ipv, D12 > 0 ? info1.D / D12 : 0.5)));
+            const Real3 newpos2_(subtract(particle.position(),
+                multiply(ipv, D12 > 0 ? info2.D / D12 : 0.5)));
+            const Real3 newpos1(space.apply_boundary(newpos1_));
+            const Real3 newpos2(space.apply_boundary(newpos2_));
+
+            // products are tested as moves of the reactant.
+            const Particle origin1(
+                info1.species, particle.position(), info1.radius, info1.D,
+                info1.constraint_radius, particle.stride(), particle.original_position());
+            const Particle origin2(
+                info2.species, particle.position(), info2.radius, info2.D,
+                info2.constraint_radius, particle.stride(), particle.original_position());
+            const Real3& edge_lengths(space.edge_lengths());
+            if (policy_.test(origin1, newpos1_, newpos1, edge_lengths) != Tpolicy_::ACCEPTED
+                || policy_.test(origin2, newpos2_, newpos2, edge_lengths) != Tpolicy_::ACCEPTED)
+            {
+                return false;
+            }
+            if (space.list_particles_within_radius(newpos1, info1.radius, pid).size() > 0
+                || space.list_particles_within_radius(newpos2, info2.radius, pid).size() > 0)
+            {
+                return false;
+            }
+
+            const Particle particle_to_update1(
+                info1.species, newpos1, info1.radius, info1.D, info1.constraint_radius,
+                add(particle.stride(), subtract(newpos1_, newpos1)), particle.original_position());
+            const Particle particle_to_update2(
+                info2.species, newpos2, info2.radius, info2.D, info2.constraint_radius,
+                add(particle.stride(), subtract(newpos2_, newpos2)), particle.original_position());
+            space.update_particle(pid, particle_to_update1);
+            ri.add_product(std::make_pair(pid, particle_to_update1));
+            ri.add_product(add_product(particle_to_update2));
+        }
+        break;
+    }
+
+    last_reactions_.push_back(std::make_pair(reactions_.reaction_rule((*rule).rule), ri));
+    ECELL4_BD_STATS(++stats_.reactions);
+    return true;
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+template<typename Tspace2_, typename Trng2_>
+bool BDSimulatorT<Tspace_, Trng_, Tpolicy_>::attempt_reaction(
+    Tspace2_& space, Trng2_& rng,
+    const std::pair<ParticleID, Particle>& reactant1,
+    const std::pair<ParticleID, Particle>& reactant2,
+    const Real t0, const Real dt0)
+{
+    const ReactionTable::index_type
+        sp1(reactions_.species_index(reactant1.second.species())),
+        sp2(reactions_.species_index(reactant2.second.species()));
+    if (sp1 == ReactionTable::npos || sp2 == ReactionTable::npos)
+    {
+        return false;
+    }
+    const ReactionTable::range_type rules(reactions_.second_order(sp1, sp2));
+    if (rules.first == rules.second)
+    {
+        return false;
+    }
+
+    const Real rnd(rng.uniform(0, 1));
+    const Real scale(reactions_.second_order_scale(sp1, sp2, dt0));
+    ReactionTable::const_iterator rule(rules.first);
+    while (rule != rules.second && (*rule).probability * scale <= rnd)
+    {
+        ++rule;
+    }
+    if (rule == rules.second)
+    {
+        return false;
+    }
+
+    const ParticleID& pid1(reactant1.first);
+    const ParticleID& pid2(reactant2.first);
+    const Particle& particle1(reactant1.second);
+    const Particle& particle2(reactant2.second);
+    reaction_info_type ri(t0 + dt0,
+        reaction_info_type::container_type(1, reactant1), reaction_info_type::container_type());
+    ri.add_reactant(reactant2);
+
+    if ((*rule).num_products == 0)
+    {
+        remove_reactant(space, pid1);
+        remove_reactant(space, pid2);
+    }
+    else
+    {
+        const ReactionTable::species_info_type& info(
+            reactions_.species_info((*rule).products[0]));
+        const Real3 pos1(particle1.position());
+        const Real3 pos2(space.periodic_transpose(particle2.position(), pos1));
+        const Real D1(particle1.D()), D2(particle2.D());
+        const Real D12(D1 + D2);
+        const Real3 newpos_(D12 > 0
+            ? divide(add(multiply(pos1, D2), multiply(pos2, D1)), D12)
+            : multiply(add(pos1, pos2), 0.5));
+        const Real3 newpos(space.apply_boundary(newpos_));
+
+        // the product is tested as a move of the first reactant.
+        const Particle origin(
+            info.species, pos1, info.radius, info.D, info.constraint_radius,
+            particle1.stride(), particle1.original_position());
+        if (policy_.test(origin, newpos_, newpos, space.edge_lengths()) != Tpolicy_::ACCEPTED)
+        {
+            return false;
+        }
+        if (space.list_particles_within_radius(newpos, info.radius, pid1, pid2).size() > 0)
+        {
+            return false;
+        }
+
+        const Particle product(
+            info.species, newpos, info.radius, info.D, info.constraint_radius,
+            add(particle1.stride(), subtract(newpos_, newpos)), particle1.original_position());
+        remove_reactant(space, pid1);
+        remove_reactant(space, pid2);
+        ri.add_product(add_product(product));
+    }
+
+    last_reactions_.push_back(std::make_pair(reactions_.reaction_rule((*rule).rule), ri));
+    ECELL4_BD_STATS(++stats_.reactions);
+    return true;
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::save_binary(std::ostream& out) const
+{
+    binary_io::write_header(out, "ECELL4BDSIMULATOR", 4);
+    (*world_).save_binary(out);
+
+    binary_io::write(out, dt_);
+    binary_io::write(out, static_cast<uint8_t>(dt_set_by_user_));
+    binary_io::write(out, num_steps_);
+    binary_io::write(out, gamma_t_);
+    binary_io::write(out, beta_);
+
+    binary_io::write(out, static_cast<uint64_t>(queue_.size()));
+    for (std::vector<size_t>::const_iterator i(queue_.begin()); i != queue_.end(); ++i)
+    {
+        binary_io::write(out, static_cast<uint64_t>(*i));
+    }
+
+    encounters_.save_binary(out);
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::load_binary(std::istream& in)
+{
+    const uint32_t version(binary_io::read_header(in, "ECELL4BDSIMULATOR", 4));
+    (*world_).load_binary(in);
+
+    binary_io::read(in, dt_);
+    dt_set_by_user_ = (binary_io::read<uint8_t>(in) != 0);
+    binary_io::read(in, num_steps_);
+    binary_io::read(in, gamma_t_);
+    binary_io::read(in, beta_);
+    if (version <= 2)
+    {
+        // the radius of the spherical region, now given by CompartmentPolicy.
+        binary_io::read<Real>(in);
+    }
+
+    const uint64_t num_queued(binary_io::read<uint64_t>(in));
+    if (num_queued != static_cast<uint64_t>((*world_).num_particles()))
+    {
+        throw IllegalState("The size of the queue does not match the number of particles.");
+    }
+    queue_.resize(num_queued);
+    for (std::vector<size_t>::iterator i(queue_.begin()); i != queue_.end(); ++i)
+    {
+        (*i) = static_cast<size_t>(binary_io::read<uint64_t>(in));
+    }
+
+    if (version >= 2)
+    {
+        encounters_.load_binary(in, version <= 3);
+        return;
+    }
+
+    // version 1 only kept the time of the first contact of each pair.
+    encounters_.clear();
+    const uint64_t num_encounters(binary_io::read<uint64_t>(in));
+    for (uint64_t i(0); i < num_encounters; ++i)
+    {
+        ParticleID pid1, pid2;
+        binary_io::read(in, pid1.lot());
+        binary_io::read(in, pid1.serial());
+        binary_io::read(in, pid2.lot());
+        binary_io::read(in, pid2.serial());
+        const Real t(binary_io::read<Real>(in));
+        encounters_.insert_first_contact(std::make_pair(pid1, pid2), t);
+    }
+}
+
+template<typename Tspace_, typename Trng_, typename Tpolicy_>
+void BDSimulatorT<Tspace_, Trng_, Tpolicy_>::copy_state(const BDSimulatorT& other)
+{
+    if ((*world_).num_particles() != (*other.world_).num_particles())
+    {
+        throw IllegalState("The size of the queue does not match the number of particles.");
+    }
+
+    dt_ = other.dt_;
+    dt_set_by_user_ = other.dt_set_by_user_;
+    num_steps_ = other.num_steps_;
+    gamma_t_ = other.gamma_t_;
+    beta_ = other.beta_;
+    queue_ = other.queue_;
+    encounters_ = other.encounters_;
+
+    propose_accept_ = other.propose_accept_;
+    continuous_exclusion_ = other.continuous_exclusion_;
+    policy_ = other.policy_;
+    set_interactions(other.interactions_);
+}
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_BD_SIMULATOR_T_HPP */
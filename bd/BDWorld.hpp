@@ -3,13 +3,22 @@
 
 #include <memory>
 #include <sstream>
+#include <fstream>
+#include <cmath>
+#include <map>
+#include <algorithm>
+#include <unordered_map>
 
 #include "./exceptions.hpp"
+#include "./binary_io.hpp"
 #include "./extras.hpp"
 #include "./RandomNumberGenerator.hpp"
 #include "./SerialIDGenerator.hpp"
 #include "./ParticleSpace.hpp"
 #include "./ParticleSpaceCellListImpl.hpp"
+#include "./ParticleView.hpp"
+#include "./MembraneSpace.hpp"
+#include "./comparators.hpp"
 #include "./Model.hpp"
 // #include "./WorldInterface.hpp"
 
@@ -25,6 +34,22 @@ struct MoleculeInfo
     const Real radius;
     const Real D;
     const Real constraint_radius;
+
+    /**
+     * the standard deviation of a displacement along an axis in dt.
+     */
+    Real sigma(const Real& dt) const
+    {
+        return std::sqrt(2.0 * D * dt);
+    }
+
+    /**
+     * the distance between centers of this and another molecule in contact.
+     */
+    Real contact_distance(const MoleculeInfo& other) const
+    {
+        return radius + other.radius;
+    }
 };
 
 class BDWorld
@@ -36,12 +61,14 @@ public:
     typedef ParticleSpaceCellListImpl particle_space_type;
     // typedef ParticleSpaceVectorImpl particle_space_type;
     typedef particle_space_type::particle_container_type particle_container_type;
+    typedef std::map<std::string, std::shared_ptr<MembraneSpace> > membrane_container_type;
 
 public:
 
     BDWorld(const Real3& edge_lengths = Real3(1, 1, 1),
         const Integer3& matrix_sizes = Integer3(3, 3, 3))
-        : ps_(new particle_space_type(edge_lengths, matrix_sizes))
+        : ps_(new particle_space_type(edge_lengths, matrix_sizes)),
+        cached_revision_(0), cache_generation_(0)
     {
         rng_ = std::shared_ptr<RandomNumberGenerator>(
             new GSLRandomNumberGenerator());
@@ -51,19 +78,45 @@ public:
     BDWorld(
         const Real3& edge_lengths, const Integer3& matrix_sizes,
         std::shared_ptr<RandomNumberGenerator> rng)
-        : ps_(new particle_space_type(edge_lengths, matrix_sizes)), rng_(rng)
+        : ps_(new particle_space_type(edge_lengths, matrix_sizes)), rng_(rng),
+        cached_revision_(0), cache_generation_(0)
     {
         ;
     }
 
     BDWorld(const std::string& filename)
-        : ps_(new particle_space_type(Real3(1, 1, 1)))
+        : ps_(new particle_space_type(Real3(1, 1, 1))),
+        cached_revision_(0), cache_generation_(0)
     {
         rng_ = std::shared_ptr<RandomNumberGenerator>(
             new GSLRandomNumberGenerator());
         this->load(filename);
     }
 
+    /**
+     * copy the world for another trajectory from the current state.
+     * the space is copied on write, so that a copy costs far less than
+     * save_binary and load_binary, and a change of either world leaves the other as it is.
+     * the ID generator is copied, and thus both worlds issue the same IDs from now on.
+     * the model bound is shared.
+     * @param rng a generator for the copy, which must not be the one of this world.
+     *  its state is used as it is. seed it or load a state before or after the copy.
+     * @return the copy
+     */
+    std::shared_ptr<BDWorld> clone(const std::shared_ptr<RandomNumberGenerator>& rng) const
+    {
+        if (!rng)
+        {
+            throw IllegalArgument("A random number generator is required for a copy.");
+        }
+        if (rng.get() == rng_.get())
+        {
+            throw IllegalArgument(
+                "A copy must not share the random number generator with the original.");
+        }
+        return std::shared_ptr<BDWorld>(new BDWorld(*this, rng));
+    }
+
     /**
      * create and add a new particle
      * @param p a particle
@@ -73,6 +126,18 @@ public:
     std::pair<std::pair<ParticleID, Particle>, bool>
     new_particle(const Particle& p)
     {
+        if (MembraneSpace* membrane = find_membrane(p))
+        {
+            const ParticleID pid(pidgen_());
+            const Particle projected(project_onto(*membrane, p));
+            if (list_particles_within_radius(projected.position(), projected.radius()).size() == 0)
+            {
+                (*membrane).update_particle(pid, projected);
+                return std::make_pair(std::make_pair(pid, projected), true);
+            }
+            return std::make_pair(std::make_pair(pid, projected), false);
+        }
+
         ParticleID pid(pidgen_());
         // if (has_particle(pid))
         // {
@@ -89,15 +154,87 @@ public:
         }
     }
 
+    /**
+     * add a new particle without testing overlaps.
+     * @param p a particle
+     * @return a pair of pid (a particle id) and p (a particle)
+     */
+    std::pair<ParticleID, Particle> new_particle_without_checking(const Particle& p)
+    {
+        const ParticleID pid(pidgen_());
+        if (MembraneSpace* membrane = find_membrane(p))
+        {
+            const Particle projected(project_onto(*membrane, p));
+            (*membrane).update_particle(pid, projected);
+            return std::make_pair(pid, projected);
+        }
+        (*ps_).update_particle(pid, p);
+        return std::make_pair(pid, p);
+    }
+
     std::pair<std::pair<ParticleID, Particle>, bool>
     new_particle(const Species& sp, const Real3& pos)
     {
         const MoleculeInfo info(get_molecule_info(sp));
-        return new_particle(Particle(sp, pos, info.radius, info.D, info.constraint_radius));
+        Particle p(sp, pos, info.radius, info.D, info.constraint_radius);
+        if (!membranes_.empty())
+        {
+            p.location() = get_location(sp);
+        }
+        return new_particle(p);
+    }
+
+    /**
+     * add new particles at once, which is much faster than new_particle for many.
+     * in contrast to new_particle, no particle is added if any overlaps.
+     * @param particles a list of particles
+     * @param check_overlaps if true, throw IllegalArgument when a particle
+     * overlaps with another in the list or in the world
+     * @return a list of ParticleIDs issued in order
+     */
+    std::vector<ParticleID> insert_particles(
+        const std::vector<Particle>& particles, const bool check_overlaps = true)
+    {
+        particle_container_type pairs;
+        pairs.reserve(particles.size());
+        for (std::vector<Particle>::const_iterator i(particles.begin());
+            i != particles.end(); ++i)
+        {
+            pairs.push_back(std::make_pair(pidgen_(), *i));
+        }
+        (*ps_).bulk_load(pairs, check_overlaps);
+
+        std::vector<ParticleID> retval;
+        retval.reserve(pairs.size());
+        for (particle_container_type::const_iterator i(pairs.begin());
+            i != pairs.end(); ++i)
+        {
+            retval.push_back((*i).first);
+        }
+        return retval;
+    }
+
+    std::vector<ParticleID> insert_particles(
+        const Species& sp, const std::vector<Real3>& positions,
+        const bool check_overlaps = true)
+    {
+        const MoleculeInfo info(get_molecule_info(sp));
+        std::vector<Particle> particles;
+        particles.reserve(positions.size());
+        for (std::vector<Real3>::const_iterator i(positions.begin());
+            i != positions.end(); ++i)
+        {
+            particles.push_back(
+                Particle(sp, *i, info.radius, info.D, info.constraint_radius));
+        }
+        return insert_particles(particles, check_overlaps);
     }
 
     /**
      * draw attributes of species and return it as a molecule info.
+     * what the bound model gives is resolved once for each species, by its dense index
+     * in this world, until the model is changed or another is bound.
+     * attributes of sp itself count only where the model gives nothing.
      * @param sp a species
      * @return info a molecule info
      */
@@ -107,35 +244,18 @@ public:
 
         if (std::shared_ptr<Model> bound_model = lock_model())
         {
-            Species newsp(bound_model->apply_species_attributes(sp));
-
-            if (newsp.has_attribute("radius"))
-            {
-                radius = newsp.get_attribute_as<Real>("radius");
-            }
-            if (newsp.has_attribute("D"))
-            {
-                D = newsp.get_attribute_as<Real>("D");
-            }
-            if (newsp.has_attribute("constraint_radius"))
-            {
-                constraint_radius = newsp.get_attribute_as<Real>("constraint_radius");
-            }
+            const resolved_attributes_type& attrs(resolve_species_attributes(bound_model, sp));
+            radius = (attrs.has_radius ? attrs.radius : get_attribute_or(sp, "radius", radius));
+            D = (attrs.has_D ? attrs.D : get_attribute_or(sp, "D", D));
+            constraint_radius = (attrs.has_constraint_radius
+                ? attrs.constraint_radius
+                : get_attribute_or(sp, "constraint_radius", constraint_radius));
         }
         else
         {
-            if (sp.has_attribute("radius"))
-            {
-                radius = sp.get_attribute_as<Real>("radius");
-            }
-            if (sp.has_attribute("D"))
-            {
-                D = sp.get_attribute_as<Real>("D");
-            }
-            if (sp.has_attribute("constraint_radius"))
-            {
-                constraint_radius = sp.get_attribute_as<Real>("constraint_radius");
-            }
+            radius = get_attribute_or(sp, "radius", radius);
+            D = get_attribute_or(sp, "D", D);
+            constraint_radius = get_attribute_or(sp, "constraint_radius", constraint_radius);
         }
 
         if (radius <= 0.0)
@@ -149,6 +269,90 @@ public:
         return info;
     }
 
+    /**
+     * @return the distance between centers of molecules of sp1 and sp2 in contact
+     */
+    Real contact_distance(const Species& sp1, const Species& sp2) const
+    {
+        return get_molecule_info(sp1).contact_distance(get_molecule_info(sp2));
+    }
+
+    /**
+     * the location of species, given by the bound model or the attribute of sp.
+     * @return the name of a membrane, or empty for the bulk
+     */
+    std::string get_location(const Species& sp) const
+    {
+        if (std::shared_ptr<Model> bound_model = lock_model())
+        {
+            const resolved_attributes_type& attrs(resolve_species_attributes(bound_model, sp));
+            if (attrs.has_location)
+            {
+                return attrs.location;
+            }
+        }
+        return (sp.has_attribute("location") ? sp.get_attribute_as<std::string>("location") : "");
+    }
+
+    /**
+     * add a membrane, where particles of the location diffuse in two dimensions.
+     * particles are bound to it by the location attribute of their species,
+     * or by Particle::location. they are not in space(), and so are neither
+     * counted by num_particles nor listed by list_particles and particles(),
+     * but are counted by num_molecules and overlap with the others as usual.
+     * see MembraneSpace.
+     * @param location the name of the membrane
+     * @param surface a rectangle spanned by orthogonal edges
+     * @param num_cols the number of cells along the first edge
+     * @param num_rows the number of cells along the second edge
+     */
+    MembraneSpace& add_membrane(const std::string& location, const PlanarSurface& surface,
+        const Integer num_cols = 8, const Integer num_rows = 8)
+    {
+        if (location.empty())
+        {
+            throw IllegalArgument("The location of a membrane must not be empty.");
+        }
+        if (membranes_.find(location) != membranes_.end())
+        {
+            throw_exception<AlreadyExists>("A membrane [", location, "] already exists.");
+        }
+        std::shared_ptr<MembraneSpace> membrane(
+            new MembraneSpace(location, surface, edge_lengths(), num_cols, num_rows));
+        membranes_.insert(std::make_pair(location, membrane));
+        return *membrane;
+    }
+
+    bool has_membranes() const
+    {
+        return !membranes_.empty();
+    }
+
+    const membrane_container_type& membranes() const
+    {
+        return membranes_;
+    }
+
+    MembraneSpace& membrane(const std::string& location)
+    {
+        membrane_container_type::iterator i(membranes_.find(location));
+        if (i == membranes_.end())
+        {
+            throw_exception<NotFound>("No such membrane [", location, "].");
+        }
+        return *(*i).second;
+    }
+
+    const MembraneSpace& membrane(const std::string& location) const
+    {
+        membrane_container_type::const_iterator i(membranes_.find(location));
+        if (i == membranes_.end())
+        {
+            throw_exception<NotFound>("No such membrane [", location, "].");
+        }
+        return *(*i).second;
+    }
+
     const Real t() const
     {
         return (*ps_).t();
@@ -181,7 +385,7 @@ public:
 
     bool has_particle(const ParticleID& pid) const
     {
-        return (*ps_).has_particle(pid);
+        return ((*ps_).has_particle(pid) || find_membrane(pid) != NULL);
     }
 
     std::vector<std::pair<ParticleID, Particle> > list_particles() const
@@ -203,7 +407,21 @@ public:
 
     std::vector<Species> list_species() const
     {
-        return (*ps_).list_species();
+        std::vector<Species> retval((*ps_).list_species());
+        for (membrane_container_type::const_iterator i(membranes_.begin());
+            i != membranes_.end(); ++i)
+        {
+            const MembraneSpace::particle_container_type& pcont((*(*i).second).particles());
+            for (MembraneSpace::particle_container_type::const_iterator j(pcont.begin());
+                j != pcont.end(); ++j)
+            {
+                if (std::find(retval.begin(), retval.end(), (*j).second.species()) == retval.end())
+                {
+                    retval.push_back((*j).second.species());
+                }
+            }
+        }
+        return retval;
     }
 
     virtual Real get_value(const Species& sp) const
@@ -218,6 +436,10 @@ public:
 
     bool update_particle_without_checking(const ParticleID& pid, const Particle& p)
     {
+        if (MembraneSpace* membrane = find_membrane(pid))
+        {
+            return (*membrane).update_particle(pid, p);
+        }
         return (*ps_).update_particle(pid, p);
     }
 
@@ -226,7 +448,7 @@ public:
         if (list_particles_within_radius(p.position(), p.radius(), pid).size()
             == 0)
         {
-            return (*ps_).update_particle(pid, p);
+            return update_particle_without_checking(pid, p);
         }
         else
         {
@@ -243,11 +465,20 @@ public:
     std::pair<ParticleID, Particle>
     get_particle(const ParticleID& pid) const
     {
+        if (const MembraneSpace* membrane = find_membrane(pid))
+        {
+            return (*membrane).get_particle(pid);
+        }
         return (*ps_).get_particle(pid);
     }
 
     void remove_particle(const ParticleID& pid)
     {
+        if (MembraneSpace* membrane = find_membrane(pid))
+        {
+            (*membrane).remove_particle(pid);
+            return;
+        }
         (*ps_).remove_particle(pid);
     }
 
@@ -255,14 +486,20 @@ public:
     list_particles_within_radius(
         const Real3& pos, const Real& radius) const
     {
-        return (*ps_).list_particles_within_radius(pos, radius);
+        std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+            retval((*ps_).list_particles_within_radius(pos, radius));
+        list_membrane_particles_within_radius(pos, radius, ParticleID(), ParticleID(), retval);
+        return retval;
     }
 
     std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
     list_particles_within_radius(
         const Real3& pos, const Real& radius, const ParticleID& ignore) const
     {
-        return (*ps_).list_particles_within_radius(pos, radius, ignore);
+        std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+            retval((*ps_).list_particles_within_radius(pos, radius, ignore));
+        list_membrane_particles_within_radius(pos, radius, ignore, ParticleID(), retval);
+        return retval;
     }
 
     std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
@@ -270,13 +507,55 @@ public:
         const Real3& pos, const Real& radius,
         const ParticleID& ignore1, const ParticleID& ignore2) const
     {
-        return (*ps_).list_particles_within_radius(pos, radius, ignore1, ignore2);
+        std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+            retval((*ps_).list_particles_within_radius(pos, radius, ignore1, ignore2));
+        list_membrane_particles_within_radius(pos, radius, ignore1, ignore2, retval);
+        return retval;
+    }
+
+    /**
+     * append particles on membranes overlapping with the sphere to retval,
+     * and sort them all by the distance if any. nothing is done without membranes.
+     */
+    void list_membrane_particles_within_radius(
+        const Real3& pos, const Real& radius,
+        const ParticleID& ignore1, const ParticleID& ignore2,
+        std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >& retval) const
+    {
+        if (membranes_.empty())
+        {
+            return;
+        }
+
+        const std::size_t offset(retval.size());
+        for (membrane_container_type::const_iterator i(membranes_.begin());
+            i != membranes_.end(); ++i)
+        {
+            (*(*i).second).list_particles_within_radius(pos, radius, ignore1, retval);
+        }
+        if (ignore2 != ParticleID())
+        {
+            retval.erase(std::remove_if(retval.begin() + offset, retval.end(),
+                [&ignore2](const std::pair<std::pair<ParticleID, Particle>, Real>& x)
+                {
+                    return x.first.first == ignore2;
+                }), retval.end());
+        }
+        if (retval.size() > offset)
+        {
+            std::sort(retval.begin(), retval.end(),
+                utils::pair_second_element_comparator<std::pair<ParticleID, Particle>, Real>());
+        }
     }
 
     bool _check_particles_within_radius(
         const Real3& pos, const Real& radius, const ParticleID& ignore) const
     {
-        return (*ps_)._check_particles_within_radius(pos, radius, ignore);
+        if (membranes_.empty())
+        {
+            return (*ps_)._check_particles_within_radius(pos, radius, ignore);
+        }
+        return (list_particles_within_radius(pos, radius, ignore).size() > 0);
     }
 
     inline Real3 periodic_transpose(
@@ -302,12 +581,24 @@ public:
 
     Integer num_molecules(const Species& sp) const
     {
-        return (*ps_).num_molecules(sp);
+        Integer retval((*ps_).num_molecules(sp));
+        for (membrane_container_type::const_iterator i(membranes_.begin());
+            i != membranes_.end(); ++i)
+        {
+            retval += (*(*i).second).num_molecules(sp);
+        }
+        return retval;
     }
 
     Integer num_molecules_exact(const Species& sp) const
     {
-        return (*ps_).num_molecules_exact(sp);
+        Integer retval((*ps_).num_molecules_exact(sp));
+        for (membrane_container_type::const_iterator i(membranes_.begin());
+            i != membranes_.end(); ++i)
+        {
+            retval += (*(*i).second).num_molecules_exact(sp);
+        }
+        return retval;
     }
 
     void add_molecules(const Species& sp, const Integer& num)
@@ -346,6 +637,16 @@ public:
         }
     }
 
+    const ParticleSpaceStatistics& space_statistics() const
+    {
+        return (*ps_).statistics();
+    }
+
+    void reset_space_statistics()
+    {
+        (*ps_).reset_statistics();
+    }
+
     const Real volume() const
     {
         const Real3& lengths(edge_lengths());
@@ -357,11 +658,55 @@ public:
         return rng_;
     }
 
+    /**
+     * the particle space, for simulators calling it without the world.
+     */
+    ParticleSpace& space()
+    {
+        return *ps_;
+    }
+
+    const ParticleSpace& space() const
+    {
+        return *ps_;
+    }
+
+    /**
+     * views below refer to the particles in the space without copies,
+     * and are valid until the next change of the world.
+     */
     const particle_container_type& particles() const
     {
         return (*ps_).particles();
     }
 
+    particle_species_view particles(const Species& sp) const
+    {
+        return particle_species_view((*ps_).particles(), (*ps_).particle_indices(sp));
+    }
+
+    strided_span<Real3> positions() const
+    {
+        const particle_container_type& pcont((*ps_).particles());
+        if (pcont.size() == 0)
+        {
+            return strided_span<Real3>();
+        }
+        return strided_span<Real3>(
+            &pcont[0].second.position(), pcont.size(), sizeof(particle_container_type::value_type));
+    }
+
+    strided_span<Real3> strides() const
+    {
+        const particle_container_type& pcont((*ps_).particles());
+        if (pcont.size() == 0)
+        {
+            return strided_span<Real3>();
+        }
+        return strided_span<Real3>(
+            &pcont[0].second.stride(), pcont.size(), sizeof(particle_container_type::value_type));
+    }
+
     void save(const std::string& filename) const
     {
 #ifdef WITH_HDF5
@@ -374,8 +719,12 @@ public:
         ps_->save_hdf5(group.get());
         extras::save_version_information(fout.get(), std::string("ecell4-bd-") + std::string(VERSION_INFO));
 #else
-        throw NotSupported(
-            "This method requires HDF5. The HDF5 support is turned off.");
+        std::ofstream fout(filename.c_str(), std::ios::binary | std::ios::trunc);
+        if (!fout)
+        {
+            throw_exception<IllegalState>("Failed to open [", filename, "].");
+        }
+        save_binary(fout);
 #endif
     }
 
@@ -407,11 +756,52 @@ public:
         pidgen_.load(*fin);
         rng_->load(*fin);
 #else
-        throw NotSupported(
-            "This method requires HDF5. The HDF5 support is turned off.");
+        std::ifstream fin(filename.c_str(), std::ios::binary);
+        if (!fin)
+        {
+            throw_exception<NotFound>("Failed to open [", filename, "].");
+        }
+        load_binary(fin);
 #endif
     }
 
+    /**
+     * save the world, including the state of the random number generator
+     * and the ID generator, in the dependency-free binary format.
+     */
+    void save_binary(std::ostream& out) const
+    {
+        binary_io::write_header(out, "ECELL4BDWORLD", 2);
+        rng_->save_binary(out);
+        pidgen_.save_binary(out);
+        ps_->save_binary(out);
+        binary_io::write(out, static_cast<uint64_t>(membranes_.size()));
+        for (membrane_container_type::const_iterator i(membranes_.begin());
+            i != membranes_.end(); ++i)
+        {
+            (*(*i).second).save_binary(out);
+        }
+    }
+
+    void load_binary(std::istream& in)
+    {
+        const uint32_t version(binary_io::read_header(in, "ECELL4BDWORLD", 2));
+        rng_->load_binary(in);
+        pidgen_.load_binary(in);
+        ps_->load_binary(in);
+
+        // version 1 has no membranes.
+        membranes_.clear();
+        const uint64_t num_membranes(version >= 2 ? binary_io::read<uint64_t>(in) : 0);
+        for (uint64_t i(0); i < num_membranes; ++i)
+        {
+            std::shared_ptr<MembraneSpace> membrane(
+                new MembraneSpace("", PlanarSurface(), edge_lengths(), 1, 1));
+            (*membrane).load_binary(in);
+            membranes_.insert(std::make_pair((*membrane).location(), membrane));
+        }
+    }
+
     void bind_to(std::shared_ptr<Model> model)
     {
         if (std::shared_ptr<Model> bound_model = lock_model())
@@ -424,6 +814,8 @@ public:
         }
 
         model_ = model;
+        cached_model_.reset();
+        ++cache_generation_;
     }
 
     std::shared_ptr<Model> lock_model() const
@@ -431,6 +823,137 @@ public:
         return model_.lock();
     }
 
+protected:
+
+    BDWorld(const BDWorld& other, const std::shared_ptr<RandomNumberGenerator>& rng)
+        : ps_((*other.ps_).clone()), rng_(rng), pidgen_(other.pidgen_), model_(other.model_),
+        species_indices_(other.species_indices_), molecule_info_cache_(other.molecule_info_cache_),
+        cached_model_(other.cached_model_), cached_revision_(other.cached_revision_),
+        cache_generation_(other.cache_generation_)
+    {
+        for (membrane_container_type::const_iterator i(other.membranes_.begin());
+            i != other.membranes_.end(); ++i)
+        {
+            membranes_.insert(std::make_pair(
+                (*i).first, std::shared_ptr<MembraneSpace>(new MembraneSpace(*(*i).second))));
+        }
+    }
+
+    /**
+     * @return the membrane which p is bound to, or NULL for the bulk
+     */
+    MembraneSpace* find_membrane(const Particle& p)
+    {
+        if (membranes_.empty())
+        {
+            return NULL;
+        }
+        const std::string location(p.location().empty() ? get_location(p.species()) : p.location());
+        membrane_container_type::iterator i(location.empty() ? membranes_.end() : membranes_.find(location));
+        return (i != membranes_.end() ? (*i).second.get() : NULL);
+    }
+
+    /**
+     * @return the membrane which the particle of pid is on, or NULL
+     */
+    MembraneSpace* find_membrane(const ParticleID& pid) const
+    {
+        for (membrane_container_type::const_iterator i(membranes_.begin());
+            i != membranes_.end(); ++i)
+        {
+            if ((*(*i).second).has_particle(pid))
+            {
+                return (*i).second.get();
+            }
+        }
+        return NULL;
+    }
+
+    /**
+     * a particle put on the membrane, with no stride.
+     */
+    static Particle project_onto(const MembraneSpace& membrane, const Particle& p)
+    {
+        Particle projected(p);
+        projected.position() = membrane.project(p.position());
+        projected.stride() = Real3(0, 0, 0);
+        projected.original_position() = projected.position();
+        projected.location() = membrane.location();
+        return projected;
+    }
+
+    /**
+     * attributes of a species given by a model, with flags for those given.
+     */
+    struct resolved_attributes_type
+    {
+        Real radius;
+        Real D;
+        Real constraint_radius;
+        std::string location;
+        bool has_radius;
+        bool has_D;
+        bool has_constraint_radius;
+        bool has_location;
+        Integer generation;  // cache_generation_ when resolved
+    };
+
+    typedef std::unordered_map<Species::serial_type, std::size_t> species_index_map_type;
+    typedef std::vector<resolved_attributes_type> molecule_info_cache_type;
+
+    static Real get_attribute_or(const Species& sp, const std::string& key, const Real& defval)
+    {
+        return (sp.has_attribute(key) ? sp.get_attribute_as<Real>(key) : defval);
+    }
+
+    /**
+     * the attributes given by the model for sp.
+     * the model is told by the identity of its owner, not by its address,
+     * so that a model allocated at the address of a freed one is never mistaken for it.
+     */
+    const resolved_attributes_type& resolve_species_attributes(
+        const std::shared_ptr<Model>& model, const Species& sp) const
+    {
+        if (cached_model_.owner_before(model) || model.owner_before(cached_model_)
+            || (*model).revision() != cached_revision_)
+        {
+            // entries of older generations are resolved again on demand.
+            cached_model_ = model;
+            cached_revision_ = (*model).revision();
+            ++cache_generation_;
+        }
+
+        // species are interned to dense indices, kept over changes of the model.
+        const Species::serial_type& serial(sp.serial());
+        species_index_map_type::const_iterator i(species_indices_.find(serial));
+        if (i == species_indices_.end())
+        {
+            i = species_indices_.insert(std::make_pair(serial, molecule_info_cache_.size())).first;
+            molecule_info_cache_.push_back(resolved_attributes_type());
+            molecule_info_cache_.back().generation = -1;
+        }
+
+        resolved_attributes_type& attrs(molecule_info_cache_[(*i).second]);
+        if (attrs.generation == cache_generation_)
+        {
+            return attrs;
+        }
+
+        // apply the model to the bare species, so that only what it gives is left.
+        const Species newsp((*model).apply_species_attributes(Species(serial)));
+        attrs.radius = get_attribute_or(newsp, "radius", 0.0);
+        attrs.D = get_attribute_or(newsp, "D", 0.0);
+        attrs.constraint_radius = get_attribute_or(newsp, "constraint_radius", 0.0);
+        attrs.location = (newsp.has_attribute("location")
+            ? newsp.get_attribute_as<std::string>("location") : "");
+        attrs.has_radius = newsp.has_attribute("radius");
+        attrs.has_D = newsp.has_attribute("D");
+        attrs.has_constraint_radius = newsp.has_attribute("constraint_radius");
+        attrs.has_location = newsp.has_attribute("location");
+        attrs.generation = cache_generation_;
+        return attrs;
+    }
+
 protected:
 
     std::unique_ptr<ParticleSpace> ps_;
@@ -438,6 +961,14 @@ protected:
     SerialIDGenerator<ParticleID> pidgen_;
 
     std::weak_ptr<Model> model_;
+
+    mutable species_index_map_type species_indices_;
+    mutable molecule_info_cache_type molecule_info_cache_;  // by the index of species
+    mutable std::weak_ptr<const Model> cached_model_;  // the model which the cache was resolved by
+    mutable Integer cached_revision_;
+    mutable Integer cache_generation_;
+
+    membrane_container_type membranes_;
 };
 
 } // bd
@@ -0,0 +1,117 @@
+#include "Checkpointer.hpp"
+#include "binary_io.hpp"
+
+#include <cstdio>
+#include <fstream>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+bool Checkpointer::exists() const
+{
+    std::ifstream fin(filename_.c_str(), std::ios::binary);
+    return fin.good();
+}
+
+template<typename Tsim_>
+bool Checkpointer::fire_simulator(const Tsim_& sim)
+{
+    const clock_type::time_point now(clock_type::now());
+    if (std::chrono::duration<Real>(now - last_).count() < interval_)
+    {
+        return false;
+    }
+
+    save(sim);
+    return true;
+}
+
+template<typename Tsim_>
+void Checkpointer::save_simulator(const Tsim_& sim)
+{
+    const std::string tmpname(filename_ + ".tmp");
+
+    {
+        std::ofstream fout(tmpname.c_str(), std::ios::binary | std::ios::trunc);
+        if (!fout)
+        {
+            throw_exception<IllegalState>("Failed to open [", tmpname, "].");
+        }
+
+        binary_io::write_header(fout, "ECELL4BDCHECKPOINT", version);
+        binary_io::write(fout, label_);
+        sim.save_binary(fout);
+        fout.flush();
+
+        if (!fout)
+        {
+            throw_exception<IllegalState>("Failed to write [", tmpname, "].");
+        }
+    }
+
+    if (std::rename(tmpname.c_str(), filename_.c_str()) != 0)
+    {
+        throw_exception<IllegalState>(
+            "Failed to rename [", tmpname, "] to [", filename_, "].");
+    }
+
+    last_ = clock_type::now();
+}
+
+template<typename Tsim_>
+void Checkpointer::load_simulator(Tsim_& sim) const
+{
+    std::ifstream fin(filename_.c_str(), std::ios::binary);
+    if (!fin)
+    {
+        throw_exception<NotFound>("Failed to open [", filename_, "].");
+    }
+
+    binary_io::read_header(fin, "ECELL4BDCHECKPOINT", version);
+    const std::string label(binary_io::read<std::string>(fin));
+    if (label != label_)
+    {
+        throw_exception<IllegalArgument>(
+            "The checkpoint [", filename_, "] was written with a different label [",
+            label, "].");
+    }
+    sim.load_binary(fin);
+}
+
+bool Checkpointer::fire(const BDSimulator& sim)
+{
+    return fire_simulator(sim);
+}
+
+bool Checkpointer::fire(const ECMCSimulator& sim)
+{
+    return fire_simulator(sim);
+}
+
+void Checkpointer::save(const BDSimulator& sim)
+{
+    save_simulator(sim);
+}
+
+void Checkpointer::save(const ECMCSimulator& sim)
+{
+    save_simulator(sim);
+}
+
+void Checkpointer::load(BDSimulator& sim) const
+{
+    load_simulator(sim);
+}
+
+void Checkpointer::load(ECMCSimulator& sim) const
+{
+    load_simulator(sim);
+}
+
+} // bd
+
+} // ecell4
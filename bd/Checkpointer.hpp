@@ -0,0 +1,109 @@
+#ifndef ECELL4_BD_CHECKPOINTER_HPP
+#define ECELL4_BD_CHECKPOINTER_HPP
+
+#include <string>
+#include <chrono>
+
+#include "types.hpp"
+#include "BDSimulator.hpp"
+#include "ECMCSimulator.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * write checkpoints of BDSimulator, or ECMCSimulator, at a wall-clock interval.
+ * a checkpoint is first written into a temporary file,
+ * and then renamed to the given filename,
+ * so that the previous checkpoint survives a preemption during the write.
+ */
+class Checkpointer
+{
+public:
+
+    typedef std::chrono::steady_clock clock_type;
+
+    static const uint32_t version = 1;
+
+public:
+
+    /**
+     * @param filename a path to the checkpoint file
+     * @param interval a wall-clock interval in seconds
+     * @param label an arbitrary string stored in, and checked against, the file.
+     *  use it to avoid resuming from a checkpoint of different parameters.
+     */
+    Checkpointer(
+        const std::string& filename, const Real interval,
+        const std::string& label = "")
+        : filename_(filename), interval_(interval), label_(label),
+        last_(clock_type::now())
+    {
+        ;
+    }
+
+    const std::string& filename() const
+    {
+        return filename_;
+    }
+
+    Real interval() const
+    {
+        return interval_;
+    }
+
+    const std::string& label() const
+    {
+        return label_;
+    }
+
+    /**
+     * @return if the checkpoint file exists or not
+     */
+    bool exists() const;
+
+    /**
+     * write a checkpoint if the interval has passed since the last one.
+     * @return if a checkpoint was written or not
+     */
+    bool fire(const BDSimulator& sim);
+    bool fire(const ECMCSimulator& sim);
+
+    /**
+     * write a checkpoint atomically.
+     */
+    void save(const BDSimulator& sim);
+    void save(const ECMCSimulator& sim);
+
+    /**
+     * restore the world and the simulator from the checkpoint.
+     */
+    void load(BDSimulator& sim) const;
+    void load(ECMCSimulator& sim) const;
+
+protected:
+
+    template<typename Tsim_>
+    bool fire_simulator(const Tsim_& sim);
+    template<typename Tsim_>
+    void save_simulator(const Tsim_& sim);
+    template<typename Tsim_>
+    void load_simulator(Tsim_& sim) const;
+
+protected:
+
+    std::string filename_;
+    Real interval_;
+    std::string label_;
+    clock_type::time_point last_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_CHECKPOINTER_HPP */
@@ -0,0 +1,307 @@
+#include "CompartmentPolicy.hpp"
+#include "collision.hpp"
+#include "exceptions.hpp"
+
+#include <algorithm>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+const CompartmentPolicy::compartment_type CompartmentPolicy::boundary;
+
+// the minimum image of a displacement in the periodic world.
+static inline Real3 minimum_image(const Real3& d, const Real3& edge_lengths)
+{
+    Real3 retval(d);
+    for (unsigned int i(0); i < 3; ++i)
+    {
+        retval[i] -= edge_lengths[i] * std::floor(retval[i] / edge_lengths[i] + 0.5);
+    }
+    return retval;
+}
+
+Real CompartmentRegion::cylinder_distance(const Real3& d) const
+{
+    const Real z(dot_product(d, axis));
+    const Real r(length(d - axis * z));
+    const Real dr(r - radius);
+    const Real dz(std::fabs(z) - half_height);
+    const Real outside(std::sqrt(pow_2(std::max(dr, 0.0)) + pow_2(std::max(dz, 0.0))));
+    return std::min(std::max(dr, dz), 0.0) + outside;
+}
+
+// append roots in (0, 1) of a t^2 + b t + c.
+static inline void quadratic_roots(const Real a, const Real b, const Real c, std::vector<Real>& retval)
+{
+    const Real disc(b * b - 4 * a * c);
+    if (a <= 0 || disc < 0)
+    {
+        return;
+    }
+    const Real sq(std::sqrt(disc));
+    const Real t1((-b - sq) / (2 * a)), t2((-b + sq) / (2 * a));
+    if (t1 > 0 && t1 < 1)
+    {
+        retval.push_back(t1);
+    }
+    if (t2 > 0 && t2 < 1)
+    {
+        retval.push_back(t2);
+    }
+}
+
+void CompartmentRegion::crossings(const Real3& d, const Real3& disp, std::vector<Real>& retval) const
+{
+    switch (shape)
+    {
+    case SPHERE:
+    case SHELL:
+        {
+            const Real a(length_sq(disp)), b(2 * dot_product(d, disp)), Lsq(length_sq(d));
+            quadratic_roots(a, b, Lsq - radius * radius, retval);
+            if (shape == SHELL)
+            {
+                quadratic_roots(a, b, Lsq - inner_radius * inner_radius, retval);
+            }
+        }
+        break;
+    default:
+        {
+            // the side within the height, and the caps within the radius.
+            const Real z0(dot_product(d, axis)), vz(dot_product(disp, axis));
+            const Real3 q0(d - axis * z0), qv(disp - axis * vz);
+            std::vector<Real>::size_type first(retval.size());
+            quadratic_roots(length_sq(qv), 2 * dot_product(q0, qv), length_sq(q0) - radius * radius, retval);
+            for (std::vector<Real>::size_type i(first); i < retval.size(); )
+            {
+                if (std::fabs(z0 + retval[i] * vz) > half_height)
+                {
+                    retval.erase(retval.begin() + i);
+                }
+                else
+                {
+                    ++i;
+                }
+            }
+
+            if (vz == 0)
+            {
+                break;
+            }
+            for (int sign(-1); sign <= 1; sign += 2)
+            {
+                const Real t((sign * half_height - z0) / vz);
+                if (t > 0 && t < 1 && length_sq(q0 + qv * t) <= radius * radius)
+                {
+                    retval.push_back(t);
+                }
+            }
+        }
+        break;
+    }
+}
+
+bool CompartmentRegion::contains(const Real3& pos, const Real3& edge_lengths) const
+{
+    const Real3 d(minimum_image(pos - center, edge_lengths));
+    switch (shape)
+    {
+    case SPHERE:
+        return length_sq(d) < radius * radius;
+    case SHELL:
+        {
+            const Real Lsq(length_sq(d));
+            return (Lsq >= inner_radius * inner_radius && Lsq < radius * radius);
+        }
+    default:
+        return cylinder_distance(d) < 0;
+    }
+}
+
+int CompartmentRegion::classify_cell(const Real3& c, const Real3& h, const Real3& edge_lengths) const
+{
+    const Real3 d(minimum_image(c - center, edge_lengths));
+    switch (shape)
+    {
+    case SPHERE:
+    case SHELL:
+        {
+            const AABB b(d - h, d + h);
+            if (collision::test_shell_AABB(SphericalSurface(Real3(), radius), b)
+                || (shape == SHELL && collision::test_shell_AABB(SphericalSurface(Real3(), inner_radius), b)))
+            {
+                return 0;
+            }
+        }
+        break;
+    default:
+        // the distance changes no faster than the point moves.
+        if (std::fabs(cylinder_distance(d)) <= length(h))
+        {
+            return 0;
+        }
+        break;
+    }
+    return (contains(c, edge_lengths) ? -1 : 1);
+}
+
+CompartmentPolicy::compartment_type CompartmentPolicy::add_sphere(const Sphere& sphere)
+{
+    CompartmentRegion region;
+    region.shape = CompartmentRegion::SPHERE;
+    region.center = sphere.center();
+    region.radius = sphere.radius();
+    region.inner_radius = 0.0;
+    region.axis = Real3();
+    region.half_height = 0.0;
+    regions_.push_back(region);
+    invalidate();
+    if (regions_.size() >= boundary)
+    {
+        regions_.pop_back();
+        throw_exception<IllegalArgument>("Too many compartments [", static_cast<int>(boundary), "].");
+    }
+    return static_cast<compartment_type>(regions_.size());
+}
+
+CompartmentPolicy::compartment_type CompartmentPolicy::add_shell(
+    const Real3& center, const Real inner_radius, const Real outer_radius)
+{
+    if (inner_radius < 0 || outer_radius <= inner_radius)
+    {
+        throw_exception<IllegalArgument>(
+            "The inner radius [", inner_radius, "] must be non-negative and smaller than the outer [",
+            outer_radius, "].");
+    }
+    const compartment_type retval(add_sphere(Sphere(center, outer_radius)));
+    regions_.back().shape = CompartmentRegion::SHELL;
+    regions_.back().inner_radius = inner_radius;
+    return retval;
+}
+
+CompartmentPolicy::compartment_type CompartmentPolicy::add_cylinder(
+    const Real3& center, const Real radius, const Real3& axis, const Real half_height)
+{
+    const Real L(length(axis));
+    if (L <= 0)
+    {
+        throw_exception<IllegalArgument>("The axis of a cylinder must not be zero.");
+    }
+    const compartment_type retval(add_sphere(Sphere(center, radius)));
+    regions_.back().shape = CompartmentRegion::CYLINDER;
+    regions_.back().axis = axis / L;
+    regions_.back().half_height = half_height;
+    return retval;
+}
+
+void CompartmentPolicy::set_resolution(const Integer resolution)
+{
+    if (resolution <= 0)
+    {
+        throw_exception<IllegalArgument>("The resolution [", resolution, "] must be positive.");
+    }
+    resolution_ = resolution;
+    invalidate();
+}
+
+CompartmentPolicy::compartment_type CompartmentPolicy::compartment(
+    const Real3& pos, const Real3& edge_lengths) const
+{
+    for (std::size_t i(0); i < regions_.size(); ++i)
+    {
+        if (regions_[i].contains(pos, edge_lengths))
+        {
+            return static_cast<compartment_type>(i + 1);
+        }
+    }
+    return 0;
+}
+
+bool CompartmentPolicy::stays_in_compartment(
+    const Real3& pos, const Real3& disp, const Real3& edge_lengths) const
+{
+    crossings_.clear();
+    for (std::vector<CompartmentRegion>::const_iterator i(regions_.begin()); i != regions_.end(); ++i)
+    {
+        (*i).crossings(minimum_image(pos - (*i).center, edge_lengths), disp, crossings_);
+    }
+    std::sort(crossings_.begin(), crossings_.end());
+    crossings_.push_back(1.0);
+
+    // the compartment is constant between crossings, thus tested once in each span.
+    const compartment_type c(compartment(pos, edge_lengths));
+    Real t0(0.0);
+    for (std::vector<Real>::const_iterator i(crossings_.begin()); i != crossings_.end(); ++i)
+    {
+        if (compartment(pos + disp * (0.5 * (t0 + (*i))), edge_lengths) != c)
+        {
+            return false;
+        }
+        t0 = (*i);
+    }
+    return (compartment(pos + disp, edge_lengths) == c);
+}
+
+Real CompartmentPolicy::boundary_fraction(const Real3& edge_lengths) const
+{
+    if (edge_lengths != edge_lengths_)
+    {
+        build(edge_lengths);
+    }
+    return static_cast<Real>(std::count(cells_.begin(), cells_.end(), boundary)) / cells_.size();
+}
+
+void CompartmentPolicy::build(const Real3& edge_lengths) const
+{
+    const Real width(
+        *std::max_element(edge_lengths.begin(), edge_lengths.end()) / resolution_);
+    Real3 widths;
+    for (unsigned int i(0); i < 3; ++i)
+    {
+        num_cells_[i] = std::max(static_cast<Integer>(std::ceil(edge_lengths[i] / width)), Integer(1));
+        widths[i] = edge_lengths[i] / num_cells_[i];
+        inverse_widths_[i] = 1.0 / widths[i];
+    }
+    const Real3 h(widths * 0.5);
+    min_width_sq_ = pow_2(std::min(std::min(widths[0], widths[1]), widths[2]));
+
+    cells_.resize(num_cells_[0] * num_cells_[1] * num_cells_[2]);
+    std::size_t idx(0);
+    for (Integer i(0); i < num_cells_[0]; ++i)
+    {
+        for (Integer j(0); j < num_cells_[1]; ++j)
+        {
+            for (Integer k(0); k < num_cells_[2]; ++k, ++idx)
+            {
+                const Real3 c((i + 0.5) * widths[0], (j + 0.5) * widths[1], (k + 0.5) * widths[2]);
+
+                // the first region not all outside decides the cell.
+                compartment_type value(0);
+                for (std::size_t r(0); r < regions_.size(); ++r)
+                {
+                    const int side(regions_[r].classify_cell(c, h, edge_lengths));
+                    if (side < 0)
+                    {
+                        value = static_cast<compartment_type>(r + 1);
+                        break;
+                    }
+                    else if (side == 0)
+                    {
+                        value = boundary;
+                        break;
+                    }
+                }
+                cells_[idx] = value;
+            }
+        }
+    }
+    edge_lengths_ = edge_lengths;
+}
+
+} // bd
+
+} // ecell4
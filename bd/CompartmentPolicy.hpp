@@ -0,0 +1,238 @@
+#ifndef ECELL4_BD_COMPARTMENT_POLICY_HPP
+#define ECELL4_BD_COMPARTMENT_POLICY_HPP
+
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <stdint.h>
+
+#include "types.hpp"
+#include "Real3.hpp"
+#include "Integer3.hpp"
+#include "Particle.hpp"
+#include "Sphere.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a region bounded by a curved surface: a sphere, a spherical shell or a finite cylinder.
+ * a point is tested by the minimum image of its displacement from the center,
+ * so that a region must be smaller than a half of the world along each axis.
+ */
+struct CompartmentRegion
+{
+    enum shape_type
+    {
+        SPHERE = 0,
+        SHELL = 1,
+        CYLINDER = 2
+    };
+
+    shape_type shape;
+    Real3 center;
+    Real radius;  // the outer radius of a shell
+    Real inner_radius;  // only for a shell
+    Real3 axis;  // a unit vector, only for a cylinder
+    Real half_height;  // only for a cylinder
+
+    /**
+     * @return if the point is inside the region
+     */
+    bool contains(const Real3& pos, const Real3& edge_lengths) const;
+
+    /**
+     * @return -1 if the cell of the half widths h at c is all inside,
+     *  1 if all outside and 0 if it touches the surface.
+     */
+    int classify_cell(const Real3& c, const Real3& h, const Real3& edge_lengths) const;
+
+    /**
+     * @return the signed distance from the surface of a cylinder, negative inside
+     */
+    Real cylinder_distance(const Real3& d) const;
+
+    /**
+     * append the parameters in (0, 1) where the segment from d to d + disp crosses
+     * the surface, with d given from the center.
+     */
+    void crossings(const Real3& d, const Real3& disp, std::vector<Real>& retval) const;
+};
+
+/**
+ * boundary conditions of compartments bounded by curved surfaces.
+ * the compartment of a point is the first region containing it, counted from 1,
+ * and 0 if none. a crowder stays in its compartment, and so does a tracer if
+ * tracers are confined too. a tracer is free otherwise.
+ * compartments of cells of a grid over the world are precomputed, so that a move
+ * is tested by two table lookups. if one end is in a cell touching a surface,
+ * or the move is longer than a cell, the whole path is tested against surfaces
+ * instead, so that a move never jumps over a region thinner than it.
+ * the grid is built lazily for the edge lengths given at the first test.
+ */
+class CompartmentPolicy
+{
+public:
+
+    enum rejection_type
+    {
+        ACCEPTED = 0,
+        REJECTED_LAYER = 1,
+        REJECTED_WALL = 2
+    };
+
+    typedef uint8_t compartment_type;
+
+    /**
+     * the mark of a cell touching a surface in the table
+     */
+    static const compartment_type boundary = 255;
+
+public:
+
+    CompartmentPolicy(const Integer resolution = 64)
+        : confine_tracers_(false), resolution_(resolution), edge_lengths_(), num_cells_(),
+        min_width_sq_(0.0)
+    {
+        ;
+    }
+
+    /**
+     * add a region as the next compartment.
+     * @return the compartment of the region
+     */
+    compartment_type add_sphere(const Sphere& sphere);
+    compartment_type add_shell(const Real3& center, const Real inner_radius, const Real outer_radius);
+    compartment_type add_cylinder(
+        const Real3& center, const Real radius, const Real3& axis, const Real half_height);
+
+    void clear()
+    {
+        regions_.clear();
+        invalidate();
+    }
+
+    const std::vector<CompartmentRegion>& regions() const
+    {
+        return regions_;
+    }
+
+    /**
+     * confine tracers to their compartments too, or let them go anywhere.
+     */
+    void set_confine_tracers(const bool confine)
+    {
+        confine_tracers_ = confine;
+    }
+
+    bool confine_tracers() const
+    {
+        return confine_tracers_;
+    }
+
+    /**
+     * set the number of cells of the grid along the longest edge.
+     */
+    void set_resolution(const Integer resolution);
+
+    Integer resolution() const
+    {
+        return resolution_;
+    }
+
+    /**
+     * @return the compartment of a point in the world, tested exactly
+     */
+    compartment_type compartment(const Real3& pos, const Real3& edge_lengths) const;
+
+    /**
+     * @return if the straight path from pos to pos + disp stays in the compartment of pos,
+     *  tested exactly against surfaces of regions
+     */
+    bool stays_in_compartment(const Real3& pos, const Real3& disp, const Real3& edge_lengths) const;
+
+    /**
+     * @return the fraction of cells touching a surface, building the grid if needed
+     */
+    Real boundary_fraction(const Real3& edge_lengths) const;
+
+    /**
+     * @param particle the particle before the move
+     * @param newpos_ the new position before applying the periodic boundary
+     * @param newpos the new position in the world
+     * @param edge_lengths the edge lengths of the world
+     */
+    inline rejection_type test(
+        const Particle& particle, const Real3& newpos_, const Real3& newpos,
+        const Real3& edge_lengths) const
+    {
+        if (regions_.empty()
+            || (!confine_tracers_ && particle.constraint_radius() == std::numeric_limits<Real>::infinity()))
+        {
+            return ACCEPTED;
+        }
+
+        if (edge_lengths != edge_lengths_)
+        {
+            build(edge_lengths);
+        }
+
+        const compartment_type c1(cells_[cell_index(particle.position())]);
+        const compartment_type c2(cells_[cell_index(newpos)]);
+        const Real3 disp(newpos_ - particle.position());
+        if (c1 != boundary && c2 != boundary && length_sq(disp) <= min_width_sq_)
+        {
+            return (c1 == c2 ? ACCEPTED : REJECTED_LAYER);
+        }
+        return (stays_in_compartment(particle.position(), disp, edge_lengths)
+            ? ACCEPTED : REJECTED_LAYER);
+    }
+
+protected:
+
+    void invalidate()
+    {
+        edge_lengths_ = Real3();
+    }
+
+    /**
+     * build the table of compartments of cells for the edge lengths.
+     */
+    void build(const Real3& edge_lengths) const;
+
+    inline std::size_t cell_index(const Real3& pos) const
+    {
+        std::size_t retval(0);
+        for (unsigned int i(0); i < 3; ++i)
+        {
+            Integer j(static_cast<Integer>(pos[i] * inverse_widths_[i]));
+            j = (j < 0 ? 0 : (j >= num_cells_[i] ? num_cells_[i] - 1 : j));
+            retval = retval * num_cells_[i] + j;
+        }
+        return retval;
+    }
+
+protected:
+
+    std::vector<CompartmentRegion> regions_;
+    bool confine_tracers_;
+    Integer resolution_;
+
+    // the grid, built for edge_lengths_ in a const test.
+    mutable Real3 edge_lengths_;
+    mutable Integer3 num_cells_;
+    mutable Real3 inverse_widths_;
+    mutable Real min_width_sq_;  // a move within it between two inner cells is not tested further
+    mutable std::vector<compartment_type> cells_;
+    mutable std::vector<Real> crossings_;  // a buffer of stays_in_compartment
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_COMPARTMENT_POLICY_HPP */
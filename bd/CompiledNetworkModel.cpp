@@ -0,0 +1,235 @@
+#include <algorithm>
+
+#include "CompiledNetworkModel.hpp"
+
+
+namespace ecell4
+{
+
+const std::size_t CompiledNetworkModel::npos(std::numeric_limits<std::size_t>::max());
+
+namespace
+{
+
+/**
+ * the key of a rule to group rules: first-order ones by the reactant,
+ * second-order ones by the ordered pair of reactants, and the others at the end.
+ */
+struct group_key_type
+{
+    int order;
+    std::size_t sp1, sp2;
+
+    bool operator<(const group_key_type& rhs) const
+    {
+        if (order != rhs.order)
+        {
+            return order < rhs.order;
+        }
+        else if (sp1 != rhs.sp1)
+        {
+            return sp1 < rhs.sp1;
+        }
+        return sp2 < rhs.sp2;
+    }
+};
+
+} // anonymous
+
+CompiledNetworkModel::CompiledNetworkModel(const Model& model)
+    : revision_(model.revision()), others_(0)
+{
+    const Model::species_container_type& attrs(model.species_attributes());
+    for (Model::species_container_type::const_iterator i(attrs.begin()); i != attrs.end(); ++i)
+    {
+        if ((*i).serial() != "_")
+        {
+            intern(*i);
+        }
+    }
+
+    const Model::reaction_rule_container_type& rules(model.reaction_rules());
+    std::vector<std::vector<species_id_type> > reactants(rules.size()), products(rules.size());
+    std::vector<std::pair<group_key_type, rule_id_type> > keys;
+    keys.reserve(rules.size());
+    for (rule_id_type id(0); id < rules.size(); ++id)
+    {
+        const ReactionRule& rr(rules[id]);
+        for (ReactionRule::reactant_container_type::const_iterator i(rr.reactants().begin());
+            i != rr.reactants().end(); ++i)
+        {
+            reactants[id].push_back(intern(*i));
+        }
+        for (ReactionRule::product_container_type::const_iterator i(rr.products().begin());
+            i != rr.products().end(); ++i)
+        {
+            products[id].push_back(intern(*i));
+        }
+
+        group_key_type key = {2, 0, 0};
+        if (reactants[id].size() == 1)
+        {
+            key.order = 0;
+            key.sp1 = reactants[id][0];
+        }
+        else if (reactants[id].size() == 2)
+        {
+            key.order = 1;
+            key.sp1 = std::min(reactants[id][0], reactants[id][1]);
+            key.sp2 = std::max(reactants[id][0], reactants[id][1]);
+        }
+        keys.push_back(std::make_pair(key, id));
+    }
+
+    // the sort is stable to keep the order in the model in each group.
+    std::stable_sort(keys.begin(), keys.end(),
+        [](const std::pair<group_key_type, rule_id_type>& lhs,
+           const std::pair<group_key_type, rule_id_type>& rhs)
+        {
+            return lhs.first < rhs.first;
+        });
+
+    rules_.reserve(rules.size());
+    rule_ids_.reserve(rules.size());
+    positions_.resize(rules.size());
+    reactants_.reserve(rules.size());
+    products_.reserve(rules.size());
+    for (std::size_t i(0); i < keys.size(); ++i)
+    {
+        const rule_id_type id(keys[i].second);
+        rules_.push_back(rules[id]);
+        rule_ids_.push_back(id);
+        positions_[id] = i;
+        reactants_.push_back(reactants[id]);
+        products_.push_back(products[id]);
+    }
+
+    const std::size_t n(species_.size());
+    first_order_offsets_.assign(n + 1, 0);
+    partner_offsets_.assign(n + 1, 0);
+    others_ = keys.size();
+
+    std::vector<partner_type> pairs;
+    for (std::size_t i(0); i < keys.size(); ++i)
+    {
+        const group_key_type& key(keys[i].first);
+        if (key.order == 0)
+        {
+            ++first_order_offsets_[key.sp1 + 1];
+        }
+        else if (key.order == 1)
+        {
+            if (pairs.empty() || pairs.back().partner != key.sp2
+                || keys[pairs.back().first].first.sp1 != key.sp1)
+            {
+                const partner_type pair = {key.sp2, i, i + 1};
+                pairs.push_back(pair);
+                ++partner_offsets_[key.sp1 + 1];
+                if (key.sp1 != key.sp2)
+                {
+                    ++partner_offsets_[key.sp2 + 1];
+                }
+            }
+            else
+            {
+                pairs.back().last = i + 1;
+            }
+        }
+        else if (others_ == keys.size())
+        {
+            others_ = i;
+        }
+    }
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        first_order_offsets_[i + 1] += first_order_offsets_[i];
+        partner_offsets_[i + 1] += partner_offsets_[i];
+    }
+
+    // pairs are in the order of (sp1, sp2) with sp1 <= sp2. filling partners of sp1
+    // with sp2 and of sp2 with sp1 in this order keeps partners of each sorted.
+    partners_.resize(partner_offsets_[n]);
+    std::vector<std::size_t> filled(partner_offsets_.begin(), partner_offsets_.end() - 1);
+    for (std::vector<partner_type>::const_iterator i(pairs.begin()); i != pairs.end(); ++i)
+    {
+        const species_id_type sp1(keys[(*i).first].first.sp1), sp2((*i).partner);
+        partners_[filled[sp1]++] = *i;
+        if (sp1 != sp2)
+        {
+            const partner_type partner = {sp1, (*i).first, (*i).last};
+            partners_[filled[sp2]++] = partner;
+        }
+    }
+}
+
+CompiledNetworkModel::species_id_type CompiledNetworkModel::intern(const Species& sp)
+{
+    const index_map_type::const_iterator i(indices_.find(sp.serial()));
+    if (i != indices_.end())
+    {
+        return (*i).second;
+    }
+
+    species_.push_back(sp);
+    indices_.insert(std::make_pair(sp.serial(), species_.size() - 1));
+    return species_.size() - 1;
+}
+
+std::pair<std::size_t, std::size_t> CompiledNetworkModel::second_order_range(
+    const species_id_type sp1, const species_id_type sp2) const
+{
+    const std::vector<partner_type>::const_iterator
+        first(partners_.begin() + partner_offsets_[sp1]),
+        last(partners_.begin() + partner_offsets_[sp1 + 1]);
+    const std::vector<partner_type>::const_iterator
+        i(std::lower_bound(first, last, sp2,
+            [](const partner_type& lhs, const species_id_type rhs)
+            {
+                return lhs.partner < rhs;
+            }));
+    if (i == last || (*i).partner != sp2)
+    {
+        return std::make_pair(0, 0);
+    }
+    return std::make_pair((*i).first, (*i).last);
+}
+
+CompiledNetworkModel::rule_id_type CompiledNetworkModel::find_reaction_rule(
+    const ReactionRule& rr) const
+{
+    std::size_t first(others_), last(rules_.size());
+    const ReactionRule::reactant_container_type& reactants(rr.reactants());
+    if (reactants.size() == 1 || reactants.size() == 2)
+    {
+        const species_id_type sp1(species_id(reactants[0]));
+        const species_id_type sp2(reactants.size() == 2 ? species_id(reactants[1]) : 0);
+        if (sp1 == npos || sp2 == npos)
+        {
+            return npos;
+        }
+
+        if (reactants.size() == 1)
+        {
+            first = first_order_offsets_[sp1];
+            last = first_order_offsets_[sp1 + 1];
+        }
+        else
+        {
+            const std::pair<std::size_t, std::size_t> range(second_order_range(sp1, sp2));
+            first = range.first;
+            last = range.second;
+        }
+    }
+
+    for (std::size_t i(first); i < last; ++i)
+    {
+        if (rules_[i] == rr)
+        {
+            return rule_ids_[i];
+        }
+    }
+    return npos;
+}
+
+} // ecell4
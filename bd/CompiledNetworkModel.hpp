@@ -0,0 +1,209 @@
+#ifndef ECELL4_COMPILED_NETWORK_MODEL_HPP
+#define ECELL4_COMPILED_NETWORK_MODEL_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <limits>
+
+#include "types.hpp"
+#include "Species.hpp"
+#include "ReactionRule.hpp"
+#include "Model.hpp"
+#include "ParticleView.hpp"
+
+
+namespace ecell4
+{
+
+/**
+ * an immutable view of a model compiled into flat index tables.
+ * species are interned to consecutive ids, in the order of species attributes
+ * (but "_"), and then of reactants and products of rules.
+ * rules are copied once, grouped by reactants, and keep the order in the model
+ * in each group. the id of a rule is its index in Model::reaction_rules().
+ * queries return spans over the rules of the view without copying them.
+ * a view is a snapshot of the model at the revision, and is never updated.
+ */
+class CompiledNetworkModel
+{
+public:
+
+    typedef std::size_t species_id_type;
+    typedef std::size_t rule_id_type;
+
+    typedef strided_span<ReactionRule> reaction_rule_span;
+    typedef strided_span<rule_id_type> rule_id_span;
+
+    static const std::size_t npos;
+
+public:
+
+    explicit CompiledNetworkModel(const Model& model);
+
+    /**
+     * @return the revision of the model compiled
+     */
+    Integer revision() const
+    {
+        return revision_;
+    }
+
+    std::size_t num_species() const
+    {
+        return species_.size();
+    }
+
+    std::size_t num_reaction_rules() const
+    {
+        return rules_.size();
+    }
+
+    /**
+     * @return the id of the species, or npos if it appears in no rule nor attribute
+     */
+    species_id_type species_id(const Species& sp) const
+    {
+        const index_map_type::const_iterator i(indices_.find(sp.serial()));
+        return (i != indices_.end() ? (*i).second : npos);
+    }
+
+    /**
+     * @return the species as first interned, without attributes of the model applied
+     */
+    const Species& species(const species_id_type id) const
+    {
+        return species_[id];
+    }
+
+    /**
+     * @return the rule of the id
+     */
+    const ReactionRule& reaction_rule(const rule_id_type id) const
+    {
+        return rules_[positions_[id]];
+    }
+
+    /**
+     * @return reactants of the rule as species ids
+     */
+    const std::vector<species_id_type>& reactant_ids(const rule_id_type id) const
+    {
+        return reactants_[positions_[id]];
+    }
+
+    /**
+     * @return products of the rule as species ids
+     */
+    const std::vector<species_id_type>& product_ids(const rule_id_type id) const
+    {
+        return products_[positions_[id]];
+    }
+
+    reaction_rule_span query_reaction_rules(const species_id_type sp) const
+    {
+        return rule_span(first_order_offsets_[sp], first_order_offsets_[sp + 1]);
+    }
+
+    reaction_rule_span query_reaction_rules(
+        const species_id_type sp1, const species_id_type sp2) const
+    {
+        const std::pair<std::size_t, std::size_t> range(second_order_range(sp1, sp2));
+        return rule_span(range.first, range.second);
+    }
+
+    reaction_rule_span query_reaction_rules(const Species& sp) const
+    {
+        const species_id_type id(species_id(sp));
+        return (id != npos ? query_reaction_rules(id) : reaction_rule_span());
+    }
+
+    reaction_rule_span query_reaction_rules(const Species& sp1, const Species& sp2) const
+    {
+        const species_id_type id1(species_id(sp1)), id2(species_id(sp2));
+        return (id1 != npos && id2 != npos ?
+            query_reaction_rules(id1, id2) : reaction_rule_span());
+    }
+
+    /**
+     * @return ids of rules in the same order as query_reaction_rules
+     */
+    rule_id_span query_reaction_rule_ids(const species_id_type sp) const
+    {
+        return id_span(first_order_offsets_[sp], first_order_offsets_[sp + 1]);
+    }
+
+    rule_id_span query_reaction_rule_ids(
+        const species_id_type sp1, const species_id_type sp2) const
+    {
+        const std::pair<std::size_t, std::size_t> range(second_order_range(sp1, sp2));
+        return id_span(range.first, range.second);
+    }
+
+    /**
+     * @return the id of the rule, or npos if it is not in the model
+     */
+    rule_id_type find_reaction_rule(const ReactionRule& rr) const;
+
+    bool has_reaction_rule(const ReactionRule& rr) const
+    {
+        return find_reaction_rule(rr) != npos;
+    }
+
+protected:
+
+    species_id_type intern(const Species& sp);
+
+    std::pair<std::size_t, std::size_t> second_order_range(
+        const species_id_type sp1, const species_id_type sp2) const;
+
+    reaction_rule_span rule_span(const std::size_t first, const std::size_t last) const
+    {
+        return (first != last ?
+            reaction_rule_span(&rules_[first], last - first, sizeof(ReactionRule)) :
+            reaction_rule_span());
+    }
+
+    rule_id_span id_span(const std::size_t first, const std::size_t last) const
+    {
+        return (first != last ?
+            rule_id_span(&rule_ids_[first], last - first, sizeof(rule_id_type)) :
+            rule_id_span());
+    }
+
+protected:
+
+    typedef std::unordered_map<Species::serial_type, species_id_type> index_map_type;
+
+    /**
+     * rules of a pair of species, as a range in rules_.
+     */
+    struct partner_type
+    {
+        species_id_type partner;
+        std::size_t first, last;
+    };
+
+    Integer revision_;
+
+    std::vector<Species> species_;
+    index_map_type indices_;
+
+    // rules in the order of groups: first-order ones by the reactant, second-order ones
+    // by the pair of reactants, and the others at the end.
+    std::vector<ReactionRule> rules_;
+    std::vector<rule_id_type> rule_ids_;  // the id of each in rules_
+    std::vector<std::size_t> positions_;  // the position in rules_ of each id
+    std::vector<std::vector<species_id_type> > reactants_, products_;
+
+    // rules of species i are in [first_order_offsets_[i], first_order_offsets_[i + 1]).
+    // partners of species i are in [partner_offsets_[i], partner_offsets_[i + 1])
+    // in the order of their ids, and a pair is found under both of the two.
+    std::vector<std::size_t> first_order_offsets_;
+    std::vector<std::size_t> partner_offsets_;
+    std::vector<partner_type> partners_;
+    std::size_t others_;  // the first of the others in rules_
+};
+
+} // ecell4
+
+#endif /* ECELL4_COMPILED_NETWORK_MODEL_HPP */
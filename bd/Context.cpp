@@ -1,6 +1,10 @@
-#include "Context.hpp"
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <functional>
+
+#include "exceptions.hpp"
+#include "Context.hpp"
 
 
 namespace ecell4
@@ -9,6 +13,10 @@ namespace ecell4
 namespace context
 {
 
+namespace
+{
+
+
 std::string itos(unsigned int val)
 {
     std::stringstream ss;
@@ -16,9 +24,10 @@ std::string itos(unsigned int val)
     return ss.str();
 }
 
-unsigned int concatenate_units(std::vector<UnitSpecies>& units1, const Species& sp, const unsigned int bond_stride)
+unsigned int concatenate_units(
+    std::vector<UnitSpecies>& units1, const std::vector<UnitSpecies>& units2,
+    const unsigned int bond_stride)
 {
-    const std::vector<UnitSpecies> units2 = sp.units();
     units1.reserve(units1.size() + units2.size());
 
     std::unordered_map<std::string, std::string> bond_cache;
@@ -96,173 +105,6 @@ bool is_correspondent(const UnitSpecies& usp1, const UnitSpecies& usp2)
     return true;
 }
 
-// struct species_formatter
-// {
-//     typedef std::vector<UnitSpecies>::size_type size_type;
-// 
-//     struct bond_type
-//     {
-//         std::string name;
-//         size_type one;
-//         size_type another;
-// 
-//         bond_type()
-//         {}
-// 
-//         bond_type(const std::string& name, const size_type one, const size_type another)
-//             : name(name), one(one), another(another)
-//         {}
-//     };
-// 
-//     typedef std::unordered_map<std::string, bond_type> bond_container_type;
-// 
-//     species_formatter(const std::vector<UnitSpecies>& units)
-//         : units(units)
-//     {
-//         bonds.clear();
-//         for (size_type idx = 0; idx != units.size(); ++idx)
-//         {
-//             const UnitSpecies& unit(units.at(idx));
-//             for (UnitSpecies::container_type::const_iterator i(unit.begin());
-//                  i != unit.end(); ++i)
-//             {
-//                 const std::string& bond = (*i).second.second;
-// 
-//                 if (is_empty(bond) || is_wildcard(bond))
-//                 {
-//                     continue;
-//                 }
-// 
-//                 bond_container_type::iterator it = bonds.find(bond);
-//                 if (it == bonds.end())
-//                 {
-//                     bonds.insert(std::make_pair(bond, bond_type(bond, idx, units.size())));
-//                 }
-//                 else
-//                 {
-//                     (*it).second.another = idx;
-//                 }
-//             }
-//         }
-//     }
-// 
-//     size_type get_partner(const std::string bond, const size_type one) const
-//     {
-//         bond_container_type::const_iterator i = bonds.find(bond);
-//         assert(i != bonds.end());
-//         const bond_type& b = (*i).second;
-//         if (b.one == one)
-//         {
-//             assert(b.another != units.size());
-//             return b.another;
-//         }
-//         else
-//         {
-//             assert(b.one != units.size());
-//             return b.one;
-//         }
-//     }
-// 
-//     // std::vector<size_type> sort(const size_type start) const
-//     // {
-//     //     std::vector<size_type> permutation(units.size(), units.size());
-// 
-//     //     size_type stride = sort(permutation, start, 0);
-//     //     for (size_type idx = 0; idx != units.size(); ++idx)
-//     //     {
-//     //         stride = sort(permutation, idx, stride);
-//     //     }
-// 
-//     //     assert(stride == units.size());
-//     //     return permutation;
-//     // }
-// 
-//     size_type sort(std::vector<size_type>& permutation, const size_type pos, const size_type idx) const
-//     {
-//         if (permutation[pos] != units.size())
-//         {
-//             return idx;
-//         }
-// 
-//         permutation[pos] = idx;
-//         size_type stride = idx + 1;
-//         const UnitSpecies& unit = units.at(pos);
-//         for (UnitSpecies::container_type::const_iterator i(unit.begin());
-//              i != unit.end(); ++i)
-//         {
-//             const std::string& bond = (*i).second.second;
-// 
-//             if (is_empty(bond) || is_wildcard(bond))
-//             {
-//                 continue;
-//             }
-// 
-//             stride = sort(permutation, get_partner(bond, pos), stride);
-//         }
-//         return stride;
-//     }
-// 
-//     Species collect(const std::vector<size_type>& permutation) const
-//     {
-//         typedef std::unordered_map<std::string, std::string> mapper_type;
-//         mapper_type bond_names;
-// 
-//         std::vector<UnitSpecies> res;
-//         for (size_type i = 0; i != permutation.size(); ++i)
-//         {
-//             const size_type& j = permutation.at(i);
-//             if (j == units.size())
-//             {
-//                 continue;
-//             }
-//             else if (j >= res.size())
-//             {
-//                 res.resize(j + 1);
-//             }
-//             res[j] = units[i];
-//         }
-// 
-//         unsigned int stride = 0;
-//         Species sp;
-//         for (std::vector<UnitSpecies>::iterator i = res.begin();
-//             i != res.end(); ++i)
-//         {
-//             UnitSpecies& unit = (*i);
-// 
-//             for (UnitSpecies::container_type::iterator k(unit.begin());
-//                  k != unit.end(); ++k)
-//             {
-//                 std::string& bond = (*k).second.second;
-// 
-//                 if (is_empty(bond) || is_wildcard(bond))
-//                 {
-//                     continue;
-//                 }
-// 
-//                 mapper_type::const_iterator
-//                     it = bond_names.find(bond);
-//                 if (it == bond_names.end())
-//                 {
-//                     const std::string new_bond_name = itos(++stride);
-//                     bond_names.insert(std::make_pair(bond, new_bond_name));
-//                     bond = new_bond_name;
-//                 }
-//                 else
-//                 {
-//                     bond = (*it).second;
-//                 }
-//             }
-// 
-//             sp.add_unit(unit);
-//         }
-// 
-//         return sp;
-//     }
-// 
-//     const std::vector<UnitSpecies>& units;
-//     bond_container_type bonds;
-// };
-
 class species_structure
 {
 public:
@@ -375,7 +217,7 @@ public:
         j = rhs.begin();
         while (i != lhs.end() && j != rhs.end())
         {
-            if ((*i).second.second != "" && (*i).second.second != "")
+            if ((*i).second.second != "" && !is_wildcard((*i).second.second))
             {
                 const std::vector<site_type>&
                     pair1(connections_[(*i).second.second]);
@@ -459,79 +301,10 @@ protected:
     std::vector<std::pair<index_type, index_type> > ignores_;
 };
 
-// int compare_unit_species(const UnitSpecies& lhs, const UnitSpecies& rhs)
-// {
-//     if (lhs.name() != rhs.name())
-//     {
-//         return (lhs.name() < rhs.name() ? 1 : -1);
-//     }
-// 
-//     for (UnitSpecies::container_type::const_iterator i(lhs.begin()), j(rhs.begin());
-//         i != lhs.end() && j != rhs.end(); ++i, ++j)
-//     {
-//         if ((*i).first != (*j).first)
-//         {
-//             return ((*i).first < (*j).first ? 1 : -1);
-//         }
-//         else if ((*i).second.first != (*j).second.first)
-//         {
-//             return ((*i).second.first < (*j).second.first ? 1 : -1);
-//         }
-//         else if (((*i).second.second == "") != ((*j).second.second == ""))
-//         {
-//             return ((*i).second.second == "" ? 1 : -1);
-//         }
-//     }
-// 
-//     if (lhs.num_sites() != rhs.num_sites())
-//     {
-//         return (lhs.num_sites() < rhs.num_sites() ? 1 : -1);
-//     }
-//     return 0;
-// }
-// 
-// struct less_unit_species
-// {
-//     bool operator()(const UnitSpecies& lhs, const UnitSpecies& rhs)
-//     {
-//         return compare_unit_species(lhs, rhs) > 0;
-//     }
-// };
+} // anonymous
 
 Species format_species(const Species& sp)
 {
-    // {
-    //     std::vector<Species> res;
-
-    //     std::vector<UnitSpecies> units = sp.units();
-    //     std::sort(units.begin(), units.end(), less_unit_species());
-
-    //     species_formatter formatter(units);
-    //     std::vector<species_formatter::size_type>::difference_type start = 0;
-    //     while (true)
-    //     {
-    //         std::vector<species_formatter::size_type> permutation(units.size(), units.size());
-    //         species_formatter::size_type stride = formatter.sort(permutation, start, 0);
-    //         res.push_back(formatter.collect(permutation));
-    //         std::vector<species_formatter::size_type>::iterator start_it = permutation.begin();
-    //         std::advance(start_it, start);
-    //         start = std::distance(permutation.begin(), std::find(start_it, permutation.end(), units.size()));
-    //         if (start == units.size())
-    //         {
-    //             break;
-    //         }
-    //     }
-
-    //     std::cout << "BEFORE: " << sp.serial() << std::endl;
-    //     std::cout << "AFTER: ";
-
-    //     for (std::vector<Species>::const_iterator i = res.begin(); i != res.end(); ++i)
-    //     {
-    //         std::cout << " " << (*i).serial();
-    //     }
-    //     std::cout << std::endl;
-    // }
-
     species_structure comp(sp);
     const std::vector<UnitSpecies>::size_type num_units = comp.units().size();
 
@@ -541,7 +314,7 @@ Species format_species(const Species& sp)
         units.push_back(i);
     }
 
-    std::sort(units.begin(), units.end(), comp);
+    std::sort(units.begin(), units.end(), std::ref(comp));  // not to copy the structure
 
     std::vector<species_structure::index_type>
         next(num_units, num_units);
@@ -563,7 +336,7 @@ Species format_species(const Species& sp)
     for (std::vector<species_structure::index_type>::const_iterator
         i(units.begin()); i != units.end(); ++i)
     {
-        UnitSpecies usp(sp.units().at(*i));
+        UnitSpecies usp(comp.units().at(*i));
         for (UnitSpecies::container_type::size_type j(0);
             j < static_cast<UnitSpecies::container_type::size_type>(usp.num_sites()); ++j)
         {
@@ -594,163 +367,22 @@ Species format_species(const Species& sp)
     return newsp;
 }
 
-boost::optional<rule_based_expression_matcher<UnitSpecies>::context_type>
-    rule_based_expression_matcher<UnitSpecies>::match_unit_species(
-        const UnitSpecies& pttrn,
-        const UnitSpecies& usp,
-        const rule_based_expression_matcher<UnitSpecies>::context_type& org)
+namespace
 {
-    typedef rule_based_expression_matcher<UnitSpecies>::context_type context_type;
-
-    context_type ctx = org;
-
-    if (is_wildcard(pttrn.name()))
-    {
-        if (is_pass_wildcard(pttrn.name()))
-        {
-            throw NotSupported(
-                "A pass wildcard '_0' is not allowed to be a name of Species.");
-        }
-        else if (is_named_wildcard(pttrn.name()))
-        {
-            context_type::variable_container_type::const_iterator
-                itr(ctx.globals.find(pttrn.name()));
-            if (itr == ctx.globals.end())
-            {
-                ctx.globals[pttrn.name()] = usp.name();
-            }
-            else if ((*itr).second != usp.name())
-            {
-                return boost::none;
-            }
-        }
-    }
-    else if (pttrn.name() != usp.name())
-    {
-        return boost::none;
-    }
-
-    for (UnitSpecies::container_type::const_iterator j(pttrn.begin());
-        j != pttrn.end(); ++j)
-    {
-        if (usp.has_site((*j).first))
-        {
-            const UnitSpecies::site_type& site(usp.get_site((*j).first));
 
-            if ((*j).second.first != "")
-            {
-                if (site.first == "")
-                {
-                    return boost::none;
-                }
-                else if (is_pass_wildcard((*j).second.first))
-                {
-                    throw NotSupported(
-                        "A pass wildcard '_0' is not allowed to be a state.");
-                }
-                else if (is_unnamed_wildcard((*j).second.first))
-                {
-                    ; // do nothing
-                }
-                else if (is_named_wildcard((*j).second.first))
-                {
-                    context_type::variable_container_type::const_iterator
-                        itr(ctx.globals.find((*j).second.first));
-                    if (itr == ctx.globals.end())
-                    {
-                        ctx.globals[(*j).second.first] = site.first;
-                    }
-                    else if ((*itr).second != site.first)
-                    {
-                        return boost::none;
-                    }
-                }
-                else if ((*j).second.first != site.first)
-                {
-                    return boost::none;
-                }
-            }
-
-            if (is_pass_wildcard((*j).second.second))
-            {
-                ; // just skip checking
-            }
-            else if ((*j).second.second == "")
-            {
-                if (site.second != "")
-                {
-                    return boost::none;
-                }
-            }
-            else
-            {
-                if (site.second == "")
-                {
-                    return boost::none;
-                }
-                else if (is_unnamed_wildcard((*j).second.second))
-                {
-                    continue;
-                }
-                else if (is_named_wildcard((*j).second.second))
-                {
-                    throw NotSupported(
-                        "A named wildcard is not allowed to be a bond.");
-                }
-
-                context_type::variable_container_type::const_iterator
-                    itr(ctx.locals.find((*j).second.second));
-                if (itr == ctx.locals.end())
-                {
-                    ctx.locals[(*j).second.second] = site.second;
-                }
-                else if ((*itr).second != site.second)
-                {
-                    return boost::none;
-                }
-
-            }
-        }
-        else
-        {
-            return boost::none;
-        }
-    }
-
-    return ctx;
-}
-
-/*
- * Apply a ReactionRule to the given set of reactants and return ReactionRules.
- */
-
-struct _ReactionRuleExpressionMatcher
+struct unit_group_type
 {
-    typedef rule_based_expression_matcher<UnitSpecies>::context_type context_type;
-    typedef ReactionRule::reactant_container_type reactant_container_type;
-
-    typedef struct
-    {
-        std::vector<UnitSpecies> products;
-        std::vector<std::vector<UnitSpecies>::size_type> correspo;
-        std::vector<std::vector<UnitSpecies>::size_type> removed;
-        std::vector<UnitSpecies>::size_type reserved;
-    } operation_type;
-
-    typedef struct
-    {
-        std::vector<UnitSpecies> units;
-        std::vector<unsigned int> groups;
-        unsigned int num_groups;
-    } unit_group_type;
+    std::vector<UnitSpecies> units;
+    std::vector<unsigned int> groups;
+    unsigned int num_groups;
 };
 
-_ReactionRuleExpressionMatcher::operation_type compile_reaction_rule(const ReactionRule& pttrn)
+rule_program::operation_type compile_reaction_rule(const ReactionRule& pttrn)
 {
     typedef std::vector<UnitSpecies>::size_type size_type;
     typedef std::vector<UnitSpecies>::const_iterator const_iterator;
 
-    _ReactionRuleExpressionMatcher::operation_type res = {};
+    rule_program::operation_type res = {};
     std::vector<UnitSpecies>& products = res.products;
     std::vector<size_type>& correspo = res.correspo;
     std::vector<size_type>& removed = res.removed;
@@ -772,7 +404,7 @@ _ReactionRuleExpressionMatcher::operation_type compile_reaction_rule(const React
     for (ReactionRule::reactant_container_type::const_iterator
         i(pttrn.products().begin()); i != pttrn.products().end(); ++i)
     {
-        product_bond_stride += concatenate_units(products, (*i), product_bond_stride);
+        product_bond_stride += concatenate_units(products, (*i).units(), product_bond_stride);
     }
 
     // 2. Check correspondences between reactant and product units
@@ -830,14 +462,13 @@ _ReactionRuleExpressionMatcher::operation_type compile_reaction_rule(const React
     return res;
 }
 
-_ReactionRuleExpressionMatcher::unit_group_type generate_units(
-    const _ReactionRuleExpressionMatcher::operation_type& operations,
-    const _ReactionRuleExpressionMatcher::context_type& ctx,
-    const ReactionRule::reactant_container_type& target,
+unit_group_type generate_units(
+    const rule_program::operation_type& operations,
+    const std::vector<unsigned int>& iterators,
+    const std::unordered_map<std::string, std::string>& globals,
+    const std::vector<const compiled_species*>& target,
     const ReactionRule::policy_type& policy)
 {
-    typedef _ReactionRuleExpressionMatcher::context_type context_type;
-    typedef _ReactionRuleExpressionMatcher::unit_group_type unit_group_type;
     typedef std::vector<UnitSpecies>::size_type size_type;
 
     const std::vector<UnitSpecies>& products = operations.products;
@@ -852,19 +483,12 @@ _ReactionRuleExpressionMatcher::unit_group_type generate_units(
 
     // 3. Concatenate units given as reactants
 
-    // const context_type ctx(context());
-
     int bond_stride = 0;
 
-    //XXX: for (std::vector<reactant_container_type::size_type>::const_iterator
-    //XXX:     i(permutation_.begin()); i != permutation_.end(); ++i)
-    //XXX: {
-    //XXX:     bond_stride += concatenate_units(units, target[*i], bond_stride);
-    //XXX: }
-    for (ReactionRule::reactant_container_type::const_iterator
+    for (std::vector<const compiled_species*>::const_iterator
         i(target.begin()); i != target.end(); ++i)
     {
-        bond_stride += concatenate_units(units, *i, bond_stride);
+        bond_stride += concatenate_units(units, (*(*i)).units, bond_stride);
     }
 
     // 4. Modify units
@@ -881,8 +505,8 @@ _ReactionRuleExpressionMatcher::unit_group_type generate_units(
             {
                 if ((*i) < reserved)
                 {
-                    assert(ctx.iterators.size() > (*i));
-                    priorities.push_back(std::make_pair(ctx.iterators[(*i)], idx));
+                    assert(iterators.size() > (*i));
+                    priorities.push_back(std::make_pair(iterators[(*i)], idx));
                 }
                 else
                 {
@@ -907,9 +531,9 @@ _ReactionRuleExpressionMatcher::unit_group_type generate_units(
                 units.push_back(op);
                 if (is_named_wildcard(op.name()))
                 {
-                    context_type::variable_container_type::const_iterator
-                        itr(ctx.globals.find(op.name()));
-                    if (itr == ctx.globals.end())
+                    std::unordered_map<std::string, std::string>::const_iterator
+                        itr(globals.find(op.name()));
+                    if (itr == globals.end())
                     {
                         std::stringstream message;
                         message << "A named wildcard [" << op.name() << "] cannot be resolved.";
@@ -921,11 +545,6 @@ _ReactionRuleExpressionMatcher::unit_group_type generate_units(
                     }
                 }
             }
-            // else
-            // {
-            //     tgt = ctx.iterators[idx2];
-            // }
-
             for (UnitSpecies::container_type::const_iterator i(op.begin());
                 i != op.end(); ++i)
             {
@@ -941,9 +560,9 @@ _ReactionRuleExpressionMatcher::unit_group_type generate_units(
                 {
                     if ((*i).second.first.size() != 1)
                     {
-                        context_type::variable_container_type::const_iterator
-                            itr(ctx.globals.find((*i).second.first));
-                        if (itr == ctx.globals.end())
+                        std::unordered_map<std::string, std::string>::const_iterator
+                            itr(globals.find((*i).second.first));
+                        if (itr == globals.end())
                         {
                             std::stringstream message;
                             message << "An invalid global name [" << (*i).second.first << "] was given.";
@@ -1005,7 +624,7 @@ _ReactionRuleExpressionMatcher::unit_group_type generate_units(
         for (std::vector<std::vector<UnitSpecies>::size_type>::const_iterator
             i(removed.begin()); i != removed.end(); ++i)
         {
-            units[ctx.iterators[(*i)]] = UnitSpecies();
+            units[iterators[(*i)]] = UnitSpecies();
         }
     }
 
@@ -1241,50 +860,511 @@ std::vector<Species> group_units(
     return products;
 }
 
-}; // context
+} // anonymous
 
-std::vector<ReactionRule> generate_reaction_rules(
-    const ReactionRule& pttrn,
-    const ReactionRule::reactant_container_type& reactants)
+symbol_type symbol_table::intern(const std::string& str)
 {
-    typedef context::_ReactionRuleExpressionMatcher::operation_type operation_type;
-    typedef context::_ReactionRuleExpressionMatcher::unit_group_type unit_group_type;
-    typedef context::rule_based_expression_matcher<std::vector<Species> >::context_type context_type;
-    typedef std::vector<ReactionRule> return_type;
+    const std::unordered_map<std::string, symbol_type>::const_iterator i(symbols_.find(str));
+    if (i != symbols_.end())
+    {
+        return (*i).second;
+    }
+
+    const symbol_type symbol(strings_.size());
+    strings_.push_back(str);
+    symbols_.insert(std::make_pair(str, symbol));
+    return symbol;
+}
+
+compiled_species::compiled_species(const Species& sp, symbol_table& symbols)
+    : species(sp), units(sp.units())
+{
+    std::unordered_map<std::string, unsigned int> bonds;
+    unsigned int num_bonds(0);
 
-    if (pttrn.reactants().size() == 0)
+    nodes.reserve(units.size());
+    for (std::vector<UnitSpecies>::const_iterator i(units.begin()); i != units.end(); ++i)
     {
-        return return_type(
-            1, ReactionRule(reactants, pttrn.products(), pttrn.k()));  // Zeroth-order reactions
+        const unit_type node = {
+            symbols.intern((*i).name()), static_cast<unsigned int>(sites.size()),
+            static_cast<unsigned int>(sites.size() + (*i).num_sites())};
+        nodes.push_back(node);
+        names.push_back(node.name);
+
+        for (UnitSpecies::container_type::const_iterator j((*i).begin()); j != (*i).end(); ++j)
+        {
+            const std::string& bond((*j).second.second);
+            site_type site = {symbols.intern((*j).first), symbols.intern((*j).second.first), 0};
+            if (is_wildcard(bond))
+            {
+                site.bond = ++num_bonds;  // never paired with the others
+            }
+            else if (bond != "")
+            {
+                const std::unordered_map<std::string, unsigned int>::const_iterator
+                    k(bonds.find(bond));
+                if (k == bonds.end())
+                {
+                    site.bond = ++num_bonds;
+                    bonds.insert(std::make_pair(bond, site.bond));
+                }
+                else
+                {
+                    site.bond = (*k).second;
+                }
+            }
+            sites.push_back(site);
+        }
     }
+    std::sort(names.begin(), names.end());
+}
 
-    std::vector<std::vector<UnitSpecies> > candidates;
-    const operation_type op = context::compile_reaction_rule(pttrn);
+namespace
+{
 
-    return_type reactions;
-    context::rule_based_expression_matcher<std::vector<Species> > matcher(pttrn.reactants());
-    for (boost::optional<context_type> ctx = matcher.match(reactants); ctx; ctx = matcher.next())
+unsigned int index_of(variable_container_type& variables, const std::string& name)
+{
+    variable_container_type::const_iterator i(std::find(variables.begin(), variables.end(), name));
+    if (i == variables.end())
     {
-        const unit_group_type _res
-            = context::generate_units(op, (*ctx), reactants, pttrn.policy());
+        variables.push_back(name);
+        return variables.size() - 1;
+    }
+    return std::distance(variables.cbegin(), i);
+}
+
+} // anonymous
 
-        std::vector<std::vector<UnitSpecies> >::iterator
-            i(std::find(candidates.begin(), candidates.end(), _res.units));
-        if (i != candidates.end())
+species_pattern::species_pattern(
+    const Species& pttrn, symbol_table& symbols, variable_container_type& globals)
+    : num_locals_(0)
+{
+    variable_container_type locals;
+
+    const std::vector<UnitSpecies> units(pttrn.units());
+    for (std::vector<UnitSpecies>::const_iterator i(units.begin()); i != units.end(); ++i)
+    {
+        const std::string& name((*i).name());
+        unit_op_type op = {NAME_EQUAL, 0,
+            static_cast<unsigned int>(sites_.size()),
+            static_cast<unsigned int>(sites_.size() + (*i).num_sites())};
+        if (is_pass_wildcard(name))
+        {
+            throw NotSupported(
+                "A pass wildcard '_0' is not allowed to be a name of Species.");
+        }
+        else if (is_named_wildcard(name))
         {
-            ; // (*i).set_k((*i).k() + rr.k());
+            op.name_op = NAME_GLOBAL;
+            op.name = index_of(globals, name);
+        }
+        else if (is_unnamed_wildcard(name))
+        {
+            op.name_op = NAME_ANY;
         }
         else
         {
-            candidates.push_back(_res.units);
-            reactions.push_back(
-                ReactionRule(
-                    reactants,
-                    context::group_units(_res.units, _res.groups, _res.num_groups),
-                    pttrn.k()));
+            op.name = symbols.intern(name);
+            names_.push_back(op.name);
+        }
+        units_.push_back(op);
+
+        for (UnitSpecies::container_type::const_iterator j((*i).begin()); j != (*i).end(); ++j)
+        {
+            const std::string& state((*j).second.first);
+            const std::string& bond((*j).second.second);
+            site_op_type site = {symbols.intern((*j).first), STATE_NONE, 0, BOND_FREE, 0};
+
+            if (state == "")
+            {
+                ; // do nothing
+            }
+            else if (is_pass_wildcard(state))
+            {
+                throw NotSupported(
+                    "A pass wildcard '_0' is not allowed to be a state.");
+            }
+            else if (is_unnamed_wildcard(state))
+            {
+                site.state_op = STATE_ANY;
+            }
+            else if (is_named_wildcard(state))
+            {
+                site.state_op = STATE_GLOBAL;
+                site.state = index_of(globals, state);
+            }
+            else
+            {
+                site.state_op = STATE_EQUAL;
+                site.state = symbols.intern(state);
+            }
+
+            if (is_pass_wildcard(bond))
+            {
+                site.bond_op = BOND_PASS;
+            }
+            else if (bond == "")
+            {
+                site.bond_op = BOND_FREE;
+            }
+            else if (is_unnamed_wildcard(bond))
+            {
+                site.bond_op = BOND_ANY;
+            }
+            else if (is_named_wildcard(bond))
+            {
+                throw NotSupported(
+                    "A named wildcard is not allowed to be a bond.");
+            }
+            else
+            {
+                site.bond_op = BOND_LOCAL;
+                site.bond = index_of(locals, bond);
+            }
+            sites_.push_back(site);
+        }
+    }
+
+    num_locals_ = locals.size();
+    std::sort(names_.begin(), names_.end());
+}
+
+bool species_pattern::may_match(const compiled_species& target) const
+{
+    return std::includes(
+        target.names.begin(), target.names.end(), names_.begin(), names_.end());
+}
+
+/**
+ * bindings of a match in progress. trail keeps what was bound, to undo:
+ * the index of a global, or the number of globals plus the index of a local.
+ */
+struct species_pattern::state_type
+{
+    std::vector<bool> used;
+    std::vector<unsigned int> iterators;
+    std::vector<symbol_type> globals;
+    std::vector<unsigned int> locals;
+    std::vector<unsigned int> trail;
+
+    void undo(const std::size_t mark)
+    {
+        while (trail.size() > mark)
+        {
+            const unsigned int i(trail.back());
+            if (i < globals.size())
+            {
+                globals[i] = 0;
+            }
+            else
+            {
+                locals[i - globals.size()] = 0;
+            }
+            trail.pop_back();
+        }
+    }
+
+    bool bind_global(const unsigned int i, const symbol_type value)
+    {
+        if (globals[i] == 0)
+        {
+            globals[i] = value;
+            trail.push_back(i);
+            return true;
+        }
+        return globals[i] == value;
+    }
+
+    bool bind_local(const unsigned int i, const unsigned int bond)
+    {
+        if (locals[i] == 0)
+        {
+            locals[i] = bond;
+            trail.push_back(globals.size() + i);
+            return true;
         }
+        return locals[i] == bond;
+    }
+};
+
+bool species_pattern::match_unit(const unit_op_type& op, const compiled_species& target,
+    const compiled_species::unit_type& unit, state_type& state) const
+{
+    if (op.name_op == NAME_EQUAL)
+    {
+        if (op.name != unit.name)
+        {
+            return false;
+        }
+    }
+    else if (op.name_op == NAME_GLOBAL)
+    {
+        if (!state.bind_global(op.name, unit.name))
+        {
+            return false;
+        }
+    }
+
+    for (unsigned int i(op.first); i < op.last; ++i)
+    {
+        const site_op_type& pttrn(sites_[i]);
+
+        unsigned int j(unit.first);
+        while (j < unit.last && target.sites[j].name != pttrn.name)
+        {
+            ++j;
+        }
+        if (j == unit.last)
+        {
+            return false;
+        }
+        const compiled_species::site_type& site(target.sites[j]);
+
+        if (pttrn.state_op != STATE_NONE)
+        {
+            if (site.state == 0)
+            {
+                return false;
+            }
+            else if (pttrn.state_op == STATE_EQUAL && pttrn.state != site.state)
+            {
+                return false;
+            }
+            else if (pttrn.state_op == STATE_GLOBAL && !state.bind_global(pttrn.state, site.state))
+            {
+                return false;
+            }
+        }
+
+        switch (pttrn.bond_op)
+        {
+        case BOND_PASS:
+            break;
+        case BOND_FREE:
+            if (site.bond != 0)
+            {
+                return false;
+            }
+            break;
+        case BOND_ANY:
+            if (site.bond == 0)
+            {
+                return false;
+            }
+            break;
+        case BOND_LOCAL:
+            if (site.bond == 0 || !state.bind_local(pttrn.bond, site.bond))
+            {
+                return false;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+void species_pattern::advance(const compiled_species& target, const std::size_t pos,
+    state_type& state, std::vector<match_type>& matches) const
+{
+    if (pos == units_.size())
+    {
+        const match_type m = {state.iterators, state.globals};
+        matches.push_back(m);
+        return;
+    }
+
+    for (unsigned int i(0); i < target.nodes.size(); ++i)
+    {
+        if (state.used[i])
+        {
+            continue;
+        }
+
+        const std::size_t mark(state.trail.size());
+        if (match_unit(units_[pos], target, target.nodes[i], state))
+        {
+            state.used[i] = true;
+            state.iterators.push_back(i);
+            advance(target, pos + 1, state, matches);
+            state.iterators.pop_back();
+            state.used[i] = false;
+        }
+        state.undo(mark);
+    }
+}
+
+void species_pattern::match(
+    const compiled_species& target, const std::vector<symbol_type>& globals,
+    std::vector<match_type>& matches) const
+{
+    if (!may_match(target))
+    {
+        return;
+    }
+
+    state_type state;
+    state.used.assign(target.nodes.size(), false);
+    state.iterators.reserve(units_.size());
+    state.globals = globals;
+    state.locals.assign(num_locals_, 0);
+    advance(target, 0, state, matches);
+}
+
+Integer species_pattern::count(const compiled_species& target, const std::size_t num_globals) const
+{
+    std::vector<match_type> matches;
+    match(target, std::vector<symbol_type>(num_globals, 0), matches);
+
+    std::vector<std::vector<unsigned int> > results;
+    results.reserve(matches.size());
+    for (std::vector<match_type>::iterator i(matches.begin()); i != matches.end(); ++i)
+    {
+        results.push_back((*i).iterators);
+        std::sort(results.back().begin(), results.back().end());
+    }
+    std::sort(results.begin(), results.end());
+    return std::distance(results.begin(), std::unique(results.begin(), results.end()));
+}
+
+rule_program::rule_program(const ReactionRule& rr, symbol_table& symbols)
+    : rule_(rr), operations_(compile_reaction_rule(rr))
+{
+    for (ReactionRule::reactant_container_type::const_iterator i(rr.reactants().begin());
+        i != rr.reactants().end(); ++i)
+    {
+        reactants_.push_back(species_pattern(*i, symbols, globals_));
+    }
+}
+
+std::vector<ReactionRule> rule_program::generate(
+    const ReactionRule::reactant_container_type& reactants,
+    const std::vector<const compiled_species*>& targets, const symbol_table& symbols) const
+{
+    std::vector<ReactionRule> reactions;
+    if (reactants_.size() == 0)
+    {
+        reactions.push_back(ReactionRule(reactants, rule_.products(), rule_.k()));  // Zeroth-order reactions
+        return reactions;
+    }
+    else if (targets.size() != reactants_.size())
+    {
+        return reactions;
+    }
+
+    for (std::size_t i(0); i < reactants_.size(); ++i)
+    {
+        if (!reactants_[i].may_match(*targets[i]))
+        {
+            return reactions;
+        }
+    }
+
+    // matches of all reactants, with globals bound by the former.
+    std::vector<match_type> partial(1), next, matches;
+    partial.front().globals.assign(globals_.size(), 0);
+    unsigned int stride(0);
+    for (std::size_t i(0); i < reactants_.size() && !partial.empty(); ++i)
+    {
+        next.clear();
+        for (std::vector<match_type>::const_iterator j(partial.begin()); j != partial.end(); ++j)
+        {
+            matches.clear();
+            reactants_[i].match(*targets[i], (*j).globals, matches);
+            for (std::vector<match_type>::iterator k(matches.begin()); k != matches.end(); ++k)
+            {
+                std::vector<unsigned int> iterators((*j).iterators);
+                for (std::vector<unsigned int>::const_iterator l((*k).iterators.begin());
+                    l != (*k).iterators.end(); ++l)
+                {
+                    iterators.push_back((*l) + stride);
+                }
+                (*k).iterators.swap(iterators);
+                next.push_back(*k);
+            }
+        }
+        partial.swap(next);
+        stride += (*targets[i]).units.size();
+    }
+
+    std::vector<std::vector<UnitSpecies> > candidates;
+    std::unordered_map<std::string, std::string> globals;
+    for (std::vector<match_type>::const_iterator i(partial.begin()); i != partial.end(); ++i)
+    {
+        globals.clear();
+        for (std::size_t j(0); j < globals_.size(); ++j)
+        {
+            if ((*i).globals[j] != 0)
+            {
+                globals.insert(std::make_pair(globals_[j], symbols.str((*i).globals[j])));
+            }
+        }
+
+        const unit_group_type res(
+            generate_units(operations_, (*i).iterators, globals, targets, rule_.policy()));
+        if (std::find(candidates.begin(), candidates.end(), res.units) != candidates.end())
+        {
+            continue;
+        }
+        candidates.push_back(res.units);
+        reactions.push_back(
+            ReactionRule(reactants, group_units(res.units, res.groups, res.num_groups), rule_.k()));
     }
     return reactions;
 }
 
+const compiled_species& rule_based_expression_cache::get(const Species& sp)
+{
+    const std::unordered_map<Species::serial_type, std::shared_ptr<compiled_species> >::const_iterator
+        i(serials_.find(sp.serial()));
+    if (i != serials_.end())
+    {
+        return *(*i).second;
+    }
+
+    const Species formatted(context::format_species(sp));
+    std::shared_ptr<compiled_species> compiled;
+    const std::unordered_map<Species::serial_type, std::shared_ptr<compiled_species> >::const_iterator
+        j(canonicals_.find(formatted.serial()));
+    if (j != canonicals_.end())
+    {
+        compiled = (*j).second;
+    }
+    else
+    {
+        compiled.reset(new compiled_species(formatted, symbols_));
+        canonicals_.insert(std::make_pair(formatted.serial(), compiled));
+    }
+    serials_.insert(std::make_pair(sp.serial(), compiled));
+    return *compiled;
+}
+
+} // context
+
+Integer count_species_matches(const Species& pttrn, const Species& sp)
+{
+    context::symbol_table symbols;
+    context::variable_container_type globals;
+    const context::species_pattern compiled(pttrn, symbols, globals);
+    return compiled.count(context::compiled_species(sp, symbols), globals.size());
+}
+
+std::vector<ReactionRule> generate_reaction_rules(
+    const ReactionRule& pttrn,
+    const ReactionRule::reactant_container_type& reactants)
+{
+    context::symbol_table symbols;
+    const context::rule_program program(pttrn, symbols);
+
+    std::vector<context::compiled_species> compiled;
+    compiled.reserve(reactants.size());
+    std::vector<const context::compiled_species*> targets;
+    for (ReactionRule::reactant_container_type::const_iterator i(reactants.begin());
+        i != reactants.end(); ++i)
+    {
+        compiled.push_back(context::compiled_species(*i, symbols));
+        targets.push_back(&compiled.back());
+    }
+    return program.generate(reactants, targets, symbols);
+}
+
 } // ecell4
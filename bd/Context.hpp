@@ -0,0 +1,364 @@
+#ifndef ECELL4_CONTEXT_HPP
+#define ECELL4_CONTEXT_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+#include "types.hpp"
+#include "UnitSpecies.hpp"
+#include "Species.hpp"
+#include "ReactionRule.hpp"
+
+
+namespace ecell4
+{
+
+namespace context
+{
+
+inline bool is_empty(const std::string& name)
+{
+    return name == "";
+}
+
+inline bool is_wildcard(const std::string& name)
+{
+    return (name.size() > 0 && name[0] == '_');
+}
+
+inline bool is_unnamed_wildcard(const std::string& name)
+{
+    return name == "_";
+}
+
+inline bool is_pass_wildcard(const std::string& name)
+{
+    return name == "_0";
+}
+
+inline bool is_named_wildcard(const std::string& name)
+{
+    return (name.size() > 1 && name[0] == '_' && !is_pass_wildcard(name));
+}
+
+/**
+ * the canonical form of a species: units sorted and bonds renamed in the order of appearance,
+ * so that the same complex gives the same serial whatever the order given.
+ */
+Species format_species(const Species& sp);
+
+inline Species::serial_type unique_serial(const Species& sp)
+{
+    return format_species(sp).serial();
+}
+
+typedef unsigned int symbol_type;
+
+/**
+ * strings of names and states interned to consecutive integers.
+ * the empty string is always 0.
+ */
+class symbol_table
+{
+public:
+
+    symbol_table()
+    {
+        intern("");
+    }
+
+    symbol_type intern(const std::string& str);
+
+    const std::string& str(const symbol_type symbol) const
+    {
+        return strings_[symbol];
+    }
+
+protected:
+
+    std::unordered_map<std::string, symbol_type> symbols_;
+    std::vector<std::string> strings_;
+};
+
+/**
+ * a species parsed once. units are in the order of Species::units(), and sites of
+ * a unit are in the order of UnitSpecies. bonds are numbered from 1, and 0 is free.
+ */
+struct compiled_species
+{
+    struct site_type
+    {
+        symbol_type name, state;
+        unsigned int bond;
+    };
+
+    struct unit_type
+    {
+        symbol_type name;
+        unsigned int first, last;  // sites of the unit in sites
+    };
+
+    compiled_species(const Species& sp, symbol_table& symbols);
+
+    Species species;
+    std::vector<UnitSpecies> units;
+    std::vector<unit_type> nodes;
+    std::vector<site_type> sites;
+    std::vector<symbol_type> names;  // names of units, sorted
+};
+
+/**
+ * a result of matching: the unit matched by each unit of the pattern,
+ * and values of named wildcards.
+ */
+struct match_type
+{
+    std::vector<unsigned int> iterators;
+    std::vector<symbol_type> globals;
+};
+
+/**
+ * names of named wildcards shared by patterns of a reaction rule.
+ */
+typedef std::vector<std::string> variable_container_type;
+
+/**
+ * a pattern of a species compiled into a program of tests over units and sites.
+ * named wildcards of names and states are bound to globals, and labels of bonds
+ * to locals of the pattern. a pass wildcard "_0" as a name or a state, or
+ * a named wildcard as a bond, is rejected at the compilation.
+ */
+class species_pattern
+{
+public:
+
+    enum name_op_type
+    {
+        NAME_EQUAL, NAME_ANY, NAME_GLOBAL
+    };
+
+    enum state_op_type
+    {
+        STATE_NONE, STATE_ANY, STATE_EQUAL, STATE_GLOBAL
+    };
+
+    enum bond_op_type
+    {
+        BOND_PASS, BOND_FREE, BOND_ANY, BOND_LOCAL
+    };
+
+    struct site_op_type
+    {
+        symbol_type name;
+        state_op_type state_op;
+        unsigned int state;  // a symbol, or the index of a global
+        bond_op_type bond_op;
+        unsigned int bond;  // the index of a local
+    };
+
+    struct unit_op_type
+    {
+        name_op_type name_op;
+        unsigned int name;  // a symbol, or the index of a global
+        unsigned int first, last;  // tests of sites in sites_
+    };
+
+public:
+
+    species_pattern(
+        const Species& pttrn, symbol_table& symbols, variable_container_type& globals);
+
+    std::size_t num_units() const
+    {
+        return units_.size();
+    }
+
+    /**
+     * @return false if the species lacks a unit of a name required, without matching
+     */
+    bool may_match(const compiled_species& target) const;
+
+    /**
+     * append every match of the pattern on the species.
+     * @param globals values of globals bound already, 0 if not
+     */
+    void match(
+        const compiled_species& target, const std::vector<symbol_type>& globals,
+        std::vector<match_type>& matches) const;
+
+    /**
+     * @return the number of different sets of units matched, as count_species_matches
+     */
+    Integer count(const compiled_species& target, const std::size_t num_globals) const;
+
+protected:
+
+    struct state_type;
+
+    void advance(const compiled_species& target, const std::size_t pos, state_type& state,
+        std::vector<match_type>& matches) const;
+    bool match_unit(const unit_op_type& op, const compiled_species& target,
+        const compiled_species::unit_type& unit, state_type& state) const;
+
+protected:
+
+    std::vector<unit_op_type> units_;
+    std::vector<site_op_type> sites_;
+    unsigned int num_locals_;
+    std::vector<symbol_type> names_;  // names of units required, sorted
+};
+
+/**
+ * a reaction rule compiled: patterns of reactants sharing named wildcards,
+ * and operations on units to make products.
+ */
+class rule_program
+{
+public:
+
+    rule_program(const ReactionRule& rr, symbol_table& symbols);
+
+    const ReactionRule& rule() const
+    {
+        return rule_;
+    }
+
+    std::size_t num_reactants() const
+    {
+        return reactants_.size();
+    }
+
+    const species_pattern& reactant(const std::size_t i) const
+    {
+        return reactants_[i];
+    }
+
+    /**
+     * @return the number of named wildcards shared by reactants
+     */
+    std::size_t num_globals() const
+    {
+        return globals_.size();
+    }
+
+    /**
+     * generate rules over the reactants given, in the order of the patterns.
+     * a rule is generated for each different result of matches, and products are not formatted.
+     */
+    std::vector<ReactionRule> generate(
+        const ReactionRule::reactant_container_type& reactants,
+        const std::vector<const compiled_species*>& targets, const symbol_table& symbols) const;
+
+public:
+
+    struct operation_type
+    {
+        std::vector<UnitSpecies> products;
+        std::vector<std::vector<UnitSpecies>::size_type> correspo;
+        std::vector<std::vector<UnitSpecies>::size_type> removed;
+        std::vector<UnitSpecies>::size_type reserved;
+    };
+
+protected:
+
+    ReactionRule rule_;
+    variable_container_type globals_;
+    std::vector<species_pattern> reactants_;
+    operation_type operations_;
+};
+
+/**
+ * species compiled once per serial, with their canonical forms.
+ * a species is parsed and formatted only at its first appearance, and
+ * two species of the same canonical form share the same compiled one.
+ */
+class rule_based_expression_cache
+{
+public:
+
+    symbol_table& symbols()
+    {
+        return symbols_;
+    }
+
+    const symbol_table& symbols() const
+    {
+        return symbols_;
+    }
+
+    /**
+     * @return the species compiled in the canonical form
+     */
+    const compiled_species& get(const Species& sp);
+
+    /**
+     * @return the canonical form of the species
+     */
+    const Species& format(const Species& sp)
+    {
+        return get(sp).species;
+    }
+
+    std::size_t size() const
+    {
+        return canonicals_.size();
+    }
+
+    void clear()
+    {
+        serials_.clear();
+        canonicals_.clear();
+    }
+
+protected:
+
+    symbol_table symbols_;
+    std::unordered_map<Species::serial_type, std::shared_ptr<compiled_species> > serials_;
+    std::unordered_map<Species::serial_type, std::shared_ptr<compiled_species> > canonicals_;
+};
+
+} // context
+
+/**
+ * New interfaces for the rule-based modeling
+ */
+
+Integer count_species_matches(const Species& pttrn, const Species& sp);
+
+inline Species format_species(const Species& sp)
+{
+    return context::format_species(sp);
+}
+
+struct SpeciesExpressionMatcher
+{
+    context::symbol_table symbols;
+    context::variable_container_type globals;
+    context::species_pattern pttrn;
+
+    SpeciesExpressionMatcher(const Species& pttrn)
+        : symbols(), globals(), pttrn(pttrn, symbols, globals)
+    {
+        ;
+    }
+
+    bool match(const Species& sp)
+    {
+        return count(sp) > 0;
+    }
+
+    size_t count(const Species& sp)
+    {
+        return pttrn.count(context::compiled_species(sp, symbols), globals.size());
+    }
+};
+
+std::vector<ReactionRule> generate_reaction_rules(
+    const ReactionRule& pttrn,
+    const ReactionRule::reactant_container_type& reactants);
+
+} // ecell4
+
+#endif /* ECELL4_CONTEXT_HPP */
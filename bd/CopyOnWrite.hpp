@@ -0,0 +1,228 @@
+#ifndef ECELL4_COPY_ON_WRITE_HPP
+#define ECELL4_COPY_ON_WRITE_HPP
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <cstddef>
+
+
+namespace ecell4
+{
+
+/**
+ * a value shared among copies until one of them changes it.
+ * a copy costs a reference count. mutate() copies the value first if shared.
+ * references given by mutate() or get() are invalidated by the next mutate()
+ * of a shared value, as well as by any change of the value itself.
+ */
+template<typename T>
+class CopyOnWrite
+{
+public:
+
+    typedef T value_type;
+
+public:
+
+    CopyOnWrite()
+        : ptr_(new value_type())
+    {
+        ;
+    }
+
+    explicit CopyOnWrite(const value_type& value)
+        : ptr_(new value_type(value))
+    {
+        ;
+    }
+
+    const value_type& get() const
+    {
+        return *ptr_;
+    }
+
+    const value_type& operator*() const
+    {
+        return *ptr_;
+    }
+
+    const value_type* operator->() const
+    {
+        return ptr_.get();
+    }
+
+    value_type& mutate()
+    {
+        if (ptr_.use_count() > 1)
+        {
+            ptr_ = std::make_shared<value_type>(*ptr_);
+        }
+        return *ptr_;
+    }
+
+    bool shared() const
+    {
+        return ptr_.use_count() > 1;
+    }
+
+protected:
+
+    std::shared_ptr<value_type> ptr_;
+};
+
+/**
+ * a flat array stored in chunks of (1 << Nbits_) elements, each copied on write.
+ * a copy of the array costs a reference count per chunk,
+ * and a change copies only the chunk containing the element if shared.
+ */
+template<typename T, std::size_t Nbits_ = 6>
+class ChunkedArray
+{
+public:
+
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::vector<value_type> chunk_type;
+
+    static const size_type chunk_size = static_cast<size_type>(1) << Nbits_;
+
+public:
+
+    ChunkedArray()
+        : size_(0)
+    {
+        ;
+    }
+
+    explicit ChunkedArray(const size_type n)
+        : size_(0)
+    {
+        resize(n);
+    }
+
+    size_type size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_type num_chunks() const
+    {
+        return chunks_.size();
+    }
+
+    /**
+     * @return the number of chunks shared with another array
+     */
+    size_type num_shared_chunks() const
+    {
+        size_type retval(0);
+        for (typename std::vector<std::shared_ptr<chunk_type> >::const_iterator
+            i(chunks_.begin()); i != chunks_.end(); ++i)
+        {
+            if ((*i).use_count() > 1)
+            {
+                ++retval;
+            }
+        }
+        return retval;
+    }
+
+    const value_type& operator[](const size_type i) const
+    {
+        return (*chunks_[i >> Nbits_])[i & (chunk_size - 1)];
+    }
+
+    value_type& mutate(const size_type i)
+    {
+        return chunk(i >> Nbits_)[i & (chunk_size - 1)];
+    }
+
+    void clear()
+    {
+        chunks_.clear();
+        size_ = 0;
+    }
+
+    void reserve(const size_type n)
+    {
+        chunks_.reserve((n + chunk_size - 1) >> Nbits_);
+    }
+
+    /**
+     * resize the array. new elements are default-constructed.
+     */
+    void resize(const size_type n)
+    {
+        const size_type num_chunks((n + chunk_size - 1) >> Nbits_);
+
+        // elements removed from the last chunk left are reset. the others are dropped with their chunks.
+        for (size_type i(n); i < std::min(size_, num_chunks << Nbits_); ++i)
+        {
+            mutate(i) = value_type();
+        }
+
+        if (num_chunks < chunks_.size())
+        {
+            chunks_.resize(num_chunks);
+        }
+        while (chunks_.size() < num_chunks)
+        {
+            chunks_.push_back(std::make_shared<chunk_type>(chunk_size));
+        }
+        size_ = n;
+    }
+
+    void push_back(const value_type& v)
+    {
+        if (size_ == (chunks_.size() << Nbits_))
+        {
+            chunks_.push_back(std::make_shared<chunk_type>(chunk_size));
+        }
+        mutate(size_) = v;
+        ++size_;
+    }
+
+    void pop_back()
+    {
+        --size_;
+        if ((size_ & (chunk_size - 1)) == 0)
+        {
+            chunks_.pop_back();
+        }
+        else
+        {
+            mutate(size_) = value_type();
+        }
+    }
+
+protected:
+
+    chunk_type& chunk(const size_type c)
+    {
+        std::shared_ptr<chunk_type>& ptr(chunks_[c]);
+        if (ptr.use_count() > 1)
+        {
+            ptr = std::make_shared<chunk_type>(*ptr);
+        }
+        return *ptr;
+    }
+
+protected:
+
+    std::vector<std::shared_ptr<chunk_type> > chunks_;
+    size_type size_;
+};
+
+template<typename T, std::size_t Nbits_>
+const typename ChunkedArray<T, Nbits_>::size_type ChunkedArray<T, Nbits_>::chunk_size;
+
+} // ecell4
+
+#endif /* ECELL4_COPY_ON_WRITE_HPP */
@@ -0,0 +1,100 @@
+#ifndef ECELL4_BD_DOUBLE_LAYER_POLICY_HPP
+#define ECELL4_BD_DOUBLE_LAYER_POLICY_HPP
+
+#include <cmath>
+#include <limits>
+
+#include "types.hpp"
+#include "Real3.hpp"
+#include "Particle.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * boundary conditions of the double-layered situation.
+ * a crowder stays in its layer, a slab as thick as the y-edge along x,
+ * and a tracer is reflected at the walls normal to x.
+ * a policy tests a move before the overlap check of BDSimulatorT.
+ */
+struct DoubleLayerPolicy
+{
+    enum rejection_type
+    {
+        ACCEPTED = 0,
+        REJECTED_LAYER = 1,
+        REJECTED_WALL = 2
+    };
+
+    /**
+     * @param particle the particle before the move
+     * @param newpos_ the new position before applying the periodic boundary
+     * @param newpos the new position in the world
+     * @param edge_lengths the edge lengths of the world
+     */
+    inline rejection_type test(
+        const Particle& particle, const Real3& newpos_, const Real3& newpos,
+        const Real3& edge_lengths) const
+    {
+        // if (constraint_radius <= std::max_element(edge_lengths.begin(), edge_lengths.end()))
+        if (particle.constraint_radius() != std::numeric_limits<Real>::infinity())
+        {
+            // crowder
+            const Real L(edge_lengths[1]);
+            const Real posx(particle.position()[0]);
+            const Real newposx(newpos[0]);
+            if (std::floor(posx / L) != std::floor(newposx / L))
+            {
+                return REJECTED_LAYER;
+            }
+        }
+        else
+        {
+            //XXX: tracer
+            //XXX: reflective boundary
+            if (newpos_[0] < 0 || newpos_[0] >= edge_lengths[0])
+            {
+                return REJECTED_WALL;
+            }
+        }
+        return ACCEPTED;
+    }
+
+    //HERE: For multi-layered situation
+    // // if (constraint_radius != std::numeric_limits<Real>::infinity()
+    // //     && (particle.position()[0] < L_2) != (newpos[0] < L_2))
+    // // {
+    // //     // crowder
+    // //     continue;
+    // // }
+    // if (constraint_radius != std::numeric_limits<Real>::infinity())
+    // {
+    //     // crowder
+    //     const Real posx(particle.position()[0]);
+    //     const Real newposx(newpos[0]);
+    //     if (posx < L)
+    //     {
+    //         if (newposx >= L) continue;
+    //     }
+    //     else if (posx < Lx - L)
+    //     {
+    //         if (newposx < L || Lx - L <= newposx) continue;
+    //     }
+    //     else
+    //     {
+    //         // assert(Lx - L <= posx);
+    //         if (newposx < Lx - L) continue;
+    //     }
+    // }
+    //THERE:
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_DOUBLE_LAYER_POLICY_HPP */
@@ -0,0 +1,294 @@
+#include "ECMCSimulator.hpp"
+#include "binary_io.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+void ECMCSimulator::initialize()
+{
+    if ((*model_).num_reaction_rules() > 0)
+    {
+        throw NotSupported("Reactions are not supported by ECMCSimulator.");
+    }
+
+    prepare();
+
+    if (chain_length_ <= 0)
+    {
+        Real rmin(std::numeric_limits<Real>::infinity());
+        for (std::vector<size_t>::const_iterator i(mobiles_.begin()); i != mobiles_.end(); ++i)
+        {
+            // a longer chain is mostly rejected at constraint radii.
+            const Particle& p((*world_).space()._get_particle(*i).second);
+            rmin = std::min(rmin, std::min(p.radius(), p.constraint_radius()));
+        }
+        chain_length_ = (mobiles_.empty() ? 0.0 : rmin);
+    }
+
+    if (!dt_set_by_user_)
+    {
+        dt_ = (mobiles_.empty()
+            ? std::numeric_limits<Real>::infinity()
+            : 1.0 / mobiles_.size());
+    }
+
+    reset_stats();
+}
+
+void ECMCSimulator::prepare()
+{
+    const ParticleSpaceCellListImpl* space(
+        dynamic_cast<const ParticleSpaceCellListImpl*>(&(*world_).space()));
+    if (space == NULL)
+    {
+        throw IllegalArgument("ECMCSimulator needs a world with ParticleSpaceCellListImpl.");
+    }
+
+    mobiles_.clear();
+    Real rmax(0.0);
+    for (size_t i(0); i < static_cast<size_t>((*space).num_particles()); ++i)
+    {
+        const Particle& p((*space)._get_particle(i).second);
+        rmax = std::max(rmax, p.radius());
+        if (p.D() != 0)
+        {
+            mobiles_.push_back(i);
+        }
+    }
+
+    // a particle out of the neighboring cells is farther than a cell from the center of a search.
+    const Real3& cell_sizes((*space).cell_sizes());
+    const Real cell_size(std::min(std::min(cell_sizes[0], cell_sizes[1]), cell_sizes[2]));
+    reach_ = 2 * (cell_size - 2 * rmax);
+    if (!mobiles_.empty() && reach_ <= 0)
+    {
+        throw_exception<IllegalArgument>(
+            "Cells [", cell_size, "] must be larger than the diameter of particles [",
+            2 * rmax, "] for ECMCSimulator.");
+    }
+}
+
+void ECMCSimulator::step()
+{
+    const Real t0(t()), dt0(dt());
+
+    if (!mobiles_.empty() && chain_length_ > 0)
+    {
+        run_chain(chain_length_);
+    }
+    ECELL4_BD_STATS(++stats_.num_steps);
+
+    set_t(t0 + dt0);
+    num_steps_++;
+}
+
+bool ECMCSimulator::step(const Real& upto)
+{
+    const Real t0(t()), dt0(dt()), tnext(next_time());
+
+    if (upto <= t0)
+    {
+        return false;
+    }
+
+    if (upto >= tnext)
+    {
+        step();
+        return true;
+    }
+
+    if (!mobiles_.empty() && chain_length_ > 0)
+    {
+        run_chain(chain_length_ * (upto - t0) / dt0);
+    }
+    ECELL4_BD_STATS(++stats_.num_steps);
+
+    set_t(upto);
+    num_steps_++;
+    return false;
+}
+
+bool ECMCSimulator::run_chain(const Real length)
+{
+    ParticleSpaceCellListImpl& space(
+        static_cast<ParticleSpaceCellListImpl&>((*world_).space()));
+    RandomNumberGenerator& rng(*(*world_).rng());
+    const Real3& edge_lengths(space.edge_lengths());
+
+    ECELL4_BD_STATS(++stats_.attempted);
+    ECELL4_BD_STATS(uint64_t tick(read_ticks()));
+
+    const size_t first(mobiles_[rng.uniform_int(0, mobiles_.size() - 1)]);
+    const Integer direction(rng.uniform_int(0, 5));
+    const Real3::size_type axis(direction % 3);
+    const Real sign(direction < 3 ? +1.0 : -1.0);
+
+    ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_rng, tick));
+
+    moved_.clear();
+    std::pair<ParticleID, Particle> active(space._get_particle(first));
+    Real rest(length);
+    bool rejected(false);
+
+    while (true)
+    {
+        const ParticleID& pid(active.first);
+        const Particle& particle(active.second);
+
+        // find the first particle hit in the rest, a search for each reach.
+        Real moved(0.0);
+        std::pair<ParticleID, Particle> hit;
+        bool has_hit(false);
+        while (moved < rest && !has_hit)
+        {
+            const Real h(std::min(rest - moved, reach_));
+            Real3 from(particle.position());
+            from[axis] += sign * moved;
+            from = space.apply_boundary(from);
+            Real3 center(from);
+            center[axis] += sign * h * 0.5;
+
+            const std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+                neighbors(space.list_particles_within_radius(
+                    space.apply_boundary(center), h * 0.5 + particle.radius(), pid));
+
+            Real best(h);
+            for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+                j(neighbors.begin()); j != neighbors.end(); ++j)
+            {
+                const Particle& other((*j).first.second);
+                const Real3 d(subtract(space.periodic_transpose(other.position(), from), from));
+                const Real along(sign * d[axis]);
+                if (along <= 0)
+                {
+                    continue;  // behind
+                }
+
+                const Real R(particle.radius() + other.radius());
+                const Real perp_sq(length_sq(d) - d[axis] * d[axis]);
+                if (perp_sq >= R * R)
+                {
+                    continue;  // passing by
+                }
+
+                const Real s(std::max(0.0, along - std::sqrt(R * R - perp_sq)));
+                if (s < best || (s == best && !has_hit))
+                {
+                    best = s;
+                    hit = (*j).first;
+                    has_hit = true;
+                }
+            }
+            moved += best;
+        }
+
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_neighbor_search, tick));
+
+        Real3 newpos_(particle.position());
+        newpos_[axis] += sign * moved;
+
+        const Real constraint_radius(particle.constraint_radius());
+        if (length_sq(subtract(add(newpos_, particle.stride()), particle.original_position()))
+            > constraint_radius * constraint_radius)
+        {
+            ECELL4_BD_STATS(++stats_.rejected_constraint);
+            rejected = true;
+            break;
+        }
+
+        const Real3 newpos(space.apply_boundary(newpos_));
+        const policy_type::rejection_type
+            test(policy_.test(particle, newpos_, newpos, edge_lengths));
+        if (test != policy_type::ACCEPTED)
+        {
+            if (test == policy_type::REJECTED_LAYER)
+            {
+                ECELL4_BD_STATS(++stats_.rejected_layer);
+            }
+            else
+            {
+                ECELL4_BD_STATS(++stats_.rejected_wall);
+            }
+            rejected = true;
+            break;
+        }
+
+        if (has_hit && hit.second.D() == 0)
+        {
+            ECELL4_BD_STATS(++stats_.rejected_overlap);
+            rejected = true;
+            break;
+        }
+
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+
+        moved_.push_back(active);
+        space.update_particle(pid, Particle(
+            particle.species(), newpos,
+            particle.radius(), particle.D(), particle.constraint_radius(),
+            add(particle.stride(), subtract(newpos_, newpos)),
+            particle.original_position()));
+        rest -= moved;
+
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_update, tick));
+
+        if (!has_hit)
+        {
+            break;  // the whole length is spent
+        }
+
+        // hand the rest over to the particle hit
+        active = space.get_particle(hit.first);
+    }
+
+    if (rejected)
+    {
+        // undo moves in the reverse order
+        for (std::vector<std::pair<ParticleID, Particle> >::const_reverse_iterator
+            i(moved_.rbegin()); i != moved_.rend(); ++i)
+        {
+            space.update_particle((*i).first, (*i).second);
+        }
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_update, tick));
+        return false;
+    }
+
+    ECELL4_BD_STATS(++stats_.accepted);
+    return true;
+}
+
+void ECMCSimulator::save_binary(std::ostream& out) const
+{
+    binary_io::write_header(out, "ECELL4ECMCSIMULATOR", 1);
+    (*world_).save_binary(out);
+
+    binary_io::write(out, dt_);
+    binary_io::write(out, static_cast<uint8_t>(dt_set_by_user_));
+    binary_io::write(out, num_steps_);
+    binary_io::write(out, chain_length_);
+}
+
+void ECMCSimulator::load_binary(std::istream& in)
+{
+    binary_io::read_header(in, "ECELL4ECMCSIMULATOR", 1);
+    (*world_).load_binary(in);
+
+    binary_io::read(in, dt_);
+    dt_set_by_user_ = (binary_io::read<uint8_t>(in) != 0);
+    binary_io::read(in, num_steps_);
+    binary_io::read(in, chain_length_);
+
+    prepare();
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,180 @@
+#ifndef ECELL4_BD_ECMC_SIMULATOR_HPP
+#define ECELL4_BD_ECMC_SIMULATOR_HPP
+
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "./Model.hpp"
+#include "./SimulatorBase.hpp"
+
+#include "BDWorld.hpp"
+#include "Statistics.hpp"
+#include "DoubleLayerPolicy.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * the event-chain Monte Carlo simulator of hard spheres in BDWorld.
+ * it samples the same equilibrium ensemble as BDSimulator, without the dynamics.
+ * a step is a chain: a mobile particle chosen at random moves along one of
+ * the six directions, and hands the rest of the chain length over to the
+ * particle it hits, until the whole length is spent.
+ * a chain is rejected as a whole if a particle breaks its constraint radius
+ * or the boundary conditions of the policy, or hits an immobile particle.
+ * the policy must accept a convex region for each particle,
+ * as DoubleLayerPolicy does, so that testing the end of each move suffices.
+ * with directions of both signs, a chain is undone by the reverse chain from
+ * the last particle, and thus the detailed balance holds.
+ * the time is just a counter advancing dt per chain. no encounters are recorded.
+ * initialize throws NotSupported for a model with reaction rules.
+ * statistics are counted per chain in BDStatistics, where rejected_overlap
+ * means a chain blocked by an immobile particle.
+ */
+class ECMCSimulator
+    : public SimulatorBase<BDWorld>
+{
+public:
+
+    typedef SimulatorBase<BDWorld> base_type;
+    typedef DoubleLayerPolicy policy_type;
+
+public:
+
+    /**
+     * @param chain_length the total displacement of a chain.
+     *  the smallest radius, or constraint radius, of mobile particles if zero.
+     */
+    ECMCSimulator(
+        std::shared_ptr<BDWorld> world, std::shared_ptr<Model> model,
+        Real chain_length = 0.0)
+        : base_type(world, model), dt_(0), chain_length_(chain_length), dt_set_by_user_(false)
+    {
+        initialize();
+    }
+
+    ECMCSimulator(std::shared_ptr<BDWorld> world, Real chain_length = 0.0)
+        : base_type(world), dt_(0), chain_length_(chain_length), dt_set_by_user_(false)
+    {
+        initialize();
+    }
+
+    // SimulatorTraits
+    void initialize();
+
+    /**
+     * @return the time per chain. by default, a unit time is as many chains as mobile particles.
+     */
+    Real dt() const
+    {
+        return dt_;
+    }
+
+    void set_dt(const Real& dt)
+    {
+        if (dt <= 0)
+        {
+            throw std::invalid_argument("The step size must be positive.");
+        }
+        dt_ = dt;
+        dt_set_by_user_ = true;
+    }
+
+    Real chain_length() const
+    {
+        return chain_length_;
+    }
+
+    void set_chain_length(const Real& chain_length)
+    {
+        if (chain_length <= 0)
+        {
+            throw std::invalid_argument("The chain length must be positive.");
+        }
+        chain_length_ = chain_length;
+    }
+
+    /**
+     * run a chain.
+     */
+    void step();
+
+    /**
+     * run a chain, shortened in proportion if it would pass upto.
+     */
+    bool step(const Real& upto);
+
+    inline std::shared_ptr<RandomNumberGenerator> rng()
+    {
+        return (*world_).rng();
+    }
+
+    policy_type& policy()
+    {
+        return policy_;
+    }
+
+    const policy_type& policy() const
+    {
+        return policy_;
+    }
+
+    /**
+     * save/load the world and the internal state of the simulator
+     * in the dependency-free binary format.
+     */
+    void save_binary(std::ostream& out) const;
+    void load_binary(std::istream& in);
+
+    BDStatistics stats() const
+    {
+        BDStatistics retval(stats_);
+        retval.cell_crossings = (*world_).space_statistics().cell_crossings;
+        retval.candidates_scanned = (*world_).space_statistics().candidates_scanned;
+        return retval;
+    }
+
+    void reset_stats()
+    {
+        stats_.reset();
+        (*world_).reset_space_statistics();
+    }
+
+protected:
+
+    /**
+     * index mobile particles and the length of a move covered by a neighbor search.
+     */
+    void prepare();
+
+    /**
+     * run a chain of the given length.
+     * @return if the chain is accepted or not
+     */
+    bool run_chain(const Real length);
+
+protected:
+
+    Real dt_;
+    Real chain_length_;
+    bool dt_set_by_user_;
+
+    policy_type policy_;
+
+    std::vector<size_t> mobiles_;  // indices of particles with non-zero D
+    Real reach_;  // the longest move tested by a single neighbor search
+
+    std::vector<std::pair<ParticleID, Particle> > moved_;  // states before a chain, for rejection
+    BDStatistics stats_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_ECMC_SIMULATOR_HPP */
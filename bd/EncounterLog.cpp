@@ -0,0 +1,181 @@
+#include "EncounterLog.hpp"
+#include "binary_io.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+static const char* const encounter_log_magic = "ECELL4ENCLOG";
+
+EncounterLog::EncounterLog(
+    const std::string& filename, const int64_t num_records, const std::size_t buffer_size)
+    : filename_(filename), buffer_size_(std::max(buffer_size, static_cast<std::size_t>(1))),
+    num_records_(0)
+{
+    if (num_records < 0)
+    {
+        out_.open(filename_.c_str(), std::ios::binary | std::ios::trunc);
+        if (!out_)
+        {
+            throw_exception<IllegalState>("Failed to open [", filename_, "].");
+        }
+        binary_io::write_header(out_, encounter_log_magic, version);
+    }
+    else
+    {
+        {
+            std::ifstream fin(filename_.c_str(), std::ios::binary);
+            if (!fin)
+            {
+                throw_exception<NotFound>("Failed to open [", filename_, "].");
+            }
+            binary_io::read_header(fin, encounter_log_magic, version);
+        }
+
+        // drop records written after the checkpoint being resumed.
+        const uintmax_t size(header_size + sizeof(encounter_event) * num_records);
+        if (std::filesystem::file_size(filename_) < size)
+        {
+            throw_exception<IllegalState>(
+                "The encounter log [", filename_, "] has less than ", num_records, " records.");
+        }
+        std::filesystem::resize_file(filename_, size);
+
+        out_.open(filename_.c_str(), std::ios::binary | std::ios::app);
+        if (!out_)
+        {
+            throw_exception<IllegalState>("Failed to open [", filename_, "].");
+        }
+        num_records_ = num_records;
+    }
+
+    buffer_.reserve(buffer_size_);
+}
+
+EncounterLog::~EncounterLog()
+{
+    flush();
+}
+
+void EncounterLog::flush()
+{
+    if (buffer_.size() > 0)
+    {
+        out_.write(reinterpret_cast<const char*>(buffer_.data()),
+            sizeof(encounter_event) * buffer_.size());
+        buffer_.clear();
+    }
+    out_.flush();
+
+    if (!out_)
+    {
+        throw_exception<IllegalState>("Failed to write [", filename_, "].");
+    }
+}
+
+EncounterLogReader::EncounterLogReader(const std::string& filename)
+{
+    std::ifstream fin(filename.c_str(), std::ios::binary);
+    if (!fin)
+    {
+        throw_exception<NotFound>("Failed to open [", filename, "].");
+    }
+    binary_io::read_header(fin, encounter_log_magic, EncounterLog::version);
+
+    const uintmax_t size(std::filesystem::file_size(filename) - EncounterLog::header_size);
+    events_.resize(size / sizeof(encounter_event));
+    if (events_.size() > 0)
+    {
+        fin.read(reinterpret_cast<char*>(events_.data()),
+            sizeof(encounter_event) * events_.size());
+        if (!fin)
+        {
+            throw_exception<IllegalState>("Failed to read [", filename, "].");
+        }
+    }
+
+    by_time_.resize(events_.size());
+    for (std::size_t i(0); i < events_.size(); ++i)
+    {
+        by_time_[i] = i;
+
+        const encounter_event& event(events_[i]);
+        by_tracer_[event.tracer_id()].push_back(i);
+        (*by_pair_.insert(std::make_pair(event.tracer_id(), event.crowder_id()),
+            index_list_type()).first).push_back(i);
+    }
+
+    // the end of a contact is recorded after its last observation
+    std::stable_sort(by_time_.begin(), by_time_.end(),
+        [this](const std::size_t i, const std::size_t j)
+        {
+            return events_[i].t < events_[j].t;
+        });
+}
+
+EncounterLogReader::index_list_type
+EncounterLogReader::list_between(const Real t0, const Real t1) const
+{
+    index_list_type::const_iterator first(std::lower_bound(by_time_.begin(), by_time_.end(), t0,
+        [this](const std::size_t i, const Real t)
+        {
+            return events_[i].t < t;
+        }));
+    index_list_type::const_iterator last(std::lower_bound(first, by_time_.end(), t1,
+        [this](const std::size_t i, const Real t)
+        {
+            return events_[i].t < t;
+        }));
+    return index_list_type(first, last);
+}
+
+const EncounterLogReader::index_list_type&
+EncounterLogReader::list_by_tracer(const ParticleID& tracer) const
+{
+    std::unordered_map<ParticleID, index_list_type>::const_iterator i(by_tracer_.find(tracer));
+    return (i != by_tracer_.end() ? (*i).second : empty_);
+}
+
+const EncounterLogReader::index_list_type&
+EncounterLogReader::list_by_pair(const ParticleID& tracer, const ParticleID& crowder) const
+{
+    const index_list_type* found(by_pair_.find(std::make_pair(tracer, crowder)));
+    return (found != NULL ? *found : empty_);
+}
+
+std::vector<ParticleID> EncounterLogReader::list_tracers() const
+{
+    std::vector<ParticleID> retval;
+    retval.reserve(by_tracer_.size());
+    for (std::unordered_map<ParticleID, index_list_type>::const_iterator i(by_tracer_.begin());
+        i != by_tracer_.end(); ++i)
+    {
+        retval.push_back((*i).first);
+    }
+    std::sort(retval.begin(), retval.end());
+    return retval;
+}
+
+std::vector<Real> EncounterLogReader::residence_times(const bool include_censored) const
+{
+    std::vector<Real> retval;
+    for (container_type::const_iterator i(events_.begin()); i != events_.end(); ++i)
+    {
+        if ((*i).kind == encounter_event::CONTACT_END
+            && (include_censored || ((*i).flags & encounter_event::CENSORED) == 0))
+        {
+            retval.push_back((*i).residence);
+        }
+    }
+    return retval;
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,208 @@
+#ifndef ECELL4_BD_ENCOUNTER_LOG_HPP
+#define ECELL4_BD_ENCOUNTER_LOG_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "types.hpp"
+#include "Identifier.hpp"
+#include "PairTable.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a fixed-size record of the binary encounter log.
+ * only serials are recorded, as BDWorld issues ParticleIDs in a single lot.
+ */
+struct encounter_event
+{
+    enum kind_type
+    {
+        FIRST_CONTACT = 0,
+        CONTACT_START = 1,
+        CONTACT_END = 2
+    };
+
+    enum flag_type
+    {
+        NONE = 0,
+        CENSORED = 1  // the contact was still continuing at the end of the run
+    };
+
+    uint32_t kind;
+    uint32_t flags;
+    uint64_t tracer;
+    uint64_t crowder;
+    Real t;  // the time of the event
+    Real residence;  // the duration of the contact for CONTACT_END, zero otherwise
+
+    ParticleID tracer_id() const
+    {
+        return ParticleID(std::make_pair(0, tracer));
+    }
+
+    ParticleID crowder_id() const
+    {
+        return ParticleID(std::make_pair(0, crowder));
+    }
+};
+
+/**
+ * append encounter events to a binary file.
+ * events are buffered in memory, and written in bulk.
+ */
+class EncounterLog
+{
+public:
+
+    static const uint32_t version = 1;
+    static const std::size_t header_size = 12 + sizeof(uint32_t);
+
+public:
+
+    /**
+     * create a new log, or truncate an existing one to num_records records.
+     * @param filename a path to the log file
+     * @param num_records the number of records to keep when resuming a run,
+     *  or -1 to start a new log
+     */
+    EncounterLog(const std::string& filename, const int64_t num_records = -1,
+        const std::size_t buffer_size = 4096);
+    ~EncounterLog();
+
+    const std::string& filename() const
+    {
+        return filename_;
+    }
+
+    /**
+     * @return the number of records including those not flushed yet
+     */
+    uint64_t size() const
+    {
+        return num_records_;
+    }
+
+    void write(const encounter_event& event)
+    {
+        buffer_.push_back(event);
+        ++num_records_;
+        if (buffer_.size() >= buffer_size_)
+        {
+            flush();
+        }
+    }
+
+    void write(const encounter_event::kind_type kind,
+        const ParticleID& tracer, const ParticleID& crowder,
+        const Real t, const Real residence = 0.0,
+        const uint32_t flags = encounter_event::NONE)
+    {
+        encounter_event event;
+        event.kind = kind;
+        event.flags = flags;
+        event.tracer = tracer.serial();
+        event.crowder = crowder.serial();
+        event.t = t;
+        event.residence = residence;
+        write(event);
+    }
+
+    void flush();
+
+protected:
+
+    std::string filename_;
+    std::ofstream out_;
+    std::size_t buffer_size_;
+    std::vector<encounter_event> buffer_;
+    uint64_t num_records_;
+};
+
+/**
+ * load a binary encounter log into memory with indices
+ * by time, by tracer and by tracer-crowder pair.
+ */
+class EncounterLogReader
+{
+public:
+
+    typedef std::vector<encounter_event> container_type;
+    typedef std::vector<std::size_t> index_list_type;
+    typedef PairTable<index_list_type>::key_type pair_type;
+
+public:
+
+    EncounterLogReader(const std::string& filename);
+
+    std::size_t size() const
+    {
+        return events_.size();
+    }
+
+    const container_type& events() const
+    {
+        return events_;
+    }
+
+    const encounter_event& operator[](const std::size_t i) const
+    {
+        return events_[i];
+    }
+
+    /**
+     * @return indices of events within [t0, t1) in time order
+     */
+    index_list_type list_between(const Real t0, const Real t1) const;
+
+    /**
+     * @return indices of events of the given tracer in the order recorded
+     */
+    const index_list_type& list_by_tracer(const ParticleID& tracer) const;
+
+    /**
+     * @return indices of events of the given pair in the order recorded
+     */
+    const index_list_type& list_by_pair(const ParticleID& tracer, const ParticleID& crowder) const;
+
+    /**
+     * @return a list of tracers recorded in the log
+     */
+    std::vector<ParticleID> list_tracers() const;
+
+    /**
+     * @return the number of distinct tracer-crowder pairs in contact
+     */
+    std::size_t num_pairs() const
+    {
+        return by_pair_.size();
+    }
+
+    /**
+     * @return residence times of all contacts
+     * @param include_censored include contacts continuing at the end of the run
+     */
+    std::vector<Real> residence_times(const bool include_censored = false) const;
+
+protected:
+
+    container_type events_;
+    index_list_type by_time_;
+    std::unordered_map<ParticleID, index_list_type> by_tracer_;
+    PairTable<index_list_type> by_pair_;
+    index_list_type empty_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_ENCOUNTER_LOG_HPP */
@@ -0,0 +1,161 @@
+#include "EncounterTracker.hpp"
+#include "binary_io.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+void EncounterTracker::end_contact(
+    const pair_type& pair, encounter_state& state, const uint32_t flags)
+{
+    const Real residence(state.until - state.start);
+    state.residence += residence;
+    state.active = false;
+    if (log_)
+    {
+        (*log_).write(encounter_event::CONTACT_END, pair.first, pair.second,
+            state.until, residence, flags);
+    }
+}
+
+void EncounterTracker::sweep(const Integer step)
+{
+    std::vector<pair_type>::size_type i(0);
+    while (i < active_.size())
+    {
+        encounter_state& state(*table_.find(active_[i]));
+        if (step - state.last_step < gap_)
+        {
+            ++i;
+            continue;
+        }
+
+        end_contact(active_[i], state, encounter_event::NONE);
+        active_[i] = active_.back();
+        active_.pop_back();
+    }
+}
+
+void EncounterTracker::close_all()
+{
+    for (std::vector<pair_type>::const_iterator i(active_.begin()); i != active_.end(); ++i)
+    {
+        end_contact(*i, *table_.find(*i), encounter_event::CENSORED);
+    }
+    active_.clear();
+
+    if (log_)
+    {
+        (*log_).flush();
+    }
+}
+
+void EncounterTracker::insert_first_contact(const pair_type& pair, const Real t)
+{
+    encounter_state state;
+    state.first_contact = t;
+    state.start = t;
+    state.until = t;
+    state.last_step = 0;
+    state.residence = 0.0;
+    state.num_contacts = 1;
+    state.active = false;
+    table_.insert(pair, state);
+}
+
+static inline void write_pair(std::ostream& out, const EncounterTracker::pair_type& pair)
+{
+    binary_io::write(out, pair.first.lot());
+    binary_io::write(out, pair.first.serial());
+    binary_io::write(out, pair.second.lot());
+    binary_io::write(out, pair.second.serial());
+}
+
+static inline EncounterTracker::pair_type read_pair(std::istream& in)
+{
+    EncounterTracker::pair_type pair;
+    binary_io::read(in, pair.first.lot());
+    binary_io::read(in, pair.first.serial());
+    binary_io::read(in, pair.second.lot());
+    binary_io::read(in, pair.second.serial());
+    return pair;
+}
+
+static inline void write_state(std::ostream& out, const encounter_state& state)
+{
+    binary_io::write(out, state.first_contact);
+    binary_io::write(out, state.start);
+    binary_io::write(out, state.until);
+    binary_io::write(out, state.last_step);
+    binary_io::write(out, state.residence);
+    binary_io::write(out, state.num_contacts);
+    binary_io::write(out, static_cast<uint8_t>(state.active));
+}
+
+static inline encounter_state read_state(std::istream& in)
+{
+    encounter_state state;
+    binary_io::read(in, state.first_contact);
+    binary_io::read(in, state.start);
+    binary_io::read(in, state.until);
+    binary_io::read(in, state.last_step);
+    binary_io::read(in, state.residence);
+    binary_io::read(in, state.num_contacts);
+    state.active = (binary_io::read<uint8_t>(in) != 0);
+    return state;
+}
+
+void EncounterTracker::save_binary(std::ostream& out) const
+{
+    if (log_)
+    {
+        (*log_).flush();
+    }
+
+    binary_io::write(out, gap_);
+    binary_io::write(out, static_cast<uint64_t>(log_ ? (*log_).size() : 0));
+
+    binary_io::write(out, static_cast<uint64_t>(table_.size()));
+    for (table_type::const_iterator i(table_.begin()); i != table_.end(); ++i)
+    {
+        write_pair(out, (*i).key);
+        write_state(out, (*i).value);
+    }
+
+    // the order of active contacts determines the order of log records.
+    binary_io::write(out, static_cast<uint64_t>(active_.size()));
+    for (std::vector<pair_type>::const_iterator i(active_.begin()); i != active_.end(); ++i)
+    {
+        write_pair(out, *i);
+    }
+}
+
+void EncounterTracker::load_binary(std::istream& in, const bool raw_states)
+{
+    clear();
+
+    binary_io::read(in, gap_);
+    binary_io::read(in, num_logged_);
+
+    const uint64_t num_pairs(binary_io::read<uint64_t>(in));
+    for (uint64_t i(0); i < num_pairs; ++i)
+    {
+        const pair_type pair(read_pair(in));
+        // older checkpoints dumped the struct as laid out in memory.
+        table_.insert(pair, raw_states ? binary_io::read<encounter_state>(in) : read_state(in));
+    }
+
+    const uint64_t num_active(binary_io::read<uint64_t>(in));
+    active_.reserve(num_active);
+    for (uint64_t i(0); i < num_active; ++i)
+    {
+        active_.push_back(read_pair(in));
+    }
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,186 @@
+#ifndef ECELL4_BD_ENCOUNTER_TRACKER_HPP
+#define ECELL4_BD_ENCOUNTER_TRACKER_HPP
+
+#include <vector>
+#include <memory>
+#include <istream>
+#include <ostream>
+
+#include "types.hpp"
+#include "Identifier.hpp"
+#include "PairTable.hpp"
+#include "EncounterLog.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * the contact history of a tracer-crowder pair.
+ */
+struct encounter_state
+{
+    Real first_contact;  // the time of the first contact
+    Real start;  // the start of the current, or last, contact
+    Real until;  // the end of the step in which the pair was last observed
+    Integer last_step;  // the step in which the pair was last observed
+    Real residence;  // the total residence time of finished contacts
+    uint32_t num_contacts;
+    bool active;
+};
+
+/**
+ * track every contact of tracer-crowder pairs.
+ * a contact starts when a move of either particle is rejected by the other,
+ * and ends when the pair is not observed for gap steps.
+ * the residence time of a contact is from the start of the step observing it first
+ * to the end of the step observing it last.
+ */
+class EncounterTracker
+{
+public:
+
+    typedef PairTable<encounter_state> table_type;
+    typedef table_type::key_type pair_type;
+
+public:
+
+    EncounterTracker(const Integer gap = 1)
+        : gap_(gap), num_logged_(0)
+    {
+        ;
+    }
+
+    Integer gap() const
+    {
+        return gap_;
+    }
+
+    void set_gap(const Integer gap)
+    {
+        gap_ = gap;
+    }
+
+    const table_type& table() const
+    {
+        return table_;
+    }
+
+    std::size_t num_active() const
+    {
+        return active_.size();
+    }
+
+    void set_log(const std::shared_ptr<EncounterLog>& log)
+    {
+        log_ = log;
+    }
+
+    const std::shared_ptr<EncounterLog>& log() const
+    {
+        return log_;
+    }
+
+    /**
+     * record a contact of the pair in the step [t, t + dt).
+     * @return true if this is the first contact of the pair
+     */
+    inline bool observe(const pair_type& pair, const Real t, const Real dt, const Integer step)
+    {
+        encounter_state initial;
+        initial.first_contact = t;
+        initial.start = t;
+        initial.until = t + dt;
+        initial.last_step = step;
+        initial.residence = 0.0;
+        initial.num_contacts = 1;
+        initial.active = true;
+
+        std::pair<encounter_state*, bool> retval(table_.insert(pair, initial));
+        if (retval.second)
+        {
+            active_.push_back(pair);
+            if (log_)
+            {
+                (*log_).write(encounter_event::FIRST_CONTACT, pair.first, pair.second, t);
+                (*log_).write(encounter_event::CONTACT_START, pair.first, pair.second, t);
+            }
+            return true;
+        }
+
+        encounter_state& state(*retval.first);
+        if (!state.active)
+        {
+            state.start = t;
+            state.num_contacts += 1;
+            state.active = true;
+            active_.push_back(pair);
+            if (log_)
+            {
+                (*log_).write(encounter_event::CONTACT_START, pair.first, pair.second, t);
+            }
+        }
+        state.until = t + dt;
+        state.last_step = step;
+        return false;
+    }
+
+    /**
+     * end contacts not observed for gap steps. call this once at the end of each step.
+     */
+    void sweep(const Integer step);
+
+    /**
+     * end all contacts, e.g. at the end of a run.
+     * they are logged as censored.
+     */
+    void close_all();
+
+    void clear()
+    {
+        table_.clear();
+        active_.clear();
+    }
+
+    /**
+     * save/load the contact history. the log is flushed on save,
+     * and the number of records logged is kept for resuming the log.
+     * raw_states reads the states written as raw structs (before version 4).
+     */
+    void save_binary(std::ostream& out) const;
+    void load_binary(std::istream& in, const bool raw_states = false);
+
+    /**
+     * @return the number of log records at the checkpoint last loaded
+     */
+    uint64_t num_logged() const
+    {
+        return num_logged_;
+    }
+
+    /**
+     * restore first contacts from the format of BDSimulator version 1.
+     */
+    void insert_first_contact(const pair_type& pair, const Real t);
+
+protected:
+
+    void end_contact(const pair_type& pair, encounter_state& state, const uint32_t flags);
+
+protected:
+
+    Integer gap_;
+    table_type table_;
+    std::vector<pair_type> active_;
+    std::shared_ptr<EncounterLog> log_;
+    uint64_t num_logged_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_ENCOUNTER_TRACKER_HPP */
@@ -0,0 +1,166 @@
+#include "InteractionTable.hpp"
+
+#include <algorithm>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+const InteractionTable::index_type InteractionTable::max_cell_classes;
+
+void InteractionTable::set(
+    const Species& sp1, const Species& sp2, const interaction_type interaction)
+{
+    if (interaction > (EXCLUDE | ENCOUNTER))
+    {
+        throw_exception<IllegalArgument>(
+            "The interaction [", static_cast<int>(interaction), "] is not one of IGNORE, EXCLUDE and ENCOUNTER.");
+    }
+
+    given_[sp1.serial()][sp2.serial()] = interaction;
+    given_[sp2.serial()][sp1.serial()] = interaction;
+    compile_defaults();
+}
+
+void InteractionTable::compile_defaults()
+{
+    species_classes_.clear();
+    cell_classes_.clear();
+    constrained_.assign(2, false);
+    constrained_[1] = true;
+    representatives_.assign(2, Species::serial_type());
+
+    table_.resize(4);
+    for (index_type c1(0); c1 < 2; ++c1)
+    {
+        for (index_type c2(0); c2 < 2; ++c2)
+        {
+            table_[c1 * 2 + c2] = compile_interaction(c1, c2);
+        }
+    }
+    masks_.assign(2, ~static_cast<uint64_t>(0));
+    partitioned_ = false;
+}
+
+InteractionTable::interaction_type InteractionTable::compile_interaction(
+    const index_type c1, const index_type c2) const
+{
+    interaction_type retval(EXCLUDE | (constrained_[c1] != constrained_[c2] ? ENCOUNTER : 0));
+
+    // a species given nothing has nothing given with others.
+    std::map<Species::serial_type, row_type>::const_iterator i(given_.find(representatives_[c1]));
+    if (i != given_.end())
+    {
+        row_type::const_iterator j((*i).second.find(representatives_[c2]));
+        if (j != (*i).second.end())
+        {
+            retval = (*j).second;
+        }
+    }
+
+    if (constrained_[c1] == constrained_[c2])
+    {
+        retval |= ORDER_BY_ID;
+    }
+    else if (constrained_[c2])
+    {
+        retval |= ORDER_SWAPPED;
+    }
+    return retval;
+}
+
+void InteractionTable::compile(const Model& model, const BDWorld& world, const ReactionTable& reactions)
+{
+    compile_defaults();
+    if (given_.empty())
+    {
+        return;
+    }
+
+    // species known, sorted to number classes in a fixed order.
+    std::map<Species::serial_type, bool> species;
+    for (Model::species_container_type::const_iterator i(model.species_attributes().begin());
+        i != model.species_attributes().end(); ++i)
+    {
+        species.insert(std::make_pair((*i).serial(), false));
+    }
+    const std::vector<Species> in_world(world.list_species());
+    for (std::vector<Species>::const_iterator i(in_world.begin()); i != in_world.end(); ++i)
+    {
+        species.insert(std::make_pair((*i).serial(), false));
+    }
+    for (ReactionTable::index_type i(0); i < reactions.num_species(); ++i)
+    {
+        species.insert(std::make_pair(reactions.species_info(i).species.serial(), false));
+    }
+    for (std::map<Species::serial_type, row_type>::const_iterator i(given_.begin());
+        i != given_.end(); ++i)
+    {
+        species.insert(std::make_pair((*i).first, false));
+    }
+    for (std::map<Species::serial_type, bool>::iterator i(species.begin()); i != species.end(); ++i)
+    {
+        (*i).second = (world.get_molecule_info(Species((*i).first)).constraint_radius
+            != std::numeric_limits<Real>::infinity());
+    }
+
+    std::map<std::pair<bool, row_type>, index_type> classes;
+    for (std::map<Species::serial_type, bool>::const_iterator i(species.begin()); i != species.end(); ++i)
+    {
+        std::map<Species::serial_type, row_type>::const_iterator row(given_.find((*i).first));
+        if (row == given_.end())
+        {
+            species_classes_[(*i).first] = ((*i).second ? 1 : 0);
+            continue;
+        }
+
+        const std::pair<std::map<std::pair<bool, row_type>, index_type>::iterator, bool>
+            inserted(classes.insert(std::make_pair(
+                std::make_pair((*i).second, (*row).second), constrained_.size())));
+        if (inserted.second)
+        {
+            constrained_.push_back((*i).second);
+            representatives_.push_back((*i).first);
+        }
+        species_classes_[(*i).first] = (*inserted.first).second;
+    }
+
+    const index_type n(num_classes());
+    bool ignored(false);
+    table_.resize(n * n);
+    for (index_type c1(0); c1 < n; ++c1)
+    {
+        for (index_type c2(0); c2 < n; ++c2)
+        {
+            table_[c1 * n + c2] = compile_interaction(c1, c2);
+            ignored |= ((table_[c1 * n + c2] & (EXCLUDE | ENCOUNTER)) == IGNORE);
+        }
+    }
+
+    partitioned_ = (ignored && n <= max_cell_classes);
+    masks_.assign(n, ~static_cast<uint64_t>(0));
+    if (!partitioned_)
+    {
+        return;
+    }
+
+    cell_classes_ = species_classes_;
+    for (index_type c1(0); c1 < n; ++c1)
+    {
+        masks_[c1] = 0;
+        for (index_type c2(0); c2 < n; ++c2)
+        {
+            if ((table_[c1 * n + c2] & (EXCLUDE | ENCOUNTER)) != IGNORE)
+            {
+                masks_[c1] |= (static_cast<uint64_t>(1) << c2);
+            }
+        }
+    }
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,192 @@
+#ifndef ECELL4_BD_INTERACTION_TABLE_HPP
+#define ECELL4_BD_INTERACTION_TABLE_HPP
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <limits>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "./types.hpp"
+#include "./Model.hpp"
+#include "BDWorld.hpp"
+#include "ReactionTable.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * how pairs of species interact on an overlap in BDSimulatorT, compiled into
+ * a dense table over classes of species.
+ * EXCLUDE rejects a move overlapping with the other, and ENCOUNTER records the
+ * encounter of the pair. a pair with neither passes through each other unnoticed.
+ * ENCOUNTER without EXCLUDE is for ghost tracers, which only report encounters.
+ * a pair not given excludes each other, and is also an encounter if only one
+ * of them is constrained, where the constrained one comes first.
+ * species with the same interactions and the same constraint share a class.
+ * the classes 0 and 1 are of unconstrained and constrained species given nothing,
+ * including those unknown at compile.
+ * when a pair of classes ignores each other, the table partitions cells of the
+ * space by classes, so that a neighbor search never visits classes ignored.
+ */
+class InteractionTable
+{
+public:
+
+    typedef std::size_t index_type;
+    typedef uint8_t interaction_type;
+
+    enum
+    {
+        IGNORE = 0,
+        EXCLUDE = 1,
+        ENCOUNTER = 2
+    };
+
+    enum
+    {
+        // the order of a pair of an encounter, added to interactions in the table.
+        ORDER_SWAPPED = 4,  // the other first
+        ORDER_BY_ID = 8  // the smaller ID first
+    };
+
+    /**
+     * the largest number of classes to partition cells
+     */
+    static const index_type max_cell_classes = 64;
+
+    typedef std::unordered_map<Species::serial_type, index_type> class_map_type;
+
+public:
+
+    InteractionTable()
+    {
+        compile_defaults();
+    }
+
+    /**
+     * set the interaction of a pair of species, in both orders.
+     * the table is to be compiled again.
+     */
+    void set(const Species& sp1, const Species& sp2, const interaction_type interaction);
+
+    /**
+     * forget interactions given by set.
+     */
+    void clear()
+    {
+        given_.clear();
+        compile_defaults();
+    }
+
+    bool empty() const
+    {
+        return given_.empty();
+    }
+
+    /**
+     * compile interactions over species of the model, the world and reactions.
+     * constraints of species are given by the world.
+     */
+    void compile(const Model& model, const BDWorld& world, const ReactionTable& reactions);
+
+    index_type num_classes() const
+    {
+        return constrained_.size();
+    }
+
+    index_type class_of(const Particle& p) const
+    {
+        const index_type retval(
+            p.constraint_radius() != std::numeric_limits<Real>::infinity() ? 1 : 0);
+        if (given_.empty())
+        {
+            return retval;
+        }
+        class_map_type::const_iterator i(species_classes_.find(p.species_serial()));
+        return (i != species_classes_.end() ? (*i).second : retval);
+    }
+
+    /**
+     * @return the interaction of the class c1 with c2, with bits of the order
+     */
+    interaction_type interaction(const index_type c1, const index_type c2) const
+    {
+        return table_[c1 * num_classes() + c2];
+    }
+
+    /**
+     * @return bits of classes interacting with the class c, all if cells are not partitioned
+     */
+    uint64_t class_mask(const index_type c) const
+    {
+        return masks_[c];
+    }
+
+    /**
+     * @return if cells are partitioned by classes
+     */
+    bool partitioned() const
+    {
+        return partitioned_;
+    }
+
+    /**
+     * @return classes of species known at compile, empty unless partitioned
+     */
+    const class_map_type& cell_classes() const
+    {
+        return cell_classes_;
+    }
+
+    /**
+     * @return a pair of an encounter of the particle pid with other, in the order of interaction
+     */
+    static std::pair<ParticleID, ParticleID> encounter_pair(
+        const interaction_type interaction, const ParticleID& pid, const ParticleID& other)
+    {
+        if ((interaction & ORDER_SWAPPED)
+            || ((interaction & ORDER_BY_ID) && other < pid))
+        {
+            return std::make_pair(other, pid);
+        }
+        return std::make_pair(pid, other);
+    }
+
+protected:
+
+    /**
+     * reset to the classes 0 and 1 only.
+     */
+    void compile_defaults();
+
+    /**
+     * @return the interaction of a pair of classes with bits of the order
+     */
+    interaction_type compile_interaction(const index_type c1, const index_type c2) const;
+
+protected:
+
+    // rows are sorted, and so compared as keys of classes.
+    typedef std::map<Species::serial_type, interaction_type> row_type;
+    std::map<Species::serial_type, row_type> given_;
+
+    class_map_type species_classes_;
+    class_map_type cell_classes_;
+    std::vector<bool> constrained_;  // by class
+    std::vector<Species::serial_type> representatives_;  // a species by class, empty for the classes 0 and 1
+    std::vector<interaction_type> table_;
+    std::vector<uint64_t> masks_;
+    bool partitioned_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_INTERACTION_TABLE_HPP */
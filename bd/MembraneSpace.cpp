@@ -0,0 +1,300 @@
+#include "MembraneSpace.hpp"
+#include "binary_io.hpp"
+#include "exceptions.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+MembraneSpace::MembraneSpace(const std::string& location, const PlanarSurface& surface,
+    const Real3& edge_lengths, const Integer num_cols, const Integer num_rows)
+    : location_(location), surface_(surface), edge_lengths_(edge_lengths),
+    num_cols_(num_cols), num_rows_(num_rows)
+{
+    reset();
+}
+
+void MembraneSpace::reset()
+{
+    lengths_[0] = length(surface_.e0());
+    lengths_[1] = length(surface_.e1());
+    if (lengths_[0] <= 0 || lengths_[1] <= 0)
+    {
+        throw_exception<IllegalArgument>("The edges of a membrane must not be zero.");
+    }
+    units_[0] = surface_.e0() / lengths_[0];
+    units_[1] = surface_.e1() / lengths_[1];
+    units_[2] = surface_.normal();
+    if (std::fabs(dot_product(units_[0], units_[1])) > 1e-9)
+    {
+        throw_exception<IllegalArgument>("The edges of a membrane must be orthogonal.");
+    }
+    if (num_cols_ <= 0 || num_rows_ <= 0)
+    {
+        throw_exception<IllegalArgument>(
+            "The number of cells [", num_cols_, " x ", num_rows_, "] must be positive.");
+    }
+
+    center_ = surface_.origin() + (surface_.e0() + surface_.e1()) * 0.5;
+    cell_widths_[0] = lengths_[0] / num_cols_;
+    cell_widths_[1] = lengths_[1] / num_rows_;
+    max_radius_ = 0.0;
+
+    particles_.clear();
+    index_.clear();
+    cell_of_.clear();
+    cells_.assign(num_cols_ * num_rows_, std::vector<uint32_t>());
+}
+
+Real3 MembraneSpace::to_internal(const Real3& pos) const
+{
+    Real3 d(pos - center_);
+    for (unsigned int i(0); i < 3; ++i)
+    {
+        d[i] -= edge_lengths_[i] * std::floor(d[i] / edge_lengths_[i] + 0.5);
+    }
+    return Real3(dot_product(d, units_[0]), dot_product(d, units_[1]), dot_product(d, units_[2]));
+}
+
+Real3 MembraneSpace::project(const Real3& pos) const
+{
+    const Real3 q(to_internal(pos));
+    return apply_boundary(center_ + units_[0] * q[0] + units_[1] * q[1]);
+}
+
+Real3 MembraneSpace::apply_boundary(const Real3& pos) const
+{
+    const Real3 d(pos - surface_.origin());
+    Real u(dot_product(d, units_[0])), v(dot_product(d, units_[1]));
+    u -= lengths_[0] * std::floor(u / lengths_[0]);
+    v -= lengths_[1] * std::floor(v / lengths_[1]);
+    return surface_.origin() + units_[0] * u + units_[1] * v;
+}
+
+std::size_t MembraneSpace::cell_index(const Real u, const Real v) const
+{
+    // u and v are from the origin, in the rectangle.
+    const Integer i(std::min(std::max(static_cast<Integer>(u / cell_widths_[0]), Integer(0)), num_cols_ - 1));
+    const Integer j(std::min(std::max(static_cast<Integer>(v / cell_widths_[1]), Integer(0)), num_rows_ - 1));
+    return i * num_rows_ + j;
+}
+
+Integer MembraneSpace::num_molecules(const Species& sp) const
+{
+    return num_molecules_exact(sp);
+}
+
+Integer MembraneSpace::num_molecules_exact(const Species& sp) const
+{
+    Integer retval(0);
+    for (particle_container_type::const_iterator i(particles_.begin()); i != particles_.end(); ++i)
+    {
+        retval += ((*i).second.species_serial() == sp.serial() ? 1 : 0);
+    }
+    return retval;
+}
+
+std::pair<ParticleID, Particle> MembraneSpace::get_particle(const ParticleID& pid) const
+{
+    std::unordered_map<ParticleID, std::size_t>::const_iterator i(index_.find(pid));
+    if (i == index_.end())
+    {
+        throw_exception<NotFound>("No such particle [", pid, "] on the membrane [", location_, "].");
+    }
+    return particles_[(*i).second];
+}
+
+std::vector<std::pair<ParticleID, Particle> > MembraneSpace::list_particles(const Species& sp) const
+{
+    std::vector<std::pair<ParticleID, Particle> > retval;
+    for (particle_container_type::const_iterator i(particles_.begin()); i != particles_.end(); ++i)
+    {
+        if ((*i).second.species_serial() == sp.serial())
+        {
+            retval.push_back(*i);
+        }
+    }
+    return retval;
+}
+
+bool MembraneSpace::update_particle(const ParticleID& pid, const Particle& p)
+{
+    std::pair<ParticleID, Particle> pair(pid, p);
+    pair.second.position() = project(p.position());
+    pair.second.location() = location_;
+    max_radius_ = std::max(max_radius_, p.radius());
+
+    const Real3 d(pair.second.position() - surface_.origin());
+    const std::size_t cell(cell_index(dot_product(d, units_[0]), dot_product(d, units_[1])));
+
+    std::unordered_map<ParticleID, std::size_t>::const_iterator i(index_.find(pid));
+    if (i != index_.end())
+    {
+        const std::size_t idx((*i).second);
+        particles_[idx] = pair;
+        if (cell_of_[idx] != cell)
+        {
+            std::vector<uint32_t>& from(cells_[cell_of_[idx]]);
+            from.erase(std::find(from.begin(), from.end(), static_cast<uint32_t>(idx)));
+            cells_[cell].push_back(static_cast<uint32_t>(idx));
+            cell_of_[idx] = cell;
+        }
+        return false;
+    }
+
+    const std::size_t idx(particles_.size());
+    particles_.push_back(pair);
+    index_[pid] = idx;
+    cell_of_.push_back(cell);
+    cells_[cell].push_back(static_cast<uint32_t>(idx));
+    return true;
+}
+
+void MembraneSpace::remove_particle(const ParticleID& pid)
+{
+    std::unordered_map<ParticleID, std::size_t>::iterator i(index_.find(pid));
+    if (i == index_.end())
+    {
+        throw_exception<NotFound>("No such particle [", pid, "] on the membrane [", location_, "].");
+    }
+
+    // move the last into the hole.
+    const std::size_t idx((*i).second), last(particles_.size() - 1);
+    index_.erase(i);
+    std::vector<uint32_t>& c(cells_[cell_of_[idx]]);
+    c.erase(std::find(c.begin(), c.end(), static_cast<uint32_t>(idx)));
+    if (idx != last)
+    {
+        particles_[idx] = particles_[last];
+        cell_of_[idx] = cell_of_[last];
+        index_[particles_[idx].first] = idx;
+        std::vector<uint32_t>& moved(cells_[cell_of_[idx]]);
+        *std::find(moved.begin(), moved.end(), static_cast<uint32_t>(last)) = static_cast<uint32_t>(idx);
+    }
+    particles_.pop_back();
+    cell_of_.pop_back();
+}
+
+void MembraneSpace::list_particles_within_radius(
+    const Real3& pos, const Real& radius, const ParticleID& ignore,
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >& retval) const
+{
+    if (particles_.empty())
+    {
+        return;
+    }
+
+    const Real3 q(to_internal(pos));
+    const Real reach(radius + max_radius_);
+    if (std::fabs(q[2]) >= reach)
+    {
+        return;
+    }
+
+    // surface coordinates from the origin, and cells within the reach along each.
+    const Real u(q[0] + lengths_[0] * 0.5), v(q[1] + lengths_[1] * 0.5);
+    const Integer ci(std::min(std::max(static_cast<Integer>(std::floor(u / cell_widths_[0])), Integer(0)), num_cols_ - 1));
+    const Integer cj(std::min(std::max(static_cast<Integer>(std::floor(v / cell_widths_[1])), Integer(0)), num_rows_ - 1));
+    const Integer si(std::min(static_cast<Integer>(std::ceil(reach / cell_widths_[0])), num_cols_ / 2));
+    const Integer sj(std::min(static_cast<Integer>(std::ceil(reach / cell_widths_[1])), num_rows_ / 2));
+    // a span wider than the grid wraps onto itself; visit each cell only once.
+    const Integer ni(std::min(2 * si + 1, num_cols_)), nj(std::min(2 * sj + 1, num_rows_));
+    const Real dnsq(q[2] * q[2]);
+
+    for (Integer di(0); di < ni; ++di)
+    {
+        const Integer i((ci - si + di + num_cols_) % num_cols_);
+        for (Integer dj(0); dj < nj; ++dj)
+        {
+            const Integer j((cj - sj + dj + num_rows_) % num_rows_);
+            const std::vector<uint32_t>& c(cells_[i * num_rows_ + j]);
+            for (std::vector<uint32_t>::const_iterator k(c.begin()); k != c.end(); ++k)
+            {
+                const std::pair<ParticleID, Particle>& other(particles_[*k]);
+                if (other.first == ignore)
+                {
+                    continue;
+                }
+
+                const Real3 d(other.second.position() - surface_.origin());
+                Real du(dot_product(d, units_[0]) - u), dv(dot_product(d, units_[1]) - v);
+                du -= lengths_[0] * std::floor(du / lengths_[0] + 0.5);
+                dv -= lengths_[1] * std::floor(dv / lengths_[1] + 0.5);
+                const Real dist(std::sqrt(du * du + dv * dv + dnsq) - other.second.radius());
+                if (dist < radius)
+                {
+                    retval.push_back(std::make_pair(other, dist));
+                }
+            }
+        }
+    }
+}
+
+void MembraneSpace::save_binary(std::ostream& out) const
+{
+    binary_io::write_header(out, "ECELL4MEMBRANESPACE", 1);
+    binary_io::write(out, location_);
+    binary_io::write(out, surface_.origin());
+    binary_io::write(out, surface_.e0());
+    binary_io::write(out, surface_.e1());
+    binary_io::write(out, edge_lengths_);
+    binary_io::write(out, static_cast<int64_t>(num_cols_));
+    binary_io::write(out, static_cast<int64_t>(num_rows_));
+
+    binary_io::write(out, static_cast<uint64_t>(particles_.size()));
+    for (particle_container_type::const_iterator i(particles_.begin()); i != particles_.end(); ++i)
+    {
+        const ParticleID& pid((*i).first);
+        const Particle& p((*i).second);
+        binary_io::write(out, pid.lot());
+        binary_io::write(out, pid.serial());
+        binary_io::write(out, p.species_serial());
+        binary_io::write(out, p.position());
+        binary_io::write(out, p.stride());
+        binary_io::write(out, p.radius());
+        binary_io::write(out, p.D());
+        binary_io::write(out, p.constraint_radius());
+        binary_io::write(out, p.original_position());
+    }
+}
+
+void MembraneSpace::load_binary(std::istream& in)
+{
+    binary_io::read_header(in, "ECELL4MEMBRANESPACE", 1);
+    binary_io::read(in, location_);
+    const Real3 origin(binary_io::read<Real3>(in));
+    const Real3 e0(binary_io::read<Real3>(in));
+    const Real3 e1(binary_io::read<Real3>(in));
+    surface_ = PlanarSurface(origin, e0, e1);
+    binary_io::read(in, edge_lengths_);
+    num_cols_ = binary_io::read<int64_t>(in);
+    num_rows_ = binary_io::read<int64_t>(in);
+    reset();
+
+    const uint64_t num_particles(binary_io::read<uint64_t>(in));
+    for (uint64_t i(0); i < num_particles; ++i)
+    {
+        ParticleID pid;
+        binary_io::read(in, pid.lot());
+        binary_io::read(in, pid.serial());
+        const std::string serial(binary_io::read<std::string>(in));
+        const Real3 position(binary_io::read<Real3>(in));
+        const Real3 stride(binary_io::read<Real3>(in));
+        const Real radius(binary_io::read<Real>(in));
+        const Real D(binary_io::read<Real>(in));
+        const Real constraint_radius(binary_io::read<Real>(in));
+        const Real3 original_position(binary_io::read<Real3>(in));
+        update_particle(pid, Particle(
+            Species(serial), position, radius, D, constraint_radius, stride, original_position));
+    }
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,178 @@
+#ifndef ECELL4_BD_MEMBRANE_SPACE_HPP
+#define ECELL4_BD_MEMBRANE_SPACE_HPP
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "types.hpp"
+#include "Real3.hpp"
+#include "Particle.hpp"
+#include "PlanarSurface.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a space of particles bound to a planar surface, the rectangle spanned by
+ * orthogonal e0 and e1 of PlanarSurface from its origin.
+ * the rectangle is periodic along e0 and e1, which agrees with the periodic
+ * boundary of the world when they are edges of the world, e.g. a plane normal to x.
+ * particles are indexed by a grid of cells in surface coordinates, and their
+ * positions are kept in the world on the plane.
+ * a query from a point in the world, e.g. a tracer in the bulk, tests the distance
+ * from the plane first, and scans cells of the grid only near the plane.
+ */
+class MembraneSpace
+{
+public:
+
+    typedef std::vector<std::pair<ParticleID, Particle> > particle_container_type;
+
+public:
+
+    /**
+     * @param location the name of the location of particles bound to it
+     * @param edge_lengths the edge lengths of the world, for the minimum image of a point
+     * @param num_cols the number of cells along e0
+     * @param num_rows the number of cells along e1
+     */
+    MembraneSpace(const std::string& location, const PlanarSurface& surface,
+        const Real3& edge_lengths, const Integer num_cols, const Integer num_rows);
+
+    const std::string& location() const
+    {
+        return location_;
+    }
+
+    const PlanarSurface& surface() const
+    {
+        return surface_;
+    }
+
+    /**
+     * @return the area of the rectangle
+     */
+    Real area() const
+    {
+        return lengths_[0] * lengths_[1];
+    }
+
+    /**
+     * @return the point on the plane closest to the minimum image of pos, in the rectangle
+     */
+    Real3 project(const Real3& pos) const;
+
+    /**
+     * @return a point on the plane moved into the rectangle periodically
+     */
+    Real3 apply_boundary(const Real3& pos) const;
+
+    /**
+     * @return the unit vectors along e0 and e1, and the normal
+     */
+    const Real3& unit0() const
+    {
+        return units_[0];
+    }
+
+    const Real3& unit1() const
+    {
+        return units_[1];
+    }
+
+    Integer num_particles() const
+    {
+        return particles_.size();
+    }
+
+    Integer num_molecules(const Species& sp) const;
+    Integer num_molecules_exact(const Species& sp) const;
+
+    bool has_particle(const ParticleID& pid) const
+    {
+        return (index_.find(pid) != index_.end());
+    }
+
+    std::pair<ParticleID, Particle> get_particle(const ParticleID& pid) const;
+
+    std::pair<ParticleID, Particle> const& _get_particle(const std::size_t idx) const
+    {
+        return particles_[idx];
+    }
+
+    const particle_container_type& particles() const
+    {
+        return particles_;
+    }
+
+    std::vector<std::pair<ParticleID, Particle> > list_particles() const
+    {
+        return particles_;
+    }
+
+    std::vector<std::pair<ParticleID, Particle> > list_particles(const Species& sp) const;
+
+    /**
+     * add or move a particle. the position is projected onto the plane,
+     * and the location is set.
+     * @return true if added
+     */
+    bool update_particle(const ParticleID& pid, const Particle& p);
+
+    void remove_particle(const ParticleID& pid);
+
+    /**
+     * list particles overlapping with a sphere at pos in the world,
+     * as ParticleSpace::list_particles_within_radius, appending to retval unsorted.
+     */
+    void list_particles_within_radius(
+        const Real3& pos, const Real& radius, const ParticleID& ignore,
+        std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >& retval) const;
+
+    void save_binary(std::ostream& out) const;
+    void load_binary(std::istream& in);
+
+protected:
+
+    /**
+     * @return the minimum image of pos relative to the center of the rectangle,
+     *  in surface coordinates from the center and the distance from the plane
+     */
+    Real3 to_internal(const Real3& pos) const;
+
+    std::size_t cell_index(const Real u, const Real v) const;
+
+    void reset();
+
+protected:
+
+    std::string location_;
+    PlanarSurface surface_;
+    Real3 edge_lengths_;
+    Integer num_cols_, num_rows_;
+
+    Real3 center_;
+    Real3 units_[3];  // e0, e1 and the normal, normalized
+    Real lengths_[2];
+    Real cell_widths_[2];
+    Real max_radius_;
+
+    particle_container_type particles_;
+    std::unordered_map<ParticleID, std::size_t> index_;
+    std::vector<std::size_t> cell_of_;  // by particle
+    std::vector<std::vector<uint32_t> > cells_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_MEMBRANE_SPACE_HPP */
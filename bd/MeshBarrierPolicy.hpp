@@ -0,0 +1,123 @@
+#ifndef ECELL4_BD_MESH_BARRIER_POLICY_HPP
+#define ECELL4_BD_MESH_BARRIER_POLICY_HPP
+
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+#include "types.hpp"
+#include "exceptions.hpp"
+#include "Real3.hpp"
+#include "Particle.hpp"
+#include "TriangleMesh.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * boundary conditions of walls given by a triangle mesh, e.g. membranes of organelles.
+ * a move of any particle crossing the mesh is rejected, and so a closed mesh
+ * keeps particles on its side. the mesh is repeated periodically, and may lie
+ * across the edges of the world, but must not overlap its own images.
+ * the path of a move is the segment from the particle to the new position
+ * before applying the periodic boundary, tested against the images of the mesh
+ * whose bounding box overlaps that of the path.
+ */
+class MeshBarrierPolicy
+{
+public:
+
+    enum rejection_type
+    {
+        ACCEPTED = 0,
+        REJECTED_LAYER = 1,
+        REJECTED_WALL = 2
+    };
+
+public:
+
+    MeshBarrierPolicy()
+    {
+        ;
+    }
+
+    /**
+     * add walls from a Wavefront OBJ file.
+     */
+    void load_mesh(const std::string& filename)
+    {
+        mesh_.load(filename);
+    }
+
+    /**
+     * add triangles with mesh().add_triangle, then call build.
+     */
+    TriangleMesh& mesh()
+    {
+        return mesh_;
+    }
+
+    const TriangleMesh& mesh() const
+    {
+        return mesh_;
+    }
+
+    /**
+     * @param particle the particle before the move
+     * @param newpos_ the new position before applying the periodic boundary
+     * @param newpos the new position in the world
+     * @param edge_lengths the edge lengths of the world
+     */
+    inline rejection_type test(
+        const Particle& particle, const Real3& newpos_, const Real3& newpos,
+        const Real3& edge_lengths) const
+    {
+        if (mesh_.empty())
+        {
+            return ACCEPTED;
+        }
+        else if (!mesh_.built())
+        {
+            throw IllegalState("The hierarchy of the mesh is not built.");
+        }
+
+        // images of the mesh overlapping the box bounding the path.
+        const Real3& pos(particle.position());
+        Integer lower[3], upper[3];
+        for (unsigned int i(0); i < 3; ++i)
+        {
+            const Real L(edge_lengths[i]);
+            lower[i] = static_cast<Integer>(std::ceil((std::min(pos[i], newpos_[i]) - mesh_.upper()[i]) / L));
+            upper[i] = static_cast<Integer>(std::floor((std::max(pos[i], newpos_[i]) - mesh_.lower()[i]) / L));
+        }
+        for (Integer i(lower[0]); i <= upper[0]; ++i)
+        {
+            for (Integer j(lower[1]); j <= upper[1]; ++j)
+            {
+                for (Integer k(lower[2]); k <= upper[2]; ++k)
+                {
+                    const Real3 shift(i * edge_lengths[0], j * edge_lengths[1], k * edge_lengths[2]);
+                    if (mesh_.test_segment(pos - shift, newpos_ - shift))
+                    {
+                        return REJECTED_WALL;
+                    }
+                }
+            }
+        }
+        return ACCEPTED;
+    }
+
+protected:
+
+    TriangleMesh mesh_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_MESH_BARRIER_POLICY_HPP */
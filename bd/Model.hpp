@@ -19,11 +19,27 @@ public:
 
 public:
 
+    Model()
+        : revision_(0)
+    {
+        ;
+    }
+
     virtual ~Model()
     {
         ;
     }
 
+    /**
+     * a counter increased by every change of species attributes or reaction rules.
+     * caches of what was resolved by the model are stale once it differs.
+     * @return the revision
+     */
+    Integer revision() const
+    {
+        return revision_;
+    }
+
     // ModelTraits
 
     /**
@@ -233,6 +249,17 @@ public:
             add_reaction_rule(*i);
         }
     }
+
+protected:
+
+    void touch()
+    {
+        ++revision_;
+    }
+
+protected:
+
+    Integer revision_;
 };
 
 } // ecell4
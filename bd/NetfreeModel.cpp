@@ -0,0 +1,449 @@
+#include <algorithm>
+
+#include "exceptions.hpp"
+#include "NetfreeModel.hpp"
+#include "NetworkModel.hpp"
+
+
+namespace ecell4
+{
+
+namespace
+{
+
+bool has_match(const context::species_pattern& pttrn, const context::compiled_species& sp,
+    const std::size_t num_globals)
+{
+    std::vector<context::match_type> matches;
+    pttrn.match(sp, std::vector<context::symbol_type>(num_globals, 0), matches);
+    return !matches.empty();
+}
+
+/**
+ * @return if the species is within the limits of stoichiometry
+ */
+bool within_limits(
+    const std::vector<std::pair<context::species_pattern, Integer> >& limits,
+    const context::compiled_species& sp, const std::size_t num_globals)
+{
+    for (std::vector<std::pair<context::species_pattern, Integer> >::const_iterator
+        i(limits.begin()); i != limits.end(); ++i)
+    {
+        if ((*i).first.count(sp, num_globals) > (*i).second)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // anonymous
+
+bool NetfreeModel::update_species_attribute(const Species& sp)
+{
+    species_container_type::iterator i(std::find(species_attributes_.begin(), species_attributes_.end(), sp));
+    if (i == species_attributes_.end())
+    {
+        add_species_attribute(sp);
+        return true;
+    }
+    (*i).overwrite_attributes(sp);
+    touch();
+    return false;
+}
+
+void NetfreeModel::add_species_attribute(const Species& sp, const bool proceed)
+{
+    species_attributes_.push_back(sp);
+    species_attributes_proceed_.push_back(proceed);
+    touch();
+}
+
+void NetfreeModel::remove_species_attribute(const Species& sp)
+{
+    species_container_type::iterator i(std::find(species_attributes_.begin(), species_attributes_.end(), sp));
+    if (i == species_attributes_.end())
+    {
+        throw_exception<NotFound>("The given Speices [", sp.serial(), "] was not found");
+    }
+    species_attributes_proceed_.erase(
+        species_attributes_proceed_.begin() + std::distance(species_attributes_.begin(), i));
+    species_attributes_.erase(i);
+    touch();
+}
+
+bool NetfreeModel::has_species_attribute(const Species& sp) const
+{
+    species_container_type::const_iterator i(
+        std::find(species_attributes_.begin(), species_attributes_.end(), sp));
+    return (i != species_attributes_.end());
+}
+
+void NetfreeModel::add_reaction_rule(const ReactionRule& rr)
+{
+    reaction_rule_container_type::iterator
+        i(std::find(reaction_rules_.begin(), reaction_rules_.end(), rr));
+    if (i != reaction_rules_.end())
+    {
+        throw_exception<AlreadyExists>("The given reaction rule [", rr.as_string(), "] already exists.");
+    }
+    reaction_rules_.push_back(rr);
+    touch();
+}
+
+void NetfreeModel::remove_reaction_rule(const ReactionRule& rr)
+{
+    const reaction_rule_container_type::iterator
+        i(std::remove(reaction_rules_.begin(), reaction_rules_.end(), rr));
+    if (i == reaction_rules_.end())
+    {
+        throw NotFound("The given reaction rule was not found.");
+    }
+    reaction_rules_.erase(i, reaction_rules_.end());
+    touch();
+}
+
+bool NetfreeModel::has_reaction_rule(const ReactionRule& rr) const
+{
+    reaction_rule_container_type::const_iterator
+        i(std::find(reaction_rules_.begin(), reaction_rules_.end(), rr));
+    return (i != reaction_rules_.end());
+}
+
+NetfreeModel::compiled_type& NetfreeModel::compile() const
+{
+    if (compiled_ && compiled_revision_ == revision())
+    {
+        return *compiled_;
+    }
+
+    std::shared_ptr<compiled_type> compiled(new compiled_type());
+    context::symbol_table& symbols((*compiled).cache.symbols());
+    for (reaction_rule_container_type::const_iterator i(reaction_rules_.begin());
+        i != reaction_rules_.end(); ++i)
+    {
+        (*compiled).rules.push_back(context::rule_program(*i, symbols));
+        if ((*i).reactants().size() == 1)
+        {
+            (*compiled).first_order.push_back((*compiled).rules.size() - 1);
+        }
+        else if ((*i).reactants().size() == 2)
+        {
+            (*compiled).second_order.push_back((*compiled).rules.size() - 1);
+        }
+    }
+    for (species_container_type::const_iterator i(species_attributes_.begin());
+        i != species_attributes_.end(); ++i)
+    {
+        (*compiled).attributes.push_back(
+            context::species_pattern(*i, symbols, (*compiled).globals));
+    }
+
+    compiled_ = compiled;
+    compiled_revision_ = revision();
+    return *compiled_;
+}
+
+void NetfreeModel::generate(
+    const context::rule_program& rule, const ReactionRule::reactant_container_type& reactants,
+    std::vector<ReactionRule>& retval) const
+{
+    compiled_type& compiled(*compiled_);
+
+    std::vector<const context::compiled_species*> targets;
+    targets.reserve(reactants.size());
+    for (ReactionRule::reactant_container_type::const_iterator i(reactants.begin());
+        i != reactants.end(); ++i)
+    {
+        targets.push_back(&compiled.cache.get(*i));
+    }
+
+    const std::vector<ReactionRule> generated(
+        rule.generate(reactants, targets, compiled.cache.symbols()));
+    for (std::vector<ReactionRule>::const_iterator i(generated.begin()); i != generated.end(); ++i)
+    {
+        ReactionRule::product_container_type products;
+        products.reserve((*i).products().size());
+        for (ReactionRule::product_container_type::const_iterator j((*i).products().begin());
+            j != (*i).products().end(); ++j)
+        {
+            products.push_back(compiled.cache.format(*j));
+        }
+        retval.push_back(ReactionRule(reactants, products, (*i).k()));
+    }
+}
+
+std::vector<ReactionRule> NetfreeModel::query_reaction_rules(const Species& sp) const
+{
+    compiled_type& compiled(compile());
+    const std::unordered_map<Species::serial_type, std::vector<ReactionRule> >::const_iterator
+        i(compiled.first_order_memo.find(sp.serial()));
+    if (i != compiled.first_order_memo.end())
+    {
+        return (*i).second;
+    }
+
+    std::vector<ReactionRule> retval;
+    const ReactionRule::reactant_container_type reactants(1, sp);
+    for (std::vector<std::size_t>::const_iterator j(compiled.first_order.begin());
+        j != compiled.first_order.end(); ++j)
+    {
+        generate(compiled.rules[*j], reactants, retval);
+    }
+    compiled.first_order_memo.insert(std::make_pair(sp.serial(), retval));
+    return retval;
+}
+
+std::vector<ReactionRule> NetfreeModel::query_reaction_rules(
+    const Species& sp1, const Species& sp2) const
+{
+    compiled_type& compiled(compile());
+    const Species::serial_type key(sp1.serial() + "\n" + sp2.serial());
+    const std::unordered_map<Species::serial_type, std::vector<ReactionRule> >::const_iterator
+        i(compiled.second_order_memo.find(key));
+    if (i != compiled.second_order_memo.end())
+    {
+        return (*i).second;
+    }
+
+    std::vector<ReactionRule> retval;
+    ReactionRule::reactant_container_type reactants(2);
+    for (std::vector<std::size_t>::const_iterator j(compiled.second_order.begin());
+        j != compiled.second_order.end(); ++j)
+    {
+        reactants[0] = sp1;
+        reactants[1] = sp2;
+        generate(compiled.rules[*j], reactants, retval);
+        if (sp1 != sp2)
+        {
+            reactants[0] = sp2;
+            reactants[1] = sp1;
+            generate(compiled.rules[*j], reactants, retval);
+        }
+    }
+    compiled.second_order_memo.insert(std::make_pair(key, retval));
+    return retval;
+}
+
+Integer NetfreeModel::apply(const Species& pttrn, const Species& sp) const
+{
+    compiled_type& compiled(compile());
+    context::variable_container_type globals;
+    const context::species_pattern compiled_pttrn(pttrn, compiled.cache.symbols(), globals);
+    return compiled_pttrn.count(compiled.cache.get(sp), globals.size());
+}
+
+std::vector<ReactionRule> NetfreeModel::apply(
+    const ReactionRule& rr, const ReactionRule::reactant_container_type& reactants) const
+{
+    compiled_type& compiled(compile());
+    const context::rule_program program(rr, compiled.cache.symbols());
+    std::vector<ReactionRule> retval;
+    generate(program, reactants, retval);
+    return retval;
+}
+
+Species NetfreeModel::apply_species_attributes(const Species& sp) const
+{
+    compiled_type& compiled(compile());
+    const context::compiled_species& target(compiled.cache.get(sp));
+
+    Species ret(sp);
+    std::vector<bool>::const_iterator j(species_attributes_proceed_.begin());
+    for (std::size_t i(0); i < species_attributes_.size(); ++i, ++j)
+    {
+        if (!has_match(compiled.attributes[i], target, compiled.globals.size()))
+        {
+            continue;
+        }
+        ret.overwrite_attributes(species_attributes_[i]);
+        if (!(*j))
+        {
+            break;
+        }
+    }
+    return ret;
+}
+
+std::shared_ptr<Model> NetfreeModel::expand(
+    const std::vector<Species>& sp, const Integer max_itr,
+    const std::map<Species, Integer>& max_stoich) const
+{
+    compiled_type& compiled(compile());
+    context::rule_based_expression_cache& cache(compiled.cache);
+    std::shared_ptr<NetworkModel> retval(new NetworkModel());
+
+    context::variable_container_type globals;
+    std::vector<std::pair<context::species_pattern, Integer> > limits;
+    for (std::map<Species, Integer>::const_iterator i(max_stoich.begin());
+        i != max_stoich.end(); ++i)
+    {
+        limits.push_back(std::make_pair(
+            context::species_pattern((*i).first, cache.symbols(), globals), (*i).second));
+    }
+
+    // species in the canonical form in the order of appearance, with their generations.
+    // a species is processed once, and pairs are made only with species processed before.
+    std::vector<Species> species;
+    std::vector<Integer> generations;
+    std::unordered_map<Species::serial_type, std::size_t> indices;
+
+    std::vector<ReactionRule> generated;
+    std::vector<std::size_t> products;
+
+    for (std::vector<Species>::const_iterator i(sp.begin()); i != sp.end(); ++i)
+    {
+        const Species& formatted(cache.format(*i));
+        if (indices.insert(std::make_pair(formatted.serial(), species.size())).second)
+        {
+            species.push_back(formatted);
+            generations.push_back(0);
+        }
+    }
+
+    for (std::vector<context::rule_program>::const_iterator i(compiled.rules.begin());
+        i != compiled.rules.end(); ++i)
+    {
+        if ((*i).num_reactants() == 0)
+        {
+            generated.clear();
+            generate(*i, ReactionRule::reactant_container_type(), generated);
+            for (std::vector<ReactionRule>::const_iterator j(generated.begin()); j != generated.end(); ++j)
+            {
+                for (ReactionRule::product_container_type::const_iterator k((*j).products().begin());
+                    k != (*j).products().end(); ++k)
+                {
+                    if (indices.insert(std::make_pair((*k).serial(), species.size())).second)
+                    {
+                        species.push_back(*k);
+                        generations.push_back(0);
+                    }
+                }
+                (*retval).add_reaction_rule(*j);
+            }
+        }
+        else if ((*i).num_reactants() > 2)
+        {
+            throw_exception<NotSupported>(
+                "The reaction rule [", (*i).rule().as_string(), "] has more than two reactants.");
+        }
+    }
+
+    // species processed which may match each reactant of second-order rules.
+    std::vector<std::vector<std::size_t> > candidates(compiled.second_order.size() * 2);
+
+    ReactionRule::reactant_container_type reactants;
+    for (std::size_t idx(0); idx < species.size(); ++idx)
+    {
+        const Integer generation(generations[idx]);
+        if (generation >= max_itr)
+        {
+            break;
+        }
+
+        const context::compiled_species& target(cache.get(species[idx]));
+
+        generated.clear();
+        reactants.assign(1, species[idx]);
+        for (std::vector<std::size_t>::const_iterator i(compiled.first_order.begin());
+            i != compiled.first_order.end(); ++i)
+        {
+            generate(compiled.rules[*i], reactants, generated);
+        }
+
+        for (std::size_t i(0); i < compiled.second_order.size(); ++i)
+        {
+            const context::rule_program& rule(compiled.rules[compiled.second_order[i]]);
+            const bool first(has_match(rule.reactant(0), target, rule.num_globals())),
+                second(has_match(rule.reactant(1), target, rule.num_globals()));
+
+            reactants.resize(2);
+            if (first)
+            {
+                std::vector<std::size_t>& others(candidates[i * 2 + 1]);
+                if (second)
+                {
+                    others.push_back(idx);
+                }
+                for (std::vector<std::size_t>::const_iterator j(others.begin()); j != others.end(); ++j)
+                {
+                    reactants[0] = species[idx];
+                    reactants[1] = species[*j];
+                    generate(rule, reactants, generated);
+                }
+                if (second)
+                {
+                    others.pop_back();
+                }
+            }
+            if (second)
+            {
+                const std::vector<std::size_t>& others(candidates[i * 2]);
+                for (std::vector<std::size_t>::const_iterator j(others.begin()); j != others.end(); ++j)
+                {
+                    reactants[0] = species[*j];
+                    reactants[1] = species[idx];
+                    generate(rule, reactants, generated);
+                }
+            }
+
+            if (first)
+            {
+                candidates[i * 2].push_back(idx);
+            }
+            if (second)
+            {
+                candidates[i * 2 + 1].push_back(idx);
+            }
+        }
+
+        for (std::vector<ReactionRule>::const_iterator i(generated.begin()); i != generated.end(); ++i)
+        {
+            products.clear();
+            bool accepted(true);
+            for (ReactionRule::product_container_type::const_iterator j((*i).products().begin());
+                j != (*i).products().end(); ++j)
+            {
+                const std::unordered_map<Species::serial_type, std::size_t>::const_iterator
+                    k(indices.find((*j).serial()));
+                if (k != indices.end())
+                {
+                    continue;
+                }
+                else if (!within_limits(limits, cache.get(*j), globals.size()))
+                {
+                    accepted = false;
+                    break;
+                }
+                products.push_back(j - (*i).products().begin());
+            }
+            if (!accepted)
+            {
+                continue;
+            }
+
+            for (std::vector<std::size_t>::const_iterator j(products.begin()); j != products.end(); ++j)
+            {
+                const Species& product((*i).products()[*j]);
+                if (indices.insert(std::make_pair(product.serial(), species.size())).second)
+                {
+                    species.push_back(product);
+                    generations.push_back(generation + 1);
+                }
+            }
+            (*retval).add_reaction_rule(*i);
+        }
+    }
+
+    for (std::vector<Species>::const_iterator i(species.begin()); i != species.end(); ++i)
+    {
+        const Species attributed(apply_species_attributes(*i));
+        if (attributed.attributes().values().size() > 0)
+        {
+            (*retval).add_species_attribute(attributed);
+        }
+    }
+    return retval;
+}
+
+} // ecell4
@@ -0,0 +1,149 @@
+#ifndef ECELL4_NETFREE_MODEL_HPP
+#define ECELL4_NETFREE_MODEL_HPP
+
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+#include "types.hpp"
+#include "Species.hpp"
+#include "ReactionRule.hpp"
+#include "Model.hpp"
+#include "Context.hpp"
+
+
+namespace ecell4
+{
+
+/**
+ * a rule-based model. reaction rules and species attributes are patterns, and
+ * rules over given reactants are generated on demand, or expanded into NetworkModel.
+ * rules are compiled into context::rule_program once per revision, and species are
+ * parsed once and kept in their canonical forms. rules generated for a species,
+ * or a pair of species, are memoized by their canonical serials.
+ */
+class NetfreeModel
+    : public Model
+{
+public:
+
+    typedef Model base_type;
+    typedef base_type::species_container_type species_container_type;
+    typedef base_type::reaction_rule_container_type reaction_rule_container_type;
+
+public:
+
+    NetfreeModel()
+        : base_type(), species_attributes_(), species_attributes_proceed_(), reaction_rules_(),
+        compiled_(), compiled_revision_(-1)
+    {
+        ;
+    }
+
+    virtual ~NetfreeModel()
+    {
+        ;
+    }
+
+    // ModelTraits
+
+    std::vector<ReactionRule> query_reaction_rules(const Species& sp) const;
+    std::vector<ReactionRule> query_reaction_rules(
+        const Species& sp1, const Species& sp2) const;
+
+    Integer apply(const Species& pttrn, const Species& sp) const;
+    std::vector<ReactionRule> apply(
+        const ReactionRule& rr,
+        const ReactionRule::reactant_container_type& reactants) const;
+
+    Species apply_species_attributes(const Species& sp) const;
+
+    /**
+     * expand rules over species reachable from seeds into NetworkModel.
+     * species are formatted, and attributes of each are resolved by apply_species_attributes.
+     * @param sp seeds
+     * @param max_itr the maximum number of generations of products
+     * @param max_stoich the maximum number of matches of a pattern in a species.
+     * a product over the limit is left out with rules to make it.
+     */
+    std::shared_ptr<Model> expand(
+        const std::vector<Species>& sp, const Integer max_itr,
+        const std::map<Species, Integer>& max_stoich) const;
+
+    std::shared_ptr<Model> expand(
+        const std::vector<Species>& sp, const Integer max_itr) const
+    {
+        return expand(sp, max_itr, std::map<Species, Integer>());
+    }
+
+    std::shared_ptr<Model> expand(const std::vector<Species>& sp) const
+    {
+        return expand(sp, 30);
+    }
+
+    // NetworkModelTraits
+
+    bool update_species_attribute(const Species& sp);
+    void add_species_attribute(const Species& sp, const bool proceed = false);
+    bool has_species_attribute(const Species& sp) const;
+    void remove_species_attribute(const Species& sp);
+
+    void add_reaction_rule(const ReactionRule& rr);
+    void remove_reaction_rule(const ReactionRule& rr);
+    bool has_reaction_rule(const ReactionRule& rr) const;
+
+    const reaction_rule_container_type& reaction_rules() const
+    {
+        return reaction_rules_;
+    }
+
+    const species_container_type& species_attributes() const
+    {
+        return species_attributes_;
+    }
+
+    const std::vector<bool>& species_attributes_proceed() const
+    {
+        return species_attributes_proceed_;
+    }
+
+protected:
+
+    /**
+     * rules and attributes of the model compiled at a revision, with memos over species.
+     */
+    struct compiled_type
+    {
+        context::rule_based_expression_cache cache;
+        std::vector<context::rule_program> rules;
+        std::vector<std::size_t> first_order, second_order;  // indices in rules
+        std::vector<context::species_pattern> attributes;
+        context::variable_container_type globals;  // shared by attributes, never bound
+
+        std::unordered_map<Species::serial_type, std::vector<ReactionRule> > first_order_memo;
+        std::unordered_map<Species::serial_type, std::vector<ReactionRule> > second_order_memo;
+    };
+
+    compiled_type& compile() const;
+
+    /**
+     * rules generated over the reactants in the order given, with products formatted.
+     */
+    void generate(
+        const context::rule_program& rule, const ReactionRule::reactant_container_type& reactants,
+        std::vector<ReactionRule>& retval) const;
+
+protected:
+
+    species_container_type species_attributes_;
+    std::vector<bool> species_attributes_proceed_;
+    reaction_rule_container_type reaction_rules_;
+
+    mutable std::shared_ptr<compiled_type> compiled_;
+    mutable Integer compiled_revision_;
+};
+
+} // ecell4
+
+#endif /* ECELL4_NETFREE_MODEL_HPP */
@@ -7,6 +7,14 @@
 namespace ecell4
 {
 
+NetworkModel::second_order_reaction_rules_map_type::key_type
+NetworkModel::second_order_key(const Species& sp1, const Species& sp2)
+{
+    return (sp1.serial() < sp2.serial() ?
+        std::make_pair(sp1.serial(), sp2.serial()) :
+        std::make_pair(sp2.serial(), sp1.serial()));
+}
+
 bool NetworkModel::update_species_attribute(const Species& sp)
 {
     species_container_type::iterator i(std::find(species_attributes_.begin(), species_attributes_.end(), sp));
@@ -16,6 +24,7 @@ bool NetworkModel::update_species_attribute(const Species& sp)
         return true;
     }
     (*i).overwrite_attributes(sp);
+    touch();
     return false;
 }
 
@@ -23,6 +32,7 @@ void NetworkModel::add_species_attribute(const Species& sp, const bool proceed)
 {
     species_attributes_.push_back(sp);
     species_attributes_proceed_.push_back(proceed);
+    touch();
 }
 
 void NetworkModel::remove_species_attribute(const Species& sp)
@@ -35,6 +45,7 @@ void NetworkModel::remove_species_attribute(const Species& sp)
     species_attributes_proceed_.erase(
         species_attributes_proceed_.begin() + std::distance(species_attributes_.begin(), i));
     species_attributes_.erase(i);
+    touch();
 }
 
 bool NetworkModel::has_species_attribute(const Species& sp) const
@@ -92,13 +103,8 @@ std::vector<ReactionRule> NetworkModel::query_reaction_rules(
     const Species& sp1, const Species& sp2) const
 {
     std::vector<ReactionRule> retval;
-    const std::pair<Species::serial_type, Species::serial_type>
-        key(sp1.serial() < sp2.serial()?
-            std::make_pair(sp1.serial(), sp2.serial()):
-            std::make_pair(sp2.serial(), sp1.serial()));
-
     second_order_reaction_rules_map_type::const_iterator
-        i(second_order_reaction_rules_map_.find(key));
+        i(second_order_reaction_rules_map_.find(second_order_key(sp1, sp2)));
     if (i != second_order_reaction_rules_map_.end())
     {
         retval.reserve((*i).second.size());
@@ -139,19 +145,16 @@ void NetworkModel::add_reaction_rule(const ReactionRule& rr)
     //     return;
     // }
 
-    for (reaction_rule_container_type::iterator i(reaction_rules_.begin());
-        i != reaction_rules_.end(); ++i)
+    const reaction_rule_container_type::size_type idx(find_reaction_rule(rr));
+    if (idx != reaction_rules_.size())
     {
-        // if ((*i) == rr && !(*i).has_descriptor())
-        if ((*i) == rr)
-        {
-            (*i).set_k((*i).k() + rr.k());  // Merging
-            return;
-        }
+        reaction_rules_[idx].set_k(reaction_rules_[idx].k() + rr.k());  // Merging
+        touch();
+        return;
     }
 
-    const reaction_rule_container_type::size_type idx(reaction_rules_.size());
     reaction_rules_.push_back(rr);
+    touch();
 
     if (rr.reactants().size() == 1)
     {
@@ -160,14 +163,8 @@ void NetworkModel::add_reaction_rule(const ReactionRule& rr)
     }
     else if (rr.reactants().size() == 2)
     {
-        const Species::serial_type
-            serial1(rr.reactants()[0].serial()),
-            serial2(rr.reactants()[1].serial());
-        const std::pair<Species::serial_type, Species::serial_type>
-            key(serial1 < serial2?
-                std::make_pair(serial1, serial2):
-                std::make_pair(serial2, serial1));
-        second_order_reaction_rules_map_[key].push_back(idx);
+        second_order_reaction_rules_map_[
+            second_order_key(rr.reactants()[0], rr.reactants()[1])].push_back(idx);
     }
     else
     {
@@ -226,8 +223,8 @@ void NetworkModel::remove_reaction_rule(const NetworkModel::reaction_rule_contai
         else if (rr.reactants().size() == 2)
         {
             second_order_reaction_rules_map_type::iterator
-                j(second_order_reaction_rules_map_.find(std::make_pair(
-                    rr.reactants()[0].serial(), rr.reactants()[1].serial())));
+                j(second_order_reaction_rules_map_.find(
+                    second_order_key(rr.reactants()[0], rr.reactants()[1])));
             assert(j != second_order_reaction_rules_map_.end());
 
             second_order_reaction_rules_map_type::mapped_type::iterator
@@ -266,9 +263,8 @@ void NetworkModel::remove_reaction_rule(const NetworkModel::reaction_rule_contai
         else if (rrlast.reactants().size() == 2)
         {
             second_order_reaction_rules_map_type::iterator
-                j(second_order_reaction_rules_map_.find(std::make_pair(
-                    rrlast.reactants()[0].serial(),
-                    rrlast.reactants()[1].serial())));
+                j(second_order_reaction_rules_map_.find(
+                    second_order_key(rrlast.reactants()[0], rrlast.reactants()[1])));
             assert(j != second_order_reaction_rules_map_.end());
 
             second_order_reaction_rules_map_type::mapped_type::iterator
@@ -281,13 +277,63 @@ void NetworkModel::remove_reaction_rule(const NetworkModel::reaction_rule_contai
     }
 
     reaction_rules_.pop_back();
+    touch();
+}
+
+NetworkModel::reaction_rule_container_type::size_type
+NetworkModel::find_reaction_rule(const ReactionRule& rr) const
+{
+    const std::vector<reaction_rule_container_type::size_type>* indices(NULL);
+    if (rr.reactants().size() == 1)
+    {
+        first_order_reaction_rules_map_type::const_iterator
+            i(first_order_reaction_rules_map_.find(rr.reactants()[0].serial()));
+        if (i == first_order_reaction_rules_map_.end())
+        {
+            return reaction_rules_.size();
+        }
+        indices = &(*i).second;
+    }
+    else if (rr.reactants().size() == 2)
+    {
+        second_order_reaction_rules_map_type::const_iterator
+            i(second_order_reaction_rules_map_.find(
+                second_order_key(rr.reactants()[0], rr.reactants()[1])));
+        if (i == second_order_reaction_rules_map_.end())
+        {
+            return reaction_rules_.size();
+        }
+        indices = &(*i).second;
+    }
+    else
+    {
+        return std::distance(reaction_rules_.begin(),
+            std::find(reaction_rules_.begin(), reaction_rules_.end(), rr));
+    }
+
+    for (std::vector<reaction_rule_container_type::size_type>::const_iterator
+             i((*indices).begin()); i != (*indices).end(); ++i)
+    {
+        if (reaction_rules_[*i] == rr)
+        {
+            return *i;
+        }
+    }
+    return reaction_rules_.size();
 }
 
 bool NetworkModel::has_reaction_rule(const ReactionRule& rr) const
 {
-    reaction_rule_container_type::const_iterator
-        i(std::find(reaction_rules_.begin(), reaction_rules_.end(), rr));
-    return (i != reaction_rules_.end());
+    return find_reaction_rule(rr) != reaction_rules_.size();
+}
+
+std::shared_ptr<const CompiledNetworkModel> NetworkModel::compile() const
+{
+    if (!compiled_ || (*compiled_).revision() != revision())
+    {
+        compiled_.reset(new CompiledNetworkModel(*this));
+    }
+    return compiled_;
 }
 
 } // ecell4
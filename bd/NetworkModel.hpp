@@ -11,6 +11,7 @@
 #include "Species.hpp"
 #include "ReactionRule.hpp"
 #include "Model.hpp"
+#include "CompiledNetworkModel.hpp"
 
 // #include "Context.hpp"
 
@@ -40,7 +41,7 @@ public:
 
     NetworkModel()
         : base_type(), species_attributes_(), species_attributes_proceed_(), reaction_rules_(),
-        first_order_reaction_rules_map_(), second_order_reaction_rules_map_()
+        first_order_reaction_rules_map_(), second_order_reaction_rules_map_(), compiled_()
     {
         ;
     }
@@ -112,10 +113,28 @@ public:
         return species_attributes_proceed_;
     }
 
+    /**
+     * the model compiled into flat index tables, for queries without copies.
+     * the view is compiled again only when the revision has changed since the last call.
+     * @return the view at the current revision
+     */
+    std::shared_ptr<const CompiledNetworkModel> compile() const;
+
 protected:
 
     void remove_reaction_rule(const reaction_rule_container_type::iterator i);
 
+    /**
+     * @return the index of the rule in reaction_rules_, or its size if not found
+     */
+    reaction_rule_container_type::size_type find_reaction_rule(const ReactionRule& rr) const;
+
+    /**
+     * the key of a pair of reactants in second_order_reaction_rules_map_, in the order of serials.
+     */
+    static second_order_reaction_rules_map_type::key_type second_order_key(
+        const Species& sp1, const Species& sp2);
+
 protected:
 
     species_container_type species_attributes_;
@@ -124,6 +143,8 @@ protected:
 
     first_order_reaction_rules_map_type first_order_reaction_rules_map_;
     second_order_reaction_rules_map_type second_order_reaction_rules_map_;
+
+    mutable std::shared_ptr<const CompiledNetworkModel> compiled_;
 };
 
 } // ecell4
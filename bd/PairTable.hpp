@@ -0,0 +1,241 @@
+#ifndef ECELL4_BD_PAIR_TABLE_HPP
+#define ECELL4_BD_PAIR_TABLE_HPP
+
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+
+#include "Identifier.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * an open-addressing hash table keyed by an ordered pair of ParticleIDs.
+ * linear probing over a power-of-two sized array of entries.
+ * entries are never removed, and pointers to values are invalidated by insert.
+ */
+template<typename Tvalue_>
+class PairTable
+{
+public:
+
+    typedef std::pair<ParticleID, ParticleID> key_type;
+    typedef Tvalue_ mapped_type;
+
+    struct entry_type
+    {
+        key_type key;
+        mapped_type value;
+        bool occupied;
+    };
+
+    typedef std::vector<entry_type> container_type;
+
+    class const_iterator
+    {
+    public:
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef entry_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const entry_type* pointer;
+        typedef const entry_type& reference;
+
+        const_iterator(
+            typename container_type::const_iterator it,
+            typename container_type::const_iterator end)
+            : it_(it), end_(end)
+        {
+            skip();
+        }
+
+        const entry_type& operator*() const
+        {
+            return *it_;
+        }
+
+        const entry_type* operator->() const
+        {
+            return &(*it_);
+        }
+
+        const_iterator& operator++()
+        {
+            ++it_;
+            skip();
+            return *this;
+        }
+
+        bool operator==(const const_iterator& rhs) const
+        {
+            return it_ == rhs.it_;
+        }
+
+        bool operator!=(const const_iterator& rhs) const
+        {
+            return it_ != rhs.it_;
+        }
+
+    protected:
+
+        void skip()
+        {
+            while (it_ != end_ && !(*it_).occupied)
+            {
+                ++it_;
+            }
+        }
+
+    protected:
+
+        typename container_type::const_iterator it_, end_;
+    };
+
+public:
+
+    PairTable(const std::size_t capacity = 64)
+        : size_(0)
+    {
+        std::size_t n(16);
+        while (n < capacity * 2)
+        {
+            n <<= 1;
+        }
+        entries_.resize(n, empty_entry());
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    void clear()
+    {
+        std::fill(entries_.begin(), entries_.end(), empty_entry());
+        size_ = 0;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(entries_.begin(), entries_.end());
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(entries_.end(), entries_.end());
+    }
+
+    mapped_type* find(const key_type& key)
+    {
+        entry_type& e(probe(entries_, key));
+        return (e.occupied ? &e.value : NULL);
+    }
+
+    const mapped_type* find(const key_type& key) const
+    {
+        const entry_type& e(const_cast<PairTable*>(this)->probe(
+            const_cast<container_type&>(entries_), key));
+        return (e.occupied ? &e.value : NULL);
+    }
+
+    /**
+     * insert a value unless the key already exists.
+     * @return a pair of a pointer to the value and if it was inserted or not
+     */
+    std::pair<mapped_type*, bool> insert(const key_type& key, const mapped_type& value)
+    {
+        if ((size_ + 1) * 2 > entries_.size())
+        {
+            rehash(entries_.size() * 2);
+        }
+
+        entry_type& e(probe(entries_, key));
+        if (e.occupied)
+        {
+            return std::make_pair(&e.value, false);
+        }
+
+        e.key = key;
+        e.value = value;
+        e.occupied = true;
+        ++size_;
+        return std::make_pair(&e.value, true);
+    }
+
+protected:
+
+    static entry_type empty_entry()
+    {
+        entry_type e;
+        e.value = mapped_type();
+        e.occupied = false;
+        return e;
+    }
+
+    static inline uint64_t mix(uint64_t x)
+    {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    static inline uint64_t hash(const key_type& key)
+    {
+        const uint64_t h1(mix(key.first.serial() ^ (static_cast<uint64_t>(key.first.lot()) << 48)));
+        const uint64_t h2(mix(key.second.serial() ^ (static_cast<uint64_t>(key.second.lot()) << 48)));
+        return mix(h1 ^ (h2 + 0x9e3779b97f4a7c15ULL + (h1 << 6) + (h1 >> 2)));
+    }
+
+    static entry_type& probe(container_type& entries, const key_type& key)
+    {
+        const std::size_t mask(entries.size() - 1);
+        std::size_t i(hash(key) & mask);
+        while (entries[i].occupied && entries[i].key != key)
+        {
+            i = (i + 1) & mask;
+        }
+        return entries[i];
+    }
+
+    void rehash(const std::size_t n)
+    {
+        container_type entries(n, empty_entry());
+        for (typename container_type::const_iterator i(entries_.begin());
+            i != entries_.end(); ++i)
+        {
+            if ((*i).occupied)
+            {
+                probe(entries, (*i).key) = (*i);
+            }
+        }
+        entries_.swap(entries);
+    }
+
+protected:
+
+    container_type entries_;
+    std::size_t size_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_PAIR_TABLE_HPP */
@@ -0,0 +1,632 @@
+#include "ParticlePlacer.hpp"
+
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a uniform grid over a box, which is periodic along the axes the box spans the world.
+ */
+struct uniform_grid
+{
+    Real3 lower;
+    Real3 width;  // the size of a cell
+    Integer n[3];
+    bool periodic[3];
+    Real3 edge_lengths;
+
+    uniform_grid(const Real3& l, const Real3& u, const Real3& edges, const Real min_width,
+        const Integer max_cells)
+        : lower(l), edge_lengths(edges)
+    {
+        Real w(min_width);
+        while (true)
+        {
+            Integer total(1);
+            for (int d(0); d < 3; ++d)
+            {
+                n[d] = std::max(static_cast<Integer>(1),
+                    static_cast<Integer>(std::ceil((u[d] - l[d]) / w)));
+                total *= n[d];
+            }
+            if (total <= max_cells)
+            {
+                break;
+            }
+            w *= std::cbrt(static_cast<Real>(total) / max_cells) * 1.01;
+        }
+
+        for (int d(0); d < 3; ++d)
+        {
+            width[d] = (u[d] - l[d]) / n[d];
+            periodic[d] = (u[d] - l[d] >= edge_lengths[d] * (1 - 1e-12));
+        }
+    }
+
+    Integer size() const
+    {
+        return n[0] * n[1] * n[2];
+    }
+
+    Real half_diagonal() const
+    {
+        return 0.5 * length(width);
+    }
+
+    Real3 center(const Integer idx) const
+    {
+        const Integer i(idx % n[0]), j((idx / n[0]) % n[1]), k(idx / (n[0] * n[1]));
+        return Real3(
+            lower[0] + (i + 0.5) * width[0],
+            lower[1] + (j + 0.5) * width[1],
+            lower[2] + (k + 0.5) * width[2]);
+    }
+
+    /**
+     * the difference of positions under the periodic boundary condition.
+     */
+    Real3 difference(const Real3& pos1, const Real3& pos2) const
+    {
+        Real3 retval(pos1 - pos2);
+        for (int d(0); d < 3; ++d)
+        {
+            retval[d] -= edge_lengths[d] * std::floor(retval[d] / edge_lengths[d] + 0.5);
+        }
+        return retval;
+    }
+
+    /**
+     * list indices of cells along the axis within the reach from a position.
+     */
+    void range(const int d, Real pos, const Real reach, std::vector<Integer>& out) const
+    {
+        out.clear();
+        if (!periodic[d])
+        {
+            // the image of the position nearest to the grid.
+            const Real c(lower[d] + 0.5 * n[d] * width[d]);
+            pos += edge_lengths[d] * std::floor((c - pos) / edge_lengths[d] + 0.5);
+        }
+
+        const Integer i0(static_cast<Integer>(std::floor((pos - reach - lower[d]) / width[d])));
+        const Integer i1(static_cast<Integer>(std::floor((pos + reach - lower[d]) / width[d])));
+        if (periodic[d])
+        {
+            if (i1 - i0 + 1 >= n[d])
+            {
+                for (Integer i(0); i < n[d]; ++i)
+                {
+                    out.push_back(i);
+                }
+                return;
+            }
+            for (Integer i(i0); i <= i1; ++i)
+            {
+                out.push_back(((i % n[d]) + n[d]) % n[d]);
+            }
+        }
+        else
+        {
+            for (Integer i(std::max(static_cast<Integer>(0), i0));
+                i <= std::min(n[d] - 1, i1); ++i)
+            {
+                out.push_back(i);
+            }
+        }
+    }
+
+    /**
+     * call func with indices of cells within the reach from a position.
+     */
+    template<typename Tfunc_>
+    void each_neighbor(const Real3& pos, const Real reach, Tfunc_ func) const
+    {
+        std::vector<Integer> r0, r1, r2;
+        range(0, pos[0], reach, r0);
+        range(1, pos[1], reach, r1);
+        range(2, pos[2], reach, r2);
+        for (std::vector<Integer>::const_iterator k(r2.begin()); k != r2.end(); ++k)
+        {
+            for (std::vector<Integer>::const_iterator j(r1.begin()); j != r1.end(); ++j)
+            {
+                for (std::vector<Integer>::const_iterator i(r0.begin()); i != r0.end(); ++i)
+                {
+                    func((*i) + n[0] * ((*j) + n[1] * (*k)));
+                }
+            }
+        }
+    }
+};
+
+/**
+ * cells which still have room for a new particle.
+ */
+struct ParticlePlacer::free_space_grid
+    : public uniform_grid
+{
+    std::vector<uint32_t> live;
+    std::vector<int32_t> slot;  // the position in live, or -1 if dead
+    std::vector<uint8_t> failures;
+
+    free_space_grid(const Real3& l, const Real3& u, const Real3& edges, const Real min_width,
+        const Integer max_cells)
+        : uniform_grid(l, u, edges, min_width, max_cells)
+    {
+        live.resize(size());
+        slot.resize(size());
+        failures.resize(size(), 0);
+        for (Integer i(0); i < size(); ++i)
+        {
+            live[i] = i;
+            slot[i] = i;
+        }
+    }
+
+    void kill(const Integer idx)
+    {
+        const int32_t s(slot[idx]);
+        if (s < 0)
+        {
+            return;
+        }
+        const uint32_t last(live.back());
+        live[s] = last;
+        slot[last] = s;
+        live.pop_back();
+        slot[idx] = -1;
+    }
+
+    /**
+     * kill cells entirely covered by a sphere.
+     * a cell is covered if its center is within reach, the radius less the half diagonal.
+     */
+    void kill_around(const Real3& pos, const Real reach)
+    {
+        if (reach <= 0)
+        {
+            return;
+        }
+        const Real reach_sq(reach * reach);
+        each_neighbor(pos, reach,
+            [&](const Integer idx)
+            {
+                if (slot[idx] >= 0 && length_sq(difference(center(idx), pos)) <= reach_sq)
+                {
+                    kill(idx);
+                }
+            });
+    }
+};
+
+void ParticlePlacer::bounding_box(const Shape& shape, Real3& lower, Real3& upper) const
+{
+    const Real3& edge_lengths(world_.edge_lengths());
+    shape.bounding_box(edge_lengths, lower, upper);
+
+    // no need to go beyond a period.
+    for (int d(0); d < 3; ++d)
+    {
+        if (upper[d] - lower[d] > edge_lengths[d])
+        {
+            lower[d] = 0.0;
+            upper[d] = edge_lengths[d];
+        }
+    }
+}
+
+bool ParticlePlacer::is_inside(const Shape& shape, const Real3& pos) const
+{
+    return (shape.is_inside(pos) <= 0 || shape.is_inside(world_.apply_boundary(pos)) <= 0);
+}
+
+bool ParticlePlacer::try_place(
+    const Species& sp, const Real3& pos, const Real radius, const MoleculeInfo& info,
+    const Shape& shape)
+{
+    if (!is_inside(shape, pos))
+    {
+        return false;
+    }
+
+    const Real3 newpos(world_.apply_boundary(pos));
+    if (world_._check_particles_within_radius(newpos, radius, ParticleID()))
+    {
+        return false;
+    }
+
+    placed_.push_back(
+        world_.new_particle(Particle(sp, newpos, radius, info.D, info.constraint_radius)).first.first);
+    return true;
+}
+
+Integer ParticlePlacer::place_in_free_space(
+    const Species& sp, const Integer num, const Shape& shape, const MoleculeInfo& info,
+    placement_result& result)
+{
+    const Real radius(info.radius);
+    Real3 lower, upper;
+    bounding_box(shape, lower, upper);
+
+    free_space_grid grid(lower, upper, world_.edge_lengths(), radius, max_grid_cells_);
+    const Real half_diagonal(grid.half_diagonal());
+
+    for (Integer i(0); i < grid.size(); ++i)
+    {
+        if (shape.is_inside(grid.center(i)) > half_diagonal)
+        {
+            grid.kill(i);
+        }
+    }
+
+    const std::vector<std::pair<ParticleID, Particle> > particles(world_.list_particles());
+    for (std::vector<std::pair<ParticleID, Particle> >::const_iterator i(particles.begin());
+        i != particles.end(); ++i)
+    {
+        grid.kill_around((*i).second.position(), radius + (*i).second.radius() - half_diagonal);
+    }
+
+    Integer placed(0);
+    while (placed < num && grid.live.size() > 0)
+    {
+        const Integer idx(grid.live[(*rng_).uniform_int(0, grid.live.size() - 1)]);
+        const Real3 c(grid.center(idx));
+        const Real3 pos(draw_in_box(c - multiply(grid.width, 0.5), c + multiply(grid.width, 0.5)));
+        ++result.num_sampled;
+
+        if (try_place(sp, pos, radius, info, shape))
+        {
+            ++placed;
+            grid.kill_around(pos, 2 * radius - half_diagonal);
+        }
+        else if (++grid.failures[idx] >= max_cell_failures_)
+        {
+            grid.kill(idx);
+        }
+    }
+    return placed;
+}
+
+Integer ParticlePlacer::place_on_lattice(
+    const Species& sp, const Integer num, const Shape& shape, const MoleculeInfo& info,
+    placement_result& result)
+{
+    const Real radius(info.radius);
+    Real3 lower, upper;
+    bounding_box(shape, lower, upper);
+    const Real3 size(upper - lower);
+
+    // shrink a face-centered cubic lattice until it has enough free sites.
+    const Real basis[4][3] = {{0, 0, 0}, {0.5, 0.5, 0}, {0.5, 0, 0.5}, {0, 0.5, 0.5}};
+    std::vector<Real3> sites;
+    Real3 spacing;
+    Real a(std::cbrt(4 * size[0] * size[1] * size[2] / num));
+    while (true)
+    {
+        if (a < radius)
+        {
+            throw_exception<IllegalState>(
+                "No room to place ", num, " particles of [", sp.serial(), "].");
+        }
+
+        // stretch the unit cell along each axis to fill the box.
+        sites.clear();
+        Integer n[3];
+        for (int d(0); d < 3; ++d)
+        {
+            n[d] = std::max(static_cast<Integer>(1), static_cast<Integer>(size[d] / a));
+            spacing[d] = size[d] / n[d];
+        }
+        for (Integer k(0); k < n[2]; ++k)
+        {
+            for (Integer j(0); j < n[1]; ++j)
+            {
+                for (Integer i(0); i < n[0]; ++i)
+                {
+                    for (int b(0); b < 4; ++b)
+                    {
+                        const Real3 site(
+                            lower[0] + (i + basis[b][0] + 0.25) * spacing[0],
+                            lower[1] + (j + basis[b][1] + 0.25) * spacing[1],
+                            lower[2] + (k + basis[b][2] + 0.25) * spacing[2]);
+                        if (shape.is_inside(site) <= 0
+                            && !world_._check_particles_within_radius(
+                                world_.apply_boundary(site), radius, ParticleID()))
+                        {
+                            sites.push_back(site);
+                        }
+                    }
+                }
+            }
+        }
+
+        if (static_cast<Integer>(sites.size()) >= num)
+        {
+            break;
+        }
+        a *= 0.95;
+    }
+
+    shuffle(*rng_, sites);
+    sites.resize(num);
+
+    // half the distance to the nearest site, less the radius.
+    const Real jitter(0.25 * std::sqrt(std::min(std::min(
+        spacing[0] * spacing[0] + spacing[1] * spacing[1],
+        spacing[1] * spacing[1] + spacing[2] * spacing[2]),
+        spacing[2] * spacing[2] + spacing[0] * spacing[0])) - radius);
+    if (jitter > 0)
+    {
+        for (std::vector<Real3>::iterator i(sites.begin()); i != sites.end(); ++i)
+        {
+            const Real3 pos((*i) + Real3(
+                (*rng_).uniform(-jitter, jitter),
+                (*rng_).uniform(-jitter, jitter),
+                (*rng_).uniform(-jitter, jitter)));
+            if (is_inside(shape, pos))
+            {
+                (*i) = pos;
+            }
+        }
+    }
+
+    relax(sites, radius, shape, result);
+
+    std::vector<Particle> particles;
+    particles.reserve(sites.size());
+    for (std::vector<Real3>::const_iterator i(sites.begin()); i != sites.end(); ++i)
+    {
+        particles.push_back(Particle(
+            sp, world_.apply_boundary(*i), radius, info.D, info.constraint_radius));
+    }
+    try
+    {
+        const std::vector<ParticleID> pids(world_.insert_particles(particles, true));
+        placed_.insert(placed_.end(), pids.begin(), pids.end());
+    }
+    catch (const IllegalArgument& e)
+    {
+        throw_exception<IllegalState>(
+            "Failed to place particles of [", sp.serial(), "] after the relaxation.");
+    }
+    result.num_lattice += num;
+    return num;
+}
+
+void ParticlePlacer::relax(
+    std::vector<Real3>& positions, const Real radius, const Shape& shape,
+    placement_result& result) const
+{
+    const Real3& edge_lengths(world_.edge_lengths());
+    const uniform_grid grid(Real3(0, 0, 0), edge_lengths, edge_lengths, 2 * radius, max_grid_cells_);
+    const Real diameter(2 * radius);
+    const Real overshoot(1.05);
+
+    std::vector<Integer> offsets(grid.size() + 1);
+    std::vector<Integer> order(positions.size());
+    std::vector<Real3> wrapped(positions.size());
+    std::vector<Real3> displacements(positions.size());
+
+    for (Integer sweep(0); sweep < max_sweeps_; ++sweep)
+    {
+        // bin particles into the grid in the compressed row format.
+        std::fill(offsets.begin(), offsets.end(), 0);
+        std::vector<Integer> cells(positions.size());
+        for (std::size_t i(0); i < positions.size(); ++i)
+        {
+            wrapped[i] = world_.apply_boundary(positions[i]);
+            Integer idx[3];
+            for (int d(0); d < 3; ++d)
+            {
+                idx[d] = std::min(grid.n[d] - 1,
+                    static_cast<Integer>(wrapped[i][d] / grid.width[d]));
+            }
+            cells[i] = idx[0] + grid.n[0] * (idx[1] + grid.n[1] * idx[2]);
+            ++offsets[cells[i] + 1];
+        }
+        for (Integer c(0); c < grid.size(); ++c)
+        {
+            offsets[c + 1] += offsets[c];
+        }
+        {
+            std::vector<Integer> cursor(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i(0); i < positions.size(); ++i)
+            {
+                order[cursor[cells[i]]++] = i;
+            }
+        }
+
+        Integer num_overlaps(0);
+        for (std::size_t i(0); i < positions.size(); ++i)
+        {
+            Real3 disp(0, 0, 0);
+
+            grid.each_neighbor(wrapped[i], diameter,
+                [&](const Integer c)
+                {
+                    for (Integer k(offsets[c]); k < offsets[c + 1]; ++k)
+                    {
+                        const Integer j(order[k]);
+                        if (static_cast<std::size_t>(j) == i)
+                        {
+                            continue;
+                        }
+                        const Real3 diff(grid.difference(wrapped[i], wrapped[j]));
+                        const Real dist(length(diff));
+                        if (dist < diameter)
+                        {
+                            ++num_overlaps;
+                            const Real3 dir(dist > 0 ? multiply(diff, 1.0 / dist)
+                                : Real3(i < static_cast<std::size_t>(j) ? 1 : -1, 0, 0));
+                            disp += multiply(dir, 0.5 * (diameter - dist) * overshoot);
+                        }
+                    }
+                });
+
+            // particles placed before are fixed.
+            const std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+                overlapped(world_.list_particles_within_radius(wrapped[i], radius));
+            for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+                j(overlapped.begin()); j != overlapped.end(); ++j)
+            {
+                ++num_overlaps;
+                const Real3 diff(grid.difference(wrapped[i], (*j).first.second.position()));
+                const Real dist(length(diff));
+                const Real3 dir(dist > 0 ? multiply(diff, 1.0 / dist) : Real3(1, 0, 0));
+                disp += multiply(dir, (radius - (*j).second) * overshoot);
+            }
+
+            displacements[i] = disp;
+        }
+
+        if (num_overlaps == 0)
+        {
+            return;
+        }
+        ++result.num_sweeps;
+
+        // move all at once, halving a displacement leaving the shape.
+        for (std::size_t i(0); i < positions.size(); ++i)
+        {
+            Real3 disp(displacements[i]);
+            for (int trial(0); trial < 4; ++trial)
+            {
+                const Real3 pos(positions[i] + disp);
+                if (is_inside(shape, pos))
+                {
+                    positions[i] = pos;
+                    break;
+                }
+                disp = multiply(disp, 0.5);
+            }
+        }
+    }
+
+    throw_exception<IllegalState>(
+        "Failed to relax overlaps of ", positions.size(), " particles in ", max_sweeps_, " sweeps.");
+}
+
+Real ParticlePlacer::packing_fraction(const std::shared_ptr<Shape>& shape) const
+{
+    Real3 lower, upper;
+    bounding_box(*shape, lower, upper);
+    const Real3 size(upper - lower);
+
+    // the volume of the shape estimated at the midpoints of a regular grid.
+    const Integer n(32);
+    Integer inside(0);
+    for (Integer k(0); k < n; ++k)
+    {
+        for (Integer j(0); j < n; ++j)
+        {
+            for (Integer i(0); i < n; ++i)
+            {
+                const Real3 pos(
+                    lower[0] + (i + 0.5) * size[0] / n,
+                    lower[1] + (j + 0.5) * size[1] / n,
+                    lower[2] + (k + 0.5) * size[2] / n);
+                if ((*shape).is_inside(pos) <= 0)
+                {
+                    ++inside;
+                }
+            }
+        }
+    }
+    const Real volume(size[0] * size[1] * size[2] * inside / (n * n * n));
+    if (volume <= 0)
+    {
+        return 0.0;
+    }
+
+    Real occupied(0.0);
+    const std::vector<std::pair<ParticleID, Particle> > particles(world_.list_particles());
+    for (std::vector<std::pair<ParticleID, Particle> >::const_iterator i(particles.begin());
+        i != particles.end(); ++i)
+    {
+        Real3 pos((*i).second.position());
+        if ((*shape).is_inside(pos) > 0)
+        {
+            // try the image nearest to the bounding box.
+            const Real3& edge_lengths(world_.edge_lengths());
+            for (int d(0); d < 3; ++d)
+            {
+                const Real c(0.5 * (lower[d] + upper[d]));
+                pos[d] += edge_lengths[d] * std::floor((c - pos[d]) / edge_lengths[d] + 0.5);
+            }
+            if ((*shape).is_inside(pos) > 0)
+            {
+                continue;
+            }
+        }
+        const Real r((*i).second.radius());
+        occupied += 4.0 / 3.0 * M_PI * r * r * r;
+    }
+    return occupied / volume;
+}
+
+placement_result ParticlePlacer::place(
+    const Species& sp, const Integer num, const std::shared_ptr<Shape>& shape)
+{
+    typedef std::chrono::steady_clock clock_type;
+    const clock_type::time_point start(clock_type::now());
+
+    if (num < 0)
+    {
+        throw std::invalid_argument("the number of particles must be positive.");
+    }
+
+    const MoleculeInfo info(world_.get_molecule_info(sp));
+    placement_result result = {0, 0, 0, 0, 0.0, 0.0};
+    placed_.clear();
+
+    Real3 lower, upper;
+    bounding_box(*shape, lower, upper);
+
+    // rejection sampling within the bounding box while it succeeds.
+    Integer failures(0);
+    while (result.num_placed < num && failures < max_failures_)
+    {
+        ++result.num_sampled;
+        if (try_place(sp, draw_in_box(lower, upper), info.radius, info, *shape))
+        {
+            ++result.num_placed;
+            failures = 0;
+        }
+        else
+        {
+            ++failures;
+        }
+    }
+
+    if (result.num_placed < num)
+    {
+        result.num_placed += place_in_free_space(
+            sp, num - result.num_placed, *shape, info, result);
+    }
+
+    if (result.num_placed < num)
+    {
+        // random positions jam below the packing of a lattice. start over on it.
+        for (std::vector<ParticleID>::const_iterator i(placed_.begin()); i != placed_.end(); ++i)
+        {
+            world_.remove_particle(*i);
+        }
+        placed_.clear();
+        result.num_placed = place_on_lattice(sp, num, *shape, info, result);
+    }
+    placed_.clear();
+
+    result.packing_fraction = packing_fraction(shape);
+    result.seconds = std::chrono::duration<Real>(clock_type::now() - start).count();
+    return result;
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,160 @@
+#ifndef ECELL4_BD_PARTICLE_PLACER_HPP
+#define ECELL4_BD_PARTICLE_PLACER_HPP
+
+#include <vector>
+#include <memory>
+#include <ostream>
+#include <stdint.h>
+
+#include "types.hpp"
+#include "Real3.hpp"
+#include "Species.hpp"
+#include "Shape.hpp"
+#include "RandomNumberGenerator.hpp"
+#include "BDWorld.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a summary of ParticlePlacer::place.
+ */
+struct placement_result
+{
+    Integer num_placed;
+    Integer num_sampled;  // positions drawn at random, in the bounding box or free cells
+    Integer num_lattice;  // particles placed by the lattice fallback
+    Integer num_sweeps;  // sweeps of the overlap relaxation
+    Real packing_fraction;  // the volume fraction of all particles centered in the shape
+    Real seconds;  // wall-clock time
+};
+
+template<typename Tstrm_, typename Ttraits_>
+inline std::basic_ostream<Tstrm_, Ttraits_>& operator<<(
+    std::basic_ostream<Tstrm_, Ttraits_>& strm, const placement_result& v)
+{
+    strm << "placed=" << v.num_placed
+        << ",sampled=" << v.num_sampled
+        << ",lattice=" << v.num_lattice
+        << ",sweeps=" << v.num_sweeps
+        << ",packing_fraction=" << v.packing_fraction
+        << ",seconds=" << v.seconds;
+    return strm;
+}
+
+/**
+ * place particles without overlaps at high packing fractions.
+ * the placement proceeds in three phases, each taking over the rest of the previous:
+ * 1. rejection sampling within the bounding box of the shape,
+ * 2. sampling from a grid of free cells, in which cells covered by a particle
+ *    or failing repeatedly are removed,
+ * 3. a lattice with jitter followed by the relaxation of overlaps,
+ *    on which all particles of the call are placed again.
+ * positions differ from extras::throw_in_particles for the same seed.
+ */
+class ParticlePlacer
+{
+public:
+
+    ParticlePlacer(BDWorld& world, const std::shared_ptr<RandomNumberGenerator>& rng)
+        : world_(world), rng_(rng),
+        max_failures_(256), max_cell_failures_(16), max_grid_cells_(1 << 22), max_sweeps_(1000)
+    {
+        ;
+    }
+
+    /**
+     * the number of consecutive failures before switching to the free-space grid.
+     */
+    void set_max_failures(const Integer max_failures)
+    {
+        max_failures_ = max_failures;
+    }
+
+    /**
+     * the number of failures before a free cell is regarded as full.
+     */
+    void set_max_cell_failures(const Integer max_cell_failures)
+    {
+        max_cell_failures_ = max_cell_failures;
+    }
+
+    /**
+     * the upper limit of the number of cells in the free-space grid.
+     */
+    void set_max_grid_cells(const Integer max_grid_cells)
+    {
+        max_grid_cells_ = max_grid_cells;
+    }
+
+    void set_max_sweeps(const Integer max_sweeps)
+    {
+        max_sweeps_ = max_sweeps;
+    }
+
+    /**
+     * place num particles of the species inside the shape.
+     * throw IllegalState if the overlaps cannot be relaxed.
+     */
+    placement_result place(const Species& sp, const Integer num, const std::shared_ptr<Shape>& shape);
+
+    /**
+     * @return the volume fraction of particles centered in the shape
+     */
+    Real packing_fraction(const std::shared_ptr<Shape>& shape) const;
+
+protected:
+
+    struct free_space_grid;
+
+    bool try_place(const Species& sp, const Real3& pos, const Real radius, const MoleculeInfo& info,
+        const Shape& shape);
+
+    Integer place_in_free_space(
+        const Species& sp, const Integer num, const Shape& shape, const MoleculeInfo& info,
+        placement_result& result);
+
+    Integer place_on_lattice(
+        const Species& sp, const Integer num, const Shape& shape, const MoleculeInfo& info,
+        placement_result& result);
+
+    void relax(std::vector<Real3>& positions, const Real radius, const Shape& shape,
+        placement_result& result) const;
+
+    void bounding_box(const Shape& shape, Real3& lower, Real3& upper) const;
+
+    /**
+     * test a position, or its image in the world, is inside the shape.
+     */
+    bool is_inside(const Shape& shape, const Real3& pos) const;
+
+    Real3 draw_in_box(const Real3& lower, const Real3& upper)
+    {
+        return Real3(
+            (*rng_).uniform(lower[0], upper[0]),
+            (*rng_).uniform(lower[1], upper[1]),
+            (*rng_).uniform(lower[2], upper[2]));
+    }
+
+protected:
+
+    BDWorld& world_;
+    std::shared_ptr<RandomNumberGenerator> rng_;
+
+    Integer max_failures_;
+    Integer max_cell_failures_;
+    Integer max_grid_cells_;
+    Integer max_sweeps_;
+
+    std::vector<ParticleID> placed_;  // particles placed in the current call
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_PARTICLE_PLACER_HPP */
@@ -2,6 +2,9 @@
 #define ECELL4_PARTICLE_SPACE_HPP
 
 #include <cmath>
+#include <memory>
+#include <istream>
+#include <ostream>
 #include <unordered_map>
 
 #include "types.hpp"
@@ -10,6 +13,7 @@
 #include "Real3.hpp"
 #include "Particle.hpp"
 #include "Species.hpp"
+#include "Statistics.hpp"
 // #include "Space.hpp"
 
 #ifdef WITH_HDF5
@@ -26,6 +30,8 @@ public:
 
     typedef std::vector<std::pair<ParticleID, Particle> >
     particle_container_type;
+    typedef std::vector<particle_container_type::size_type>
+    particle_index_list;
 
 public:
 
@@ -166,6 +172,45 @@ public:
     virtual void load_hdf5(const H5::Group& root) = 0;
 #endif
 
+    /**
+     * save/load the space in the dependency-free binary format.
+     * the order of particles is preserved.
+     */
+    virtual void save_binary(std::ostream& out) const
+    {
+        throw NotSupported(
+            "save_binary(std::ostream&) is not supported by this space class");
+    }
+
+    virtual void load_binary(std::istream& in)
+    {
+        throw NotSupported(
+            "load_binary(std::istream&) is not supported by this space class");
+    }
+
+    /**
+     * copy the space including the time.
+     * the copy may share the storage with this until either is changed.
+     */
+    virtual std::unique_ptr<ParticleSpace> clone() const
+    {
+        throw NotSupported("clone() is not supported by this space class");
+    }
+
+    /**
+     * add particles not in the space at once.
+     * the order of particles is preserved.
+     * @param particles a list of pairs of a new ParticleID and Particle
+     * @param check_overlaps if true, throw IllegalArgument without adding
+     * any particle when a particle overlaps with another
+     */
+    virtual void bulk_load(
+        const particle_container_type& particles, const bool check_overlaps)
+    {
+        throw NotSupported(
+            "bulk_load(const particle_container_type&, const bool) is not supported by this space class");
+    }
+
     // ParticleSpace member functions
 
     /**
@@ -189,6 +234,25 @@ public:
 
     virtual std::pair<ParticleID, Particle> const& _get_particle(const size_t idx) const = 0;
 
+    /**
+     * get the index of a particle in particles(), valid until the next change of the space.
+     * throws NotFound if no such particle.
+     * @param pid ParticleID
+     * @return the index
+     */
+    virtual size_t _get_index(const ParticleID& pid) const
+    {
+        const particle_container_type& pcont(particles());
+        for (particle_container_type::const_iterator i(pcont.begin()); i != pcont.end(); ++i)
+        {
+            if ((*i).first == pid)
+            {
+                return i - pcont.begin();
+            }
+        }
+        throw NotFound("No such particle.");
+    }
+
     /**
      * remove a particle
      * this function is a member of ParticleSpace
@@ -237,6 +301,36 @@ public:
         const Real3& pos, const Real& radius,
         const ParticleID& ignore1, const ParticleID& ignore2) const = 0;
 
+    /**
+     * get particles of the given classes within a spherical region except for ignore.
+     * a space not partitioned by classes may list particles of other classes too.
+     * @param pos a center position of the sphere
+     * @param radius a radius of the sphere
+     * @param ignore an ignored ID
+     * @param classes bits of classes of species, see set_cell_classes
+     * @return a list of particles
+     */
+    virtual std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+    list_particles_within_radius(
+        const Real3& pos, const Real& radius,
+        const ParticleID& ignore, const uint64_t classes) const
+    {
+        return list_particles_within_radius(pos, radius, ignore);
+    }
+
+    /**
+     * partition the space by classes of species, up to 64, for queries by classes.
+     * species not given are in the class 0. ignored by a space without partitions.
+     * @param classes classes of species
+     * @param num_classes the number of classes
+     */
+    virtual void set_cell_classes(
+        const std::unordered_map<Species::serial_type, std::size_t>& classes,
+        const std::size_t num_classes)
+    {
+        ;
+    }
+
     /**
      * transpose a position based on the periodic boundary condition.
      * this function is a part of the trait of ParticleSpace.
@@ -329,6 +423,17 @@ public:
 
     virtual const particle_container_type& particles() const = 0;
 
+    /**
+     * get indices of particles of a species in particles(), in no particular order.
+     * @param sp a species
+     * @return a list of indices, valid until the next change of the space
+     */
+    virtual const particle_index_list& particle_indices(const Species& sp) const
+    {
+        throw NotSupported(
+            "particle_indices(const Species&) is not supported by this space class");
+    }
+
     virtual Real get_value(const Species& sp) const
     {
         return static_cast<Real>(num_molecules(sp));
@@ -345,9 +450,23 @@ public:
         return size[0] * size[1] * size[2];
     }
 
+    /**
+     * counters of the space, see ECELL4_BD_STATS.
+     */
+    const ParticleSpaceStatistics& statistics() const
+    {
+        return stats_;
+    }
+
+    void reset_statistics()
+    {
+        stats_.reset();
+    }
+
 protected:
 
     Real t_;
+    mutable ParticleSpaceStatistics stats_;
 };
 
 // class ParticleSpaceVectorImpl
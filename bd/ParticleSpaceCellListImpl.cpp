@@ -1,6 +1,11 @@
+#include <fstream>
+#include <algorithm>
+#include <thread>
+
 #include "ParticleSpaceCellListImpl.hpp"
 // #include "Context.hpp"
 #include "comparators.hpp"
+#include "binary_io.hpp"
 
 
 namespace ecell4
@@ -9,67 +14,351 @@ namespace ecell4
 void ParticleSpaceCellListImpl::reset(const Real3& edge_lengths)
 {
     base_type::t_ = 0.0;
-    particles_.clear();
-    rmap_.clear();
-    particle_pool_.clear();
 
-    for (matrix_type::size_type i(0); i < matrix_.shape()[0]; ++i)
+    // leave the storage shared with copies as it is.
+    particles_ = CopyOnWrite<particle_container_type>();
+    rmap_ = CopyOnWrite<key_to_value_map_type>();
+    particle_pool_ = CopyOnWrite<per_species_particle_index_list>();
+    pool_slots_.clear();
+    matrix_.clear();
+    matrix_.resize(num_cell_classes_ * num_cells());
+
+    for (Real3::size_type dim(0); dim < 3; ++dim)
+    {
+        if (edge_lengths[dim] <= 0)
+        {
+            throw std::invalid_argument("the edge length must be positive.");
+        }
+    }
+
+    edge_lengths_ = edge_lengths;
+    cell_sizes_[0] = edge_lengths_[0] / shape_[0];
+    cell_sizes_[1] = edge_lengths_[1] / shape_[1];
+    cell_sizes_[2] = edge_lengths_[2] / shape_[2];
+    // throw NotImplemented("Not implemented yet.");
+}
+
+void ParticleSpaceCellListImpl::reset(
+    const Real3& edge_lengths, const Integer3& matrix_sizes)
+{
+    if (matrix_sizes.col <= 0 || matrix_sizes.row <= 0 || matrix_sizes.layer <= 0)
+    {
+        throw std::invalid_argument("the matrix size must be positive.");
+    }
+
+    shape_[0] = matrix_sizes.col;
+    shape_[1] = matrix_sizes.row;
+    shape_[2] = matrix_sizes.layer;
+    reset(edge_lengths);
+}
+
+void ParticleSpaceCellListImpl::save(const std::string& filename) const
+{
+    std::ofstream fout(filename.c_str(), std::ios::binary | std::ios::trunc);
+    if (!fout)
+    {
+        throw_exception<IllegalState>("Failed to open [", filename, "].");
+    }
+    save_binary(fout);
+}
+
+void ParticleSpaceCellListImpl::save_binary(std::ostream& out) const
+{
+    binary_io::write_header(out, "ECELL4PSCELLLIST", 1);
+    binary_io::write(out, base_type::t_);
+    binary_io::write(out, edge_lengths_);
+    binary_io::write(out, static_cast<int64_t>(shape_[0]));
+    binary_io::write(out, static_cast<int64_t>(shape_[1]));
+    binary_io::write(out, static_cast<int64_t>(shape_[2]));
+
+    binary_io::write(out, static_cast<uint64_t>((*particles_).size()));
+    for (particle_container_type::const_iterator i((*particles_).begin());
+        i != (*particles_).end(); ++i)
+    {
+        const ParticleID& pid((*i).first);
+        const Particle& p((*i).second);
+        binary_io::write(out, pid.lot());
+        binary_io::write(out, pid.serial());
+        binary_io::write(out, p.species_serial());
+        binary_io::write(out, p.position());
+        binary_io::write(out, p.stride());
+        binary_io::write(out, p.radius());
+        binary_io::write(out, p.D());
+        binary_io::write(out, p.constraint_radius());
+        binary_io::write(out, p.original_position());
+        binary_io::write(out, p.location());
+    }
+}
+
+void ParticleSpaceCellListImpl::load_binary(std::istream& in)
+{
+    binary_io::read_header(in, "ECELL4PSCELLLIST", 1);
+    const Real t(binary_io::read<Real>(in));
+    const Real3 edge_lengths(binary_io::read<Real3>(in));
+    const int64_t col(binary_io::read<int64_t>(in));
+    const int64_t row(binary_io::read<int64_t>(in));
+    const int64_t layer(binary_io::read<int64_t>(in));
+    reset(edge_lengths, Integer3(col, row, layer));
+    set_t(t);
+
+    const uint64_t num_particles(binary_io::read<uint64_t>(in));
+    particle_container_type particles;
+    particles.reserve(num_particles);
+    for (uint64_t i(0); i < num_particles; ++i)
+    {
+        ParticleID pid;
+        binary_io::read(in, pid.lot());
+        binary_io::read(in, pid.serial());
+        const std::string serial(binary_io::read<std::string>(in));
+        const Real3 position(binary_io::read<Real3>(in));
+        const Real3 stride(binary_io::read<Real3>(in));
+        const Real radius(binary_io::read<Real>(in));
+        const Real D(binary_io::read<Real>(in));
+        const Real constraint_radius(binary_io::read<Real>(in));
+        const Real3 original_position(binary_io::read<Real3>(in));
+
+        Particle p(Species(serial), position, radius, D, constraint_radius,
+                   stride, original_position);
+        binary_io::read(in, p.location());
+        particles.push_back(std::make_pair(pid, p));
+    }
+    bulk_load(particles, false);
+}
+
+void ParticleSpaceCellListImpl::bulk_load(
+    const particle_container_type& particles, const bool check_overlaps)
+{
+    if (particles.size() == 0)
+    {
+        return;
+    }
+
     {
-        for (matrix_type::size_type j(0); j < matrix_.shape()[1]; ++j)
+        std::vector<ParticleID> pids;
+        pids.reserve(particles.size());
+        for (particle_container_type::const_iterator i(particles.begin());
+            i != particles.end(); ++i)
         {
-            for (matrix_type::size_type k(0); k < matrix_.shape()[2]; ++k)
+            if ((*rmap_).find((*i).first))
             {
-                matrix_[i][j][k].clear();
+                throw_exception<AlreadyExists>(
+                    "A particle with the ID [", (*i).first, "] already exists.");
             }
+            pids.push_back((*i).first);
+        }
+        std::sort(pids.begin(), pids.end());
+        std::vector<ParticleID>::const_iterator
+            dup(std::adjacent_find(pids.begin(), pids.end()));
+        if (dup != pids.end())
+        {
+            throw_exception<AlreadyExists>(
+                "The ID [", *dup, "] is given to more than one particle.");
         }
     }
 
-    for (Real3::size_type dim(0); dim < 3; ++dim)
+    // counting sort by the flat index of cells.
+    const std::size_t num_cells(matrix_.size());
+    std::vector<std::size_t> cells(particles.size());
+    std::vector<std::size_t> offsets(num_cells + 1, 0);
+    for (std::size_t i(0); i < particles.size(); ++i)
     {
-        if (edge_lengths[dim] <= 0)
+        cells[i] = cell_of(particles[i].second);
+        ++offsets[cells[i] + 1];
+    }
+    for (std::size_t c(0); c < num_cells; ++c)
+    {
+        offsets[c + 1] += offsets[c];
+    }
+
+    if (check_overlaps)
+    {
+        std::vector<std::size_t> order(particles.size());
         {
-            throw std::invalid_argument("the edge length must be positive.");
+            std::vector<std::size_t> pos(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i(0); i < particles.size(); ++i)
+            {
+                order[pos[cells[i]]++] = i;
+            }
+        }
+
+        // each thread tests a contiguous chunk of at least 1024 particles.
+        const std::size_t num_threads(std::max(static_cast<std::size_t>(1), std::min(
+            static_cast<std::size_t>(std::thread::hardware_concurrency()),
+            particles.size() / 1024)));
+        const std::size_t chunk((particles.size() + num_threads - 1) / num_threads);
+        std::vector<std::size_t> found(num_threads, particles.size());
+        std::vector<std::thread> threads;
+        for (std::size_t t(1); t < num_threads; ++t)
+        {
+            threads.push_back(std::thread(
+                [&, t]()
+                {
+                    found[t] = find_overlap_in_bulk(particles, order, offsets,
+                        t * chunk, std::min(particles.size(), (t + 1) * chunk));
+                }));
+        }
+        found[0] = find_overlap_in_bulk(
+            particles, order, offsets, 0, std::min(particles.size(), chunk));
+        for (std::vector<std::thread>::iterator i(threads.begin()); i != threads.end(); ++i)
+        {
+            (*i).join();
+        }
+
+        const std::size_t first(*std::min_element(found.begin(), found.end()));
+        if (first != particles.size())
+        {
+            throw_exception<IllegalArgument>(
+                "The particle [", particles[first].first, "] overlaps with another.");
         }
     }
 
-    edge_lengths_ = edge_lengths;
-    // throw NotImplemented("Not implemented yet.");
+    particle_container_type& dst_particles(particles_.mutate());
+    key_to_value_map_type& rmap(rmap_.mutate());
+    per_species_particle_index_list& particle_pool(particle_pool_.mutate());
+
+    dst_particles.reserve(dst_particles.size() + particles.size());
+    pool_slots_.reserve(dst_particles.size() + particles.size());
+    for (std::size_t c(0); c < num_cells; ++c)
+    {
+        if (offsets[c + 1] != offsets[c])
+        {
+            cell_type& dst(matrix_.mutate(c));
+            dst.reserve(dst.size() + offsets[c + 1] - offsets[c]);
+        }
+    }
+
+    // new indices are larger than any in the cells, which stay sorted.
+    per_species_particle_index_list::iterator pool(particle_pool.end());
+    for (std::size_t i(0); i < particles.size(); ++i)
+    {
+        const Species::serial_type& serial(particles[i].second.species_serial());
+        const particle_container_type::size_type idx(dst_particles.size());
+        dst_particles.push_back(particles[i]);
+        matrix_.mutate(cells[i]).push_back(idx);
+        rmap.assign(particles[i].first, idx);
+
+        if (pool == particle_pool.end() || (*pool).first != serial)
+        {
+            pool = particle_pool.insert(std::make_pair(serial, particle_index_list())).first;
+        }
+        pool_slots_.push_back((*pool).second.size());
+        (*pool).second.push_back(idx);
+    }
+}
+
+std::size_t ParticleSpaceCellListImpl::find_overlap_in_bulk(
+    const particle_container_type& particles,
+    const std::vector<std::size_t>& order, const std::vector<std::size_t>& offsets,
+    const std::size_t begin, const std::size_t end) const
+{
+    // the same criterion as _check_particles_within_radius, without counting.
+    // particles are visited in the order of cells for the locality.
+    std::size_t retval(particles.size());
+    for (std::size_t k(begin); k < end; ++k)
+    {
+        const std::size_t i(order[k]);
+        const Real3& pos(particles[i].second.position());
+        const Real radius(particles[i].second.radius());
+        const cell_index_type idx(this->index(pos));
+
+        bool overlapped(false);
+        cell_offset_type off;
+        for (off[2] = -1; off[2] <= 1 && !overlapped; ++off[2])
+        {
+            for (off[1] = -1; off[1] <= 1 && !overlapped; ++off[1])
+            {
+                for (off[0] = -1; off[0] <= 1 && !overlapped; ++off[0])
+                {
+                    cell_index_type newidx(idx);
+                    const Real3 stride(this->offset_index_cyclic(newidx, off));
+
+                    for (std::size_t k(0); k < num_cell_classes_ && !overlapped; ++k)
+                    {
+                        const std::size_t f(k * num_cells() + flat_index(newidx));
+                        const cell_type& c(matrix_[f]);
+                        for (cell_type::const_iterator j(c.begin()); j != c.end(); ++j)
+                        {
+                            const Particle& p((*particles_)[*j].second);
+                            if (length(p.position() + stride - pos) - p.radius() < radius)
+                            {
+                                overlapped = true;
+                                break;
+                            }
+                        }
+
+                        for (std::size_t l(offsets[f]); l < offsets[f + 1] && !overlapped; ++l)
+                        {
+                            const std::size_t j(order[l]);
+                            if (j == i)
+                            {
+                                continue;
+                            }
+                            const Particle& p(particles[j].second);
+                            if (length(p.position() + stride - pos) - p.radius() < radius)
+                            {
+                                overlapped = true;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        if (overlapped && i < retval)
+        {
+            retval = i;
+        }
+    }
+    return retval;
 }
 
 bool ParticleSpaceCellListImpl::update_particle(
     const ParticleID& pid, const Particle& p)
 {
     particle_container_type::iterator i(find(pid));
-    if (i != particles_.end())
+    const particle_container_type& particles(*particles_);  // not shared after find
+    if (i != particles.end())
     {
         if ((*i).second.species() != p.species())
         {
-            particle_pool_[(*i).second.species_serial()].erase((*i).first);
-            particle_pool_[p.species_serial()].insert(pid);
+            const particle_container_type::size_type idx(i - particles.begin());
+            erase_from_pool((*i).second.species_serial(), idx);
+            push_into_pool(p.species_serial(), idx);
         }
         this->update(i, std::make_pair(pid, p));
         return false;
     }
 
-    this->update(std::make_pair(pid, p));
+    const particle_container_type::iterator
+        j(this->update(std::make_pair(pid, p)).first);
     // const bool succeeded(this->update(std::make_pair(pid, p)).second);
     // BOOST_ASSERT(succeeded);
 
-    particle_pool_[p.species_serial()].insert(pid);
+    push_into_pool(p.species_serial(), j - (*particles_).begin());
     return true;
 }
 
 std::pair<ParticleID, Particle> const& ParticleSpaceCellListImpl::_get_particle(
     const size_t idx) const
 {
-    return particles_[idx];
+    return (*particles_)[idx];
+}
+
+size_t ParticleSpaceCellListImpl::_get_index(const ParticleID& pid) const
+{
+    particle_container_type::const_iterator i(this->find(pid));
+    if (i == (*particles_).end())
+    {
+        throw NotFound("No such particle.");
+    }
+    return i - (*particles_).begin();
 }
 
 std::pair<ParticleID, Particle> ParticleSpaceCellListImpl::get_particle(
     const ParticleID& pid) const
 {
     particle_container_type::const_iterator i(this->find(pid));
-    if (i == particles_.end())
+    if (i == (*particles_).end())
     {
         throw NotFound("No such particle.");
     }
@@ -78,7 +367,8 @@ std::pair<ParticleID, Particle> ParticleSpaceCellListImpl::get_particle(
 
 bool ParticleSpaceCellListImpl::has_particle(const ParticleID& pid) const
 {
-    return (this->find(pid) != particles_.end());
+    const particle_container_type::size_type* p((*rmap_).find(pid));
+    return (p != NULL);
 }
 
 void ParticleSpaceCellListImpl::remove_particle(const ParticleID& pid)
@@ -86,14 +376,19 @@ void ParticleSpaceCellListImpl::remove_particle(const ParticleID& pid)
     //XXX: In contrast to the original ParticleContainer in epdp,
     //XXX: this remove_particle throws an error when no corresponding
     //XXX: particle is found.
-    std::pair<ParticleID, Particle> pp(get_particle(pid)); //XXX: may raise an error.
-    particle_pool_[pp.second.species_serial()].erase(pid);
-    this->erase(pid);
+    particle_container_type::iterator i(this->find(pid));
+    const particle_container_type& particles(*particles_);  // not shared after find
+    if (i == particles.end())
+    {
+        throw NotFound("No such particle.");
+    }
+    erase_from_pool((*i).second.species_serial(), i - particles.begin());
+    this->erase(i);
 }
 
 Integer ParticleSpaceCellListImpl::num_particles() const
 {
-    return particles_.size();
+    return (*particles_).size();
 }
 
 Integer ParticleSpaceCellListImpl::num_particles(const Species& sp) const
@@ -115,8 +410,8 @@ Integer ParticleSpaceCellListImpl::num_particles(const Species& sp) const
 
 Integer ParticleSpaceCellListImpl::num_particles_exact(const Species& sp) const
 {
-    per_species_particle_id_set::const_iterator i(particle_pool_.find(sp.serial()));
-    if (i == particle_pool_.end())
+    per_species_particle_index_list::const_iterator i((*particle_pool_).find(sp.serial()));
+    if (i == (*particle_pool_).end())
     {
         return 0;
     }
@@ -145,7 +440,7 @@ Integer ParticleSpaceCellListImpl::num_molecules_exact(const Species& sp) const
 std::vector<std::pair<ParticleID, Particle> >
     ParticleSpaceCellListImpl::list_particles() const
 {
-    return particles_;
+    return *particles_;
 }
 
 std::vector<std::pair<ParticleID, Particle> >
@@ -171,23 +466,22 @@ std::vector<std::pair<ParticleID, Particle> >
 {
     std::vector<std::pair<ParticleID, Particle> > retval;
 
-    // per_species_particle_id_set::const_iterator
-    //     i(particle_pool_.find(sp.serial()));
-    // if (i == particle_pool_.end())
-    // {
-    //     //XXX: In the original, this raises an error,
-    //     //XXX: but returns an empty vector here.
-    //     return retval;
-    // }
-    // retval.reserve((*i).second.size());
+    per_species_particle_index_list::const_iterator
+        i((*particle_pool_).find(sp.serial()));
+    if (i == (*particle_pool_).end())
+    {
+        //XXX: In the original, this raises an error,
+        //XXX: but returns an empty vector here.
+        return retval;
+    }
 
-    for (particle_container_type::const_iterator i(particles_.begin());
-         i != particles_.end(); ++i)
+    // sorted to keep the order in particles_.
+    particle_index_list indices((*i).second);
+    std::sort(indices.begin(), indices.end());
+    retval.reserve(indices.size());
+    for (particle_index_list::const_iterator j(indices.begin()); j != indices.end(); ++j)
     {
-        if ((*i).second.species() == sp)
-        {
-            retval.push_back(*i);
-        }
+        retval.push_back((*particles_)[*j]);
     }
     return retval;
 }
@@ -199,12 +493,15 @@ std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
     std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > retval;
 
     // MatrixSpace::each_neighbor_cyclic
-    if (particles_.size() == 0)
+    const particle_container_type& particles(*particles_);
+    if (particles.size() == 0)
     {
         return retval;
     }
 
     cell_index_type idx(this->index(pos));
+    const std::size_t num_classes(num_cell_classes_);
+    const matrix_type::size_type ncells(num_cells());
 
     // MatrixSpace::each_neighbor_cyclic_loops
     cell_offset_type off;
@@ -216,23 +513,28 @@ std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
             {
                 cell_index_type newidx(idx);
                 const Real3 stride(this->offset_index_cyclic(newidx, off));
-                const cell_type& c(this->cell(newidx));
-                for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
+                const matrix_type::size_type f(flat_index(newidx));
+                for (std::size_t k(0); k < num_classes; ++k)
                 {
-                    // neighbor_filter::operator()
-                    particle_container_type::const_iterator
-                        itr(particles_.begin() + (*i));
-                    // particle_container_type::const_iterator itr = particles_.begin();
-                    // std::advance(itr, *i);
-
-                    const Real dist(
-                        length((*itr).second.position() + stride - pos)
-                        - (*itr).second.radius());
-                    if (dist < radius)
+                    const cell_type& c(matrix_[k * ncells + f]);
+                    ECELL4_BD_STATS(stats_.candidates_scanned += c.size());
+                    for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
                     {
-                        // overlap_checker::operator()
-                        retval.push_back(
-                            std::make_pair(*itr, dist));
+                        // neighbor_filter::operator()
+                        particle_container_type::const_iterator
+                            itr(particles.begin() + (*i));
+                        // particle_container_type::const_iterator itr = particles_.begin();
+                        // std::advance(itr, *i);
+
+                        const Real dist(
+                            length((*itr).second.position() + stride - pos)
+                            - (*itr).second.radius());
+                        if (dist < radius)
+                        {
+                            // overlap_checker::operator()
+                            retval.push_back(
+                                std::make_pair(*itr, dist));
+                        }
                     }
                 }
             }
@@ -252,12 +554,15 @@ std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
     std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > retval;
 
     // MatrixSpace::each_neighbor_cyclic
-    if (particles_.size() == 0)
+    const particle_container_type& particles(*particles_);
+    if (particles.size() == 0)
     {
         return retval;
     }
 
     cell_index_type idx(this->index(pos));
+    const std::size_t num_classes(num_cell_classes_);
+    const matrix_type::size_type ncells(num_cells());
 
     // MatrixSpace::each_neighbor_cyclic_loops
     cell_offset_type off;
@@ -269,23 +574,28 @@ std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
             {
                 cell_index_type newidx(idx);
                 const Real3 stride(this->offset_index_cyclic(newidx, off));
-                const cell_type& c(this->cell(newidx));
-                for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
+                const matrix_type::size_type f(flat_index(newidx));
+                for (std::size_t k(0); k < num_classes; ++k)
                 {
-                    // neighbor_filter::operator()
-                    particle_container_type::const_iterator
-                        itr(particles_.begin() + (*i));
-
-                    const Real dist(
-                        length((*itr).second.position() + stride - pos)
-                        - (*itr).second.radius());
-                    if (dist < radius)
+                    const cell_type& c(matrix_[k * ncells + f]);
+                    ECELL4_BD_STATS(stats_.candidates_scanned += c.size());
+                    for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
                     {
-                        // overlap_checker::operator()
-                        if ((*itr).first != ignore)
+                        // neighbor_filter::operator()
+                        particle_container_type::const_iterator
+                            itr(particles.begin() + (*i));
+
+                        const Real dist(
+                            length((*itr).second.position() + stride - pos)
+                            - (*itr).second.radius());
+                        if (dist < radius)
                         {
-                            retval.push_back(
-                                std::make_pair(*itr, dist));
+                            // overlap_checker::operator()
+                            if ((*itr).first != ignore)
+                            {
+                                retval.push_back(
+                                    std::make_pair(*itr, dist));
+                            }
                         }
                     }
                 }
@@ -306,12 +616,15 @@ std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
     std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > retval;
 
     // MatrixSpace::each_neighbor_cyclic
-    if (particles_.size() == 0)
+    const particle_container_type& particles(*particles_);
+    if (particles.size() == 0)
     {
         return retval;
     }
 
     cell_index_type idx(this->index(pos));
+    const std::size_t num_classes(num_cell_classes_);
+    const matrix_type::size_type ncells(num_cells());
 
     // MatrixSpace::each_neighbor_cyclic_loops
     cell_offset_type off;
@@ -323,20 +636,85 @@ std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
             {
                 cell_index_type newidx(idx);
                 const Real3 stride(this->offset_index_cyclic(newidx, off));
-                const cell_type& c(this->cell(newidx));
-                for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
+                const matrix_type::size_type f(flat_index(newidx));
+                for (std::size_t k(0); k < num_classes; ++k)
                 {
-                    // neighbor_filter::operator()
-                    particle_container_type::const_iterator
-                        itr(particles_.begin() + (*i));
-
-                    const Real dist(
-                        length((*itr).second.position() + stride - pos)
-                        - (*itr).second.radius());
-                    if (dist < radius)
+                    const cell_type& c(matrix_[k * ncells + f]);
+                    ECELL4_BD_STATS(stats_.candidates_scanned += c.size());
+                    for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
                     {
-                        // overlap_checker::operator()
-                        if ((*itr).first != ignore1 && (*itr).first != ignore2)
+                        // neighbor_filter::operator()
+                        particle_container_type::const_iterator
+                            itr(particles.begin() + (*i));
+
+                        const Real dist(
+                            length((*itr).second.position() + stride - pos)
+                            - (*itr).second.radius());
+                        if (dist < radius)
+                        {
+                            // overlap_checker::operator()
+                            if ((*itr).first != ignore1 && (*itr).first != ignore2)
+                            {
+                                retval.push_back(
+                                    std::make_pair(*itr, dist));
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    std::sort(retval.begin(), retval.end(),
+        utils::pair_second_element_comparator<std::pair<ParticleID, Particle>, Real>());
+    return retval;
+}
+
+std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+    ParticleSpaceCellListImpl::list_particles_within_radius(
+        const Real3& pos, const Real& radius,
+        const ParticleID& ignore, const uint64_t classes) const
+{
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > retval;
+
+    const particle_container_type& particles(*particles_);
+    if (particles.size() == 0 || classes == 0)
+    {
+        return retval;
+    }
+
+    cell_index_type idx(this->index(pos));
+    const std::size_t num_classes(num_cell_classes_);
+    const matrix_type::size_type ncells(num_cells());
+
+    cell_offset_type off;
+    for (off[2] = -1; off[2] <= 1; ++off[2])
+    {
+        for (off[1] = -1; off[1] <= 1; ++off[1])
+        {
+            for (off[0] = -1; off[0] <= 1; ++off[0])
+            {
+                cell_index_type newidx(idx);
+                const Real3 stride(this->offset_index_cyclic(newidx, off));
+                const matrix_type::size_type f(flat_index(newidx));
+                for (std::size_t k(0); k < num_classes; ++k)
+                {
+                    if (((classes >> k) & 1) == 0)
+                    {
+                        continue;
+                    }
+
+                    const cell_type& c(matrix_[k * ncells + f]);
+                    ECELL4_BD_STATS(stats_.candidates_scanned += c.size());
+                    for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
+                    {
+                        particle_container_type::const_iterator
+                            itr(particles.begin() + (*i));
+
+                        const Real dist(
+                            length((*itr).second.position() + stride - pos)
+                            - (*itr).second.radius());
+                        if (dist < radius && (*itr).first != ignore)
                         {
                             retval.push_back(
                                 std::make_pair(*itr, dist));
@@ -352,16 +730,57 @@ std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
     return retval;
 }
 
+void ParticleSpaceCellListImpl::set_cell_classes(
+    const std::unordered_map<Species::serial_type, std::size_t>& classes,
+    const std::size_t num_classes)
+{
+    if (num_classes == 0 || num_classes > 64)
+    {
+        throw_exception<IllegalArgument>(
+            "The number of classes [", num_classes, "] must be from 1 to 64.");
+    }
+    for (std::unordered_map<Species::serial_type, std::size_t>::const_iterator
+        i(classes.begin()); i != classes.end(); ++i)
+    {
+        if ((*i).second >= num_classes)
+        {
+            throw_exception<IllegalArgument>(
+                "The class [", (*i).second, "] of [", (*i).first, "] is out of range.");
+        }
+    }
+
+    if (num_classes == num_cell_classes_ && (num_classes == 1 || classes == cell_classes_))
+    {
+        return;
+    }
+
+    num_cell_classes_ = num_classes;
+    cell_classes_ = (num_classes == 1
+        ? std::unordered_map<Species::serial_type, std::size_t>() : classes);
+
+    // indices are pushed in the increasing order, and cells stay sorted.
+    const particle_container_type& particles(*particles_);
+    matrix_.clear();
+    matrix_.resize(num_cell_classes_ * num_cells());
+    for (particle_container_type::size_type i(0); i < particles.size(); ++i)
+    {
+        matrix_.mutate(cell_of(particles[i].second)).push_back(i);
+    }
+}
+
 bool ParticleSpaceCellListImpl::_check_particles_within_radius(
     const Real3& pos, const Real& radius, const ParticleID& ignore) const
 {
     // MatrixSpace::each_neighbor_cyclic
-    if (particles_.size() == 0)
+    const particle_container_type& particles(*particles_);
+    if (particles.size() == 0)
     {
         return false;
     }
 
     cell_index_type idx(this->index(pos));
+    const std::size_t num_classes(num_cell_classes_);
+    const matrix_type::size_type ncells(num_cells());
 
     // MatrixSpace::each_neighbor_cyclic_loops
     cell_offset_type off;
@@ -373,22 +792,27 @@ bool ParticleSpaceCellListImpl::_check_particles_within_radius(
             {
                 cell_index_type newidx(idx);
                 const Real3 stride(this->offset_index_cyclic(newidx, off));
-                const cell_type& c(this->cell(newidx));
-                for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
+                const matrix_type::size_type f(flat_index(newidx));
+                for (std::size_t k(0); k < num_classes; ++k)
                 {
-                    // neighbor_filter::operator()
-                    particle_container_type::const_iterator
-                        itr(particles_.begin() + (*i));
-
-                    const Real dist(
-                        length((*itr).second.position() + stride - pos)
-                        - (*itr).second.radius());
-                    if (dist < radius)
+                    const cell_type& c(matrix_[k * ncells + f]);
+                    ECELL4_BD_STATS(stats_.candidates_scanned += c.size());
+                    for (cell_type::const_iterator i(c.begin()); i != c.end(); ++i)
                     {
-                        // overlap_checker::operator()
-                        if ((*itr).first != ignore)
+                        // neighbor_filter::operator()
+                        particle_container_type::const_iterator
+                            itr(particles.begin() + (*i));
+
+                        const Real dist(
+                            length((*itr).second.position() + stride - pos)
+                            - (*itr).second.radius());
+                        if (dist < radius)
                         {
-                            return true;
+                            // overlap_checker::operator()
+                            if ((*itr).first != ignore)
+                            {
+                                return true;
+                            }
                         }
                     }
                 }
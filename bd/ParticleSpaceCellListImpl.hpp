@@ -2,8 +2,9 @@
 #define ECELL4_PARTICLE_SPACE_CELL_LIST_IMPL_HPP
 
 #include <set>
-#include <boost/multi_array.hpp>
 #include <array>
+#include <memory>
+#include <limits>
 
 #include "ParticleSpace.hpp"
 
@@ -12,12 +13,14 @@
 #endif
 
 #include "Integer3.hpp"
+#include "SerialSlotMap.hpp"
+#include "CopyOnWrite.hpp"
 
 
 namespace ecell4
 {
 
-class ParticleSpaceCellListImpl
+class ParticleSpaceCellListImpl final
     : public ParticleSpace
 {
 public:
@@ -25,53 +28,64 @@ public:
     typedef ParticleSpace base_type;
     typedef ParticleSpace::particle_container_type particle_container_type;
 
-    typedef std::unordered_map<ParticleID, particle_container_type::size_type>
+    typedef SerialSlotMap<ParticleID, particle_container_type::size_type>
         key_to_value_map_type;
 
-    typedef std::set<ParticleID> particle_id_set;
-    typedef std::map<Species::serial_type, particle_id_set> per_species_particle_id_set;
+    typedef ParticleSpace::particle_index_list particle_index_list; // unsorted
+    typedef std::map<Species::serial_type, particle_index_list> per_species_particle_index_list;
 
     typedef std::vector<particle_container_type::size_type> cell_type; // sorted
-    typedef boost::multi_array<cell_type, 3> matrix_type;
+    typedef ChunkedArray<cell_type> matrix_type; // cells in the row-major order
     typedef std::array<matrix_type::size_type, 3> cell_index_type;
     typedef std::array<matrix_type::difference_type, 3> cell_offset_type;
 
 public:
 
     ParticleSpaceCellListImpl(const Real3& edge_lengths)
-        : base_type(), edge_lengths_(edge_lengths), matrix_(boost::extents[3][3][3])
+        : base_type(), edge_lengths_(edge_lengths), matrix_(3 * 3 * 3), num_cell_classes_(1)
     {
-        cell_sizes_[0] = edge_lengths_[0] / matrix_.shape()[0];
-        cell_sizes_[1] = edge_lengths_[1] / matrix_.shape()[1];
-        cell_sizes_[2] = edge_lengths_[2] / matrix_.shape()[2];
+        shape_[0] = 3;
+        shape_[1] = 3;
+        shape_[2] = 3;
+        cell_sizes_[0] = edge_lengths_[0] / shape_[0];
+        cell_sizes_[1] = edge_lengths_[1] / shape_[1];
+        cell_sizes_[2] = edge_lengths_[2] / shape_[2];
     }
 
     ParticleSpaceCellListImpl(
         const Real3& edge_lengths, const Integer3& matrix_sizes)
         : base_type(), edge_lengths_(edge_lengths),
-        matrix_(boost::extents[matrix_sizes.col][matrix_sizes.row][matrix_sizes.layer])
+        matrix_(matrix_sizes.col * matrix_sizes.row * matrix_sizes.layer), num_cell_classes_(1)
     {
-        cell_sizes_[0] = edge_lengths_[0] / matrix_.shape()[0];
-        cell_sizes_[1] = edge_lengths_[1] / matrix_.shape()[1];
-        cell_sizes_[2] = edge_lengths_[2] / matrix_.shape()[2];
+        shape_[0] = matrix_sizes.col;
+        shape_[1] = matrix_sizes.row;
+        shape_[2] = matrix_sizes.layer;
+        cell_sizes_[0] = edge_lengths_[0] / shape_[0];
+        cell_sizes_[1] = edge_lengths_[1] / shape_[1];
+        cell_sizes_[2] = edge_lengths_[2] / shape_[2];
+    }
+
+    /**
+     * copy the space in O(the number of cells / ChunkedArray::chunk_size).
+     * the copy shares particles and cells with this until either changes them:
+     * the first change copies the list of particles and its indices as a whole,
+     * and a chunk of cells only when a particle enters or leaves a cell in it.
+     */
+    std::unique_ptr<ParticleSpace> clone() const
+    {
+        return std::unique_ptr<ParticleSpace>(new ParticleSpaceCellListImpl(*this));
     }
 
     void diagnosis() const
     {
-        for (matrix_type::size_type i(0); i < matrix_.shape()[0]; ++i)
+        for (matrix_type::size_type i(0); i < matrix_.size(); ++i)
         {
-            for (matrix_type::size_type j(0); j < matrix_.shape()[1]; ++j)
+            const cell_type& c = matrix_[i];
+            for (cell_type::const_iterator it(c.begin()); it != c.end(); ++it)
             {
-                for (matrix_type::size_type k(0); k < matrix_.shape()[2]; ++k)
+                if (*it >= (*particles_).size())
                 {
-                    const cell_type& c = matrix_[i][j][k];
-                    for (cell_type::const_iterator it(c.begin()); it != c.end(); ++it)
-                    {
-                        if (*it >= particles_.size())
-                        {
-                            throw IllegalState("out of bounds.");
-                        }
-                    }
+                    throw IllegalState("out of bounds.");
                 }
             }
         }
@@ -81,18 +95,18 @@ public:
 
     virtual Integer num_species() const
     {
-        return particle_pool_.size();
+        return (*particle_pool_).size();
     }
     virtual bool has_species(const Species& sp) const
     {
-        return (particle_pool_.find(sp.serial()) != particle_pool_.end());
+        return ((*particle_pool_).find(sp.serial()) != (*particle_pool_).end());
     }
 
     virtual std::vector<Species> list_species() const
     {
         std::vector<Species> retval;
-        for (per_species_particle_id_set::const_iterator
-            i(particle_pool_.begin()); i != particle_pool_.end(); ++i)
+        for (per_species_particle_index_list::const_iterator
+            i((*particle_pool_).begin()); i != (*particle_pool_).end(); ++i)
         {
             retval.push_back(Species((*i).first));
         }
@@ -113,19 +127,28 @@ public:
 
     const Integer3 matrix_sizes() const
     {
-        return Integer3(matrix_.shape()[0], matrix_.shape()[1], matrix_.shape()[2]);
+        return Integer3(shape_[0], shape_[1], shape_[2]);
     }
 
     void reset(const Real3& edge_lengths);
+    void reset(const Real3& edge_lengths, const Integer3& matrix_sizes);
 
     bool update_particle(const ParticleID& pid, const Particle& p);
 
     const particle_container_type& particles() const
     {
-        return particles_;
+        return *particles_;
+    }
+
+    const particle_index_list& particle_indices(const Species& sp) const
+    {
+        static const particle_index_list empty;
+        per_species_particle_index_list::const_iterator i((*particle_pool_).find(sp.serial()));
+        return (i == (*particle_pool_).end() ? empty : (*i).second);
     }
 
     std::pair<ParticleID, Particle> const& _get_particle(const size_t idx) const;
+    size_t _get_index(const ParticleID& pid) const;
     std::pair<ParticleID, Particle> get_particle(const ParticleID& pid) const;
     bool has_particle(const ParticleID& pid) const;
     void remove_particle(const ParticleID& pid);
@@ -143,11 +166,16 @@ public:
     std::vector<std::pair<ParticleID, Particle> >
         list_particles_exact(const Species& sp) const;
 
-    virtual void save(const std::string& filename) const
-    {
-        throw NotSupported(
-            "save(const std::string) is not supported by this space class");
-    }
+    virtual void save(const std::string& filename) const;
+
+    void save_binary(std::ostream& out) const;
+    void load_binary(std::istream& in);
+
+    /**
+     * particles are binned by a counting sort and appended to the cells in one pass.
+     * overlaps are tested in parallel before any change.
+     */
+    void bulk_load(const particle_container_type& particles, const bool check_overlaps);
 
 #ifdef WITH_HDF5
     void save_hdf5(H5::Group* root) const
@@ -173,6 +201,27 @@ public:
             const Real3& pos, const Real& radius,
             const ParticleID& ignore1, const ParticleID& ignore2) const;
 
+    /**
+     * visit only cells of the given classes.
+     */
+    std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+        list_particles_within_radius(
+            const Real3& pos, const Real& radius,
+            const ParticleID& ignore, const uint64_t classes) const;
+
+    /**
+     * each cell is split into a cell by class. particles are binned again if changed.
+     * classes are kept over reset and load_binary.
+     */
+    void set_cell_classes(
+        const std::unordered_map<Species::serial_type, std::size_t>& classes,
+        const std::size_t num_classes);
+
+    std::size_t num_cell_classes() const
+    {
+        return num_cell_classes_;
+    }
+
     bool _check_particles_within_radius(
         const Real3& pos, const Real& radius, const ParticleID& ignore) const;
 
@@ -183,11 +232,11 @@ protected:
     {
         cell_index_type retval = {{
             static_cast<matrix_type::size_type>(
-                pos[0] / cell_sizes_[0]) % matrix_.shape()[0],
+                pos[0] / cell_sizes_[0]) % shape_[0],
             static_cast<matrix_type::size_type>(
-                pos[1] / cell_sizes_[1]) % matrix_.shape()[1],
+                pos[1] / cell_sizes_[1]) % shape_[1],
             static_cast<matrix_type::size_type>(
-                pos[2] / cell_sizes_[2]) % matrix_.shape()[2]
+                pos[2] / cell_sizes_[2]) % shape_[2]
             }}; // std::array<matrix_type::size_type, 3>
         return retval;
     }
@@ -201,16 +250,16 @@ protected:
             static_cast<matrix_type::size_type>(-o[0]) > i[0])
         {
             matrix_type::size_type t(
-                (i[0] + matrix_.shape()[0] - (-o[0] % matrix_.shape()[0]))
-                % matrix_.shape()[0]);
+                (i[0] + shape_[0] - (-o[0] % shape_[0]))
+                % shape_[0]);
             retval[0] = (o[0] - static_cast<matrix_type::difference_type>(t - i[0]))
                 * cell_sizes_[0];
             i[0] = t;
         }
-        else if (matrix_.shape()[0] - o[0] <= i[0])
+        else if (shape_[0] - o[0] <= i[0])
         {
             matrix_type::size_type
-                t((i[0] + (o[0] % matrix_.shape()[0])) % matrix_.shape()[0]);
+                t((i[0] + (o[0] % shape_[0])) % shape_[0]);
             retval[0] = (o[0] - static_cast<matrix_type::difference_type>(t - i[0]))
                 * cell_sizes_[0];
             i[0] = t;
@@ -224,16 +273,16 @@ protected:
             static_cast<matrix_type::size_type>(-o[1]) > i[1])
         {
             matrix_type::size_type t(
-                (i[1] + matrix_.shape()[1] - (-o[1] % matrix_.shape()[1]))
-                % matrix_.shape()[1]);
+                (i[1] + shape_[1] - (-o[1] % shape_[1]))
+                % shape_[1]);
             retval[1] = (o[1] - static_cast<matrix_type::difference_type>(t - i[1]))
                 * cell_sizes_[1];
             i[1] = t;
         }
-        else if (matrix_.shape()[1] - o[1] <= i[1])
+        else if (shape_[1] - o[1] <= i[1])
         {
             matrix_type::size_type
-                t((i[1] + (o[1] % matrix_.shape()[1])) % matrix_.shape()[1]);
+                t((i[1] + (o[1] % shape_[1])) % shape_[1]);
             retval[1] = (o[1] - static_cast<matrix_type::difference_type>(t - i[1]))
                 * cell_sizes_[1];
             i[1] = t;
@@ -247,16 +296,16 @@ protected:
             static_cast<matrix_type::size_type>(-o[2]) > i[2])
         {
             matrix_type::size_type
-                t((i[2] + matrix_.shape()[2] - (-o[2] % matrix_.shape()[2]))
-                % matrix_.shape()[2]);
+                t((i[2] + shape_[2] - (-o[2] % shape_[2]))
+                % shape_[2]);
             retval[2] = (o[2] - static_cast<matrix_type::difference_type>(t - i[2]))
                 * cell_sizes_[2];
             i[2] = t;
         }
-        else if (matrix_.shape()[2] - o[2] <= i[2])
+        else if (shape_[2] - o[2] <= i[2])
         {
             matrix_type::size_type t(
-                (i[2] + (o[2] % matrix_.shape()[2])) % matrix_.shape()[2]);
+                (i[2] + (o[2] % shape_[2])) % shape_[2]);
             retval[2] = (o[2] - static_cast<matrix_type::difference_type>(t - i[2]))
                 * cell_sizes_[2];
             i[2] = t;
@@ -269,155 +318,190 @@ protected:
         return retval;
     }
 
-    inline const cell_type& cell(const cell_index_type& i) const
+    inline matrix_type::size_type flat_index(const cell_index_type& i) const
     {
-        return matrix_[i[0]][i[1]][i[2]];
+        return (i[0] * shape_[1] + i[1]) * shape_[2] + i[2];
     }
 
-    inline cell_type& cell(const cell_index_type& i)
+    inline matrix_type::size_type num_cells() const
     {
-        return matrix_[i[0]][i[1]][i[2]];
+        return shape_[0] * shape_[1] * shape_[2];
     }
 
+    /**
+     * @return the offset of flat indices of cells for the class of a particle.
+     * a species not in classes goes to the class 1 if constrained, or 0,
+     * as InteractionTable::class_of.
+     */
+    inline matrix_type::size_type class_offset(const Particle& p) const
+    {
+        if (num_cell_classes_ == 1)
+        {
+            return 0;
+        }
+        std::unordered_map<Species::serial_type, std::size_t>::const_iterator
+            i(cell_classes_.find(p.species_serial()));
+        if (i != cell_classes_.end())
+        {
+            return (*i).second * num_cells();
+        }
+        return (p.constraint_radius() != std::numeric_limits<Real>::infinity() ? num_cells() : 0);
+    }
+
+    /**
+     * @return the flat index of the cell of a particle, in its class
+     */
+    inline matrix_type::size_type cell_of(const Particle& p) const
+    {
+        return class_offset(p) + flat_index(index(p.position()));
+    }
+
+    /**
+     * test particles from order[begin] to order[end - 1], where order and
+     * offsets bin the list by the flat index of cells.
+     * @return the smallest index of particles overlapping with one in the space
+     * or another in the list, or the size of the list if none.
+     */
+    std::size_t find_overlap_in_bulk(
+        const particle_container_type& particles,
+        const std::vector<std::size_t>& order, const std::vector<std::size_t>& offsets,
+        const std::size_t begin, const std::size_t end) const;
+
+    /**
+     * find a particle to be changed. particles are no longer shared after this.
+     */
     inline particle_container_type::iterator find(const ParticleID& k)
     {
-        key_to_value_map_type::const_iterator p(rmap_.find(k));
-        if (rmap_.end() == p)
+        particle_container_type& particles(particles_.mutate());
+        const particle_container_type::size_type* p((*rmap_).find(k));
+        if (!p)
         {
-            return particles_.end();
+            return particles.end();
         }
-        return particles_.begin() + (*p).second;
+        return particles.begin() + (*p);
     }
 
     inline particle_container_type::const_iterator find(const ParticleID& k) const
     {
-        key_to_value_map_type::const_iterator p(rmap_.find(k));
-        if (rmap_.end() == p)
+        const particle_container_type::size_type* p((*rmap_).find(k));
+        if (!p)
+        {
+            return (*particles_).end();
+        }
+        return (*particles_).begin() + (*p);
+    }
+
+    /**
+     * add a particle to the index list of its species in O(1).
+     */
+    inline void push_into_pool(
+        const Species::serial_type& serial, const particle_container_type::size_type& idx)
+    {
+        particle_index_list& pool(particle_pool_.mutate()[serial]);
+        if (pool_slots_.size() <= idx)
         {
-            return particles_.end();
+            pool_slots_.resize(idx + 1);
         }
-        return particles_.begin() + (*p).second;
+        pool_slots_.mutate(idx) = pool.size();
+        pool.push_back(idx);
+    }
+
+    /**
+     * remove a particle from the index list of its species in O(1),
+     * moving the last index in the list to the hole.
+     */
+    inline void erase_from_pool(
+        const Species::serial_type& serial, const particle_container_type::size_type& idx)
+    {
+        particle_index_list& pool(particle_pool_.mutate()[serial]);
+        const particle_index_list::size_type pos(pool_slots_[idx]);
+        const particle_container_type::size_type last(pool.back());
+        pool[pos] = last;
+        pool_slots_.mutate(last) = pos;
+        pool.pop_back();
+    }
+
+    /**
+     * move a particle from a cell to another, which are given by flat indices.
+     */
+    inline void move_between_cells(
+        const matrix_type::size_type from, const matrix_type::size_type to,
+        const particle_container_type::size_type& idx)
+    {
+        cell_type* old_cell(&matrix_.mutate(from));
+        erase_from_cell(old_cell, find_in_cell(old_cell, idx));
+        push_into_cell(&matrix_.mutate(to), idx);
+        ECELL4_BD_STATS(++stats_.cell_crossings);
     }
 
     inline particle_container_type::iterator update(
         particle_container_type::iterator const& old_value,
         const std::pair<ParticleID, Particle>& v)
     {
-        cell_type* new_cell(&cell(index(v.second.position())));
-        cell_type* old_cell(0);
+        particle_container_type& particles(particles_.mutate());
+        const matrix_type::size_type new_cell(cell_of(v.second));
 
-        if (old_value != particles_.end())
-        {
-            old_cell = &cell(index((*old_value).second.position()));
-        }
-
-        if (new_cell == old_cell)
+        if (old_value != particles.end())
         {
+            const matrix_type::size_type old_cell(cell_of((*old_value).second));
             // reinterpret_cast<nonconst_value_type&>(*old_value) = v;
             *old_value = v;
-            return old_value;
-        }
-        else
-        {
-            particle_container_type::size_type idx(0);
-
-            if (old_cell)
+            if (new_cell != old_cell)
             {
-                // reinterpret_cast<nonconst_value_type&>(*old_value) = v;
-                *old_value = v;
-
-                cell_type::iterator
-                    i(find_in_cell(old_cell, old_value - particles_.begin()));
-                idx = *i;
-                erase_from_cell(old_cell, i);
-                push_into_cell(new_cell, idx);
+                move_between_cells(old_cell, new_cell, old_value - particles.begin());
             }
-            else
-            {
-                idx = particles_.size();
-                particles_.push_back(v);
-                push_into_cell(new_cell, idx);
-                rmap_[v.first] = idx;
-            }
-            return particles_.begin() + idx;
+            return old_value;
         }
+
+        const particle_container_type::size_type idx(particles.size());
+        particles.push_back(v);
+        push_into_cell(&matrix_.mutate(new_cell), idx);
+        rmap_.mutate().assign(v.first, idx);
+        return particles.begin() + idx;
     }
 
     inline std::pair<particle_container_type::iterator, bool> update(
         const std::pair<ParticleID, Particle>& v)
     {
-        cell_type* new_cell(&cell(index(v.second.position())));
-        particle_container_type::iterator old_value(particles_.end());
-        cell_type* old_cell(0);
-
+        particle_container_type& particles(particles_.mutate());
+        particle_container_type::iterator old_value(particles.end());
         {
-            key_to_value_map_type::const_iterator i(rmap_.find(v.first));
-            if (i != rmap_.end())
+            const particle_container_type::size_type* i((*rmap_).find(v.first));
+            if (i)
             {
-                old_value = particles_.begin() + (*i).second;
-                old_cell = &cell(index(old_value->second.position()));
+                old_value = particles.begin() + (*i);
             }
         }
 
-        if (new_cell == old_cell)
-        {
-            // reinterpret_cast<nonconst_value_type&>(*old_value) = v;
-            *old_value = v;
-            // return std::pair<particle_container_type::iterator, bool>(old_value, false);
-            return std::make_pair(old_value, false);
-        }
-        else
-        {
-            particle_container_type::size_type idx(0);
-
-            if (old_cell)
-            {
-                // reinterpret_cast<nonconst_value_type&>(*old_value) = v;
-                *old_value = v;
-
-                cell_type::iterator
-                    i(find_in_cell(old_cell, old_value - particles_.begin()));
-                idx = *i;
-                erase_from_cell(old_cell, i);
-                push_into_cell(new_cell, idx);
-                return std::pair<particle_container_type::iterator, bool>(
-                    particles_.begin() + idx, false);
-            }
-            else
-            {
-                idx = particles_.size();
-                particles_.push_back(v);
-                push_into_cell(new_cell, idx);
-                rmap_[v.first] = idx;
-                return std::pair<particle_container_type::iterator, bool>(
-                    particles_.begin() + idx, true);
-            }
-        }
+        const bool inserted(old_value == particles.end());
+        return std::make_pair(update(old_value, v), inserted);
     }
 
     inline bool erase(particle_container_type::iterator const& i)
     {
-        if (particles_.end() == i)
+        particle_container_type& particles(particles_.mutate());
+        if (particles.end() == i)
         {
             return false;
         }
 
-        particle_container_type::size_type old_idx(i - particles_.begin());
-        cell_type& old_cell(cell(index((*i).second.position())));
+        particle_container_type::size_type old_idx(i - particles.begin());
+        cell_type& old_cell(matrix_.mutate(cell_of((*i).second)));
         const bool succeeded(erase_from_cell(&old_cell, old_idx));
         if (!succeeded)
         {
             throw IllegalState("never get here");
         }
         // BOOST_ASSERT(succeeded);
-        rmap_.erase((*i).first);
+        key_to_value_map_type& rmap(rmap_.mutate());
+        rmap.erase((*i).first);
 
-        particle_container_type::size_type const last_idx(particles_.size() - 1);
+        particle_container_type::size_type const last_idx(particles.size() - 1);
 
         if (old_idx < last_idx)
         {
-            const std::pair<ParticleID, Particle>& last(particles_[last_idx]);
-            cell_type& last_cell(cell(index(last.second.position())));
+            const std::pair<ParticleID, Particle>& last(particles[last_idx]);
+            cell_type& last_cell(matrix_.mutate(cell_of(last.second)));
             const bool tmp(erase_from_cell(&last_cell, last_idx));
             if (!tmp)
             {
@@ -425,22 +509,29 @@ protected:
             }
             // BOOST_ASSERT(tmp);
             push_into_cell(&last_cell, old_idx);
-            rmap_[last.first] = old_idx;
+            rmap.assign(last.first, old_idx);
+
+            // the last particle keeps its position in the index list of its species.
+            particle_pool_.mutate()[last.second.species_serial()][pool_slots_[last_idx]] = old_idx;
+            pool_slots_.mutate(old_idx) = pool_slots_[last_idx];
+
             // reinterpret_cast<nonconst_value_type&>(*i) = last;
             (*i) = last;
         }
-        particles_.pop_back();
+        particles.pop_back();
+        pool_slots_.pop_back();
         return true;
     }
 
     inline bool erase(const ParticleID& k)
     {
-        key_to_value_map_type::const_iterator p(rmap_.find(k));
-        if (rmap_.end() == p)
+        const particle_container_type::size_type* p((*rmap_).find(k));
+        if (!p)
         {
             return false;
         }
-        return erase(particles_.begin() + (*p).second);
+        const particle_container_type::size_type idx(*p);
+        return erase(particles_.mutate().begin() + idx);
     }
 
     inline void erase_from_cell(cell_type* c, const cell_type::iterator& i)
@@ -498,12 +589,18 @@ protected:
 
     Real3 edge_lengths_;
 
-    particle_container_type particles_;
-    key_to_value_map_type rmap_;
-    per_species_particle_id_set particle_pool_;
+    // particles are kept contiguous for views, and copied as a whole on write.
+    CopyOnWrite<particle_container_type> particles_;
+    CopyOnWrite<key_to_value_map_type> rmap_;
+    CopyOnWrite<per_species_particle_index_list> particle_pool_;
+    ChunkedArray<particle_index_list::size_type> pool_slots_; // the position of each particle in its index list
 
-    matrix_type matrix_;
+    matrix_type matrix_;  // cells of the class k from k * num_cells()
+    cell_index_type shape_;
     Real3 cell_sizes_;
+
+    std::unordered_map<Species::serial_type, std::size_t> cell_classes_;
+    std::size_t num_cell_classes_;
 };
 
 }; // ecell4
@@ -0,0 +1,280 @@
+#ifndef ECELL4_PARTICLE_VIEW_HPP
+#define ECELL4_PARTICLE_VIEW_HPP
+
+#include <vector>
+#include <iterator>
+#include <cstddef>
+
+#include "Particle.hpp"
+#include "Identifier.hpp"
+
+
+namespace ecell4
+{
+
+/**
+ * a non-owning view of members of elements in a contiguous array,
+ * e.g. positions in a list of pairs of ParticleID and Particle.
+ * the stride is given in bytes.
+ * a view is valid until the next change of the array.
+ */
+template<typename T_>
+class strided_span
+{
+public:
+
+    typedef T_ value_type;
+    typedef std::size_t size_type;
+
+    class const_iterator
+    {
+    public:
+
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T_ value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T_* pointer;
+        typedef const T_& reference;
+
+        const_iterator(const char* ptr, const std::ptrdiff_t stride)
+            : ptr_(ptr), stride_(stride)
+        {
+            ;
+        }
+
+        const T_& operator*() const
+        {
+            return *reinterpret_cast<const T_*>(ptr_);
+        }
+
+        const T_* operator->() const
+        {
+            return reinterpret_cast<const T_*>(ptr_);
+        }
+
+        const T_& operator[](const difference_type n) const
+        {
+            return *reinterpret_cast<const T_*>(ptr_ + n * stride_);
+        }
+
+        const_iterator& operator++()
+        {
+            ptr_ += stride_;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator retval(*this);
+            ptr_ += stride_;
+            return retval;
+        }
+
+        const_iterator& operator--()
+        {
+            ptr_ -= stride_;
+            return *this;
+        }
+
+        const_iterator& operator+=(const difference_type n)
+        {
+            ptr_ += n * stride_;
+            return *this;
+        }
+
+        const_iterator operator+(const difference_type n) const
+        {
+            return const_iterator(ptr_ + n * stride_, stride_);
+        }
+
+        difference_type operator-(const const_iterator& rhs) const
+        {
+            return (ptr_ - rhs.ptr_) / stride_;
+        }
+
+        bool operator==(const const_iterator& rhs) const
+        {
+            return ptr_ == rhs.ptr_;
+        }
+
+        bool operator!=(const const_iterator& rhs) const
+        {
+            return ptr_ != rhs.ptr_;
+        }
+
+        bool operator<(const const_iterator& rhs) const
+        {
+            return ptr_ < rhs.ptr_;
+        }
+
+    protected:
+
+        const char* ptr_;
+        std::ptrdiff_t stride_;
+    };
+
+public:
+
+    strided_span()
+        : data_(NULL), size_(0), stride_(sizeof(T_))
+    {
+        ;
+    }
+
+    strided_span(const T_* data, const size_type size, const std::ptrdiff_t stride)
+        : data_(reinterpret_cast<const char*>(data)), size_(size), stride_(stride)
+    {
+        ;
+    }
+
+    size_type size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    std::ptrdiff_t stride() const
+    {
+        return stride_;
+    }
+
+    const T_& operator[](const size_type i) const
+    {
+        return *reinterpret_cast<const T_*>(data_ + i * stride_);
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(data_, stride_);
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(data_ + size_ * stride_, stride_);
+    }
+
+protected:
+
+    const char* data_;
+    size_type size_;
+    std::ptrdiff_t stride_;
+};
+
+/**
+ * a non-owning view of the particles of a species, in no particular order.
+ * a view is valid until the next change of the space.
+ */
+class particle_species_view
+{
+public:
+
+    typedef std::pair<ParticleID, Particle> value_type;
+    typedef std::vector<value_type> particle_container_type;
+    typedef std::vector<particle_container_type::size_type> particle_index_list;
+    typedef particle_index_list::size_type size_type;
+
+    class const_iterator
+    {
+    public:
+
+        typedef std::forward_iterator_tag iterator_category;
+        typedef particle_species_view::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        const_iterator(
+            const particle_container_type& particles,
+            particle_index_list::const_iterator it)
+            : particles_(&particles), it_(it)
+        {
+            ;
+        }
+
+        const value_type& operator*() const
+        {
+            return (*particles_)[*it_];
+        }
+
+        const value_type* operator->() const
+        {
+            return &(*particles_)[*it_];
+        }
+
+        const_iterator& operator++()
+        {
+            ++it_;
+            return *this;
+        }
+
+        bool operator==(const const_iterator& rhs) const
+        {
+            return it_ == rhs.it_;
+        }
+
+        bool operator!=(const const_iterator& rhs) const
+        {
+            return it_ != rhs.it_;
+        }
+
+    protected:
+
+        const particle_container_type* particles_;
+        particle_index_list::const_iterator it_;
+    };
+
+public:
+
+    particle_species_view(
+        const particle_container_type& particles, const particle_index_list& indices)
+        : particles_(particles), indices_(indices)
+    {
+        ;
+    }
+
+    size_type size() const
+    {
+        return indices_.size();
+    }
+
+    bool empty() const
+    {
+        return indices_.empty();
+    }
+
+    const value_type& operator[](const size_type i) const
+    {
+        return particles_[indices_[i]];
+    }
+
+    /**
+     * @return indices of the particles in the container of the space
+     */
+    const particle_index_list& indices() const
+    {
+        return indices_;
+    }
+
+    const_iterator begin() const
+    {
+        return const_iterator(particles_, indices_.begin());
+    }
+
+    const_iterator end() const
+    {
+        return const_iterator(particles_, indices_.end());
+    }
+
+protected:
+
+    const particle_container_type& particles_;
+    const particle_index_list& indices_;
+};
+
+} // ecell4
+
+#endif /* ECELL4_PARTICLE_VIEW_HPP */
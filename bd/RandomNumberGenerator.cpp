@@ -2,6 +2,7 @@
 #include <sstream>
 
 #include "RandomNumberGenerator.hpp"
+#include "binary_io.hpp"
 
 #ifdef WITH_HDF5
 #include "extras.hpp"
@@ -117,4 +118,35 @@ void GSLRandomNumberGenerator::seed()
     gsl_rng_set(rng_.get(), unsigned(std::time(0)));
 }
 
+void GSLRandomNumberGenerator::save_binary(std::ostream& out) const
+{
+    binary_io::write_header(out, "ECELL4GSLRNG", 1);
+    binary_io::write(out, std::string(gsl_rng_name(rng_.get())));
+    const uint64_t bufsize(gsl_rng_size(rng_.get()));
+    binary_io::write(out, bufsize);
+    out.write(static_cast<const char*>(gsl_rng_state(rng_.get())), bufsize);
+}
+
+void GSLRandomNumberGenerator::load_binary(std::istream& in)
+{
+    binary_io::read_header(in, "ECELL4GSLRNG", 1);
+    const std::string name(binary_io::read<std::string>(in));
+    if (name != gsl_rng_name(rng_.get()))
+    {
+        throw_exception<NotSupported>(
+            "The generator type [", name, "] does not match [",
+            gsl_rng_name(rng_.get()), "].");
+    }
+    const uint64_t bufsize(binary_io::read<uint64_t>(in));
+    if (bufsize != gsl_rng_size(rng_.get()))
+    {
+        throw IllegalState("The size of the generator state does not match.");
+    }
+    in.read(static_cast<char*>(gsl_rng_state(rng_.get())), bufsize);
+    if (!in)
+    {
+        throw IllegalState("Unexpected end of a binary stream.");
+    }
+}
+
 } // ecell4
@@ -4,6 +4,9 @@
 #include <ctime>
 #include <vector>
 #include <memory>
+#include <istream>
+#include <ostream>
+#include <fstream>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
 
@@ -38,6 +41,13 @@ public:
     virtual void seed(Integer val) = 0;
     virtual void seed() = 0;
 
+    /**
+     * save/load the internal state in the dependency-free binary format.
+     * the state restored by load_binary reproduces exactly the same sequence.
+     */
+    virtual void save_binary(std::ostream& out) const = 0;
+    virtual void load_binary(std::istream& in) = 0;
+
 #ifdef WITH_HDF5
     virtual void save(H5::H5Location* root) const = 0;
     virtual void load(const H5::H5Location& root) = 0;
@@ -46,21 +56,29 @@ public:
 #else
     void save(const std::string& filename) const
     {
-        throw NotSupported(
-            "This method requires HDF5. The HDF5 support is turned off.");
+        std::ofstream fout(filename.c_str(), std::ios::binary | std::ios::trunc);
+        if (!fout)
+        {
+            throw_exception<IllegalState>("Failed to open [", filename, "].");
+        }
+        save_binary(fout);
     }
 
     void load(const std::string& filename)
     {
-        throw NotSupported(
-            "This method requires HDF5. The HDF5 support is turned off.");
+        std::ifstream fin(filename.c_str(), std::ios::binary);
+        if (!fin)
+        {
+            throw_exception<NotFound>("Failed to open [", filename, "].");
+        }
+        load_binary(fin);
     }
 #endif
 
 };
 
-template<typename Telem_>
-inline void shuffle(RandomNumberGenerator& rng, std::vector<Telem_>& cont)
+template<typename Trng_, typename Telem_>
+inline void shuffle(Trng_& rng, std::vector<Telem_>& cont)
 {
     using std::swap;
     typedef std::vector<Telem_> container_type;
@@ -72,7 +90,7 @@ inline void shuffle(RandomNumberGenerator& rng, std::vector<Telem_>& cont)
     }
 }
 
-class GSLRandomNumberGenerator
+class GSLRandomNumberGenerator final
     : public RandomNumberGenerator
 {
 public:
@@ -90,6 +108,9 @@ public:
     void seed(Integer val);
     void seed();
 
+    void save_binary(std::ostream& out) const;
+    void load_binary(std::istream& in);
+
 #ifdef WITH_HDF5
     void save(H5::H5Location* root) const;
     void load(const H5::H5Location& root);
@@ -0,0 +1,228 @@
+#include "ReactionTable.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+Real I_bd_3d(const Real sigma, const Real t, const Real D)
+{
+    const Real sqrtPi(std::sqrt(M_PI));
+
+    const Real Dt(D * t);
+    const Real Dt2(Dt + Dt);
+    const Real sqrtDt(std::sqrt(Dt));
+    const Real sigmasq(sigma * sigma);
+
+    const Real term1(1 / (3 * sqrtPi));
+    const Real term2(sigmasq - Dt2);
+    const Real term3(Dt2 - 3 * sigmasq);
+    const Real term4(sqrtPi * sigmasq * sigma * std::erfc(sigma / sqrtDt));
+
+    return term1 * (-sqrtDt * (term2 * std::exp(-sigmasq / Dt) + term3) + term4);
+}
+
+const ReactionTable::index_type ReactionTable::npos(
+    std::numeric_limits<ReactionTable::index_type>::max());
+
+void ReactionTable::compile(const Model& model, const BDWorld& world, const Real dt)
+{
+    model_.reset(new CompiledNetworkModel(model));
+    species_.clear();
+    first_order_.clear();
+    second_order_.clear();
+    first_order_offsets_.clear();
+    second_order_offsets_.clear();
+    revision_ = model.revision();
+
+    const CompiledNetworkModel& compiled(*model_);
+    if (compiled.num_reaction_rules() == 0)
+    {
+        dt_ = dt;
+        return;
+    }
+
+    std::vector<entry_type> entries;
+    entries.reserve(compiled.num_reaction_rules());
+    for (index_type i(0); i < compiled.num_reaction_rules(); ++i)
+    {
+        const ReactionRule& rr(compiled.reaction_rule(i));
+        const std::vector<index_type>& products(compiled.product_ids(i));
+        if (rr.reactants().size() == 0 || rr.reactants().size() > 2)
+        {
+            throw_exception<NotSupported>(
+                "The reaction rule [", rr.as_string(), "] must have one or two reactants.");
+        }
+        if (products.size() > 3 - rr.reactants().size())
+        {
+            throw_exception<NotSupported>(
+                "The reaction rule [", rr.as_string(), "] has too many products.");
+        }
+
+        entry_type entry = {i, rr.k(), 0.0, products.size(), {npos, npos}};
+        std::copy(products.begin(), products.end(), entry.products);
+        entries.push_back(entry);
+    }
+
+    const index_type n(compiled.num_species());
+    species_.reserve(n);
+    for (index_type i(0); i < n; ++i)
+    {
+        const Species& sp(compiled.species(i));
+        const MoleculeInfo info(world.get_molecule_info(sp));
+        const species_info_type v = {
+            model.apply_species_attributes(sp), info.radius, info.D, info.constraint_radius};
+        species_.push_back(v);
+    }
+
+    // fill tables in the order of rules, by counting first.
+    first_order_offsets_.assign(n + 1, 0);
+    second_order_offsets_.assign(n * n + 1, 0);
+    for (std::vector<entry_type>::const_iterator i(entries.begin()); i != entries.end(); ++i)
+    {
+        const std::vector<index_type>& reactants(compiled.reactant_ids((*i).rule));
+        if (reactants.size() == 1)
+        {
+            ++first_order_offsets_[reactants[0] + 1];
+        }
+        else
+        {
+            ++second_order_offsets_[reactants[0] * n + reactants[1] + 1];
+            if (reactants[0] != reactants[1])
+            {
+                ++second_order_offsets_[reactants[1] * n + reactants[0] + 1];
+            }
+        }
+    }
+    for (index_type i(0); i < n; ++i)
+    {
+        first_order_offsets_[i + 1] += first_order_offsets_[i];
+    }
+    for (index_type i(0); i < n * n; ++i)
+    {
+        second_order_offsets_[i + 1] += second_order_offsets_[i];
+    }
+
+    first_order_.resize(first_order_offsets_[n]);
+    second_order_.resize(second_order_offsets_[n * n]);
+    std::vector<index_type> first_order_filled(first_order_offsets_.begin(), first_order_offsets_.end() - 1);
+    std::vector<index_type> second_order_filled(second_order_offsets_.begin(), second_order_offsets_.end() - 1);
+    for (std::vector<entry_type>::const_iterator i(entries.begin()); i != entries.end(); ++i)
+    {
+        const std::vector<index_type>& reactants(compiled.reactant_ids((*i).rule));
+        if (reactants.size() == 1)
+        {
+            first_order_[first_order_filled[reactants[0]]++] = (*i);
+        }
+        else
+        {
+            second_order_[second_order_filled[reactants[0] * n + reactants[1]]++] = (*i);
+            if (reactants[0] != reactants[1])
+            {
+                second_order_[second_order_filled[reactants[1] * n + reactants[0]]++] = (*i);
+            }
+        }
+    }
+
+    set_dt(dt);
+}
+
+void ReactionTable::set_dt(const Real dt)
+{
+    dt_ = dt;
+
+    const index_type n(species_.size());
+    for (index_type sp(0); sp < n; ++sp)
+    {
+        const std::vector<entry_type>::iterator
+            first(first_order_.begin() + first_order_offsets_[sp]),
+            last(first_order_.begin() + first_order_offsets_[sp + 1]);
+
+        Real ktot(0.0);
+        for (std::vector<entry_type>::iterator i(first); i != last; ++i)
+        {
+            ktot += (*i).k;
+        }
+
+        const Real ptot(ktot > 0 ? 1.0 - std::exp(-ktot * dt) : 0.0);
+        Real k(0.0);
+        for (std::vector<entry_type>::iterator i(first); i != last; ++i)
+        {
+            k += (*i).k;
+            (*i).probability = ptot * (k / ktot);
+        }
+    }
+
+    for (index_type sp1(0); sp1 < n; ++sp1)
+    {
+        for (index_type sp2(0); sp2 < n; ++sp2)
+        {
+            const std::vector<entry_type>::iterator
+                first(second_order_.begin() + second_order_offsets_[sp1 * n + sp2]),
+                last(second_order_.begin() + second_order_offsets_[sp1 * n + sp2 + 1]);
+            if (first == last)
+            {
+                continue;
+            }
+
+            const species_info_type& info1(species_[sp1]);
+            const species_info_type& info2(species_[sp2]);
+            const Real r12(info1.radius + info2.radius);
+            const Real Ibd(I_bd_3d(r12, dt, info1.D) + I_bd_3d(r12, dt, info2.D));
+
+            Real prob(0.0);
+            for (std::vector<entry_type>::iterator i(first); i != last; ++i)
+            {
+                prob += (Ibd > 0 ? (*i).k * dt / (Ibd * 4 * M_PI) : 0.0);
+                (*i).probability = prob;
+            }
+
+            if (prob >= 1 && sp1 <= sp2)
+            {
+                std::cerr << "Warning: the total reaction probability of ["
+                    << info1.species.serial() << "] and [" << info2.species.serial()
+                    << "] exceeds 1. the step interval is too long." << std::endl;
+            }
+        }
+    }
+}
+
+Real ReactionTable::first_order_scale(const index_type sp, const Real dt) const
+{
+    if (dt == dt_)
+    {
+        return 1.0;
+    }
+
+    Real ktot(0.0);
+    for (const_iterator i(first_order(sp).first); i != first_order(sp).second; ++i)
+    {
+        ktot += (*i).k;
+    }
+    return (ktot > 0 ? std::expm1(-ktot * dt) / std::expm1(-ktot * dt_) : 0.0);
+}
+
+Real ReactionTable::second_order_scale(const index_type sp1, const index_type sp2, const Real dt) const
+{
+    if (dt == dt_)
+    {
+        return 1.0;
+    }
+
+    const species_info_type& info1(species_[sp1]);
+    const species_info_type& info2(species_[sp2]);
+    const Real r12(info1.radius + info2.radius);
+    const Real Ibd(I_bd_3d(r12, dt, info1.D) + I_bd_3d(r12, dt, info2.D));
+    const Real Ibd0(I_bd_3d(r12, dt_, info1.D) + I_bd_3d(r12, dt_, info2.D));
+    return (Ibd > 0 ? (dt * Ibd0) / (dt_ * Ibd) : 0.0);
+}
+
+} // bd
+
+} // ecell4
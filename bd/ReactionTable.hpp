@@ -0,0 +1,253 @@
+#ifndef ECELL4_BD_REACTION_TABLE_HPP
+#define ECELL4_BD_REACTION_TABLE_HPP
+
+#include <vector>
+#include <memory>
+#include <limits>
+
+#include "./types.hpp"
+#include "./Model.hpp"
+#include "./CompiledNetworkModel.hpp"
+#include "BDWorld.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * the integral of the probability for a pair at the distance larger than sigma
+ * to come within sigma in t, over the distance, divided by 4 pi.
+ * see I_bd_3d of E-Cell4.
+ * @param sigma the contact distance
+ * @param t the step interval
+ * @param D the diffusion coefficient
+ */
+Real I_bd_3d(const Real sigma, const Real t, const Real D);
+
+/**
+ * a reaction occurred in a step.
+ */
+class ReactionInfo
+{
+public:
+
+    typedef std::pair<ParticleID, Particle> particle_id_pair_type;
+    typedef std::vector<particle_id_pair_type> container_type;
+
+public:
+
+    ReactionInfo(const Real t, const container_type& reactants, const container_type& products)
+        : t_(t), reactants_(reactants), products_(products)
+    {
+        ;
+    }
+
+    Real t() const
+    {
+        return t_;
+    }
+
+    const container_type& reactants() const
+    {
+        return reactants_;
+    }
+
+    void add_reactant(const particle_id_pair_type& pid_pair)
+    {
+        reactants_.push_back(pid_pair);
+    }
+
+    const container_type& products() const
+    {
+        return products_;
+    }
+
+    void add_product(const particle_id_pair_type& pid_pair)
+    {
+        products_.push_back(pid_pair);
+    }
+
+protected:
+
+    Real t_;
+    container_type reactants_, products_;
+};
+
+/**
+ * reaction rules of a model compiled into dense tables over species,
+ * so that rules of a particle, or a pair of particles, are found in O(1)
+ * without allocations in the innermost loop of BDSimulatorT.
+ * species are numbered as CompiledNetworkModel interns them.
+ * probabilities per step are given for the step interval last set, and scaled
+ * for a shorter step, e.g. the last one before an output, without recomputing the table:
+ * 1 - exp(-k dt) in total for first-order rules, as Smoldyn does, and
+ * k dt / (4 pi (I_bd_3d(r12, dt, D1) + I_bd_3d(r12, dt, D2))) for second-order rules
+ * on the overlap of a pair, as E-Cell4 does.
+ * only rules with one or two reactants are accepted, and at most two products
+ * for first-order rules and one for second-order rules.
+ */
+class ReactionTable
+{
+public:
+
+    typedef std::size_t index_type;
+
+    static const index_type npos;
+
+    /**
+     * a species with attributes applied by the model, and its molecule info.
+     */
+    struct species_info_type
+    {
+        Species species;
+        Real radius;
+        Real D;
+        Real constraint_radius;
+    };
+
+    struct entry_type
+    {
+        index_type rule;  // the id in CompiledNetworkModel
+        Real k;
+        Real probability;  // cumulative over rules of the reactants
+        index_type num_products;
+        index_type products[2];  // indices of species
+    };
+
+    typedef std::vector<entry_type> entry_container_type;
+    typedef entry_container_type::const_iterator const_iterator;
+    typedef std::pair<const_iterator, const_iterator> range_type;
+
+public:
+
+    ReactionTable()
+        : dt_(0), revision_(-1), model_()
+    {
+        ;
+    }
+
+    /**
+     * compile rules of the model. attributes of species are given by the world.
+     * throws NotSupported for a rule of an unsupported form.
+     */
+    void compile(const Model& model, const BDWorld& world, const Real dt);
+
+    /**
+     * recompute probabilities for another step interval.
+     */
+    void set_dt(const Real dt);
+
+    /**
+     * @return the ratio of probabilities of rules of the reactant in a step of dt
+     *  to those in the table, 1 for dt()
+     */
+    Real first_order_scale(const index_type sp, const Real dt) const;
+
+    /**
+     * @return the ratio of probabilities of rules of the pair of reactants in a step of dt
+     *  to those in the table, 1 for dt()
+     */
+    Real second_order_scale(const index_type sp1, const index_type sp2, const Real dt) const;
+
+    Real dt() const
+    {
+        return dt_;
+    }
+
+    /**
+     * @return the revision of the model compiled
+     */
+    Integer revision() const
+    {
+        return revision_;
+    }
+
+    bool empty() const
+    {
+        return (!model_ || (*model_).num_reaction_rules() == 0);
+    }
+
+    bool has_first_order() const
+    {
+        return first_order_.size() > 0;
+    }
+
+    bool has_second_order() const
+    {
+        return second_order_.size() > 0;
+    }
+
+    /**
+     * @return the model compiled, or NULL before the first compile
+     */
+    const std::shared_ptr<const CompiledNetworkModel>& model() const
+    {
+        return model_;
+    }
+
+    const ReactionRule& reaction_rule(const index_type rule) const
+    {
+        return (*model_).reaction_rule(rule);
+    }
+
+    index_type num_species() const
+    {
+        return species_.size();
+    }
+
+    /**
+     * @return the index of the species, or npos if it appears in no rule nor attribute
+     */
+    index_type species_index(const Species& sp) const
+    {
+        return (model_ ? (*model_).species_id(sp) : npos);
+    }
+
+    const species_info_type& species_info(const index_type i) const
+    {
+        return species_[i];
+    }
+
+    /**
+     * @return rules with the reactant in the order of cumulative probabilities
+     */
+    range_type first_order(const index_type sp) const
+    {
+        return range_type(
+            first_order_.begin() + first_order_offsets_[sp],
+            first_order_.begin() + first_order_offsets_[sp + 1]);
+    }
+
+    /**
+     * @return rules with the pair of reactants in the order of cumulative probabilities
+     */
+    range_type second_order(const index_type sp1, const index_type sp2) const
+    {
+        const index_type i(sp1 * species_.size() + sp2);
+        return range_type(
+            second_order_.begin() + second_order_offsets_[i],
+            second_order_.begin() + second_order_offsets_[i + 1]);
+    }
+
+protected:
+
+    Real dt_;
+    Integer revision_;
+
+    std::shared_ptr<const CompiledNetworkModel> model_;
+    std::vector<species_info_type> species_;
+
+    // rules of species i are in [offsets[i], offsets[i + 1]),
+    // and those of a pair (i, j) are at i * num_species() + j in the same way.
+    entry_container_type first_order_, second_order_;
+    std::vector<index_type> first_order_offsets_, second_order_offsets_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_REACTION_TABLE_HPP */
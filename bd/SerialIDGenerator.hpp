@@ -4,8 +4,11 @@
 #include <functional>
 #include <memory>
 #include <type_traits>
+#include <istream>
+#include <ostream>
 
 #include "config.h"
+#include "exceptions.hpp"
 
 #ifdef WITH_HDF5
 #include <hdf5.h>
@@ -350,6 +353,22 @@ public:
     }
 #endif
 
+    void save_binary(std::ostream& out) const
+    {
+        out.write(reinterpret_cast<const char*>(&next_), sizeof(identifier_type));
+    }
+
+    void load_binary(std::istream& in)
+    {
+        identifier_type state;
+        in.read(reinterpret_cast<char*>(&state), sizeof(identifier_type));
+        if (!in)
+        {
+            throw IllegalState("Unexpected end of a binary stream.");
+        }
+        next_ = state;
+    }
+
 private:
 
     identifier_type next_;
@@ -0,0 +1,185 @@
+#ifndef ECELL4_SERIAL_SLOT_MAP_HPP
+#define ECELL4_SERIAL_SLOT_MAP_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstddef>
+
+
+namespace ecell4
+{
+
+/**
+ * a map from an Identifier to a value, indexed by the serial of the key.
+ * keys from SerialIDGenerator are dense, so that a lookup is an array access.
+ * each slot keeps the lot of its key as the generation, so that a key
+ * with the same serial and another lot never hits.
+ * the array grows to the largest serial, at most doubling at a time;
+ * serials out of that range, or negative ones, are kept in a hash map.
+ */
+template<typename Tkey_, typename Tvalue_>
+class SerialSlotMap
+{
+public:
+
+    typedef Tkey_ key_type;
+    typedef Tvalue_ mapped_type;
+    typedef typename key_type::lot_type lot_type;
+    typedef typename key_type::serial_type serial_type;
+
+    struct slot_type
+    {
+        lot_type lot;
+        mapped_type value;
+        bool occupied;
+    };
+
+    typedef std::vector<slot_type> container_type;
+    typedef std::unordered_map<key_type, mapped_type> overflow_map_type;
+
+public:
+
+    SerialSlotMap()
+        : size_(0)
+    {
+        ;
+    }
+
+    std::size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    void clear()
+    {
+        slots_.clear();
+        overflow_.clear();
+        size_ = 0;
+    }
+
+    /**
+     * reserve slots for serials below num.
+     */
+    void reserve(const std::size_t num)
+    {
+        if (slots_.size() < num)
+        {
+            slot_type empty = {lot_type(), mapped_type(), false};
+            slots_.resize(num, empty);
+        }
+    }
+
+    const mapped_type* find(const key_type& k) const
+    {
+        if (is_dense(k.serial()))
+        {
+            const slot_type& s(slots_[k.serial()]);
+            if (s.occupied && s.lot == k.lot())
+            {
+                return &s.value;
+            }
+        }
+        if (overflow_.empty())
+        {
+            return NULL;
+        }
+        typename overflow_map_type::const_iterator i(overflow_.find(k));
+        return (i == overflow_.end() ? NULL : &(*i).second);
+    }
+
+    mapped_type* find(const key_type& k)
+    {
+        return const_cast<mapped_type*>(
+            static_cast<const SerialSlotMap&>(*this).find(k));
+    }
+
+    /**
+     * insert a key, or overwrite the value of an existing one.
+     */
+    void assign(const key_type& k, const mapped_type& v)
+    {
+        if (!is_dense(k.serial()) && is_growable(k.serial()))
+        {
+            reserve(std::max(static_cast<std::size_t>(k.serial()) + 1, 2 * slots_.size()));
+        }
+
+        if (is_dense(k.serial()))
+        {
+            slot_type& s(slots_[k.serial()]);
+            if (s.occupied && s.lot == k.lot())
+            {
+                s.value = v;
+                return;
+            }
+            else if (!s.occupied && (overflow_.empty() || overflow_.find(k) == overflow_.end()))
+            {
+                s.lot = k.lot();
+                s.value = v;
+                s.occupied = true;
+                ++size_;
+                return;
+            }
+        }
+
+        // another generation holds the slot, or the serial is out of range.
+        std::pair<typename overflow_map_type::iterator, bool>
+            retval(overflow_.insert(std::make_pair(k, v)));
+        if (retval.second)
+        {
+            ++size_;
+        }
+        else
+        {
+            (*retval.first).second = v;
+        }
+    }
+
+    bool erase(const key_type& k)
+    {
+        if (is_dense(k.serial()))
+        {
+            slot_type& s(slots_[k.serial()]);
+            if (s.occupied && s.lot == k.lot())
+            {
+                s.occupied = false;
+                --size_;
+                return true;
+            }
+        }
+        if (!overflow_.empty() && overflow_.erase(k) > 0)
+        {
+            --size_;
+            return true;
+        }
+        return false;
+    }
+
+protected:
+
+    bool is_dense(const serial_type& serial) const
+    {
+        return (serial >= 0 && static_cast<std::size_t>(serial) < slots_.size());
+    }
+
+    bool is_growable(const serial_type& serial) const
+    {
+        return (serial >= 0 && static_cast<std::size_t>(serial)
+            < std::max(2 * slots_.size(), 2 * size_ + 1024));
+    }
+
+protected:
+
+    container_type slots_;
+    overflow_map_type overflow_;
+    std::size_t size_;
+};
+
+} // ecell4
+
+#endif /* ECELL4_SERIAL_SLOT_MAP_HPP */
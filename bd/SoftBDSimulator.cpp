@@ -0,0 +1,514 @@
+#include "SoftBDSimulator.hpp"
+#include "binary_io.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+Real PairPotential::cutoff() const
+{
+    switch (type)
+    {
+    case WCA:
+        return std::pow(2.0, 1.0 / 6.0) * sigma;
+    case HARMONIC:
+        return sigma;
+    default:
+        return 0.0;
+    }
+}
+
+void SoftBDSimulator::set_pair_potential(
+    const Species& sp1, const Species& sp2, const PairPotential& potential)
+{
+    given_potentials_[sp1.serial()][sp2.serial()] = potential;
+    given_potentials_[sp2.serial()][sp1.serial()] = potential;
+}
+
+PairPotential SoftBDSimulator::get_pair_potential(const Species& sp1, const Species& sp2) const
+{
+    std::unordered_map<Species::serial_type,
+        std::unordered_map<Species::serial_type, PairPotential> >::const_iterator
+        i(given_potentials_.find(sp1.serial()));
+    if (i != given_potentials_.end())
+    {
+        std::unordered_map<Species::serial_type, PairPotential>::const_iterator
+            j((*i).second.find(sp2.serial()));
+        if (j != (*i).second.end())
+        {
+            return (*j).second;
+        }
+    }
+    return default_potential_;
+}
+
+void SoftBDSimulator::initialize()
+{
+    if (dynamic_cast<const ParticleSpaceCellListImpl*>(&(*world_).space()) == NULL)
+    {
+        throw IllegalArgument("SoftBDSimulator needs a world with ParticleSpaceCellListImpl.");
+    }
+    if ((*model_).num_reaction_rules() > 0)
+    {
+        throw NotSupported("Reactions are not supported by SoftBDSimulator.");
+    }
+
+    gather();
+
+    // resolve potentials over species of particles.
+    const ParticleSpace& space((*world_).space());
+    std::vector<Real> radii(species_.size(), 0.0);
+    for (size_t i(0); i < static_cast<size_t>(space.num_particles()); ++i)
+    {
+        radii[species_index_[i]] = space._get_particle(i).second.radius();
+    }
+
+    const std::size_t n(species_.size());
+    potentials_.resize(n * n);
+    cutoff_max_ = 0.0;
+    for (std::size_t i(0); i < n; ++i)
+    {
+        for (std::size_t j(0); j < n; ++j)
+        {
+            PairPotential p(get_pair_potential(species_[i], species_[j]));
+            if (p.sigma <= 0)
+            {
+                p.sigma = radii[i] + radii[j];
+            }
+            potentials_[i * n + j] = p;
+            cutoff_max_ = std::max(cutoff_max_, p.cutoff());
+        }
+    }
+    skin_in_use_ = (skin_ > 0 ? skin_ : 0.25 * cutoff_max_);
+
+    if (!dt_set_by_user_)
+    {
+        dt_ = determine_dt();
+    }
+
+    num_list_builds_ = 0;
+    build_lists();
+    reset_stats();
+}
+
+Real SoftBDSimulator::determine_dt() const
+{
+    constexpr Real inf = std::numeric_limits<Real>::infinity();
+    Real rmin(inf), Dmax(0.0);
+
+    const ParticleSpace& space((*world_).space());
+    for (size_t i(0); i < static_cast<size_t>(space.num_particles()); ++i)
+    {
+        const Particle& p(space._get_particle(i).second);
+        rmin = std::min(rmin, p.radius());
+        Dmax = std::max(Dmax, p.D());
+    }
+
+    return (rmin < inf && Dmax > 0.0
+        ? 4.0 * rmin * rmin / (2.0 * Dmax) * bd_dt_factor_
+        : inf);
+}
+
+void SoftBDSimulator::gather()
+{
+    const ParticleSpace& space((*world_).space());
+    const std::size_t n(space.num_particles());
+
+    std::unordered_map<Species::serial_type, uint32_t> indices;
+    species_.clear();
+    species_index_.resize(n);
+    x_.resize(n); y_.resize(n); z_.resize(n);
+    fx_.resize(n); fy_.resize(n); fz_.resize(n);
+    for (std::size_t i(0); i < n; ++i)
+    {
+        const Particle& p(space._get_particle(i).second);
+        const std::pair<std::unordered_map<Species::serial_type, uint32_t>::iterator, bool>
+            inserted(indices.insert(std::make_pair(
+                p.species().serial(), static_cast<uint32_t>(species_.size()))));
+        if (inserted.second)
+        {
+            species_.push_back(p.species());
+        }
+        species_index_[i] = (*inserted.first).second;
+
+        x_[i] = p.position()[0];
+        y_[i] = p.position()[1];
+        z_[i] = p.position()[2];
+    }
+}
+
+void SoftBDSimulator::build_lists()
+{
+    const ParticleSpaceCellListImpl& space(
+        static_cast<const ParticleSpaceCellListImpl&>((*world_).space()));
+    const std::size_t n(x_.size());
+
+    Real rmax(0.0);
+    for (std::size_t i(0); i < n; ++i)
+    {
+        rmax = std::max(rmax, space._get_particle(i).second.radius());
+    }
+
+    // a neighbor out of the neighboring cells is farther than a cell from the center.
+    const Real reach(cutoff_max_ + skin_in_use_);
+    const Real3& cell_sizes(space.cell_sizes());
+    const Real cell_size(std::min(std::min(cell_sizes[0], cell_sizes[1]), cell_sizes[2]));
+    if (n > 0 && reach + rmax > cell_size)
+    {
+        throw_exception<IllegalArgument>(
+            "Cells [", cell_size, "] must be larger than the cutoff with the skin [",
+            reach + rmax, "] for SoftBDSimulator.");
+    }
+
+    wca_.clear();
+    harmonic_.clear();
+    for (std::size_t i(0); i < n; ++i)
+    {
+        const std::pair<ParticleID, Particle>& pid_particle_pair(space._get_particle(i));
+        const Real3& pos(pid_particle_pair.second.position());
+        const std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >
+            neighbors(space.list_particles_within_radius(pos, reach, pid_particle_pair.first));
+
+        for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+            k(neighbors.begin()); k != neighbors.end(); ++k)
+        {
+            const std::size_t j(space._get_index((*k).first.first));
+            if (j <= i)
+            {
+                continue;  // a pair is listed once
+            }
+
+            const PairPotential& p(potential(species_index_[i], species_index_[j]));
+            const Real r(p.cutoff() + skin_in_use_);
+            if (p.type == PairPotential::NONE
+                || length_sq(subtract(space.periodic_transpose((*k).first.second.position(), pos), pos))
+                    >= r * r)
+            {
+                continue;
+            }
+
+            (p.type == PairPotential::WCA ? wca_ : harmonic_).push_back(
+                static_cast<uint32_t>(i), static_cast<uint32_t>(j), p);
+        }
+    }
+
+    x0_ = x_;
+    y0_ = y_;
+    z0_ = z_;
+    ++num_list_builds_;
+}
+
+bool SoftBDSimulator::needs_rebuild() const
+{
+    const Real3& edge_lengths((*world_).edge_lengths());
+    const Real threshold_sq(0.25 * skin_in_use_ * skin_in_use_);
+    const std::size_t n(x_.size());
+    bool retval(false);
+    for (std::size_t i(0); i < n; ++i)
+    {
+        Real dx(x_[i] - x0_[i]), dy(y_[i] - y0_[i]), dz(z_[i] - z0_[i]);
+        dx -= edge_lengths[0] * std::floor(dx / edge_lengths[0] + 0.5);
+        dy -= edge_lengths[1] * std::floor(dy / edge_lengths[1] + 0.5);
+        dz -= edge_lengths[2] * std::floor(dz / edge_lengths[2] + 0.5);
+        retval |= (dx * dx + dy * dy + dz * dz > threshold_sq);
+    }
+    return retval;
+}
+
+void SoftBDSimulator::gather_separations(
+    pair_list& pairs, const Real* x, const Real* y, const Real* z, const Real3& edge_lengths)
+{
+    const std::size_t n(pairs.size());
+    pairs.dx.resize(n); pairs.dy.resize(n); pairs.dz.resize(n);
+
+    // a separation in the world is shorter than an edge, and so an image is chosen
+    // by comparisons, with neither floor nor a branch.
+    const Real Lx(edge_lengths[0]), Ly(edge_lengths[1]), Lz(edge_lengths[2]);
+    const Real hx(0.5 * Lx), hy(0.5 * Ly), hz(0.5 * Lz);
+    const uint32_t* i(pairs.i.data());
+    const uint32_t* j(pairs.j.data());
+    Real* dx(pairs.dx.data());
+    Real* dy(pairs.dy.data());
+    Real* dz(pairs.dz.data());
+    for (std::size_t k(0); k < n; ++k)
+    {
+        const Real sx(x[j[k]] - x[i[k]]), sy(y[j[k]] - y[i[k]]), sz(z[j[k]] - z[i[k]]);
+        dx[k] = sx - Lx * (static_cast<Real>(sx >= hx) - static_cast<Real>(sx < -hx));
+        dy[k] = sy - Ly * (static_cast<Real>(sy >= hy) - static_cast<Real>(sy < -hy));
+        dz[k] = sz - Lz * (static_cast<Real>(sz >= hz) - static_cast<Real>(sz < -hz));
+    }
+}
+
+void SoftBDSimulator::wca_kernel(pair_list& pairs)
+{
+    const std::size_t n(pairs.size());
+    pairs.f.resize(n);
+
+    const Real* epsilon(pairs.epsilon.data());
+    const Real* sigma(pairs.sigma.data());
+    const Real* cutoff_sq(pairs.cutoff_sq.data());
+    const Real* dx(pairs.dx.data());
+    const Real* dy(pairs.dy.data());
+    const Real* dz(pairs.dz.data());
+    Real* f(pairs.f.data());
+    for (std::size_t k(0); k < n; ++k)
+    {
+        const Real r2(dx[k] * dx[k] + dy[k] * dy[k] + dz[k] * dz[k]);
+        const Real s2(sigma[k] * sigma[k] / r2);
+        const Real s6(s2 * s2 * s2);
+        // masked by the cutoff, not branched.
+        const Real within(static_cast<Real>(r2 < cutoff_sq[k]));
+        f[k] = within * 24 * epsilon[k] * (2 * s6 * s6 - s6) / r2;
+    }
+}
+
+void SoftBDSimulator::harmonic_kernel(pair_list& pairs)
+{
+    const std::size_t n(pairs.size());
+    pairs.f.resize(n);
+
+    const Real* epsilon(pairs.epsilon.data());
+    const Real* sigma(pairs.sigma.data());
+    const Real* cutoff_sq(pairs.cutoff_sq.data());
+    const Real* dx(pairs.dx.data());
+    const Real* dy(pairs.dy.data());
+    const Real* dz(pairs.dz.data());
+    Real* f(pairs.f.data());
+    for (std::size_t k(0); k < n; ++k)
+    {
+        const Real r2(dx[k] * dx[k] + dy[k] * dy[k] + dz[k] * dz[k]);
+        const Real r(std::sqrt(r2));
+        // no force at the exact contact of centers, where the direction is undefined.
+        const Real within(static_cast<Real>(r2 < cutoff_sq[k]) * static_cast<Real>(r2 > 0));
+        const Real rsafe(r + static_cast<Real>(r2 <= 0));
+        f[k] = within * epsilon[k] / sigma[k] * (1 - r / sigma[k]) / rsafe;
+    }
+}
+
+void SoftBDSimulator::compute_forces()
+{
+    const ParticleSpace& space((*world_).space());
+    const Real3& edge_lengths(space.edge_lengths());
+    const std::size_t n(x_.size());
+
+    // tethers to original positions.
+    for (std::size_t i(0); i < n; ++i)
+    {
+        const Particle& p(space._get_particle(i).second);
+        const Real rc(p.constraint_radius());
+        if (rc == std::numeric_limits<Real>::infinity())
+        {
+            fx_[i] = fy_[i] = fz_[i] = 0.0;
+            continue;
+        }
+        const Real3 u(subtract(add(p.position(), p.stride()), p.original_position()));
+        const Real k(-3.0 / (rc * rc));
+        fx_[i] = k * u[0];
+        fy_[i] = k * u[1];
+        fz_[i] = k * u[2];
+    }
+
+    pair_list* lists[] = {&wca_, &harmonic_};
+    gather_separations(wca_, x_.data(), y_.data(), z_.data(), edge_lengths);
+    gather_separations(harmonic_, x_.data(), y_.data(), z_.data(), edge_lengths);
+    wca_kernel(wca_);
+    harmonic_kernel(harmonic_);
+    for (std::size_t l(0); l < 2; ++l)
+    {
+        const pair_list& pairs(*lists[l]);
+        for (std::size_t k(0); k < pairs.size(); ++k)
+        {
+            // on the first of the pair along -(dx, dy, dz).
+            const Real fx(-pairs.f[k] * pairs.dx[k]);
+            const Real fy(-pairs.f[k] * pairs.dy[k]);
+            const Real fz(-pairs.f[k] * pairs.dz[k]);
+            fx_[pairs.i[k]] += fx;
+            fy_[pairs.i[k]] += fy;
+            fz_[pairs.i[k]] += fz;
+            fx_[pairs.j[k]] -= fx;
+            fy_[pairs.j[k]] -= fy;
+            fz_[pairs.j[k]] -= fz;
+        }
+    }
+}
+
+Real SoftBDSimulator::potential_energy()
+{
+    if (needs_rebuild())
+    {
+        build_lists();
+    }
+
+    const ParticleSpace& space((*world_).space());
+    Real retval(0.0);
+
+    for (std::size_t i(0); i < x_.size(); ++i)
+    {
+        const Particle& p(space._get_particle(i).second);
+        const Real rc(p.constraint_radius());
+        if (rc != std::numeric_limits<Real>::infinity())
+        {
+            retval += 1.5 * length_sq(subtract(add(p.position(), p.stride()), p.original_position()))
+                / (rc * rc);
+        }
+    }
+
+    const pair_list* lists[] = {&wca_, &harmonic_};
+    for (std::size_t l(0); l < 2; ++l)
+    {
+        const pair_list& pairs(*lists[l]);
+        for (std::size_t k(0); k < pairs.size(); ++k)
+        {
+            const Real3 pos(x_[pairs.i[k]], y_[pairs.i[k]], z_[pairs.i[k]]);
+            const Real r2(length_sq(subtract(space.periodic_transpose(
+                Real3(x_[pairs.j[k]], y_[pairs.j[k]], z_[pairs.j[k]]), pos), pos)));
+            if (r2 >= pairs.cutoff_sq[k])
+            {
+                continue;
+            }
+            if (l == 0)
+            {
+                const Real s2(pairs.sigma[k] * pairs.sigma[k] / r2);
+                const Real s6(s2 * s2 * s2);
+                retval += 4 * pairs.epsilon[k] * (s6 * s6 - s6) + pairs.epsilon[k];
+            }
+            else
+            {
+                const Real d(1 - std::sqrt(r2) / pairs.sigma[k]);
+                retval += 0.5 * pairs.epsilon[k] * d * d;
+            }
+        }
+    }
+    return retval;
+}
+
+void SoftBDSimulator::step()
+{
+    ParticleSpaceCellListImpl& space(
+        static_cast<ParticleSpaceCellListImpl&>((*world_).space()));
+    RandomNumberGenerator& rng(*(*world_).rng());
+    const Real3& edge_lengths(space.edge_lengths());
+    const Real t0(t()), dt0(dt());
+
+    ECELL4_BD_STATS(uint64_t tick(read_ticks()));
+
+    if (needs_rebuild())
+    {
+        build_lists();
+    }
+    compute_forces();
+
+    ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_neighbor_search, tick));
+
+    for (std::size_t i(0); i < x_.size(); ++i)
+    {
+        const std::pair<ParticleID, Particle>& pid_particle_pair(space._get_particle(i));
+        const Particle& particle(pid_particle_pair.second);
+        const Real D(particle.D());
+        if (D == 0)
+        {
+            continue;
+        }
+
+        ECELL4_BD_STATS(++stats_.attempted);
+
+        const Real sigma(std::sqrt(2 * D * dt0));
+        const Real drift(D * dt0);
+        const Real3 newpos_(
+            particle.position()[0] + drift * fx_[i] + rng.gaussian(sigma),
+            particle.position()[1] + drift * fy_[i] + rng.gaussian(sigma),
+            particle.position()[2] + drift * fz_[i] + rng.gaussian(sigma));
+
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_rng, tick));
+
+        const Real3 newpos(space.apply_boundary(newpos_));
+        const policy_type::rejection_type test(policy_.test(particle, newpos_, newpos, edge_lengths));
+        if (test != policy_type::ACCEPTED)
+        {
+            if (test == policy_type::REJECTED_LAYER)
+            {
+                ECELL4_BD_STATS(++stats_.rejected_layer);
+            }
+            else
+            {
+                ECELL4_BD_STATS(++stats_.rejected_wall);
+            }
+            ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+            continue;
+        }
+
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_boundary, tick));
+
+        space.update_particle(pid_particle_pair.first, Particle(
+            particle.species(), newpos,
+            particle.radius(), particle.D(), particle.constraint_radius(),
+            add(particle.stride(), subtract(newpos_, newpos)),
+            particle.original_position()));
+        x_[i] = newpos[0];
+        y_[i] = newpos[1];
+        z_[i] = newpos[2];
+
+        ECELL4_BD_STATS(++stats_.accepted);
+        ECELL4_BD_STATS(BDStatistics::lap(stats_.ticks_update, tick));
+    }
+
+    ECELL4_BD_STATS(++stats_.num_steps);
+    set_t(t0 + dt0);
+    num_steps_++;
+}
+
+bool SoftBDSimulator::step(const Real& upto)
+{
+    const Real t0(t()), dt0(dt()), tnext(next_time());
+
+    if (upto <= t0)
+    {
+        return false;
+    }
+
+    if (upto >= tnext)
+    {
+        step();
+        return true;
+    }
+
+    dt_ = upto - t0;
+    step();
+    dt_ = dt0;
+    return false;
+}
+
+void SoftBDSimulator::save_binary(std::ostream& out) const
+{
+    binary_io::write_header(out, "ECELL4SOFTBDSIMULATOR", 1);
+    (*world_).save_binary(out);
+
+    binary_io::write(out, dt_);
+    binary_io::write(out, static_cast<uint8_t>(dt_set_by_user_));
+    binary_io::write(out, num_steps_);
+    binary_io::write(out, skin_);
+}
+
+void SoftBDSimulator::load_binary(std::istream& in)
+{
+    binary_io::read_header(in, "ECELL4SOFTBDSIMULATOR", 1);
+    (*world_).load_binary(in);
+
+    binary_io::read(in, dt_);
+    dt_set_by_user_ = (binary_io::read<uint8_t>(in) != 0);
+    binary_io::read(in, num_steps_);
+    binary_io::read(in, skin_);
+
+    initialize();
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,313 @@
+#ifndef ECELL4_BD_SOFT_BD_SIMULATOR_HPP
+#define ECELL4_BD_SOFT_BD_SIMULATOR_HPP
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+#include "./Model.hpp"
+#include "./SimulatorBase.hpp"
+
+#include "BDWorld.hpp"
+#include "Statistics.hpp"
+#include "DoubleLayerPolicy.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a repulsive pair potential. energies are in units of kT.
+ * WCA is the Lennard-Jones potential cut at its minimum 2^(1/6) sigma and shifted up,
+ * 4 epsilon ((sigma/r)^12 - (sigma/r)^6) + epsilon.
+ * HARMONIC is epsilon / 2 (1 - r/sigma)^2 within sigma.
+ * sigma is the sum of radii of a pair if zero.
+ */
+struct PairPotential
+{
+    enum potential_type
+    {
+        NONE = 0,
+        WCA = 1,
+        HARMONIC = 2
+    };
+
+    potential_type type;
+    Real epsilon;
+    Real sigma;
+
+    PairPotential(const potential_type type = WCA, const Real epsilon = 1.0, const Real sigma = 0.0)
+        : type(type), epsilon(epsilon), sigma(sigma)
+    {
+        ;
+    }
+
+    /**
+     * @return the distance where the potential vanishes
+     */
+    Real cutoff() const;
+};
+
+/**
+ * the Brownian dynamics simulator of soft spheres in BDWorld, by the Ermak-McCammon
+ * integrator without hydrodynamic interactions,
+ * x(t + dt) = x(t) + D F dt / kT + sqrt(2 D dt) g.
+ * forces are from pair potentials given per pair of species, and the constraint radius
+ * is a harmonic tether to the original position, 3/2 (|x - x0| / constraint_radius)^2,
+ * so that the root mean square of the displacement at rest is the constraint radius.
+ * forces are evaluated at the beginning of a step, and all particles move at once.
+ * a move rejected by the policy leaves the particle there. no encounters are recorded.
+ * pairs are kept in Verlet lists, built with the cell list of ParticleSpaceCellListImpl
+ * and rebuilt when a particle moves farther than a half of the skin. the lists are
+ * split by the type of potentials. separations of pairs are gathered into arrays first,
+ * and forces are evaluated over them by a branch-free kernel, vectorized by the compiler.
+ * reactions are not supported, and initialize throws NotSupported for a model with
+ * reaction rules. particles must not be added or removed while running.
+ */
+class SoftBDSimulator
+    : public SimulatorBase<BDWorld>
+{
+public:
+
+    typedef SimulatorBase<BDWorld> base_type;
+    typedef DoubleLayerPolicy policy_type;
+
+public:
+
+    SoftBDSimulator(std::shared_ptr<BDWorld> world, std::shared_ptr<Model> model,
+        Real bd_dt_factor = 1e-5)
+        : base_type(world, model), dt_(0), bd_dt_factor_(bd_dt_factor), dt_set_by_user_(false),
+        skin_(0.0), default_potential_()
+    {
+        initialize();
+    }
+
+    SoftBDSimulator(std::shared_ptr<BDWorld> world, Real bd_dt_factor = 1e-5)
+        : base_type(world), dt_(0), bd_dt_factor_(bd_dt_factor), dt_set_by_user_(false),
+        skin_(0.0), default_potential_()
+    {
+        initialize();
+    }
+
+    // SimulatorTraits
+    void initialize();
+
+    Real determine_dt() const;
+
+    Real dt() const
+    {
+        return dt_;
+    }
+
+    void set_dt(const Real& dt)
+    {
+        if (dt <= 0)
+        {
+            throw std::invalid_argument("The step size must be positive.");
+        }
+        dt_ = dt;
+        dt_set_by_user_ = true;
+    }
+
+    void step();
+    bool step(const Real& upto);
+
+    inline std::shared_ptr<RandomNumberGenerator> rng()
+    {
+        return (*world_).rng();
+    }
+
+    /**
+     * set the potential between two species, in both orders.
+     * call initialize after changing potentials.
+     */
+    void set_pair_potential(const Species& sp1, const Species& sp2, const PairPotential& potential);
+
+    /**
+     * set the potential of pairs not given by set_pair_potential, WCA with epsilon 1 by default.
+     */
+    void set_default_pair_potential(const PairPotential& potential)
+    {
+        default_potential_ = potential;
+    }
+
+    PairPotential get_pair_potential(const Species& sp1, const Species& sp2) const;
+
+    /**
+     * the margin of Verlet lists beyond the cutoff, a quarter of the longest cutoff if zero.
+     */
+    void set_skin(const Real skin)
+    {
+        skin_ = skin;
+    }
+
+    Real skin() const
+    {
+        return skin_;
+    }
+
+    /**
+     * @return the number of builds of Verlet lists since initialize
+     */
+    Integer num_list_builds() const
+    {
+        return num_list_builds_;
+    }
+
+    /**
+     * @return the number of pairs in Verlet lists
+     */
+    std::size_t num_pairs() const
+    {
+        return wca_.size() + harmonic_.size();
+    }
+
+    /**
+     * @return the potential energy of the current configuration in kT, tethers included.
+     * lists are rebuilt if needed.
+     */
+    Real potential_energy();
+
+    policy_type& policy()
+    {
+        return policy_;
+    }
+
+    const policy_type& policy() const
+    {
+        return policy_;
+    }
+
+    /**
+     * save/load the world and the internal state of the simulator
+     * in the dependency-free binary format. potentials are not saved.
+     */
+    void save_binary(std::ostream& out) const;
+    void load_binary(std::istream& in);
+
+    BDStatistics stats() const
+    {
+        BDStatistics retval(stats_);
+        retval.cell_crossings = (*world_).space_statistics().cell_crossings;
+        retval.candidates_scanned = (*world_).space_statistics().candidates_scanned;
+        return retval;
+    }
+
+    void reset_stats()
+    {
+        stats_.reset();
+        (*world_).reset_space_statistics();
+    }
+
+protected:
+
+    /**
+     * pairs of a type of potentials in the structure of arrays, with their forces.
+     */
+    struct pair_list
+    {
+        std::vector<uint32_t> i, j;
+        std::vector<Real> epsilon, sigma, cutoff_sq;
+        std::vector<Real> dx, dy, dz;  // from the first to the second, gathered for kernels
+        std::vector<Real> f;  // -(dU/dr) / r
+
+        std::size_t size() const
+        {
+            return i.size();
+        }
+
+        void clear()
+        {
+            i.clear(); j.clear();
+            epsilon.clear(); sigma.clear(); cutoff_sq.clear();
+        }
+
+        void push_back(const uint32_t i_, const uint32_t j_, const PairPotential& p)
+        {
+            i.push_back(i_);
+            j.push_back(j_);
+            epsilon.push_back(p.epsilon);
+            sigma.push_back(p.sigma);
+            cutoff_sq.push_back(p.cutoff() * p.cutoff());
+        }
+    };
+
+    /**
+     * copy positions of particles into arrays, and index their species.
+     */
+    void gather();
+
+    /**
+     * build Verlet lists over the positions gathered.
+     */
+    void build_lists();
+
+    /**
+     * @return if a particle moved farther than a half of the skin since the last build
+     */
+    bool needs_rebuild() const;
+
+    /**
+     * evaluate pair forces and tethers into fx_, fy_ and fz_.
+     */
+    void compute_forces();
+
+    /**
+     * gather the minimum images of separations of pairs into dx, dy and dz.
+     * positions must be in the world.
+     */
+    static void gather_separations(pair_list& pairs, const Real* x, const Real* y, const Real* z,
+        const Real3& edge_lengths);
+
+    /**
+     * evaluate forces of pairs from separations gathered, with no branch in the loop,
+     * so that it is vectorized. see the report of -fopt-info-vec.
+     */
+    static void wca_kernel(pair_list& pairs);
+    static void harmonic_kernel(pair_list& pairs);
+
+    /**
+     * the potential between the idx1-th and idx2-th species, with sigma resolved.
+     */
+    const PairPotential& potential(const std::size_t idx1, const std::size_t idx2) const
+    {
+        return potentials_[idx1 * species_.size() + idx2];
+    }
+
+protected:
+
+    Real dt_;
+    const Real bd_dt_factor_;
+    bool dt_set_by_user_;
+    Real skin_;
+
+    policy_type policy_;
+
+    PairPotential default_potential_;
+    std::unordered_map<Species::serial_type, std::unordered_map<Species::serial_type, PairPotential> >
+        given_potentials_;
+
+    std::vector<Species> species_;  // species of particles, in the order of appearance
+    std::vector<PairPotential> potentials_;  // a dense table over pairs of species_
+    Real skin_in_use_, cutoff_max_;
+
+    std::vector<uint32_t> species_index_;  // by particle
+    std::vector<Real> x_, y_, z_;  // positions in the world
+    std::vector<Real> x0_, y0_, z0_;  // positions at the last build of lists, unwrapped
+    std::vector<Real> fx_, fy_, fz_;  // forces in kT per length
+    pair_list wca_, harmonic_;
+    Integer num_list_builds_;
+
+    BDStatistics stats_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_SOFT_BD_SIMULATOR_HPP */
@@ -53,7 +53,7 @@ Species::Species(
     set_attribute("dimension", dimension);
 }
 
-const Species::serial_type Species::serial() const
+const Species::serial_type& Species::serial() const
 {
     return serial_;
 }
@@ -84,37 +84,42 @@ Integer Species::count(const Species& sp) const
     throw NotSupported("Function 'Species::count' was deprecated. Rather use 'count_species_matches'");
 }
 
-// const std::vector<UnitSpecies> Species::units() const
-// {
-//     std::vector<std::string> unit_serials;
-//     boost::split(unit_serials, serial_, boost::is_any_of("."));
-// 
-//     std::vector<UnitSpecies> units_;
-//     for (std::vector<std::string>::const_iterator i(unit_serials.begin());
-//         i != unit_serials.end(); ++i)
-//     {
-//         UnitSpecies usp;
-//         usp.deserialize(*i);
-//         units_.insert(std::lower_bound(units_.begin(), units_.end(), usp), usp);
-//     }
-//     return units_;
-// }
-// 
-// void Species::add_unit(const UnitSpecies& usp)
-// {
-//     if (usp.name() == "")
-//     {
-//         throw NotSupported("UnitSpecies must have a name.");
-//     }
-//     else if (serial_ != "")
-//     {
-//         serial_ += "." + usp.serial();
-//     }
-//     else
-//     {
-//         serial_ = usp.serial();
-//     }
-// }
+const std::vector<UnitSpecies> Species::units() const
+{
+    std::vector<UnitSpecies> units_;
+    if (serial_ == "")
+    {
+        return units_;
+    }
+
+    std::vector<std::string> unit_serials;
+    boost::split(unit_serials, serial_, boost::is_any_of("."));
+
+    for (std::vector<std::string>::const_iterator i(unit_serials.begin());
+        i != unit_serials.end(); ++i)
+    {
+        UnitSpecies usp;
+        usp.deserialize(*i);
+        units_.insert(std::lower_bound(units_.begin(), units_.end(), usp), usp);
+    }
+    return units_;
+}
+
+void Species::add_unit(const UnitSpecies& usp)
+{
+    if (usp.name() == "")
+    {
+        throw NotSupported("UnitSpecies must have a name.");
+    }
+    else if (serial_ != "")
+    {
+        serial_ += "." + usp.serial();
+    }
+    else
+    {
+        serial_ = usp.serial();
+    }
+}
 
 Species::attribute_type Species::get_attribute(const std::string& key) const
 {
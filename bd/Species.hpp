@@ -17,7 +17,7 @@
 
 #include "types.hpp"
 #include "exceptions.hpp"
-// #include "UnitSpecies.hpp"
+#include "UnitSpecies.hpp"
 // #include "Context.hpp"
 #include "Quantity.hpp"
 #include "Attribute.hpp"
@@ -31,7 +31,7 @@ class Species
 public:
 
     // typedef UnitSpecies::serial_type serial_type; //XXX: std::string
-    // typedef std::vector<UnitSpecies> container_type;
+    typedef std::vector<UnitSpecies> container_type;
     typedef std::string serial_type;
 
 public:
@@ -49,10 +49,15 @@ public:
     Species(const serial_type& name, const Quantity<Real>& radius, const Quantity<Real>& D,
             const std::string location = "", const Integer& dimension = 0);
 
-    const serial_type serial() const;
+    const serial_type& serial() const;
 
-    // void add_unit(const UnitSpecies& usp);
-    // const std::vector<UnitSpecies> units() const;
+    void add_unit(const UnitSpecies& usp);
+
+    /**
+     * parse the serial into units. this is not cheap.
+     * context::rule_based_expression_cache keeps what is parsed.
+     */
+    const std::vector<UnitSpecies> units() const;
 
     const Attribute& attributes() const;
 
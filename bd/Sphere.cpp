@@ -77,6 +77,14 @@ bool Sphere::test_AABB(const Real3& l, const Real3& u) const
     return collision::test_sphere_AABB(*this, l, u);
 }
 
+void Sphere::bounding_box(
+    const Real3& edge_lengths, Real3& lower, Real3& upper) const
+{
+    const Real3 r(radius_, radius_, radius_);
+    lower = center_ - r;
+    upper = center_ + r;
+}
+
 SphericalSurface::SphericalSurface()
     : center_(), radius_()
 {
@@ -136,4 +144,12 @@ bool SphericalSurface::test_AABB(const Real3& l, const Real3& u) const
     return collision::test_shell_AABB(*this, l, u);
 }
 
+void SphericalSurface::bounding_box(
+    const Real3& edge_lengths, Real3& lower, Real3& upper) const
+{
+    const Real3 r(radius_, radius_, radius_);
+    lower = center_ - r;
+    upper = center_ + r;
+}
+
 } // ecell4
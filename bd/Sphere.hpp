@@ -33,6 +33,8 @@ public:
     Real3 draw_position(
         std::shared_ptr<RandomNumberGenerator>& rng) const;
     bool test_AABB(const Real3& l, const Real3& u) const;
+    void bounding_box(
+        const Real3& edge_lengths, Real3& lower, Real3& upper) const;
 
     inline const Real3& position() const
     {
@@ -79,6 +81,8 @@ struct SphericalSurface
     Real3 draw_position(
         std::shared_ptr<RandomNumberGenerator>& rng) const;
     bool test_AABB(const Real3& l, const Real3& u) const;
+    void bounding_box(
+        const Real3& edge_lengths, Real3& lower, Real3& upper) const;
 
     dimension_kind dimension() const
     {
@@ -0,0 +1,166 @@
+#ifndef ECELL4_BD_STATISTICS_HPP
+#define ECELL4_BD_STATISTICS_HPP
+
+#include <ostream>
+#include <chrono>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "types.hpp"
+
+/**
+ * ECELL4_BD_STATS(expr) evaluates expr only when the counters are enabled.
+ * define ECELL4_BD_ENABLE_STATS, or configure with -DBD_ENABLE_STATS=ON,
+ * to enable them. otherwise, the hot path is left untouched.
+ */
+#ifdef ECELL4_BD_ENABLE_STATS
+#define ECELL4_BD_STATS(expr) expr
+#else
+#define ECELL4_BD_STATS(expr)
+#endif
+
+
+namespace ecell4
+{
+
+/**
+ * a timestamp in ticks, cpu cycles on x86, or nanoseconds of steady_clock otherwise.
+ */
+inline uint64_t read_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/**
+ * counters of ParticleSpace. only incremented when ECELL4_BD_ENABLE_STATS is defined.
+ */
+struct ParticleSpaceStatistics
+{
+    uint64_t cell_crossings;  // updates moving a particle into another cell
+    uint64_t candidates_scanned;  // particles in neighboring cells tested for overlap
+
+    ParticleSpaceStatistics()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        cell_crossings = 0;
+        candidates_scanned = 0;
+    }
+};
+
+namespace bd
+{
+
+/**
+ * counters and per-phase timers of BDSimulator::step.
+ * only incremented when ECELL4_BD_ENABLE_STATS is defined.
+ */
+struct BDStatistics
+{
+#ifdef ECELL4_BD_ENABLE_STATS
+    static const bool enabled = true;
+#else
+    static const bool enabled = false;
+#endif
+
+    uint64_t num_steps;
+    uint64_t attempted;  // moves of mobile particles
+    uint64_t rejected_constraint;  // out of the constraint radius
+    uint64_t rejected_layer;  // a crowder crossing the layer boundary
+    uint64_t rejected_wall;  // a tracer hitting the reflective wall
+    uint64_t rejected_overlap;
+    uint64_t accepted;
+    uint64_t cell_crossings;
+    uint64_t candidates_scanned;
+    uint64_t encounters;  // tracer-crowder overlaps observed
+    uint64_t first_encounters;
+    uint64_t reactions;
+
+    uint64_t ticks_rng;
+    uint64_t ticks_boundary;
+    uint64_t ticks_neighbor_search;
+    uint64_t ticks_update;  // moving a particle, or recording its encounters
+
+    BDStatistics()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        num_steps = 0;
+        attempted = 0;
+        rejected_constraint = 0;
+        rejected_layer = 0;
+        rejected_wall = 0;
+        rejected_overlap = 0;
+        accepted = 0;
+        cell_crossings = 0;
+        candidates_scanned = 0;
+        encounters = 0;
+        first_encounters = 0;
+        reactions = 0;
+        ticks_rng = 0;
+        ticks_boundary = 0;
+        ticks_neighbor_search = 0;
+        ticks_update = 0;
+    }
+
+    Real acceptance() const
+    {
+        return (attempted > 0 ? static_cast<Real>(accepted) / attempted : 0.0);
+    }
+
+    /**
+     * add the ticks since the last lap to the counter, and restart.
+     */
+    static inline void lap(uint64_t& counter, uint64_t& tick)
+    {
+        const uint64_t now(read_ticks());
+        counter += now - tick;
+        tick = now;
+    }
+};
+
+/**
+ * write statistics as comma-separated key=value pairs.
+ */
+template<typename Tstrm_, typename Ttraits_>
+inline std::basic_ostream<Tstrm_, Ttraits_>& operator<<(
+    std::basic_ostream<Tstrm_, Ttraits_>& strm, const BDStatistics& v)
+{
+    strm << "steps=" << v.num_steps
+        << ",attempted=" << v.attempted
+        << ",rejected_constraint=" << v.rejected_constraint
+        << ",rejected_layer=" << v.rejected_layer
+        << ",rejected_wall=" << v.rejected_wall
+        << ",rejected_overlap=" << v.rejected_overlap
+        << ",accepted=" << v.accepted
+        << ",cell_crossings=" << v.cell_crossings
+        << ",candidates_scanned=" << v.candidates_scanned
+        << ",encounters=" << v.encounters
+        << ",first_encounters=" << v.first_encounters
+        << ",reactions=" << v.reactions
+        << ",ticks_rng=" << v.ticks_rng
+        << ",ticks_boundary=" << v.ticks_boundary
+        << ",ticks_neighbor_search=" << v.ticks_neighbor_search
+        << ",ticks_update=" << v.ticks_update;
+    return strm;
+}
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_STATISTICS_HPP */
@@ -0,0 +1,214 @@
+#include "TriangleMesh.hpp"
+#include "collision.hpp"
+#include "exceptions.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+const std::size_t TriangleMesh::leaf_size;
+
+void TriangleMesh::add_triangle(const Real3& a, const Real3& b, const Real3& c)
+{
+    triangle_type t;
+    t.a = a;
+    t.b = b;
+    t.c = c;
+    triangles_.push_back(t);
+    built_ = false;
+}
+
+void TriangleMesh::load(const std::string& filename)
+{
+    std::ifstream fin(filename.c_str());
+    if (!fin)
+    {
+        throw_exception<NotFound>("Failed to open [", filename, "].");
+    }
+
+    std::vector<Real3> vertices;
+    std::string line;
+    std::size_t lineno(0);
+    while (std::getline(fin, line))
+    {
+        ++lineno;
+        std::istringstream iss(line);
+        std::string tag;
+        if (!(iss >> tag) || tag[0] == '#')
+        {
+            continue;
+        }
+
+        if (tag == "v")
+        {
+            Real3 v;
+            if (!(iss >> v[0] >> v[1] >> v[2]))
+            {
+                throw_exception<IllegalArgument>(
+                    "A vertex must have three coordinates [", filename, ":", lineno, "].");
+            }
+            vertices.push_back(v);
+        }
+        else if (tag == "f")
+        {
+            // an index is followed by optional texture and normal indices, as 1/2/3.
+            std::vector<std::size_t> face;
+            std::string token;
+            while (iss >> token)
+            {
+                const long idx(std::strtol(token.c_str(), NULL, 10));
+                const long resolved(idx < 0 ? static_cast<long>(vertices.size()) + idx : idx - 1);
+                if (idx == 0 || resolved < 0 || resolved >= static_cast<long>(vertices.size()))
+                {
+                    throw_exception<IllegalArgument>(
+                        "No vertex [", token, "] is defined [", filename, ":", lineno, "].");
+                }
+                face.push_back(static_cast<std::size_t>(resolved));
+            }
+            if (face.size() < 3)
+            {
+                throw_exception<IllegalArgument>(
+                    "A face must have three vertices at least [", filename, ":", lineno, "].");
+            }
+            for (std::size_t i(2); i < face.size(); ++i)
+            {
+                add_triangle(vertices[face[0]], vertices[face[i - 1]], vertices[face[i]]);
+            }
+        }
+    }
+
+    build();
+}
+
+void TriangleMesh::build()
+{
+    nodes_.clear();
+    built_ = true;
+    if (triangles_.empty())
+    {
+        return;
+    }
+
+    std::vector<Real3> centroids(triangles_.size());
+    for (std::size_t i(0); i < triangles_.size(); ++i)
+    {
+        centroids[i] = (triangles_[i].a + triangles_[i].b + triangles_[i].c) / 3.0;
+    }
+    nodes_.reserve(2 * (triangles_.size() / leaf_size + 1));
+    build_node(centroids, 0, triangles_.size());
+}
+
+void TriangleMesh::build_node(
+    std::vector<Real3>& centroids, const std::size_t begin, const std::size_t end)
+{
+    const std::size_t idx(nodes_.size());
+    nodes_.push_back(node_type());
+
+    Real3 lower(triangles_[begin].a), upper(triangles_[begin].a);
+    Real3 clower(centroids[begin]), cupper(centroids[begin]);
+    for (std::size_t i(begin); i < end; ++i)
+    {
+        const triangle_type& t(triangles_[i]);
+        for (unsigned int j(0); j < 3; ++j)
+        {
+            lower[j] = std::min(std::min(lower[j], t.a[j]), std::min(t.b[j], t.c[j]));
+            upper[j] = std::max(std::max(upper[j], t.a[j]), std::max(t.b[j], t.c[j]));
+            clower[j] = std::min(clower[j], centroids[i][j]);
+            cupper[j] = std::max(cupper[j], centroids[i][j]);
+        }
+    }
+    nodes_[idx].lower = lower;
+    nodes_[idx].upper = upper;
+
+    // split at the median of centroids along the longest extent.
+    const Real3 extent(cupper - clower);
+    const unsigned int axis(
+        extent[0] >= extent[1] ? (extent[0] >= extent[2] ? 0 : 2) : (extent[1] >= extent[2] ? 1 : 2));
+    if (end - begin <= leaf_size || extent[axis] <= 0)
+    {
+        nodes_[idx].offset = static_cast<uint32_t>(begin);
+        nodes_[idx].count = static_cast<uint32_t>(end - begin);
+        return;
+    }
+
+    std::vector<std::size_t> order(end - begin);
+    for (std::size_t i(0); i < order.size(); ++i)
+    {
+        order[i] = begin + i;
+    }
+    const std::size_t mid(order.size() / 2);
+    std::nth_element(order.begin(), order.begin() + mid, order.end(),
+        [&centroids, axis](const std::size_t i, const std::size_t j)
+        {
+            return centroids[i][axis] < centroids[j][axis];
+        });
+    std::vector<triangle_type> triangles(order.size());
+    std::vector<Real3> cs(order.size());
+    for (std::size_t i(0); i < order.size(); ++i)
+    {
+        triangles[i] = triangles_[order[i]];
+        cs[i] = centroids[order[i]];
+    }
+    std::copy(triangles.begin(), triangles.end(), triangles_.begin() + begin);
+    std::copy(cs.begin(), cs.end(), centroids.begin() + begin);
+
+    build_node(centroids, begin, begin + mid);
+    nodes_[idx].offset = static_cast<uint32_t>(nodes_.size());
+    nodes_[idx].count = 0;
+    build_node(centroids, begin + mid, end);
+}
+
+bool TriangleMesh::test_segment(const Real3& p, const Real3& q) const
+{
+    if (!built_)
+    {
+        throw IllegalState("The hierarchy of the mesh is not built.");
+    }
+    if (nodes_.empty())
+    {
+        return false;
+    }
+
+    // the depth is about log2 of the number of leaves, as split at the median.
+    uint32_t stack[64];
+    std::size_t top(0);
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const uint32_t idx(stack[--top]);
+        const node_type& node(nodes_[idx]);
+        if (!collision::test_segment_AABB(p, q, node.lower, node.upper))
+        {
+            continue;
+        }
+
+        if (node.count > 0)
+        {
+            for (uint32_t i(node.offset); i < node.offset + node.count; ++i)
+            {
+                const triangle_type& t(triangles_[i]);
+                Real s;
+                if (collision::intersect_segment_triangle(p, q, t.a, t.b, t.c, s))
+                {
+                    return true;
+                }
+            }
+            continue;
+        }
+        stack[top++] = node.offset;
+        stack[top++] = idx + 1;
+    }
+    return false;
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,142 @@
+#ifndef ECELL4_BD_TRIANGLE_MESH_HPP
+#define ECELL4_BD_TRIANGLE_MESH_HPP
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "types.hpp"
+#include "Real3.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * a set of triangles with a bounding volume hierarchy over them,
+ * for testing if a segment crosses any of them in logarithmic time.
+ * triangles are added one by one, or read from a Wavefront OBJ file,
+ * and the hierarchy is built by build before tests.
+ */
+class TriangleMesh
+{
+public:
+
+    struct triangle_type
+    {
+        Real3 a, b, c;
+    };
+
+    /**
+     * the largest number of triangles in a leaf of the hierarchy
+     */
+    static const std::size_t leaf_size = 4;
+
+public:
+
+    TriangleMesh()
+        : built_(true)
+    {
+        ;
+    }
+
+    void add_triangle(const Real3& a, const Real3& b, const Real3& c);
+
+    /**
+     * add triangles of a Wavefront OBJ file, and build the hierarchy.
+     * only vertices (v) and faces (f) are read, and a polygon is split into a fan.
+     */
+    void load(const std::string& filename);
+
+    /**
+     * build the hierarchy over triangles added.
+     */
+    void build();
+
+    void clear()
+    {
+        triangles_.clear();
+        nodes_.clear();
+        built_ = true;
+    }
+
+    bool empty() const
+    {
+        return triangles_.empty();
+    }
+
+    bool built() const
+    {
+        return built_;
+    }
+
+    std::size_t num_triangles() const
+    {
+        return triangles_.size();
+    }
+
+    /**
+     * @return triangles in the order of leaves of the hierarchy
+     */
+    const std::vector<triangle_type>& triangles() const
+    {
+        return triangles_;
+    }
+
+    std::size_t num_nodes() const
+    {
+        return nodes_.size();
+    }
+
+    /**
+     * @return the corners of the box bounding all triangles, once built
+     */
+    const Real3& lower() const
+    {
+        return nodes_.front().lower;
+    }
+
+    const Real3& upper() const
+    {
+        return nodes_.front().upper;
+    }
+
+    /**
+     * @return if the segment from p to q crosses a triangle, except at p.
+     * throws IllegalState unless built.
+     */
+    bool test_segment(const Real3& p, const Real3& q) const;
+
+protected:
+
+    /**
+     * a node with a bounding box. the first child of an inner node follows it,
+     * and the second is at offset. a leaf holds count triangles from offset.
+     */
+    struct node_type
+    {
+        Real3 lower, upper;
+        uint32_t offset;
+        uint32_t count;  // zero for an inner node
+    };
+
+    /**
+     * build the subtree over triangles [begin, end) into nodes_.
+     */
+    void build_node(std::vector<Real3>& centroids, const std::size_t begin, const std::size_t end);
+
+protected:
+
+    std::vector<triangle_type> triangles_;
+    std::vector<node_type> nodes_;
+    bool built_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_TRIANGLE_MESH_HPP */
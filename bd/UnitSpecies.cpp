@@ -24,7 +24,7 @@ void UnitSpecies::deserialize(const UnitSpecies::serial_type& serial)
 
     using namespace std;
 
-    regex r1(
+    static const regex r1(
         "^\\s*(\\w+)\\s*(\\(\\s*([\\w\\s\\^=,]*)\\))?\\s*$");
     smatch results1;
     if (regex_match(serial, results1, r1))
@@ -32,7 +32,7 @@ void UnitSpecies::deserialize(const UnitSpecies::serial_type& serial)
         name_ = std::string(results1.str(1).c_str());
         if (results1.str(3).size() > 0)
         {
-            regex r2(
+            static const regex r2(
                 "\\s*(\\w+)(\\s*=\\s*(\\w+))?(\\s*\\^\\s*(\\w+))?\\s*");
             // match_results<std::string::const_iterator> results2;
             smatch results2;
@@ -0,0 +1,209 @@
+#include "WeightedEnsemble.hpp"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+WeightedEnsemble::WeightedEnsemble(
+    const BDSimulator& sim, const ParticleID& tracer, const Real threshold,
+    const std::vector<Real>& edges, const Integer walkers_per_bin, const Real tau,
+    const Integer seed)
+    : tracer_(tracer), threshold_(threshold), edges_(edges),
+    walkers_per_bin_(walkers_per_bin), tau_(tau), rng_(seed), t_(0.0), num_steps_(0),
+    null_stream_(&null_buffer_)
+{
+    if (walkers_per_bin_ <= 0)
+    {
+        throw std::invalid_argument("The number of walkers per bin must be positive.");
+    }
+    if (tau_ <= 0)
+    {
+        throw std::invalid_argument("The interval of resampling must be positive.");
+    }
+    if (!(*sim.world()).has_particle(tracer_))
+    {
+        throw NotFound("No such tracer.");
+    }
+    std::sort(edges_.begin(), edges_.end());
+
+    null_output_ = std::shared_ptr<AsyncOutputWriter>(new AsyncOutputWriter(null_stream_));
+    output_ = null_output_;
+
+    if (progress(sim) >= threshold_)
+    {
+        passages_.push_back(std::make_pair(0.0, 1.0));
+        return;
+    }
+
+    walkers_.reserve(walkers_per_bin_);
+    for (Integer i(0); i < walkers_per_bin_; ++i)
+    {
+        const walker_type w = {clone(sim), 1.0 / walkers_per_bin_};
+        walkers_.push_back(w);
+    }
+}
+
+WeightedEnsemble::~WeightedEnsemble()
+{
+    walkers_.clear();
+    (*null_output_).stop();
+}
+
+void WeightedEnsemble::set_output(const std::shared_ptr<AsyncOutputWriter>& output)
+{
+    output_ = output;
+    for (walker_container_type::iterator i(walkers_.begin()); i != walkers_.end(); ++i)
+    {
+        (*(*i).sim).set_output(output_);
+    }
+}
+
+Real WeightedEnsemble::progress(const BDSimulator& sim) const
+{
+    const Particle p((*sim.world()).get_particle(tracer_).second);
+    return p.position()[0] + p.stride()[0];
+}
+
+Real WeightedEnsemble::survival() const
+{
+    Real retval(0.0);
+    for (walker_container_type::const_iterator i(walkers_.begin()); i != walkers_.end(); ++i)
+    {
+        retval += (*i).weight;
+    }
+    return retval;
+}
+
+std::shared_ptr<BDSimulator> WeightedEnsemble::clone(const BDSimulator& sim)
+{
+    std::shared_ptr<RandomNumberGenerator> rng(new GSLRandomNumberGenerator(
+        rng_.uniform_int(1, std::numeric_limits<int32_t>::max())));
+    std::shared_ptr<BDSimulator> retval(
+        new BDSimulator((*sim.world()).clone(rng), sim.model()));
+    (*retval).copy_state(sim);
+    (*retval).set_output(output_);
+    return retval;
+}
+
+bool WeightedEnsemble::step()
+{
+    const Real upto(t_ + tau_);
+    const std::size_t num_passages(passages_.size());
+
+    walker_container_type survivors;
+    survivors.reserve(walkers_.size());
+    for (walker_container_type::iterator i(walkers_.begin()); i != walkers_.end(); ++i)
+    {
+        BDSimulator& sim(*(*i).sim);
+        const Real t0(sim.t() - t_);  // walkers start from the time of the initial state
+
+        bool passed(false);
+        while (true)
+        {
+            const bool full(sim.step(t0 + upto));
+            if (progress(sim) >= threshold_)
+            {
+                passages_.push_back(std::make_pair(sim.t() - t0, (*i).weight));
+                passed = true;
+                break;
+            }
+            if (!full)
+            {
+                break;
+            }
+        }
+
+        if (!passed)
+        {
+            survivors.push_back(*i);
+        }
+    }
+    walkers_.swap(survivors);
+
+    t_ = upto;
+    ++num_steps_;
+
+    // passages in this step are later than the others.
+    std::sort(passages_.begin() + num_passages, passages_.end());
+
+    resample();
+
+    (*output_).frame().set_t(t_);
+    (*output_).commit();
+    return !walkers_.empty();
+}
+
+void WeightedEnsemble::resample()
+{
+    // walkers in each bin, in the order of the container
+    std::vector<walker_container_type> bins(edges_.size() + 1);
+    for (walker_container_type::const_iterator i(walkers_.begin()); i != walkers_.end(); ++i)
+    {
+        bins[bin(progress(*(*i).sim))].push_back(*i);
+    }
+
+    walker_container_type resampled;
+    resampled.reserve(bins.size() * walkers_per_bin_);
+    for (std::vector<walker_container_type>::iterator b(bins.begin()); b != bins.end(); ++b)
+    {
+        walker_container_type& walkers(*b);
+
+        while (!walkers.empty() && walkers.size() < static_cast<std::size_t>(walkers_per_bin_))
+        {
+            walker_container_type::iterator heaviest(walkers.begin());
+            for (walker_container_type::iterator i(walkers.begin()); i != walkers.end(); ++i)
+            {
+                if ((*i).weight > (*heaviest).weight)
+                {
+                    heaviest = i;
+                }
+            }
+
+            (*heaviest).weight *= 0.5;
+            const walker_type w = {clone(*(*heaviest).sim), (*heaviest).weight};
+            walkers.push_back(w);
+        }
+
+        while (walkers.size() > static_cast<std::size_t>(walkers_per_bin_))
+        {
+            walker_container_type::iterator first(walkers.begin()), second(walkers.begin() + 1);
+            if ((*second).weight < (*first).weight)
+            {
+                std::swap(first, second);
+            }
+            for (walker_container_type::iterator i(walkers.begin() + 2); i != walkers.end(); ++i)
+            {
+                if ((*i).weight < (*first).weight)
+                {
+                    second = first;
+                    first = i;
+                }
+                else if ((*i).weight < (*second).weight)
+                {
+                    second = i;
+                }
+            }
+
+            const Real weight((*first).weight + (*second).weight);
+            if (rng_.uniform(0.0, weight) < (*first).weight)
+            {
+                std::swap(*first, *second);
+            }
+            (*second).weight = weight;
+            walkers.erase(first);
+        }
+
+        resampled.insert(resampled.end(), walkers.begin(), walkers.end());
+    }
+    walkers_.swap(resampled);
+}
+
+} // bd
+
+} // ecell4
@@ -0,0 +1,174 @@
+#ifndef ECELL4_BD_WEIGHTED_ENSEMBLE_HPP
+#define ECELL4_BD_WEIGHTED_ENSEMBLE_HPP
+
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include <algorithm>
+
+#include "BDSimulator.hpp"
+#include "AsyncOutputWriter.hpp"
+
+
+namespace ecell4
+{
+
+namespace bd
+{
+
+/**
+ * the weighted ensemble of BDSimulator for the first passage of a tracer.
+ * walkers, copies of a simulator with weights summing up to one, are binned by
+ * the x coordinate of the tracer, and run for tau in each iteration.
+ * after an iteration, walkers are split and merged to walkers_per_bin in each bin:
+ * the heaviest is split into halves, and the lightest two are merged into
+ * one of them chosen with probabilities proportional to their weights.
+ * a walker whose tracer reaches the threshold is removed,
+ * and its weight is recorded as the probability of the first passage at the time.
+ * thus, recorded weights give an unbiased distribution of first-passage times.
+ * a walker is copied by BDWorld::clone and BDSimulatorT::copy_state,
+ * and the copy is given a new seed from the random number generator of the ensemble.
+ * lines of encounters from walkers are passed to the output, and discarded by default.
+ */
+class WeightedEnsemble
+{
+public:
+
+    struct walker_type
+    {
+        std::shared_ptr<BDSimulator> sim;
+        Real weight;
+    };
+
+    typedef std::vector<walker_type> walker_container_type;
+    typedef std::pair<Real, Real> passage_type;  // a pair of the time and the weight
+
+public:
+
+    /**
+     * @param sim a simulator giving the initial state. it is left untouched.
+     * @param tracer a particle in sim
+     * @param threshold the x coordinate to be reached
+     * @param edges sorted edges of bins
+     * @param walkers_per_bin the number of walkers in each occupied bin
+     * @param tau the interval of resampling
+     * @param seed a seed of the random number generator for resampling and new streams
+     */
+    WeightedEnsemble(
+        const BDSimulator& sim, const ParticleID& tracer, const Real threshold,
+        const std::vector<Real>& edges, const Integer walkers_per_bin, const Real tau,
+        const Integer seed);
+
+    virtual ~WeightedEnsemble();
+
+    /**
+     * run all walkers for tau, and resample them.
+     * @return if any walker is left
+     */
+    bool step();
+
+    /**
+     * @return the time elapsed from the initial state
+     */
+    Real t() const
+    {
+        return t_;
+    }
+
+    Integer num_steps() const
+    {
+        return num_steps_;
+    }
+
+    const walker_container_type& walkers() const
+    {
+        return walkers_;
+    }
+
+    /**
+     * @return pairs of the first-passage time and its weight, in order of time
+     */
+    const std::vector<passage_type>& first_passages() const
+    {
+        return passages_;
+    }
+
+    /**
+     * @return the total weight of walkers not passed yet
+     */
+    Real survival() const;
+
+    /**
+     * the x coordinate of the tracer, the progress of a walker.
+     */
+    Real progress(const BDSimulator& sim) const;
+
+    /**
+     * pass encounters of walkers to the given writer. commit it for each step.
+     */
+    void set_output(const std::shared_ptr<AsyncOutputWriter>& output);
+
+    const std::shared_ptr<AsyncOutputWriter>& output() const
+    {
+        return output_;
+    }
+
+protected:
+
+    /**
+     * copy a simulator with an independent stream of random numbers.
+     */
+    std::shared_ptr<BDSimulator> clone(const BDSimulator& sim);
+
+    /**
+     * split and merge walkers in each bin.
+     */
+    void resample();
+
+    std::size_t bin(const Real x) const
+    {
+        return std::upper_bound(edges_.begin(), edges_.end(), x) - edges_.begin();
+    }
+
+protected:
+
+    /**
+     * a stream buffer discarding everything.
+     */
+    class null_buffer
+        : public std::streambuf
+    {
+    protected:
+
+        int overflow(int c)
+        {
+            return traits_type::not_eof(c);
+        }
+    };
+
+protected:
+
+    ParticleID tracer_;
+    Real threshold_;
+    std::vector<Real> edges_;
+    Integer walkers_per_bin_;
+    Real tau_;
+
+    GSLRandomNumberGenerator rng_;
+    Real t_;
+    Integer num_steps_;
+
+    walker_container_type walkers_;
+    std::vector<passage_type> passages_;
+
+    null_buffer null_buffer_;
+    std::ostream null_stream_;
+    std::shared_ptr<AsyncOutputWriter> null_output_;
+    std::shared_ptr<AsyncOutputWriter> output_;
+};
+
+} // bd
+
+} // ecell4
+
+#endif /* ECELL4_BD_WEIGHTED_ENSEMBLE_HPP */
@@ -0,0 +1,162 @@
+#ifndef ECELL4_BINARY_IO_HPP
+#define ECELL4_BINARY_IO_HPP
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include <type_traits>
+
+#include "types.hpp"
+#include "exceptions.hpp"
+#include "Real3.hpp"
+
+
+namespace ecell4
+{
+
+/**
+ * dependency-free helpers for the binary checkpoint format.
+ * values are written in the native byte order of the host,
+ * which is sufficient for restarting on the same cluster.
+ */
+namespace binary_io
+{
+
+template<typename T_>
+inline void write(std::ostream& out, const T_& value)
+{
+    static_assert(std::is_trivially_copyable<T_>::value,
+        "binary_io::write requires a trivially copyable type.");
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T_));
+}
+
+template<typename T_>
+inline void read(std::istream& in, T_& value)
+{
+    static_assert(std::is_trivially_copyable<T_>::value,
+        "binary_io::read requires a trivially copyable type.");
+    in.read(reinterpret_cast<char*>(&value), sizeof(T_));
+    if (!in)
+    {
+        throw IllegalState("Unexpected end of a binary stream.");
+    }
+}
+
+inline void write(std::ostream& out, const std::string& value)
+{
+    write(out, static_cast<uint64_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+inline void read(std::istream& in, std::string& value)
+{
+    uint64_t size;
+    read(in, size);
+    value.resize(size);
+    if (size > 0)
+    {
+        in.read(&value[0], size);
+        if (!in)
+        {
+            throw IllegalState("Unexpected end of a binary stream.");
+        }
+    }
+}
+
+inline void write(std::ostream& out, const Real3& value)
+{
+    write(out, value[0]);
+    write(out, value[1]);
+    write(out, value[2]);
+}
+
+inline void read(std::istream& in, Real3& value)
+{
+    read(in, value[0]);
+    read(in, value[1]);
+    read(in, value[2]);
+}
+
+template<typename T_>
+inline void write(std::ostream& out, const std::vector<T_>& value)
+{
+    static_assert(std::is_trivially_copyable<T_>::value,
+        "binary_io::write requires a trivially copyable type.");
+    write(out, static_cast<uint64_t>(value.size()));
+    if (value.size() > 0)
+    {
+        out.write(reinterpret_cast<const char*>(value.data()), sizeof(T_) * value.size());
+    }
+}
+
+template<typename T_>
+inline void read(std::istream& in, std::vector<T_>& value)
+{
+    static_assert(std::is_trivially_copyable<T_>::value,
+        "binary_io::read requires a trivially copyable type.");
+    uint64_t size;
+    read(in, size);
+    value.resize(size);
+    if (size > 0)
+    {
+        in.read(reinterpret_cast<char*>(value.data()), sizeof(T_) * size);
+        if (!in)
+        {
+            throw IllegalState("Unexpected end of a binary stream.");
+        }
+    }
+}
+
+/**
+ * read a value of the given type. declared after all overloads of read.
+ */
+template<typename T_>
+inline T_ read(std::istream& in)
+{
+    T_ value;
+    read(in, value);
+    return value;
+}
+
+/**
+ * write a section header, a fixed magic string followed by a version.
+ */
+inline void write_header(std::ostream& out, const char* magic, const uint32_t version)
+{
+    out.write(magic, std::strlen(magic));
+    write(out, version);
+}
+
+/**
+ * read a section header and return its version.
+ * @param magic the expected magic string
+ * @param max_version the latest version supported by the reader
+ */
+inline uint32_t read_header(std::istream& in, const char* magic, const uint32_t max_version)
+{
+    const std::size_t len(std::strlen(magic));
+    std::string buf(len, '\0');
+    in.read(&buf[0], len);
+    if (!in || buf != magic)
+    {
+        throw_exception<NotSupported>("Not a binary stream of [", magic, "].");
+    }
+
+    const uint32_t version(read<uint32_t>(in));
+    if (version == 0 || version > max_version)
+    {
+        throw_exception<NotSupported>(
+            "The version of [", magic, "] is not supported [",
+            version, " > ", max_version, "].");
+    }
+    return version;
+}
+
+} // binary_io
+
+} // ecell4
+
+#endif /* ECELL4_BINARY_IO_HPP */
@@ -188,7 +188,7 @@ bool test_segment_AABB(
     constexpr double epsilon = std::numeric_limits<Real>::epsilon();
     const Real3 c((upper + lower) * 0.5);
     const Real3 e(upper - c);
-    Real3 m(multiply(p1 - p0, 0.5));
+    Real3 m(multiply(p0 + p1, 0.5));
     const Real3 d(p1 - m);
     m = m - c;
 
@@ -226,18 +226,18 @@ bool test_segment_AABB(
     return true;
 }
 
-// bool test_AABB_plane(const AABB& b, const PlanarSurface& p)
-// {
-//     const Real3 c(b.center());
-//     const Real3 e(b.radius());
-// 
-//     const Real3& n(p.normal());
-//     const Real d(dot_product(p.origin(), n));
-// 
-//     const Real r(e[0] * abs(n[0]) + e[1] * abs(n[1]) + e[2] * abs(n[2]));
-//     const Real s(dot_product(n, c) - d);
-//     return (abs(s) <= r);
-// }
+bool test_AABB_plane(const AABB& b, const PlanarSurface& p)
+{
+    const Real3 c(b.center());
+    const Real3 e(b.radius());
+
+    const Real3& n(p.normal());
+    const Real d(dot_product(p.origin(), n));
+
+    const Real r(e[0] * abs(n[0]) + e[1] * abs(n[1]) + e[2] * abs(n[2]));
+    const Real s(dot_product(n, c) - d);
+    return (abs(s) <= r);
+}
 
 bool test_sphere_AABB(const Sphere& s, const AABB& b)
 {
@@ -385,6 +385,39 @@ bool intersect_moving_sphere_AABB(
         p0, p1, b.corner(u^7), b.corner(v), radius, t);
 }
 
+bool intersect_segment_triangle(
+    const Real3& p, const Real3& q, const Real3& a, const Real3& b, const Real3& c, Real& s)
+{
+    // Moller and Trumbore, from either side of the triangle.
+    constexpr double epsilon = std::numeric_limits<Real>::epsilon();
+    const Real3 d(q - p);
+    const Real3 ab(b - a);
+    const Real3 ac(c - a);
+    const Real3 h(cross_product(d, ac));
+    const Real det(dot_product(ab, h));
+    if (abs(det) <= epsilon * length(ab) * length(ac) * length(d))
+    {
+        // parallel to the plane.
+        return false;
+    }
+
+    const Real inv(1.0 / det);
+    const Real3 ap(p - a);
+    const Real u(dot_product(ap, h) * inv);
+    if (u < 0.0 || u > 1.0)
+    {
+        return false;
+    }
+    const Real3 k(cross_product(ap, ab));
+    const Real v(dot_product(d, k) * inv);
+    if (v < 0.0 || u + v > 1.0)
+    {
+        return false;
+    }
+    s = dot_product(ac, k) * inv;
+    return (s > 0.0 && s <= 1.0);
+}
+
 // Real3 closest_point_point_triangle(const Real3& p, const Triangle& t)
 // {
 //     // this implementation is based on
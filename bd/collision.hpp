@@ -6,7 +6,7 @@
 
 #include "AABB.hpp"
 // #include "Cylinder.hpp"
-// #include "PlanarSurface.hpp"
+#include "PlanarSurface.hpp"
 #include "Sphere.hpp"
 // #include "Rod.hpp"
 // #include "Circle.hpp"
@@ -68,7 +68,7 @@ inline bool test_segment_AABB(
     return test_segment_AABB(p0, p1, b.lower(), b.upper());
 }
 
-// bool test_AABB_plane(const AABB& b, const PlanarSurface& p);
+bool test_AABB_plane(const AABB& b, const PlanarSurface& p);
 bool test_shell_AABB(const SphericalSurface& s, const AABB& b);
 
 inline bool test_shell_AABB(const SphericalSurface& s, const Real3& l, const Real3& u)
@@ -102,6 +102,13 @@ bool intersect_segment_capsule(
 bool intersect_moving_sphere_AABB(
     const Sphere& s, const Real3& d, const AABB& b, Real& t);
 
+/**
+ * a segment from p to q crossing the triangle abc from either side.
+ * @param s the fraction of the segment at the crossing, in (0, 1]
+ */
+bool intersect_segment_triangle(
+    const Real3& p, const Real3& q, const Real3& a, const Real3& b, const Real3& c, Real& s);
+
 /* ------ 2D stuff ------ */
 
 //XXX PROPOSAL:
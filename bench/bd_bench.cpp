@@ -0,0 +1,1167 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <streambuf>
+
+#include "../bd/NetworkModel.hpp"
+#include "../bd/NetfreeModel.hpp"
+#include "../bd/BDSimulator.hpp"
+#include "../bd/SoftBDSimulator.hpp"
+#include "../bd/ParticlePlacer.hpp"
+#include "../bd/TriangleMesh.hpp"
+
+using namespace ecell4;
+using namespace ecell4::bd;
+
+/*
+    reproducible benchmarks of the BD engine.
+    results are written to std::cout as JSON.
+    checks, named check/..., count failures against references instead of timing,
+    and the exit status is 1 if any of them fails. run them alone with --filter check/.
+
+    usage: bd_bench [--seed N] [--min-time SEC] [--max-particles N] [--filter SUBSTR]
+        [--propose-accept 0|1] [--continuous-exclusion 0|1]
+*/
+
+typedef std::chrono::steady_clock clock_type;
+
+struct bench_options
+{
+    unsigned long int seed;
+    Real min_time;  // the minimum wall-clock time to measure each benchmark
+    Integer max_particles;  // skip scaled scenarios larger than this
+    std::string filter;  // run only benchmarks whose name contains this
+    bool propose_accept;  // split steps of simulators, see BDSimulatorT::set_propose_accept
+    bool continuous_exclusion;  // see BDSimulatorT::set_continuous_exclusion
+};
+
+struct bench_result
+{
+    std::string name;
+    std::string kind;
+    std::vector<std::pair<std::string, Real> > params;
+    std::vector<std::pair<std::string, Real> > metrics;
+};
+
+/**
+ * discard all characters. encounters are written here during benchmarks.
+ */
+class null_buffer
+    : public std::streambuf
+{
+protected:
+
+    int overflow(int c)
+    {
+        return traits_type::not_eof(c);
+    }
+};
+
+inline Real elapsed(const clock_type::time_point& start)
+{
+    return std::chrono::duration<Real>(clock_type::now() - start).count();
+}
+
+/**
+ * repeat a batch with a doubling size until min_time has passed.
+ * @return a pair of the number of iterations and seconds
+ */
+template<typename Tfunc_>
+std::pair<Integer, Real> measure(const Real min_time, Tfunc_ func)
+{
+    func(1);  // warm up
+
+    Integer total(0), batch(1);
+    Real seconds(0.0);
+    while (seconds < min_time)
+    {
+        const clock_type::time_point start(clock_type::now());
+        func(batch);
+        seconds += elapsed(start);
+        total += batch;
+        batch *= 2;
+    }
+    return std::make_pair(total, seconds);
+}
+
+/**
+ * parameters of the double-layer scenario of main.cpp.
+ * counts and the box are scaled by the same factor, keeping the densities.
+ * soft/ benchmarks run the same scenarios with SoftBDSimulator and WCA spheres.
+ */
+struct scenario_params
+{
+    std::string name;
+    Real tracer_diameter;  // nm
+    Real crowder_constraint_diameter;  // nm
+    Real D_crowder;  // um2/s
+    Integer N_crowder_right;
+};
+
+struct scenario_type
+{
+    std::shared_ptr<NetworkModel> model;
+    std::shared_ptr<BDWorld> world;
+    std::shared_ptr<BDSimulator> sim;
+    Integer3 matrix_sizes;
+};
+
+/**
+ * cells are as large as the largest diameter times cell_factor.
+ */
+scenario_type build_scenario(
+    const scenario_params& params, const Real scale, const unsigned long int seed,
+    const Real cell_factor = 1.0)
+{
+    const Real crowder_diameter(9.6);  // nm
+    const Real dt(1e-9);  // sec
+    const Real L(0.149 * std::cbrt(scale));  // um
+    const Real3 edge_lengths(L * 2, L, L);
+    const Real cell_size(std::max(params.tracer_diameter, crowder_diameter) * 1e-3 * cell_factor);
+    const Integer3 matrix_sizes(
+        std::max(3, static_cast<int>(edge_lengths[0] / cell_size)),
+        std::max(3, static_cast<int>(edge_lengths[1] / cell_size)),
+        std::max(3, static_cast<int>(edge_lengths[2] / cell_size)));
+
+    const Integer N_crowder_left(std::lround(96 * scale));
+    const Integer N_crowder_right(std::lround(params.N_crowder_right * scale));
+    const Integer N_tracer(std::max(1L, std::lround(10 * scale)));
+    const Real D_tracer(90.0 / params.tracer_diameter);  // um2/s
+
+    scenario_type s;
+    s.matrix_sizes = matrix_sizes;
+    s.model = std::shared_ptr<NetworkModel>(new NetworkModel());
+    Species sp_tracer("X", params.tracer_diameter * 1e-3 * 0.5, D_tracer);
+    (*s.model).add_species_attribute(sp_tracer);
+    Species sp_crowder1("C1", crowder_diameter * 1e-3 * 0.5, params.D_crowder);
+    sp_crowder1.set_attribute("constraint_radius", params.crowder_constraint_diameter * 1e-3 * 0.5);
+    (*s.model).add_species_attribute(sp_crowder1);
+    Species sp_crowder2("C2", crowder_diameter * 1e-3 * 0.5, params.D_crowder);
+    sp_crowder2.set_attribute("constraint_radius", params.crowder_constraint_diameter * 1e-3 * 0.5);
+    (*s.model).add_species_attribute(sp_crowder2);
+
+    std::shared_ptr<RandomNumberGenerator> rng(new GSLRandomNumberGenerator(seed));
+    s.world = std::shared_ptr<BDWorld>(new BDWorld(edge_lengths, matrix_sizes, rng));
+    (*s.world).bind_to(s.model);
+
+    ParticlePlacer placer(*s.world, rng);
+    placer.place(sp_crowder1, N_crowder_left,
+        std::shared_ptr<Shape>(new AABB(Real3(L * 0, 0, 0), Real3(L * 1, L, L))));
+    placer.place(sp_crowder2, N_crowder_right,
+        std::shared_ptr<Shape>(new AABB(Real3(L * 1, 0, 0), Real3(L * 2, L, L))));
+    placer.place(sp_tracer, N_tracer,
+        std::shared_ptr<Shape>(new AABB(Real3(L * 0, 0, 0), Real3(L * 1, L, L))));
+
+    s.sim = std::shared_ptr<BDSimulator>(new BDSimulator(s.world, s.model));
+    (*s.sim).set_dt(dt);
+    (*s.sim).initialize();
+    return s;
+}
+
+/**
+ * place crowders into a cube at the given packing fraction, once.
+ * with legacy, extras::throw_in_particles_wo_draw_position is used instead.
+ */
+bench_result bench_placement(const bench_options& opts, const Real fraction, const bool legacy)
+{
+    const Real L(0.1);  // um
+    const Real radius(9.6e-3 * 0.5);  // um
+    const Integer num(std::lround(fraction * L * L * L / (4.0 / 3.0 * M_PI * radius * radius * radius)));
+
+    std::shared_ptr<RandomNumberGenerator> rng(new GSLRandomNumberGenerator(opts.seed));
+    BDWorld w(Real3(L, L, L), Integer3(10, 10, 10), rng);
+    const Species sp("C", radius, 1.0);
+    const std::shared_ptr<Shape> shape(new AABB(Real3(0, 0, 0), Real3(L, L, L)));
+
+    ParticlePlacer placer(w, rng);
+    const clock_type::time_point start(clock_type::now());
+    placement_result placed;
+    if (legacy)
+    {
+        w.add_molecules(sp, num, shape);
+        placed.num_lattice = 0;
+        placed.packing_fraction = placer.packing_fraction(shape);
+    }
+    else
+    {
+        placed = placer.place(sp, num, shape);
+    }
+    const Real seconds(elapsed(start));
+
+    bench_result result;
+    std::ostringstream name;
+    name << "micro/placement_" << (legacy ? "legacy_" : "") << fraction;
+    result.name = name.str();
+    result.kind = "micro";
+    result.params.push_back(std::make_pair("num_particles", static_cast<Real>(num)));
+    result.params.push_back(std::make_pair("target_packing_fraction", fraction));
+    result.metrics.push_back(std::make_pair("seconds", seconds));
+    result.metrics.push_back(std::make_pair("packing_fraction", placed.packing_fraction));
+    result.metrics.push_back(std::make_pair("num_lattice", static_cast<Real>(placed.num_lattice)));
+    return result;
+}
+
+bench_result bench_rng_gaussian(const bench_options& opts)
+{
+    GSLRandomNumberGenerator rng(opts.seed);
+    Real sum(0.0);
+    const Integer n(1 << 16);
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch * n; ++i)
+            {
+                sum += rng.gaussian(1.0);
+            }
+        }));
+
+    bench_result result;
+    result.name = "micro/rng_gaussian";
+    result.kind = "micro";
+    result.metrics.push_back(std::make_pair("items", static_cast<Real>(r.first * n)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("items_per_second", r.first * n / r.second));
+    result.metrics.push_back(std::make_pair("checksum", sum));
+    return result;
+}
+
+bench_result bench_shuffle(const bench_options& opts, const Integer size)
+{
+    GSLRandomNumberGenerator rng(opts.seed);
+    std::vector<size_t> queue(size);
+    for (Integer i(0); i < size; ++i)
+    {
+        queue[i] = i;
+    }
+
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                shuffle(rng, queue);
+            }
+        }));
+
+    bench_result result;
+    std::ostringstream name;
+    name << "micro/shuffle_" << size;
+    result.name = name.str();
+    result.kind = "micro";
+    result.params.push_back(std::make_pair("size", static_cast<Real>(size)));
+    result.metrics.push_back(std::make_pair("items", static_cast<Real>(r.first * size)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("items_per_second", r.first * size / r.second));
+    return result;
+}
+
+/**
+ * a copolymer of two types of monomers A(t=x) and A(t=y), growing by a monomer at
+ * its right end up to max_length, and breaking at any bond.
+ * it has 2^(max_length + 1) - 2 species, all sequences of types.
+ */
+std::shared_ptr<NetfreeModel> build_polymer_model()
+{
+    std::shared_ptr<NetfreeModel> model(new NetfreeModel());
+    (*model).add_species_attribute(Species("A", 0.005, 1.0));
+    (*model).add_reaction_rule(create_binding_reaction_rule(
+        Species("A(r)"), Species("A(l,r)"), Species("A(r^1).A(l^1,r)"), 1.0));
+    (*model).add_reaction_rule(create_unbinding_reaction_rule(
+        Species("A(r^1).A(l^1)"), Species("A(r)"), Species("A(l)"), 1.0));
+    return model;
+}
+
+/**
+ * a rule as a string of canonical serials, for comparison.
+ */
+std::string rule_key(const ReactionRule& rule)
+{
+    std::ostringstream key;
+    key.precision(17);
+    for (ReactionRule::reactant_container_type::const_iterator i(rule.reactants().begin());
+        i != rule.reactants().end(); ++i)
+    {
+        key << format_species(*i).serial() << "+";
+    }
+    key << ">";
+    for (ReactionRule::product_container_type::const_iterator i(rule.products().begin());
+        i != rule.products().end(); ++i)
+    {
+        key << format_species(*i).serial() << "+";
+    }
+    key << "|" << rule.k();
+    return key.str();
+}
+
+/**
+ * rules of a network as keys, sorted.
+ */
+std::vector<std::string> list_rule_keys(const Model& model)
+{
+    std::vector<std::string> retval;
+    const std::vector<ReactionRule>& rules(model.reaction_rules());
+    for (std::vector<ReactionRule>::const_iterator i(rules.begin()); i != rules.end(); ++i)
+    {
+        retval.push_back(rule_key(*i));
+    }
+    std::sort(retval.begin(), retval.end());
+    return retval;
+}
+
+/**
+ * the network expanded naively by generate_reaction_rules, as before NetfreeModel::expand.
+ * all rules are tried over each species and over each pair of species matching reactants.
+ */
+std::shared_ptr<NetworkModel> expand_by_generate_reaction_rules(
+    const NetfreeModel& model, const std::vector<Species>& seeds,
+    const Species& limited, const Integer max_stoich)
+{
+    std::shared_ptr<NetworkModel> retval(new NetworkModel());
+    const std::vector<ReactionRule>& rules(model.reaction_rules());
+
+    std::vector<Species> species;
+    std::unordered_map<Species::serial_type, std::size_t> indices;
+    for (std::vector<Species>::const_iterator i(seeds.begin()); i != seeds.end(); ++i)
+    {
+        const Species sp(format_species(*i));
+        if (indices.insert(std::make_pair(sp.serial(), species.size())).second)
+        {
+            species.push_back(sp);
+        }
+    }
+
+    // matches[i][k] tells if the k-th reactant of the rule i may match a species.
+    std::vector<std::vector<std::vector<bool> > > matches(rules.size());
+    for (std::size_t idx(0); idx < species.size(); ++idx)
+    {
+        for (std::size_t i(0); i < rules.size(); ++i)
+        {
+            const ReactionRule::reactant_container_type& pttrns(rules[i].reactants());
+            matches[i].resize(pttrns.size());
+            for (std::size_t k(0); k < pttrns.size(); ++k)
+            {
+                matches[i][k].push_back(count_species_matches(pttrns[k], species[idx]) > 0);
+            }
+        }
+
+        std::vector<ReactionRule> generated;
+        for (std::size_t i(0); i < rules.size(); ++i)
+        {
+            ReactionRule::reactant_container_type reactants(1, species[idx]);
+            if (rules[i].reactants().size() == 1)
+            {
+                const std::vector<ReactionRule> retvals(generate_reaction_rules(rules[i], reactants));
+                generated.insert(generated.end(), retvals.begin(), retvals.end());
+                continue;
+            }
+
+            reactants.resize(2);
+            for (std::size_t j(0); j <= idx; ++j)
+            {
+                if (matches[i][0][idx] && matches[i][1][j])
+                {
+                    reactants[0] = species[idx];
+                    reactants[1] = species[j];
+                    const std::vector<ReactionRule> retvals(generate_reaction_rules(rules[i], reactants));
+                    generated.insert(generated.end(), retvals.begin(), retvals.end());
+                }
+                if (j != idx && matches[i][0][j] && matches[i][1][idx])
+                {
+                    reactants[0] = species[j];
+                    reactants[1] = species[idx];
+                    const std::vector<ReactionRule> retvals(generate_reaction_rules(rules[i], reactants));
+                    generated.insert(generated.end(), retvals.begin(), retvals.end());
+                }
+            }
+        }
+
+        for (std::vector<ReactionRule>::const_iterator i(generated.begin()); i != generated.end(); ++i)
+        {
+            ReactionRule::product_container_type products;
+            bool accepted(true);
+            for (ReactionRule::product_container_type::const_iterator j((*i).products().begin());
+                j != (*i).products().end(); ++j)
+            {
+                products.push_back(format_species(*j));
+                if (indices.find(products.back().serial()) == indices.end()
+                    && count_species_matches(limited, products.back()) > max_stoich)
+                {
+                    accepted = false;
+                    break;
+                }
+            }
+            if (!accepted)
+            {
+                continue;
+            }
+
+            for (ReactionRule::product_container_type::const_iterator j(products.begin());
+                j != products.end(); ++j)
+            {
+                if (indices.insert(std::make_pair((*j).serial(), species.size())).second)
+                {
+                    species.push_back(*j);
+                }
+            }
+            (*retval).add_reaction_rule(ReactionRule((*i).reactants(), products, (*i).k()));
+        }
+    }
+
+    for (std::vector<Species>::const_iterator i(species.begin()); i != species.end(); ++i)
+    {
+        (*retval).add_species_attribute(model.apply_species_attributes(*i));
+    }
+    return retval;
+}
+
+std::vector<Species> polymer_seeds()
+{
+    std::vector<Species> seeds;
+    seeds.push_back(Species("A(l,r,t=x)"));
+    seeds.push_back(Species("A(l,r,t=y)"));
+    return seeds;
+}
+
+/**
+ * expand the copolymer of build_polymer_model from monomers with NetfreeModel::expand.
+ * see check_netfree_expand for the network expanded.
+ */
+bench_result bench_netfree_expand(const bench_options& opts, const Integer max_length)
+{
+    const std::vector<Species> seeds(polymer_seeds());
+    std::map<Species, Integer> max_stoich;
+    max_stoich[Species("A")] = max_length;
+
+    // a model is compiled at the first expansion, thus it is built again for each.
+    std::shared_ptr<Model> expanded;
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                expanded = (*build_polymer_model()).expand(seeds, 30, max_stoich);
+            }
+        }));
+
+    const clock_type::time_point start(clock_type::now());
+    expand_by_generate_reaction_rules(*build_polymer_model(), seeds, Species("A"), max_length);
+    const Real reference_seconds(elapsed(start));
+
+    bench_result result;
+    std::ostringstream name;
+    name << "micro/netfree_expand_polymer_" << max_length;
+    result.name = name.str();
+    result.kind = "micro";
+    result.params.push_back(std::make_pair("max_length", static_cast<Real>(max_length)));
+    result.metrics.push_back(std::make_pair("num_species",
+        static_cast<Real>((*expanded).species_attributes().size())));
+    result.metrics.push_back(std::make_pair("num_reaction_rules",
+        static_cast<Real>((*expanded).reaction_rules().size())));
+    result.metrics.push_back(std::make_pair("items", static_cast<Real>(r.first)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("seconds_per_expansion", r.second / r.first));
+    result.metrics.push_back(std::make_pair("reference_seconds", reference_seconds));
+    return result;
+}
+
+/**
+ * compare the copolymer expanded by NetfreeModel::expand with the network known in closed form.
+ * all sequences of 1 to max_length monomers are species, 2^(max_length + 1) - 2.
+ * a sequence of n < max_length grows by either monomer, 2 (2^max_length - 2) rules,
+ * and a sequence of n breaks at n - 1 bonds, the sum of 2^n (n - 1) rules.
+ * a few rules are also looked up by hand-written species, and the rules by
+ * generate_reaction_rules are compared as a second reference.
+ * each mismatch is counted as a failure.
+ */
+bench_result check_netfree_expand(const bench_options& opts, const Integer max_length)
+{
+    const std::vector<Species> seeds(polymer_seeds());
+    std::map<Species, Integer> max_stoich;
+    max_stoich[Species("A")] = max_length;
+    const std::shared_ptr<Model> expanded((*build_polymer_model()).expand(seeds, 30, max_stoich));
+
+    Integer num_species(0), num_bindings(2 * ((1 << max_length) - 2)), num_unbindings(0);
+    for (Integer n(1); n <= max_length; ++n)
+    {
+        num_species += (1 << n);
+        num_unbindings += (1 << n) * (n - 1);
+    }
+
+    const Species x("A(l,r,t=x)"), y("A(l,r,t=y)");
+    const Species xy("A(l,r^1,t=x).A(l^1,r,t=y)"), yx("A(l,r^1,t=y).A(l^1,r,t=x)");
+    const Species xyx("A(l,r^1,t=x).A(l^1,r^2,t=y).A(l^2,r,t=x)");
+    std::vector<ReactionRule> known;
+    known.push_back(create_binding_reaction_rule(x, y, xy, 1.0));
+    known.push_back(create_binding_reaction_rule(y, x, yx, 1.0));
+    known.push_back(create_binding_reaction_rule(xy, x, xyx, 1.0));
+    known.push_back(create_unbinding_reaction_rule(xy, x, y, 1.0));
+    known.push_back(create_unbinding_reaction_rule(xyx, x, yx, 1.0));
+    known.push_back(create_unbinding_reaction_rule(xyx, xy, x, 1.0));
+
+    const std::vector<std::string> keys(list_rule_keys(*expanded));
+    Integer failures(0);
+    if (static_cast<Integer>((*expanded).species_attributes().size()) != num_species)
+    {
+        ++failures;
+    }
+    if (static_cast<Integer>(keys.size()) != num_bindings + num_unbindings)
+    {
+        ++failures;
+    }
+    for (std::vector<ReactionRule>::const_iterator i(known.begin()); i != known.end(); ++i)
+    {
+        if (!std::binary_search(keys.begin(), keys.end(), rule_key(*i)))
+        {
+            ++failures;
+        }
+    }
+    const std::shared_ptr<NetworkModel> reference(expand_by_generate_reaction_rules(
+        *build_polymer_model(), seeds, Species("A"), max_length));
+    if (list_rule_keys(*reference) != keys)
+    {
+        ++failures;
+    }
+
+    bench_result result;
+    std::ostringstream name;
+    name << "check/netfree_expand_polymer_" << max_length;
+    result.name = name.str();
+    result.kind = "check";
+    result.params.push_back(std::make_pair("max_length", static_cast<Real>(max_length)));
+    result.params.push_back(std::make_pair("num_species", static_cast<Real>(num_species)));
+    result.params.push_back(std::make_pair("num_reaction_rules",
+        static_cast<Real>(num_bindings + num_unbindings)));
+    result.params.push_back(std::make_pair("num_known_rules", static_cast<Real>(known.size())));
+    result.metrics.push_back(std::make_pair("failures", static_cast<Real>(failures)));
+    return result;
+}
+
+bench_result bench_neighbor_query(const bench_options& opts, const scenario_params& params, const Real scale)
+{
+    scenario_type s(build_scenario(params, scale, opts.seed));
+    BDWorld& w(*s.world);
+    const Real3 edge_lengths(w.edge_lengths());
+    const Real radius(params.tracer_diameter * 1e-3 * 0.5);
+
+    // fixed query points, so that every run scans the same cells.
+    GSLRandomNumberGenerator rng(opts.seed);
+    std::vector<Real3> points(4096);
+    for (std::vector<Real3>::iterator i(points.begin()); i != points.end(); ++i)
+    {
+        (*i) = Real3(rng.uniform(0, edge_lengths[0]),
+            rng.uniform(0, edge_lengths[1]), rng.uniform(0, edge_lengths[2]));
+    }
+
+    std::size_t found(0);
+    const Integer n(points.size());
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                for (std::vector<Real3>::const_iterator j(points.begin()); j != points.end(); ++j)
+                {
+                    found += w.list_particles_within_radius(*j, radius).size();
+                }
+            }
+        }));
+
+    bench_result result;
+    result.name = "micro/neighbor_query_" + params.name;
+    result.kind = "micro";
+    result.params.push_back(std::make_pair("num_particles", static_cast<Real>(w.num_particles())));
+    result.metrics.push_back(std::make_pair("items", static_cast<Real>(r.first * n)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("items_per_second", r.first * n / r.second));
+    result.metrics.push_back(std::make_pair("mean_found", static_cast<Real>(found) / (r.first * n + n)));
+    return result;
+}
+
+/**
+ * test short segments against a sphere tessellated into about num_triangles,
+ * for the scaling of TriangleMesh::test_segment in the number of triangles.
+ */
+bench_result bench_mesh_segment(const bench_options& opts, const Integer num_triangles)
+{
+    const Real L(1.0), R(0.4);
+    const Real3 center(L * 0.5, L * 0.5, L * 0.5);
+    const Integer n(std::max(2L, std::lround(std::sqrt(num_triangles / 2.0))));
+    TriangleMesh mesh;
+    const auto vertex = [&](const Integer i, const Integer j)
+        {
+            const Real theta(M_PI * i / n), phi(2 * M_PI * j / n);
+            return center + Real3(
+                R * std::sin(theta) * std::cos(phi), R * std::sin(theta) * std::sin(phi), R * std::cos(theta));
+        };
+    for (Integer i(0); i < n; ++i)
+    {
+        for (Integer j(0); j < n; ++j)
+        {
+            mesh.add_triangle(vertex(i, j), vertex(i + 1, j), vertex(i + 1, j + 1));
+            mesh.add_triangle(vertex(i, j), vertex(i + 1, j + 1), vertex(i, j + 1));
+        }
+    }
+    mesh.build();
+
+    GSLRandomNumberGenerator rng(opts.seed);
+    std::vector<std::pair<Real3, Real3> > segments(4096);
+    for (std::vector<std::pair<Real3, Real3> >::iterator i(segments.begin()); i != segments.end(); ++i)
+    {
+        const Real3 p(rng.uniform(0, L), rng.uniform(0, L), rng.uniform(0, L));
+        (*i) = std::make_pair(p, p + Real3(rng.gaussian(0.01), rng.gaussian(0.01), rng.gaussian(0.01)));
+    }
+
+    std::size_t crossed(0);
+    const Integer m(segments.size());
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                for (std::vector<std::pair<Real3, Real3> >::const_iterator j(segments.begin());
+                    j != segments.end(); ++j)
+                {
+                    crossed += mesh.test_segment((*j).first, (*j).second);
+                }
+            }
+        }));
+
+    bench_result result;
+    std::ostringstream name;
+    name << "micro/mesh_segment_" << num_triangles;
+    result.name = name.str();
+    result.kind = "micro";
+    result.params.push_back(std::make_pair("num_triangles", static_cast<Real>(mesh.num_triangles())));
+    result.metrics.push_back(std::make_pair("items", static_cast<Real>(r.first * m)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("items_per_second", r.first * m / r.second));
+    result.metrics.push_back(std::make_pair("crossed_fraction", static_cast<Real>(crossed) / (r.first * m + m)));
+    return result;
+}
+
+/**
+ * compare MembraneSpace::list_particles_within_radius with all pairs in the minimum image
+ * on grids of 1 to 5 cells along each edge, including queries reaching beyond half the edge.
+ * a missed or duplicated particle is counted as a failure.
+ */
+bench_result check_membrane_neighbors(const bench_options& opts)
+{
+    const Real3 edge_lengths(1.0, 1.0, 1.0);
+    const PlanarSurface surface(Real3(0.5, 0.0, 0.0), Real3(0.0, 1.0, 0.0), Real3(0.0, 0.0, 1.0));
+    const Species sp("M");
+    GSLRandomNumberGenerator rng(opts.seed);
+
+    Integer num_queries(0), failures(0);
+    for (Integer num_cols(1); num_cols <= 5; ++num_cols)
+    {
+        for (Integer num_rows(1); num_rows <= 5; ++num_rows)
+        {
+            MembraneSpace space("M", surface, edge_lengths, num_cols, num_rows);
+            for (Integer i(0); i < 200; ++i)
+            {
+                const Real3 pos(0.5, rng.uniform(0.0, 1.0), rng.uniform(0.0, 1.0));
+                space.update_particle(ParticleID(std::make_pair(0, i + 1)),
+                    Particle(sp, pos, rng.uniform(0.005, 0.05), 0.0, 0.0));
+            }
+
+            for (Integer i(0); i < 100; ++i, ++num_queries)
+            {
+                const Real3 pos(rng.uniform(0.3, 0.7), rng.uniform(0.0, 1.0), rng.uniform(0.0, 1.0));
+                const Real radius(rng.uniform(0.01, 0.4));
+                std::vector<std::pair<std::pair<ParticleID, Particle>, Real> > found;
+                space.list_particles_within_radius(pos, radius, ParticleID(), found);
+
+                std::vector<ParticleID> retval, expected;
+                for (std::vector<std::pair<std::pair<ParticleID, Particle>, Real> >::const_iterator
+                    j(found.begin()); j != found.end(); ++j)
+                {
+                    retval.push_back((*j).first.first);
+                }
+                for (MembraneSpace::particle_container_type::const_iterator
+                    j(space.particles().begin()); j != space.particles().end(); ++j)
+                {
+                    Real3 d((*j).second.position() - pos);
+                    for (unsigned int k(0); k < 3; ++k)
+                    {
+                        d[k] -= edge_lengths[k] * std::floor(d[k] / edge_lengths[k] + 0.5);
+                    }
+                    if (length(d) - (*j).second.radius() < radius)
+                    {
+                        expected.push_back((*j).first);
+                    }
+                }
+
+                std::sort(retval.begin(), retval.end());
+                std::sort(expected.begin(), expected.end());
+                if (retval != expected)
+                {
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    bench_result result;
+    result.name = "check/membrane_neighbors";
+    result.kind = "check";
+    result.params.push_back(std::make_pair("queries", static_cast<Real>(num_queries)));
+    result.metrics.push_back(std::make_pair("failures", static_cast<Real>(failures)));
+    return result;
+}
+
+bench_result bench_cell_update(const bench_options& opts, const scenario_params& params, const Real scale)
+{
+    scenario_type s(build_scenario(params, scale, opts.seed));
+    BDWorld& w(*s.world);
+    const Integer n(w.num_particles());
+    const Real sigma(std::sqrt(2 * 9.0 * 1e-9));  // a displacement of a crowder in a step
+
+    // displace particles without checking overlaps. only the cell list is measured.
+    GSLRandomNumberGenerator rng(opts.seed);
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                for (Integer j(0); j < n; ++j)
+                {
+                    std::pair<ParticleID, Particle> pid_particle_pair(w._get_particle(j));
+                    Particle& p(pid_particle_pair.second);
+                    p.position() = w.apply_boundary(p.position()
+                        + Real3(rng.gaussian(sigma), rng.gaussian(sigma), rng.gaussian(sigma)));
+                    w.update_particle_without_checking(pid_particle_pair.first, p);
+                }
+            }
+        }));
+
+    bench_result result;
+    result.name = "micro/cell_update_" + params.name;
+    result.kind = "micro";
+    result.params.push_back(std::make_pair("num_particles", static_cast<Real>(n)));
+    result.metrics.push_back(std::make_pair("items", static_cast<Real>(r.first * n)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("items_per_second", r.first * n / r.second));
+    return result;
+}
+
+/**
+ * rebuild the world of a scenario from its particles, one by one or at once.
+ */
+bench_result bench_insertion(
+    const bench_options& opts, const scenario_params& params, const Real scale, const bool bulk)
+{
+    scenario_type s(build_scenario(params, scale, opts.seed));
+    const BDWorld& w(*s.world);
+    std::vector<Particle> particles;
+    particles.reserve(w.num_particles());
+    for (Integer j(0); j < w.num_particles(); ++j)
+    {
+        particles.push_back(w._get_particle(j).second);
+    }
+    const Integer n(particles.size());
+
+    std::shared_ptr<RandomNumberGenerator> rng(new GSLRandomNumberGenerator(opts.seed));
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                BDWorld dst(w.edge_lengths(), s.matrix_sizes, rng);
+                if (bulk)
+                {
+                    dst.insert_particles(particles, true);
+                }
+                else
+                {
+                    for (std::vector<Particle>::const_iterator j(particles.begin());
+                        j != particles.end(); ++j)
+                    {
+                        dst.new_particle(*j);
+                    }
+                }
+            }
+        }));
+
+    bench_result result;
+    result.name = std::string("micro/insert_") + (bulk ? "bulk_" : "sequential_") + params.name;
+    result.kind = "micro";
+    result.params.push_back(std::make_pair("num_particles", static_cast<Real>(n)));
+    result.metrics.push_back(std::make_pair("items", static_cast<Real>(r.first * n)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("items_per_second", r.first * n / r.second));
+    return result;
+}
+
+bench_result bench_scenario(
+    const bench_options& opts, const std::string& name,
+    const scenario_params& params, const Real scale, std::ostream& sink)
+{
+    const clock_type::time_point setup_start(clock_type::now());
+    scenario_type s(build_scenario(params, scale, opts.seed));
+    const Real setup_seconds(elapsed(setup_start));
+
+    BDSimulator& sim(*s.sim);
+    std::shared_ptr<AsyncOutputWriter> output(new AsyncOutputWriter(sink));
+    sim.set_output(output);
+    sim.set_propose_accept(opts.propose_accept);
+    sim.set_continuous_exclusion(opts.continuous_exclusion);
+
+    // steps go through step(upto), as SimulatorBase::run and main do.
+    const Integer n((*s.world).num_particles());
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                sim.step(sim.next_time());
+            }
+        }));
+    (*output).stop();
+    const BDStatistics stats(sim.stats());
+    if (!sim.is_static())
+    {
+        throw IllegalState("The scenario does not hold the types of the static dispatch.");
+    }
+
+    bench_result result;
+    result.name = name;
+    result.kind = "macro";
+    result.params.push_back(std::make_pair("tracer_diameter", params.tracer_diameter));
+    result.params.push_back(std::make_pair("crowder_constraint_diameter", params.crowder_constraint_diameter));
+    result.params.push_back(std::make_pair("D_crowder", params.D_crowder));
+    result.params.push_back(std::make_pair("N_crowder_right", static_cast<Real>(params.N_crowder_right)));
+    result.params.push_back(std::make_pair("scale", scale));
+    result.params.push_back(std::make_pair("num_particles", static_cast<Real>(n)));
+    result.params.push_back(std::make_pair("propose_accept", static_cast<Real>(opts.propose_accept)));
+    result.params.push_back(std::make_pair("continuous_exclusion", static_cast<Real>(opts.continuous_exclusion)));
+    result.metrics.push_back(std::make_pair("setup_seconds", setup_seconds));
+    result.metrics.push_back(std::make_pair("steps", static_cast<Real>(r.first)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("steps_per_second", r.first / r.second));
+    // attempted moves, including rejected ones.
+    result.metrics.push_back(std::make_pair("particle_moves_per_second", r.first * n / r.second));
+
+    if (BDStatistics::enabled)
+    {
+        const Real ticks(stats.ticks_rng + stats.ticks_boundary
+            + stats.ticks_neighbor_search + stats.ticks_update);
+        result.metrics.push_back(std::make_pair("acceptance", stats.acceptance()));
+        result.metrics.push_back(std::make_pair("candidates_per_move",
+            static_cast<Real>(stats.candidates_scanned) / stats.attempted));
+        result.metrics.push_back(std::make_pair("cell_crossings_per_move",
+            static_cast<Real>(stats.cell_crossings) / stats.attempted));
+        result.metrics.push_back(std::make_pair("fraction_rng", stats.ticks_rng / ticks));
+        result.metrics.push_back(std::make_pair("fraction_boundary", stats.ticks_boundary / ticks));
+        result.metrics.push_back(std::make_pair("fraction_neighbor_search", stats.ticks_neighbor_search / ticks));
+        result.metrics.push_back(std::make_pair("fraction_update", stats.ticks_update / ticks));
+    }
+    return result;
+}
+
+/**
+ * the scenario with SoftBDSimulator, where all pairs are WCA spheres of epsilon 1 kT.
+ * cells are doubled to hold the cutoff with the skin.
+ */
+bench_result bench_soft_scenario(
+    const bench_options& opts, const std::string& name,
+    const scenario_params& params, const Real scale)
+{
+    const clock_type::time_point setup_start(clock_type::now());
+    scenario_type s(build_scenario(params, scale, opts.seed, 2.0));
+    SoftBDSimulator sim(s.world, s.model);
+    sim.set_dt((*s.sim).dt());
+    sim.initialize();
+    const Real setup_seconds(elapsed(setup_start));
+
+    const Integer n((*s.world).num_particles());
+    const std::pair<Integer, Real> r(measure(opts.min_time,
+        [&](const Integer batch)
+        {
+            for (Integer i(0); i < batch; ++i)
+            {
+                sim.step();
+            }
+        }));
+
+    bench_result result;
+    result.name = name;
+    result.kind = "macro";
+    result.params.push_back(std::make_pair("tracer_diameter", params.tracer_diameter));
+    result.params.push_back(std::make_pair("crowder_constraint_diameter", params.crowder_constraint_diameter));
+    result.params.push_back(std::make_pair("D_crowder", params.D_crowder));
+    result.params.push_back(std::make_pair("N_crowder_right", static_cast<Real>(params.N_crowder_right)));
+    result.params.push_back(std::make_pair("scale", scale));
+    result.params.push_back(std::make_pair("num_particles", static_cast<Real>(n)));
+    result.params.push_back(std::make_pair("skin", sim.skin()));
+    result.metrics.push_back(std::make_pair("setup_seconds", setup_seconds));
+    result.metrics.push_back(std::make_pair("steps", static_cast<Real>(r.first)));
+    result.metrics.push_back(std::make_pair("seconds", r.second));
+    result.metrics.push_back(std::make_pair("steps_per_second", r.first / r.second));
+    result.metrics.push_back(std::make_pair("particle_moves_per_second", r.first * n / r.second));
+    result.metrics.push_back(std::make_pair("pairs_per_particle", static_cast<Real>(sim.num_pairs()) / n));
+    // the first build in initialize is not counted against steps.
+    result.metrics.push_back(std::make_pair("list_builds_per_step",
+        static_cast<Real>(sim.num_list_builds() - 1) / sim.num_steps()));
+    return result;
+}
+
+void write_json_number(std::ostream& out, const Real value)
+{
+    if (std::isfinite(value))
+    {
+        out << value;
+    }
+    else
+    {
+        out << "null";  // JSON has no infinity
+    }
+}
+
+void write_json_object(std::ostream& out, const std::vector<std::pair<std::string, Real> >& values)
+{
+    out << "{";
+    for (std::vector<std::pair<std::string, Real> >::const_iterator i(values.begin());
+        i != values.end(); ++i)
+    {
+        out << (i == values.begin() ? "" : ", ") << "\"" << (*i).first << "\": ";
+        write_json_number(out, (*i).second);
+    }
+    out << "}";
+}
+
+void write_json(std::ostream& out, const bench_options& opts, const std::vector<bench_result>& results)
+{
+    out.precision(9);
+    out << "{\n"
+        << "  \"benchmark\": \"bd_bench\",\n"
+        << "  \"seed\": " << opts.seed << ",\n"
+        << "  \"min_time\": " << opts.min_time << ",\n"
+        << "  \"results\": [";
+    for (std::vector<bench_result>::const_iterator i(results.begin()); i != results.end(); ++i)
+    {
+        out << (i == results.begin() ? "\n" : ",\n")
+            << "    {\"name\": \"" << (*i).name << "\", \"kind\": \"" << (*i).kind << "\",\n"
+            << "     \"params\": ";
+        write_json_object(out, (*i).params);
+        out << ",\n     \"metrics\": ";
+        write_json_object(out, (*i).metrics);
+        out << "}";
+    }
+    out << "\n  ]\n}" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options opts;
+    opts.seed = 0;
+    opts.min_time = 1.0;
+    opts.max_particles = 1000000;
+    opts.filter = "";
+    opts.propose_accept = false;
+    opts.continuous_exclusion = false;
+
+    for (int i(1); i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (i + 1 >= argc)
+        {
+            std::cerr << "Missing a value for [" << arg << "]." << std::endl;
+            return 1;
+        }
+
+        if (arg == "--seed")
+        {
+            opts.seed = std::stoul(argv[++i]);
+        }
+        else if (arg == "--min-time")
+        {
+            opts.min_time = std::stod(argv[++i]);
+        }
+        else if (arg == "--max-particles")
+        {
+            opts.max_particles = std::stol(argv[++i]);
+        }
+        else if (arg == "--filter")
+        {
+            opts.filter = argv[++i];
+        }
+        else if (arg == "--propose-accept")
+        {
+            opts.propose_accept = (std::stoi(argv[++i]) != 0);
+        }
+        else if (arg == "--continuous-exclusion")
+        {
+            opts.continuous_exclusion = (std::stoi(argv[++i]) != 0);
+        }
+        else
+        {
+            std::cerr << "Unknown option [" << arg << "]." << std::endl;
+            return 1;
+        }
+    }
+
+    const Real inf(std::numeric_limits<Real>::infinity());
+    std::vector<scenario_params> scenarios;
+    {
+        // the reference points of the double-layer scenario.
+        const scenario_params sparse = {"sparse", 10.0, inf, 9.0, 96};
+        const scenario_params dense = {"dense", 10.0, inf, 9.0, 692};
+        const scenario_params constrained = {"constrained", 10.0, 4.0, 9.0, 692};
+        const scenario_params immobile = {"immobile", 5.0, inf, 0.0, 692};
+        scenarios.push_back(sparse);
+        scenarios.push_back(dense);
+        scenarios.push_back(constrained);
+        scenarios.push_back(immobile);
+    }
+
+    const Integer num_particles[] = {1000, 10000, 100000, 1000000};
+
+    null_buffer nullbuf;
+    std::ostream sink(&nullbuf);
+
+    std::vector<bench_result> results;
+    const auto selected = [&opts](const std::string& name)
+        {
+            return opts.filter == "" || name.find(opts.filter) != std::string::npos;
+        };
+
+    if (selected("micro/rng_gaussian"))
+    {
+        results.push_back(bench_rng_gaussian(opts));
+    }
+    if (selected("micro/shuffle_1000"))
+    {
+        results.push_back(bench_shuffle(opts, 1000));
+    }
+    if (selected("micro/shuffle_100000"))
+    {
+        results.push_back(bench_shuffle(opts, 100000));
+    }
+    const Real fractions[] = {0.1, 0.3, 0.45};
+    for (std::size_t i(0); i < sizeof(fractions) / sizeof(Real); ++i)
+    {
+        std::ostringstream name;
+        name << "micro/placement_" << fractions[i];
+        if (selected(name.str()))
+        {
+            results.push_back(bench_placement(opts, fractions[i], false));
+        }
+    }
+    for (std::size_t i(0); i < 2; ++i)
+    {
+        // random sequential insertion does not reach beyond about 0.38.
+        std::ostringstream name;
+        name << "micro/placement_legacy_" << fractions[i];
+        if (selected(name.str()))
+        {
+            results.push_back(bench_placement(opts, fractions[i], true));
+        }
+    }
+
+    // the dense scenario scaled to 10^4 particles.
+    const Real micro_scale(10000.0 / (96 + scenarios[1].N_crowder_right + 10));
+    if (selected("micro/neighbor_query_dense"))
+    {
+        results.push_back(bench_neighbor_query(opts, scenarios[1], micro_scale));
+    }
+    if (selected("micro/cell_update_dense"))
+    {
+        results.push_back(bench_cell_update(opts, scenarios[1], micro_scale));
+    }
+    if (selected("micro/insert_sequential_dense"))
+    {
+        results.push_back(bench_insertion(opts, scenarios[1], micro_scale, false));
+    }
+    if (selected("micro/insert_bulk_dense"))
+    {
+        results.push_back(bench_insertion(opts, scenarios[1], micro_scale, true));
+    }
+
+    // 2046 species and 18432 rules.
+    if (selected("micro/netfree_expand_polymer_10"))
+    {
+        results.push_back(bench_netfree_expand(opts, 10));
+    }
+    if (selected("check/netfree_expand_polymer_10"))
+    {
+        results.push_back(check_netfree_expand(opts, 10));
+    }
+
+    if (selected("check/membrane_neighbors"))
+    {
+        results.push_back(check_membrane_neighbors(opts));
+    }
+
+    const Integer mesh_sizes[] = {1000, 100000};
+    for (std::size_t i(0); i < sizeof(mesh_sizes) / sizeof(Integer); ++i)
+    {
+        std::ostringstream name;
+        name << "micro/mesh_segment_" << mesh_sizes[i];
+        if (selected(name.str()))
+        {
+            results.push_back(bench_mesh_segment(opts, mesh_sizes[i]));
+        }
+    }
+
+    for (std::vector<scenario_params>::const_iterator i(scenarios.begin()); i != scenarios.end(); ++i)
+    {
+        const Real base(96 + (*i).N_crowder_right + 10);
+
+        // the original size first, then scaled up.
+        std::vector<std::pair<std::string, Real> > scales;
+        scales.push_back(std::make_pair("macro/" + (*i).name, 1.0));
+        for (std::size_t j(0); j < sizeof(num_particles) / sizeof(Integer); ++j)
+        {
+            if (num_particles[j] <= opts.max_particles && num_particles[j] > base)
+            {
+                std::ostringstream name;
+                name << "macro/" << (*i).name << "_n" << num_particles[j];
+                scales.push_back(std::make_pair(name.str(), num_particles[j] / base));
+            }
+        }
+
+        for (std::vector<std::pair<std::string, Real> >::const_iterator j(scales.begin());
+            j != scales.end(); ++j)
+        {
+            if (selected((*j).first))
+            {
+                std::cerr << "running " << (*j).first << std::endl;
+                results.push_back(bench_scenario(opts, (*j).first, *i, (*j).second, sink));
+            }
+
+            const std::string soft_name("soft/" + (*j).first.substr(std::string("macro/").size()));
+            if (selected(soft_name))
+            {
+                std::cerr << "running " << soft_name << std::endl;
+                results.push_back(bench_soft_scenario(opts, soft_name, *i, (*j).second));
+            }
+        }
+    }
+
+    write_json(std::cout, opts, results);
+
+    int status(0);
+    for (std::vector<bench_result>::const_iterator i(results.begin()); i != results.end(); ++i)
+    {
+        if ((*i).kind != "check")
+        {
+            continue;
+        }
+        for (std::vector<std::pair<std::string, Real> >::const_iterator j((*i).metrics.begin());
+            j != (*i).metrics.end(); ++j)
+        {
+            if ((*j).first == "failures" && (*j).second > 0)
+            {
+                std::cerr << "Check [" << (*i).name << "] failed." << std::endl;
+                status = 1;
+            }
+        }
+    }
+    return status;
+}
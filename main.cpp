@@ -1,28 +1,92 @@
 #include <iostream>
+#include <sstream>
+#include <cmath>
 
 #include "./bd/NetworkModel.hpp"
 #include "./bd/BDSimulator.hpp"
+#include "./bd/ECMCSimulator.hpp"
+#include "./bd/WeightedEnsemble.hpp"
+#include "./bd/Checkpointer.hpp"
 
 using namespace ecell4;
 using namespace ecell4::bd;
 using namespace ecell4::extras;
 
-void dump_positions(BDSimulator const& sim, bool const dump_all = false)
+void dump_positions(
+    BDWorld const& w, AsyncOutputWriter& output, bool const dump_all = false)
 {
-    BDWorld const& w(*sim.world());
+    OutputFrame& frame(output.frame());
+    frame.set_t(w.t());
 
-    typedef std::vector<std::pair<ParticleID, Particle> > container_type;
-    container_type const particles = w.list_particles();
-    for (container_type::const_iterator i(particles.begin()); i != particles.end(); ++i)
+    if (dump_all)
     {
-        ParticleID const& pid = (*i).first;
-        Real3 const& pos = add((*i).second.position(), (*i).second.stride());
-        Species const& sp = (*i).second.species();
+        typedef BDWorld::particle_container_type container_type;
+        container_type const& particles = w.particles();
+        for (container_type::const_iterator i(particles.begin()); i != particles.end(); ++i)
+        {
+            frame.add_position(
+                (*i).second.species_serial(), (*i).first,
+                add((*i).second.position(), (*i).second.stride()));
+        }
+    }
+    else
+    {
+        particle_species_view const tracers = w.particles(Species("X"));
+        for (particle_species_view::const_iterator i(tracers.begin()); i != tracers.end(); ++i)
+        {
+            frame.add_position(
+                "X", (*i).first, add((*i).second.position(), (*i).second.stride()));
+        }
+    }
+
+    output.commit();
+}
+
+/*
+    restore the simulator from the checkpoint if resuming, or dump the initial state.
+    returns the index of the next interval.
+*/
+template<typename Tsim_>
+unsigned int restore(
+    Tsim_& sim, Checkpointer const& checkpointer, bool const resume,
+    AsyncOutputWriter& output, Real const interval)
+{
+    if (resume)
+    {
+        checkpointer.load(sim);
+        return static_cast<unsigned int>(std::lround(sim.t() / interval)) + 1;
+    }
+
+    dump_positions(*sim.world(), output, true);
+    return 1;
+}
+
+template<typename Tsim_>
+void run(
+    Tsim_& sim, unsigned int const start, Checkpointer& checkpointer,
+    AsyncOutputWriter& output, Real const interval, Real const duration)
+{
+    for (unsigned int i(start); i <= duration / interval; ++i)
+    {
+        while (sim.step(interval * i))
+        {
+            ; // do nothing
+        }
 
-        if (dump_all || sp.serial() == "X")
+        dump_positions(*sim.world(), output);
+        // dump_positions(*sim.world(), output, true);
+
+        if (BDStatistics::enabled && i % 1000 == 0)
+        {
+            // counters go to stderr, apart from the data.
+            std::cerr << "#S," << sim.t() << "," << sim.stats() << std::endl;
+            sim.reset_stats();
+        }
+
+        if (checkpointer.filename() != "")
         {
-            std::cout << w.t() << "," << sp.serial() << "," << pid.serial()
-                << "," << pos[0] << "," << pos[1] << "," << pos[2] << std::endl;
+            output.flush();  // the output must not fall behind the checkpoint.
+            checkpointer.fire(sim);
         }
     }
 }
@@ -41,15 +105,55 @@ int main(int argc, char* argv[])
     const Real crowder_diameter(argc > 5 ? std::stod(argv[5]) : 9.6);  // nm
     const Integer N_crowder_right(argc > 6 ? std::stoi(argv[6]) : 96);
     const Real dt(argc > 7 ? std::stod(argv[7]) : 1e-9);  // sec
+    const std::string checkpoint_filename(argc > 8 ? argv[8] : "");  // no checkpoint if empty
+    const Real checkpoint_interval(argc > 9 ? std::stod(argv[9]) : 1800.0);  // wall-clock sec
+    const std::string encounter_log_filename(argc > 10 ? argv[10] : "");  // no log if empty
+    const std::string engine(argc > 11 ? argv[11] : "bd");  // "bd", "swept", "ecmc" or "we"
+    // swept: bd testing the whole path of each move, for larger dt
+    // ecmc: the chain length in um, determined by ECMCSimulator if zero
+    // we: deltax in um, the distance beyond L to be reached by a tracer
+    const Real engine_option(argc > 12 ? std::stod(argv[12]) : (engine == "we" ? 0.05 : 0.0));
 
-    std::cout
+    if (engine != "bd" && engine != "swept" && engine != "ecmc" && engine != "we")
+    {
+        std::cerr << "Unknown engine [" << engine << "]." << std::endl;
+        return 1;
+    }
+    if (engine == "we" && checkpoint_filename != "")
+    {
+        std::cerr << "Checkpoints are not supported by the weighted ensemble." << std::endl;
+        return 1;
+    }
+
+    std::ostringstream params;
+    params
         << "#seed=" << seed
         << ",tracer_diameter=" << tracer_diameter
         << ",crowder_constraint_diameter=" << crowder_constraint_diameter
         << ",D_crowder=" << D_crowder
         << ",crowder_diameter=" << crowder_diameter
         << ",N_crowder_right=" << N_crowder_right
-        << ",dt=" << dt << std::endl;
+        << ",dt=" << dt;
+    if (engine == "ecmc")
+    {
+        // dt is the time per chain of ECMCSimulator.
+        params << ",engine=" << engine << ",chain_length=" << engine_option;
+    }
+    else if (engine == "we")
+    {
+        params << ",engine=" << engine << ",deltax=" << engine_option;
+    }
+    else if (engine == "swept")
+    {
+        params << ",engine=" << engine;
+    }
+    Checkpointer checkpointer(checkpoint_filename, checkpoint_interval, params.str());
+    const bool resume(checkpoint_filename != "" && checkpointer.exists());
+
+    if (!resume)
+    {
+        std::cout << params.str() << std::endl;
+    }
 
     const Real L(0.149);  // um
     const Real3 edge_lengths(L * 2, L, L);
@@ -66,11 +170,14 @@ int main(int argc, char* argv[])
 
     const Real D_tracer(90.0 / tracer_diameter);  // um2/s
 
-    std::cout
-        << "#L=" << L
-        << ",N_crowder_left=" << N_crowder_left
-        << ",N_tracer=" << N_tracer
-        << ",D_tracer=" << D_tracer << std::endl;
+    if (!resume)
+    {
+        std::cout
+            << "#L=" << L
+            << ",N_crowder_left=" << N_crowder_left
+            << ",N_tracer=" << N_tracer
+            << ",D_tracer=" << D_tracer << std::endl;
+    }
 
     std::shared_ptr<NetworkModel> m(new NetworkModel());
     Species sp_tracer("X", tracer_diameter * 1e-3 * 0.5, D_tracer);
@@ -93,23 +200,78 @@ int main(int argc, char* argv[])
     (*w).add_molecules(sp_tracer, 10,
         std::shared_ptr<Shape>(new AABB(Real3(L * 0, 0, 0), Real3(L * 1, L, L))));  // sparse region
 
-    BDSimulator sim(w, m);
-    sim.set_dt(dt);
-    sim.initialize();
-
     const Real interval(10e-6);
     const Real duration(100e-3);
     // const Real duration(1e-3);
 
-    dump_positions(sim, true);
-    for (unsigned int i(1); i <= duration / interval; ++i)
+    // all lines below are written from the writer thread.
+    std::shared_ptr<AsyncOutputWriter> output(new AsyncOutputWriter(std::cout));
+
+    if (engine == "ecmc")
     {
-        while (sim.step(interval * i))
+        ECMCSimulator sim(w, m, engine_option);
+        sim.set_dt(dt);
+        sim.initialize();
+
+        const unsigned int start(restore(sim, checkpointer, resume, *output, interval));
+        run(sim, start, checkpointer, *output, interval, duration);
+    }
+    else if (engine == "we")
+    {
+        BDSimulator sim(w, m);
+        sim.set_dt(dt);
+        sim.initialize();
+
+        // follow the first tracer. bins are as wide as the tracer up to the threshold.
+        const ParticleID tracer((*w).list_particles_exact(sp_tracer).front().first);
+        const Real threshold(L + engine_option);
+        std::vector<Real> edges;
+        for (Real x(tracer_diameter * 1e-3); x < threshold; x += tracer_diameter * 1e-3)
         {
-            ; // do nothing
+            edges.push_back(x);
+        }
+
+        WeightedEnsemble we(sim, tracer, threshold, edges, 4, interval, seed);
+        std::size_t num_passages(0);
+        for (unsigned int i(1); i <= duration / interval; ++i)
+        {
+            const bool running(we.step());
+
+            const std::vector<WeightedEnsemble::passage_type>& passages(we.first_passages());
+            for (; num_passages < passages.size(); ++num_passages)
+            {
+                std::cout << "#P," << passages[num_passages].first
+                    << "," << passages[num_passages].second << std::endl;
+            }
+            std::cout << "#W," << we.t() << "," << we.walkers().size()
+                << "," << we.survival() << std::endl;
+
+            if (!running)
+            {
+                break;
+            }
+        }
+    }
+    else
+    {
+        BDSimulator sim(w, m);
+        sim.set_dt(dt);
+        sim.initialize();
+        sim.set_output(output);
+        sim.set_continuous_exclusion(engine == "swept");
+
+        const unsigned int start(restore(sim, checkpointer, resume, *output, interval));
+
+        if (encounter_log_filename != "")
+        {
+            // records after the checkpoint are dropped when resuming.
+            sim.encounters().set_log(std::shared_ptr<EncounterLog>(new EncounterLog(
+                encounter_log_filename,
+                resume ? static_cast<int64_t>(sim.encounters().num_logged()) : -1)));
         }
 
-        dump_positions(sim);
-        // dump_positions(sim, true);
+        run(sim, start, checkpointer, *output, interval, duration);
+        sim.encounters().close_all();
     }
+    (*output).stop();
 }